@@ -0,0 +1,184 @@
+/** @defgroup bytecodecache Bytecode cache
+ *
+ * @brief Sandbox-wide cache of compiled Lua chunks, keyed by the SHA256 hash of their source.
+ *
+ * @par Sandbox threads constructed with @ref gh_threadoptions.bytecode_cache load scripts
+ *      from the cache instead of parsing and compiling them in every subjail. The first
+ *      time a chunk is seen, it is compiled by a dedicated subjail owned by the cache,
+ *      which never runs any code. Bytecode produced by subjails running untrusted scripts
+ *      is never stored, because loading maliciously crafted bytecode can escape the Lua VM.
+ *
+ * @par Every cache entry is a sealed memory file, so that the same file can be passed
+ *      to any number of subjails without copying and without any of them being able
+ *      to modify it.
+ *
+ * @{
+ */
+
+#ifndef GHOST_BYTECODECACHE_H
+#define GHOST_BYTECODECACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <ghost/result.h>
+#include <ghost/alloc.h>
+#include <ghost/sandbox.h>
+#include <ghost/sha256provider.h>
+#include <ghost/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Value of @ref gh_bytecodecacheoptions.max_entries representing no limit. */
+#define GH_BYTECODECACHE_NOLIMIT 0
+
+/** @brief Extension of bytecode files in the persistent store. */
+#define GH_BYTECODECACHE_FILEEXT ".ljbc"
+
+/** @brief Cached bytecode of a single chunk. */
+typedef struct {
+    /** @brief Hash of the chunk name and source. */
+    gh_sha256 hash;
+    /** @brief Sealed memory file holding the bytecode. */
+    int fd;
+    /** @brief Size of the bytecode in bytes. */
+    size_t size;
+} gh_bytecodecacheentry;
+
+/** @brief Bytecode cache statistics. */
+typedef struct {
+    /** @brief Number of chunks currently cached. */
+    size_t entries;
+    /** @brief Total size of cached bytecode in bytes. */
+    size_t bytes;
+    /** @brief Number of lookups served from memory. */
+    uint64_t hits;
+    /** @brief Number of lookups not served from memory. */
+    uint64_t misses;
+    /** @brief Number of misses served from the persistent store. */
+    uint64_t disk_hits;
+    /** @brief Number of chunks compiled by the compiler subjail. */
+    uint64_t compiles;
+    /** @brief Number of chunks that failed to compile. */
+    uint64_t compile_errors;
+    /** @brief Number of failures reading or writing the persistent store.
+     *         These failures are not fatal - the chunk is simply not persisted.
+     */
+    uint64_t persist_errors;
+} gh_bytecodecachestats;
+
+/** @brief Bytecode cache options. */
+typedef struct {
+    /** @brief Options used to construct the compiler sandbox thread.
+     *         The `sandbox` field is ignored and replaced by the sandbox passed
+     *         to @ref gh_bytecodecache_ctor. The `bytecode_cache` field is ignored.
+     */
+    gh_threadoptions thread_options;
+
+    /** @brief Path to the directory of the persistent store, or `NULL` to only
+     *         keep bytecode in memory. @n
+     *         The directory must already exist and must only be writable by trusted
+     *         users - bytecode read from it is loaded by subjails as is. Clear the
+     *         directory after upgrading LuaJIT, as bytecode isn't portable between
+     *         LuaJIT versions.
+     */
+    const char * persist_path;
+
+    /** @brief Maximum number of cached chunks, or @ref GH_BYTECODECACHE_NOLIMIT.
+     *         Once reached, uncached chunks are compiled by the subjails running them.
+     */
+    size_t max_entries;
+} gh_bytecodecacheoptions;
+
+/** @brief Bytecode cache. */
+struct gh_bytecodecache {
+    /** @brief Allocator. */
+    gh_alloc * alloc;
+
+    /** @brief Sandbox thread compiling uncached chunks. */
+    gh_thread compiler;
+
+    /** @brief Directory file descriptor of the persistent store, or -1. */
+    int persist_dirfd;
+
+    /** @brief Maximum number of cached chunks. */
+    size_t max_entries;
+
+    /** @brief Protects @ref buffer and @ref stats. */
+    pthread_mutex_t mutex;
+
+    /** @brief Entries (dynamic array). */
+    gh_bytecodecacheentry * buffer;
+    /** @brief Capacity of @ref buffer. */
+    size_t capacity;
+    /** @brief Number of entries. */
+    size_t size;
+
+    /** @brief Cumulative statistics. */
+    gh_bytecodecachestats stats;
+};
+
+#ifndef GH_TYPEDEF_BYTECODECACHE
+typedef struct gh_bytecodecache gh_bytecodecache;
+#define GH_TYPEDEF_BYTECODECACHE
+#endif
+
+/** @brief Construct a bytecode cache.
+ *
+ * @note This function spawns the compiler subjail.
+ *
+ * @param cache   Pointer to uninitialized memory.
+ * @param sandbox Sandbox to spawn the compiler sandbox thread in.
+ * @param options Bytecode cache options.
+ *
+ * @return Result code.
+ */
+gh_result gh_bytecodecache_ctor(gh_bytecodecache * cache, gh_sandbox * sandbox, gh_bytecodecacheoptions options);
+
+/** @brief Destroy a bytecode cache.
+ *
+ * @par All sandbox threads using the cache must be destroyed first.
+ *
+ * @param cache Pointer to a bytecode cache.
+ *
+ * @return Result code.
+ */
+gh_result gh_bytecodecache_dtor(gh_bytecodecache * cache);
+
+/** @brief Retrieve the bytecode of a chunk, compiling it if necessary.
+ *
+ * @par Safe to call from multiple OS threads at once.
+ *
+ * @param cache      Pointer to a bytecode cache.
+ * @param chunk_name Null terminated chunk name. Part of the key, as it is
+ *                   embedded in the bytecode.
+ * @param source     Pointer to Lua source code.
+ * @param source_len Length of @p source.
+ * @param[out] out_fd Will hold a sealed memory file containing the bytecode.
+ *                    The file descriptor is owned by the cache and remains valid
+ *                    until the cache is destroyed. Read it with `pread`, as its
+ *                    offset is shared by every user.
+ *
+ * @return @ref GHR_OK on success. @n
+ *         @ref GHR_BYTECODECACHE_COMPILE if the chunk failed to compile. @n
+ *         @ref GHR_BYTECODECACHE_FULL if the chunk is not cached and the cache is full. @n
+ *         Otherwise a result code indicating an error.
+ */
+gh_result gh_bytecodecache_load(gh_bytecodecache * cache, const char * chunk_name, const char * source, size_t source_len, int * out_fd);
+
+/** @brief Retrieve a snapshot of bytecode cache statistics.
+ *
+ * @param cache     Pointer to a bytecode cache.
+ * @param out_stats Will hold the statistics.
+ */
+void gh_bytecodecache_stats(gh_bytecodecache * cache, gh_bytecodecachestats * out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
@@ -0,0 +1,160 @@
+/** @defgroup cgroup cgroup
+ *
+ * @brief cgroup v2 placement and accounting of jails and subjails.
+ *
+ * @par A sandbox constructed with @ref gh_sandboxoptions.cgroup_path creates
+ *      its own cgroup below the given (delegated) one, with the `cpu`,
+ *      `memory` and `pids` controllers enabled:
+ *
+ * @code
+ * <cgroup_path>/sandbox.<jail pid>/jail/             the jail process
+ * <cgroup_path>/sandbox.<jail pid>/subjail.<pid>/    every subjail
+ * @endcode
+ *
+ * @par The host must be allowed to move processes into the subtree, which
+ *      usually means that it runs in a leaf cgroup of the same delegated
+ *      subtree.
+ *
+ * @{
+ */
+
+#ifndef GHOST_CGROUP_H
+#define GHOST_CGROUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <ghost/result.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum size (with null terminator) of the name of a cgroup created
+ *         by libghost.
+ */
+#define GH_CGROUP_MAXNAME 64
+
+/** @brief Value of @ref gh_cgrouplimits fields representing no limit. */
+#define GH_CGROUP_NOLIMIT 0
+
+/** @brief Period of @ref gh_cgrouplimits.cpu_quota_us in microseconds. */
+#define GH_CGROUP_CPUPERIODUS 100000
+
+/** @brief cgroup created by libghost. */
+typedef struct {
+    /** @brief Directory of the parent cgroup (not owned). */
+    int parent_fd;
+    /** @brief Directory of the cgroup, or -1 if not constructed. */
+    int fd;
+    /** @brief Name of the cgroup in the parent directory. */
+    char name[GH_CGROUP_MAXNAME];
+} gh_cgroup;
+
+/** @brief Resource limits enforced by the kernel on all processes of a cgroup. */
+typedef struct {
+    /** @brief `memory.max` in bytes, or @ref GH_CGROUP_NOLIMIT. @n
+     *         Memory above it is reclaimed, and if that isn't possible, the
+     *         kernel kills a process of the cgroup.
+     */
+    uint64_t memory_max_bytes;
+
+    /** @brief CPU time in microseconds the processes may use every
+     *         @ref GH_CGROUP_CPUPERIODUS, or @ref GH_CGROUP_NOLIMIT. @n
+     *         May be larger than the period on multiprocessor systems.
+     */
+    uint64_t cpu_quota_us;
+
+    /** @brief `pids.max`, or @ref GH_CGROUP_NOLIMIT. */
+    uint64_t pids_max;
+} gh_cgrouplimits;
+
+/** @brief Resource usage of a cgroup. */
+typedef struct {
+    /** @brief `memory.current` in bytes - all memory charged to the cgroup,
+     *         including page cache and kernel memory.
+     */
+    uint64_t memory_bytes;
+
+    /** @brief CPU time used by all processes of the cgroup in nanoseconds,
+     *         from `cpu.stat` (microsecond resolution).
+     */
+    uint64_t cpu_ns;
+} gh_cgroupstats;
+
+/** @brief Construct an unconstructed-equivalent cgroup.
+ *
+ * @par @ref gh_cgroup_dtor may be called on it and does nothing.
+ */
+void gh_cgroup_ctoridle(gh_cgroup * cgroup);
+
+/** @brief Create a cgroup.
+ *
+ * @param cgroup    Pointer to unconstructed memory that will hold the new instance.
+ * @param parent_fd Directory of the parent cgroup. Must stay open for the
+ *                  lifetime of the new instance.
+ * @param name      Null terminated name of the new cgroup.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cgroup_ctor(gh_cgroup * cgroup, int parent_fd, const char * name);
+
+/** @brief Check whether the cgroup has been created.
+ *
+ * @return True if @p cgroup was constructed with @ref gh_cgroup_ctor.
+ */
+bool gh_cgroup_active(gh_cgroup * cgroup);
+
+/** @brief Remove a cgroup.
+ *
+ * @par All processes of the cgroup must have exited.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cgroup_dtor(gh_cgroup * cgroup);
+
+/** @brief Enable the `cpu`, `memory` and `pids` controllers for the children
+ *         of a cgroup.
+ *
+ * @param fd Directory of the cgroup. It must not contain processes itself.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cgroup_enablecontrollers(int fd);
+
+/** @brief Apply resource limits to a cgroup.
+ *
+ * @par Limits set to @ref GH_CGROUP_NOLIMIT are left at the default (none).
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cgroup_setlimits(gh_cgroup * cgroup, gh_cgrouplimits limits);
+
+/** @brief Move a process into a cgroup.
+ *
+ * @par Memory the process allocated before is still charged to its previous
+ *      cgroup.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cgroup_attach(gh_cgroup * cgroup, pid_t pid);
+
+/** @brief Read the resource usage of a cgroup.
+ *
+ * @par Reads two small interface files, which is cheaper than parsing procfs
+ *      (see @ref procstat).
+ *
+ * @param cgroup         Pointer to a constructed cgroup.
+ * @param[out] out_stats Will hold the resource usage.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cgroup_stats(gh_cgroup * cgroup, gh_cgroupstats * out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
@@ -0,0 +1,95 @@
+/** @defgroup cpuset cpuset
+ *
+ * @brief Sets of CPUs that jails and subjails are allowed to run on.
+ *
+ * @par Keeping a latency-sensitive subjail on a fixed set of CPUs (and batch
+ *      subjails off of them) avoids migrations, which keeps its caches warm and
+ *      lowers the latency of waking it up for IPC. See
+ *      @ref gh_sandboxoptions.cpuset and @ref gh_threadoptions.cpuset.
+ *
+ * @{
+ */
+
+#ifndef GHOST_CPUSET_H
+#define GHOST_CPUSET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <ghost/result.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Number of CPUs that can be represented in a @ref gh_cpuset. */
+#define GH_CPUSET_MAXCPUS 1024
+
+/** @brief Set of CPUs. @n
+ *         Zero-initialized, the set is empty, which options treat as leaving
+ *         the affinity unchanged.
+ */
+typedef struct {
+    /** @brief Bit `cpu % 64` of word `cpu / 64` is set if `cpu` is in the set. */
+    uint64_t mask[GH_CPUSET_MAXCPUS / 64];
+} gh_cpuset;
+
+/** @brief Add a CPU to a set.
+ *
+ * @param cpuset Pointer to the set.
+ * @param cpu    Index of the CPU, as used by `sched_setaffinity`.
+ *
+ * @return @ref GHR_OK on success or @ref GHR_CPUSET_BADCPU if the index is
+ *         outside of the range representable by the set.
+ */
+gh_result gh_cpuset_add(gh_cpuset * cpuset, int cpu);
+
+/** @brief Check whether a CPU is in a set.
+ *
+ * @return True if @p cpu is in @p cpuset.
+ */
+bool gh_cpuset_has(const gh_cpuset * cpuset, int cpu);
+
+/** @brief Check whether a set is empty.
+ *
+ * @return True if @p cpuset contains no CPUs.
+ */
+bool gh_cpuset_isempty(const gh_cpuset * cpuset);
+
+/** @brief Remove all CPUs from a set that aren't in another set.
+ *
+ * @param cpuset Pointer to the set to narrow.
+ * @param other  Pointer to the set of CPUs to keep.
+ */
+void gh_cpuset_intersect(gh_cpuset * cpuset, const gh_cpuset * other);
+
+/** @brief Retrieve the CPU that the calling OS thread is running on.
+ *
+ * @par The thread may be migrated right afterwards, unless its own affinity
+ *      only allows a single CPU.
+ *
+ * @param[out] out_cpuset Will hold a set containing only that CPU.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cpuset_current(gh_cpuset * out_cpuset);
+
+/** @brief Restrict a process to the CPUs of a set.
+ *
+ * @par Only the calling thread is affected if @p pid is 0. Threads and
+ *      processes created afterwards inherit the affinity.
+ *
+ * @param cpuset Pointer to a non-empty set.
+ * @param pid    PID of the process, or 0 for the calling thread.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_cpuset_apply(const gh_cpuset * cpuset, pid_t pid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
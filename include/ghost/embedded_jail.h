@@ -26,6 +26,8 @@ extern unsigned int gh_embeddedjail_exe_data_len;
 bool gh_embeddedjail_available(void);
 
 /** @brief Creates a memory file containing the jail executable.
+ *
+ * @par The file is sealed against any modification and closed on exec.
  *
  * @param out_fd Output pointer for the file descriptor of the new memory file.
  *
@@ -33,7 +35,24 @@ bool gh_embeddedjail_available(void);
  */
 gh_result gh_embeddedjail_createfd(int * out_fd);
 
+/** @brief Retrieves the memory file containing the jail executable shared by
+ *         every sandbox of this process.
+ *
+ * @par The file is created by @ref gh_embeddedjail_createfd on first use and
+ *      kept open for the lifetime of the process, so that the executable is
+ *      only copied once and all jails share its page cache. Thread safe.
+ *      If creating the file fails, every later call fails with the same result.
+ *
+ * @param out_fd Output pointer for the file descriptor. Must not be closed.
+ *
+ * @return Result code.
+ */
+gh_result gh_embeddedjail_sharedfd(int * out_fd);
+
 /** @brief Replaces current address space with the embedded jail executable if available.
+ *
+ * @par Executes the file returned by @ref gh_embeddedjail_sharedfd. Call that
+ *      function before forking, so that the file is only created once.
  *
  * @param name Name of the process passed as argv[0].
  * @param options_fd File descriptor containing sandbox options to be passed as argv[1].
@@ -9,7 +9,9 @@
 #define GHOST_IPC_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <ghost/result.h>
@@ -35,14 +37,67 @@ extern "C" {
 #define GH_IPC_HUPTIMEOUTMS 1000
 #define GH_IPC_NOTIMEOUT 0
 
+/** @brief Request ID used by messages that don't belong to any request. @n
+ *         Request IDs are assigned by the host to Lua requests (LUASTRING, LUAFILE,
+ *         LUAHOSTVARIABLE, LUACALL, LUATENANT, LUACOMPILE, LUARESET, LUAGC, LUATRIM, LANDLOCK) and echoed back by the subjail in every message
+ *         caused by that request (LUAINFO, LUARESULT, FUNCTIONCALL), so that replies
+ *         to multiple in-flight requests can be told apart.
+ */
+#define GH_IPC_NOREQUEST 0
+
+/** @brief Tenant ID that selects the subjail's own global environment. @n
+ *         Other tenant IDs are assigned by the host with a LUATENANT message and
+ *         select an isolated global environment hosted in the same subjail.
+ */
+#define GH_IPC_NOTENANT 0
+
+/** @brief Deadline of LUASTRING, LUAFILE and LUACALL requests representing no deadline. @n
+ *         Otherwise, the deadline is the number of milliseconds the request may take
+ *         from the moment the subjail starts it. Requests that run out of time are
+ *         aborted with @ref GHR_LUA_DEADLINE.
+ */
+#define GH_IPC_NODEADLINE 0
+
+/** @brief Value of a garbage collector parameter in a LUAGC message, which
+ *         leaves the parameter unchanged.
+ */
+#define GH_IPC_GCKEEP (-1)
+
 typedef enum {
     GH_IPCMODE_CONTROLLER,
     GH_IPCMODE_CHILD
 } gh_ipc_mode;
 
+/** @brief Cumulative traffic counters of an IPC object. */
+typedef struct {
+    atomic_uint_least64_t messages_sent;
+    atomic_uint_least64_t bytes_sent;
+    atomic_uint_least64_t messages_received;
+    atomic_uint_least64_t bytes_received;
+} gh_ipccounters;
+
+/** @brief Snapshot of @ref gh_ipccounters. */
+typedef struct {
+    /** @brief Number of messages sent. */
+    uint64_t messages_sent;
+    /** @brief Number of bytes sent (excluding passed file descriptors). */
+    uint64_t bytes_sent;
+    /** @brief Number of messages received. */
+    uint64_t messages_received;
+    /** @brief Number of bytes received. */
+    uint64_t bytes_received;
+} gh_ipcstats;
+
 typedef struct {
     gh_ipc_mode mode;
     int sockfd;
+
+    /** @brief Traffic of this IPC object. */
+    gh_ipccounters counters;
+    /** @brief If not `NULL`, traffic is also added to these counters
+     *         (e.g. the total of all sandbox threads of a sandbox).
+     */
+    gh_ipccounters * aggregate;
 } gh_ipc;
 
 typedef enum {
@@ -59,6 +114,16 @@ typedef enum {
     GH_IPCMSG_LUAHOSTVARIABLE,
     GH_IPCMSG_LUACALL,
     GH_IPCMSG_FUNCTIONRETURN,
+    GH_IPCMSG_LUATENANT,
+    GH_IPCMSG_LUACOMPILE,
+    GH_IPCMSG_LUACANCEL,
+    GH_IPCMSG_LUARESET,
+    GH_IPCMSG_LUAGC,
+    GH_IPCMSG_LUATRIM,
+    GH_IPCMSG_LANDLOCK,
+
+    // jail send (on the socket of a new subjail)
+    GH_IPCMSG_SUBJAILPIDFD,
 
     // subjail send
     GH_IPCMSG_SUBJAILALIVE,
@@ -77,6 +142,26 @@ GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
     pid_t pid;
+
+    // only used by subjails - budgets of the sandbox thread, or 0 for no budget
+    uint64_t cpu_budget_ns;
+    uint64_t instruction_budget;
+
+    // only used by subjails - time without messages after which the subjail
+    // trims its memory, or 0 to only trim on LUATRIM
+    int idle_trim_ms;
+
+    // only used by subjails - limit of memory allocated by the Lua state, or 0
+    uint64_t memory_limit_bytes;
+
+    // only used by subjails - true if the host serves openat through the
+    // subjail's user notification listener
+    bool native_open;
+
+    // only used by subjails - bytes of the Lua arena to back with memory
+    // right away, and whether to also lock them into memory
+    uint64_t prefault_bytes;
+    bool prefault_lock;
 } gh_ipcmsg_hello;
 
 GH_IPCMSG_ALIGN
@@ -88,6 +173,9 @@ GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
     int sockfd;
+    // if true, the subjail doesn't hand openat to the host, but restricts
+    // itself with a Landlock ruleset built from LANDLOCK messages
+    bool landlock;
 } gh_ipcmsg_newsubjail;
 
 GH_IPCMSG_ALIGN
@@ -101,12 +189,31 @@ typedef struct {
     gh_ipcmsg_type type;
     int index;
     pid_t pid;
+    // seccomp user notification listener of the subjail's openat calls,
+    // or -1 if the subjail uses Landlock instead (or the sandbox is disabled)
+    int notifyfd;
+    // true if the subjail waits for a Landlock ruleset instead (only if
+    // requested in NEWSUBJAIL and supported by the kernel)
+    bool landlock;
 } gh_ipcmsg_subjailalive;
 
-#define GH_IPCMSG_LUASTRING_MAXSIZE (GH_IPCMSG_MAXSIZE - sizeof(gh_ipcmsg_type))
+// Sent by the jail right after spawning a subjail, so it may arrive before or
+// after the subjail's own SUBJAILALIVE.
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    pid_t pid;
+    // -1 if the kernel doesn't support clone3
+    int pidfd;
+} gh_ipcmsg_subjailpidfd;
+
+#define GH_IPCMSG_LUASTRING_MAXSIZE (GH_IPCMSG_MAXSIZE - sizeof(gh_ipcmsg_type) - sizeof(int) * 3)
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
+    int tenant_id;
+    int deadline_ms;
     char content[GH_IPCMSG_LUASTRING_MAXSIZE];
 } gh_ipcmsg_luastring;
 
@@ -119,10 +226,103 @@ GH_STATICASSERT(
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
+    int tenant_id;
+    int deadline_ms;
     int fd;
+    // if true, the file is read with pread from offset 0 instead of read
+    // from the current offset, so that the same open file description
+    // (e.g. a cached bytecode memfd) can be loaded by many subjails at once
+    bool positional;
     char chunk_name[GH_IPCMSG_LUAFILE_CHUNKNAMEMAX];
 } gh_ipcmsg_luafile;
 
+// Compiles the source stored at the start of the fdmem without running it.
+// The subjail answers with LUAINFO and LUARESULT, whose return_ptr points to
+// a string variant holding the bytecode (as produced by string.dump).
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    int request_id;
+    int ipcfdmem_fd;
+    size_t ipcfdmem_occupied;
+    size_t source_size;
+    char chunk_name[GH_IPCMSG_LUAFILE_CHUNKNAMEMAX];
+} gh_ipcmsg_luacompile;
+
+// Aborts an in-flight request with GHR_LUA_CANCELLED. Not acknowledged - the
+// request is answered with its LUARESULT as usual. Ignored if the request
+// already finished.
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    int request_id;
+} gh_ipcmsg_luacancel;
+
+// Replaces the Lua state of the subjail with a fresh one, dropping all
+// globals, callbacks, host variables and tenants. Answered with LUAINFO and
+// LUARESULT like any other request. Fails with GHR_JAIL_RESETBUSY if any
+// other request is still in flight.
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    int request_id;
+} gh_ipcmsg_luareset;
+
+typedef enum {
+    // collect only when allocation triggers it (the default)
+    GH_IPCMSG_LUAGC_IDLENONE,
+    // take incremental steps while no message is waiting, until a cycle finishes
+    GH_IPCMSG_LUAGC_IDLESTEP,
+    // run a full collection once the subjail becomes idle
+    GH_IPCMSG_LUAGC_IDLEFULL
+} gh_ipcmsg_luagc_idle;
+
+// Configures the garbage collector of the subjail's Lua state. Answered with
+// LUAINFO and LUARESULT. The settings survive LUARESET.
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    int request_id;
+    // LUA_GCSETPAUSE and LUA_GCSETSTEPMUL, or GH_IPC_GCKEEP
+    int pause;
+    int stepmul;
+    // stop the collector while LUACALL requests run
+    bool stop_during_calls;
+    gh_ipcmsg_luagc_idle idle;
+    // size of an idle step in KB, or 0 for the default
+    int idle_step_kb;
+} gh_ipcmsg_luagc;
+
+// Runs a full garbage collection and returns freed memory to the kernel.
+// Answered with LUAINFO and LUARESULT.
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    int request_id;
+} gh_ipcmsg_luatrim;
+
+typedef enum {
+    GH_IPCMSG_LANDLOCK_ADDRULE,
+    GH_IPCMSG_LANDLOCK_RESTRICT
+} gh_ipcmsg_landlock_op;
+
+// Builds the Landlock ruleset of a subjail spawned with NEWSUBJAIL.landlock.
+// ADDRULE allows the PermFS mode (read and write only) beneath the directory
+// or on the file of fd and isn't answered - errors are reported by RESTRICT,
+// which enforces the ruleset and is answered with LUAINFO and LUARESULT.
+// The subjail enforces whatever it has got before running any other request.
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    int request_id;
+    gh_ipcmsg_landlock_op op;
+    // O_PATH file descriptor, -1 for RESTRICT
+    int fd;
+    // gh_permfs_mode
+    unsigned int mode;
+} gh_ipcmsg_landlock;
+
 typedef enum {
     GH_IPCMSG_LUAHOSTVARIABLE_INT,
     GH_IPCMSG_LUAHOSTVARIABLE_DOUBLE,
@@ -134,6 +334,7 @@ typedef enum {
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
     gh_ipcmsg_luahostvariable_type datatype;
     char name[GH_IPCMSG_LUAHOSTVARIABLE_NAMEMAX];
     union {
@@ -158,15 +359,37 @@ GH_STATICASSERT(
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
+    int tenant_id;
+    int deadline_ms;
     int ipcfdmem_fd;
     size_t ipcfdmem_occupied;
     char name[GH_IPCMSG_LUACALL_NAMEMAX];
     gh_fdmem_ptr params[GH_IPCMSG_LUACALL_MAXPARAMS];
 } gh_ipcmsg_luacall;
 
+/** @brief Number of Lua VM instructions a tenant request runs before the subjail
+ *         considers switching to another runnable request.
+ */
+#define GH_IPCMSG_LUATENANT_SLICE 10000
+
+typedef enum {
+    GH_IPCMSG_LUATENANT_NEW,
+    GH_IPCMSG_LUATENANT_FREE
+} gh_ipcmsg_luatenant_op;
+
+GH_IPCMSG_ALIGN
+typedef struct {
+    gh_ipcmsg_type type;
+    int request_id;
+    int tenant_id;
+    gh_ipcmsg_luatenant_op op;
+} gh_ipcmsg_luatenant;
+
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
     int script_id;
 } gh_ipcmsg_luainfo;
 
@@ -174,12 +397,26 @@ typedef struct {
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
     gh_result result;
     char error_msg[GH_IPCMSG_LUARESULT_ERRORMSGMAX];
     int script_id;
 
     // only filled in for response to LUACALL
     gh_fdmem_ptr return_ptr;
+
+    // resources used by the request
+    uint64_t cpu_ns;
+    uint64_t instructions;
+
+    // resources used by all requests of the subjail so far
+    uint64_t total_cpu_ns;
+    uint64_t total_instructions;
+
+    // size of the Lua heap after the request
+    uint64_t lua_heap_bytes;
+    // memory allocated by the Lua allocator (counted against the memory limit)
+    uint64_t lua_alloc_bytes;
 } gh_ipcmsg_luaresult;
 
 GH_STATICASSERT(
@@ -198,6 +435,7 @@ typedef struct {
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
     char name[GH_IPCMSG_FUNCTIONCALL_MAXNAME];
     gh_ipcmsg_functioncall_arg return_arg;
     size_t arg_count;
@@ -212,6 +450,7 @@ GH_STATICASSERT(
 GH_IPCMSG_ALIGN
 typedef struct {
     gh_ipcmsg_type type;
+    int request_id;
     int fd;
     gh_result result;
 } gh_ipcmsg_functionreturn;
@@ -275,6 +514,45 @@ gh_result gh_ipc_send(gh_ipc * ipc, gh_ipcmsg * msg, size_t msg_size);
  */
 gh_result gh_ipc_recv(gh_ipc * ipc, gh_ipcmsg * msg, int timeout_ms);
 
+/** @brief Returns the request ID carried by a message, or @ref GH_IPC_NOREQUEST
+ *         if the message type doesn't carry one.
+ *
+ * @param msg Pointer to message.
+ *
+ * @return Request ID.
+ */
+int gh_ipc_requestid(const gh_ipcmsg * msg);
+
+/** @brief Initializes IPC traffic counters to zero.
+ *
+ * @param counters Pointer to counters.
+ */
+void gh_ipccounters_init(gh_ipccounters * counters);
+
+/** @brief Retrieves a snapshot of IPC traffic counters.
+ *
+ * @param counters  Pointer to counters.
+ * @param out_stats Will hold the snapshot.
+ */
+void gh_ipccounters_stats(gh_ipccounters * counters, gh_ipcstats * out_stats);
+
+/** @brief Sends a FUNCTIONCALL message without waiting for the reply.
+ *
+ * @par The host writes the return value directly into @p return_arg and replies with
+ *      a FUNCTIONRETURN message carrying the same @p request_id.
+ *
+ * @param ipc             Pointer to the IPC object.
+ * @param request_id      ID of the request on whose behalf the function is called.
+ * @param name            Name of the RPC function.
+ * @param argc            Number of arguments.
+ * @param args            Array of arguments.
+ * @param return_arg      Buffer for the return value. Must remain valid until the reply arrives.
+ * @param return_arg_size Size of @p return_arg.
+ *
+ * @return Result code.
+ */
+gh_result gh_ipc_callsend(gh_ipc * ipc, int request_id, const char * name, size_t argc, gh_ipcmsg_functioncall_arg * args, void * return_arg, size_t return_arg_size);
+
 gh_result gh_ipc_call(gh_ipc * ipc, const char * name, size_t argc, gh_ipcmsg_functioncall_arg * args, int * return_fd, void * return_arg, size_t return_arg_size);
 
 #ifdef __cplusplus
@@ -0,0 +1,330 @@
+/** @defgroup jobqueue Job queue
+ *
+ * @brief Queue of Lua scripts and remote Lua function calls executed by a set of identically configured sandbox threads, with work stealing between them.
+ *
+ * @{
+ */
+
+#ifndef GHOST_JOBQUEUE_H
+#define GHOST_JOBQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <ghost/result.h>
+#include <ghost/alloc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Job type. */
+typedef enum {
+    /** @brief Run a Lua script passed as a string. */
+    GH_JOB_SCRIPT,
+    /** @brief Call a function registered in `ghost.callbacks`. */
+    GH_JOB_CALL
+} gh_jobtype;
+
+/** @brief Job priority class. @n
+ *         Jobs of a higher class are always started before jobs of a lower class.
+ *         Within a class, jobs are started earliest deadline first.
+ */
+typedef enum {
+    /** @brief Background work. Only class accepted by batch-only workers. */
+    GH_JOBPRIORITY_BATCH = -1,
+    /** @brief Default class. */
+    GH_JOBPRIORITY_NORMAL = 0,
+    /** @brief Latency sensitive work. */
+    GH_JOBPRIORITY_INTERACTIVE = 1
+} gh_jobpriority;
+
+/** @brief Value of @ref gh_job.deadline_ms representing no deadline. */
+#define GH_JOB_NODEADLINE 0
+
+/** @brief Callback type: prepare call frame of a @ref GH_JOB_CALL job.
+ *
+ * @note Called on the worker OS thread.
+ *
+ * @param frame    Constructed, empty remote Lua call frame.
+ * @param userdata Userdata of the job.
+ *
+ * @return Arbitrary result code. Any error fails the job.
+ */
+typedef gh_result gh_job_args_func(gh_thread_callframe * frame, void * userdata);
+
+/** @brief Callback type: consume the result of a @ref GH_JOB_CALL job.
+ *
+ * @note Called on the worker OS thread, before the future is completed.
+ *
+ * @param frame    Remote Lua call frame after the function has returned.
+ *                 The frame is destroyed after this callback returns.
+ * @param status   Result of the remote Lua function call.
+ * @param userdata Userdata of the job.
+ *
+ * @return Arbitrary result code. Any error fails the job.
+ */
+typedef gh_result gh_job_result_func(gh_thread_callframe * frame, const gh_threadnotif_script * status, void * userdata);
+
+/** @brief Job description. */
+typedef struct {
+    /** @brief Job type. Determines which of the remaining fields are used. */
+    gh_jobtype type;
+
+    /** @brief Script (@ref GH_JOB_SCRIPT). Must remain valid until the job completes. */
+    const char * script;
+    /** @brief Length of @ref script. */
+    size_t script_len;
+
+    /** @brief Name of the remote Lua function (@ref GH_JOB_CALL). Must remain valid until
+     *         the job completes.
+     */
+    const char * function_name;
+    /** @brief Callback preparing parameters (@ref GH_JOB_CALL). May be `NULL`. */
+    gh_job_args_func * args_func;
+    /** @brief Callback consuming the return value (@ref GH_JOB_CALL). May be `NULL`. */
+    gh_job_result_func * result_func;
+
+    /** @brief Arbitrary userdata passed to callbacks. */
+    void * userdata;
+
+    /** @brief Priority class. */
+    gh_jobpriority priority;
+
+    /** @brief Time after submission, in milliseconds, by which a worker must
+     *         start the job, or @ref GH_JOB_NODEADLINE. @n
+     *         Jobs that are still queued when their deadline passes are dropped
+     *         and complete with @ref GHR_JOBQUEUE_EXPIRED. Must not be negative.
+     */
+    int deadline_ms;
+} gh_job;
+
+typedef struct gh_jobfuture gh_jobfuture;
+
+/** @brief Handle to a submitted job. @n
+ *         Storage is owned by the caller and must remain valid until
+ *         @ref gh_jobfuture_wait returns and @ref gh_jobfuture_dtor is called.
+ *         Do not access fields directly while the job is pending.
+ */
+struct gh_jobfuture {
+    /** @brief Copy of the job description. */
+    gh_job job;
+
+    /** @brief Next job in worker queue. */
+    gh_jobfuture * next;
+    /** @brief Previous job in worker queue. */
+    gh_jobfuture * prev;
+
+    /** @brief Protects completion fields. */
+    pthread_mutex_t mutex;
+    /** @brief Signalled when the job completes. */
+    pthread_cond_t cond;
+    /** @brief If true, the job has completed. */
+    bool done;
+
+    /** @brief Result of running the job (not of the Lua code). */
+    gh_result result;
+    /** @brief Result of the Lua code. */
+    gh_threadnotif_script status;
+
+    /** @brief Monotonic time of submission in nanoseconds. */
+    uint64_t submit_ns;
+    /** @brief Monotonic time when a worker started the job in nanoseconds. */
+    uint64_t start_ns;
+    /** @brief Monotonic time of completion in nanoseconds. */
+    uint64_t end_ns;
+    /** @brief Absolute monotonic deadline in nanoseconds, or 0 if none. */
+    uint64_t deadline_ns;
+};
+
+/** @brief Wait until a job completes.
+ *
+ * @param future     Pointer to a submitted job future.
+ * @param out_status If not `NULL`, will hold the result of the Lua code.
+ *
+ * @return Result of running the job. Lua errors are reported through
+ *         @p out_status, not through the return value.
+ */
+gh_result gh_jobfuture_wait(gh_jobfuture * future, gh_threadnotif_script * out_status);
+
+/** @brief Check whether a job has completed without blocking. */
+bool gh_jobfuture_done(gh_jobfuture * future);
+
+/** @brief Time the job spent queued before a worker started it, in nanoseconds.
+ *         Only valid after completion.
+ */
+uint64_t gh_jobfuture_waitns(const gh_jobfuture * future);
+
+/** @brief Time the job spent running on a worker, in nanoseconds.
+ *         Only valid after completion.
+ */
+uint64_t gh_jobfuture_runns(const gh_jobfuture * future);
+
+/** @brief Destroy a completed job future.
+ *
+ * @param future Pointer to a completed job future.
+ *
+ * @return Result code.
+ */
+gh_result gh_jobfuture_dtor(gh_jobfuture * future);
+
+/** @brief Per-worker job queue, ordered by priority class and deadline.
+ *         Owned by a single sandbox thread.
+ */
+typedef struct {
+    /** @brief Sandbox thread executing jobs. */
+    gh_thread thread;
+    /** @brief OS thread driving @ref thread. */
+    pthread_t pthread;
+
+    /** @brief Protects the queue. */
+    pthread_mutex_t mutex;
+    /** @brief Most urgent queued job. */
+    gh_jobfuture * head;
+    /** @brief Least urgent queued job. */
+    gh_jobfuture * tail;
+    /** @brief Number of queued jobs. */
+    atomic_size_t depth;
+
+    /** @brief If true, the worker only runs @ref GH_JOBPRIORITY_BATCH jobs. */
+    bool batch_only;
+
+    /** @brief Parent job queue. */
+    struct gh_jobqueue * queue;
+} gh_jobqueueworker;
+
+/** @brief Job queue statistics. */
+typedef struct {
+    /** @brief Number of jobs currently queued (not including running jobs). */
+    size_t queue_depth;
+    /** @brief Number of jobs currently running. */
+    size_t running;
+    /** @brief Total number of submitted jobs. */
+    uint64_t submitted;
+    /** @brief Total number of completed jobs. */
+    uint64_t completed;
+    /** @brief Total number of jobs taken from another worker's queue. */
+    uint64_t stolen;
+    /** @brief Total number of jobs dropped because their deadline passed.
+     *         Included in @ref completed.
+     */
+    uint64_t expired;
+    /** @brief Sum of time completed jobs spent queued, in nanoseconds. */
+    uint64_t total_wait_ns;
+    /** @brief Maximum time a completed job spent queued, in nanoseconds. */
+    uint64_t max_wait_ns;
+    /** @brief Sum of time completed jobs spent running, in nanoseconds. */
+    uint64_t total_run_ns;
+    /** @brief Maximum time a completed job spent running, in nanoseconds. */
+    uint64_t max_run_ns;
+} gh_jobqueuestats;
+
+/** @brief Job queue options. */
+typedef struct {
+    /** @brief Options used to construct every worker sandbox thread.
+     *         The `sandbox` field is ignored and replaced by the sandbox passed
+     *         to @ref gh_jobqueue_ctor.
+     */
+    gh_threadoptions thread_options;
+
+    /** @brief Number of workers (subjails). */
+    size_t worker_count;
+
+    /** @brief Lua script executed once in every worker before any job is run.
+     *         May be `NULL`.
+     */
+    const char * script;
+    /** @brief Length of @ref script. */
+    size_t script_len;
+
+    /** @brief Number of workers (out of @ref worker_count) that only run
+     *         @ref GH_JOBPRIORITY_BATCH jobs. Must be less than @ref worker_count.
+     */
+    size_t batch_worker_count;
+    /** @brief Scheduling policy applied to batch-only workers. See @ref gh_thread_setsched. */
+    gh_threadsched batch_sched;
+    /** @brief Niceness applied to batch-only workers. See @ref gh_thread_setsched. */
+    int batch_nice;
+} gh_jobqueueoptions;
+
+/** @brief Job queue. */
+typedef struct gh_jobqueue {
+    /** @brief Allocator. */
+    gh_alloc * alloc;
+
+    /** @brief Workers. */
+    gh_jobqueueworker * workers;
+    /** @brief Number of workers. */
+    size_t worker_count;
+
+    /** @brief Protects sleeping and shutdown. */
+    pthread_mutex_t mutex;
+    /** @brief Signalled when jobs are submitted or the queue is stopping. */
+    pthread_cond_t cond;
+    /** @brief If true, workers exit once all queues are empty. */
+    bool stopping;
+
+    /** @brief Number of queued jobs across all workers. */
+    atomic_size_t pending;
+    /** @brief Number of queued @ref GH_JOBPRIORITY_BATCH jobs across all workers. */
+    atomic_size_t pending_batch;
+    /** @brief Number of running jobs. */
+    atomic_size_t running;
+    /** @brief Round-robin cursor used to break ties during submission. */
+    atomic_size_t submit_cursor;
+
+    /** @brief Protects @ref stats. */
+    pthread_mutex_t stats_mutex;
+    /** @brief Cumulative statistics. */
+    gh_jobqueuestats stats;
+} gh_jobqueue;
+
+/** @brief Create a job queue and spawn its workers.
+ *
+ * @param queue   Pointer to uninitialized memory.
+ * @param sandbox Sandbox to spawn worker threads in.
+ * @param options Job queue options.
+ *
+ * @return Result code.
+ */
+gh_result gh_jobqueue_ctor(gh_jobqueue * queue, gh_sandbox * sandbox, gh_jobqueueoptions options);
+
+/** @brief Submit a job.
+ *
+ * @par The job is placed in the queue of the least loaded worker that accepts its
+ *      priority class. Batch jobs prefer batch-only workers if there are any. Idle
+ *      workers steal the most urgent eligible job of the most loaded worker.
+ *
+ * @param queue      Pointer to a job queue.
+ * @param job        Job description.
+ * @param out_future Pointer to caller owned storage for the future.
+ *
+ * @return Result code.
+ */
+gh_result gh_jobqueue_submit(gh_jobqueue * queue, gh_job job, gh_jobfuture * out_future);
+
+/** @brief Retrieve a snapshot of job queue statistics.
+ *
+ * @param queue     Pointer to a job queue.
+ * @param out_stats Will hold the statistics.
+ */
+void gh_jobqueue_stats(gh_jobqueue * queue, gh_jobqueuestats * out_stats);
+
+/** @brief Run all remaining jobs, stop workers and destroy their sandbox threads.
+ *
+ * @param queue Pointer to a job queue.
+ *
+ * @return Result code.
+ */
+gh_result gh_jobqueue_dtor(gh_jobqueue * queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
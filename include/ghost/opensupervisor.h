@@ -0,0 +1,100 @@
+/** @defgroup opensupervisor Open supervisor
+ *
+ * @brief Host thread serving `openat` calls of a subjail through its seccomp user notification listener.
+ *
+ * @{
+ */
+
+#ifndef GHOST_OPENSUPERVISOR_H
+#define GHOST_OPENSUPERVISOR_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <ghost/result.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef GH_TYPEDEF_THREAD
+typedef struct gh_thread gh_thread;
+#define GH_TYPEDEF_THREAD
+#endif
+
+/** @brief Open supervisor.
+ *
+ * @par Subjails hand `openat` to a seccomp user notification listener. The
+ *      supervisor reads the path out of the subjail's memory, opens the file
+ *      with @ref gh_std_openat (so the thread's permissions apply exactly like
+ *      to `ghost.open`) and installs the new file descriptor in the subjail,
+ *      which sees it as the result of its `openat` call. Rejected and failed
+ *      opens fail with the errno of the underlying error, or `EACCES`.
+ *
+ * @par Only paths relative to the current directory (or absolute paths) are
+ *      supported, directory file descriptors of the subjail mean nothing to
+ *      the host. Relative paths are resolved against the host's current
+ *      directory, like with `ghost.open`.
+ */
+typedef struct {
+    /** @brief Sandbox thread whose permissions and subjail are used. */
+    gh_thread * thread;
+    /** @brief Seccomp user notification listener, or -1 if not running. */
+    int notify_fd;
+    /** @brief eventfd that wakes up the supervisor thread to stop it. */
+    int stop_fd;
+    /** @brief Size of `struct seccomp_notif` expected by the kernel. */
+    size_t notif_size;
+    /** @brief Size of `struct seccomp_notif_resp` expected by the kernel. */
+    size_t notif_resp_size;
+    /** @brief Supervisor OS thread. */
+    pthread_t os_thread;
+    /** @brief Number of files opened on behalf of the subjail. */
+    atomic_uint_least64_t opens;
+} gh_opensupervisor;
+
+/** @brief Start serving `openat` calls of a sandbox thread's subjail.
+ *
+ * @param supervisor Pointer to unconstructed memory that will hold the new instance.
+ * @param thread     Sandbox thread. Must outlive the supervisor and its PID and safe
+ *                   ID must already be set.
+ * @param notify_fd  Listener received from the subjail. Owned by the supervisor
+ *                   from now on, even if construction fails.
+ *
+ * @return @ref GHR_OK on success, @ref GHR_OPENSUPERVISOR_NOTLISTENER if
+ *         @p notify_fd is not a seccomp user notification listener, or a result
+ *         code indicating an error.
+ */
+gh_result gh_opensupervisor_ctor(gh_opensupervisor * supervisor, gh_thread * thread, int notify_fd);
+
+/** @brief Construct a supervisor that isn't running, so that @ref gh_opensupervisor_dtor is a no-op.
+ *
+ * @param supervisor Pointer to unconstructed memory that will hold the new instance.
+ */
+void gh_opensupervisor_ctoridle(gh_opensupervisor * supervisor);
+
+/** @brief Check whether the supervisor serves `openat` calls.
+ *
+ * @param supervisor Pointer to an open supervisor.
+ *
+ * @return True if the supervisor thread is running.
+ */
+bool gh_opensupervisor_running(gh_opensupervisor * supervisor);
+
+/** @brief Stop the supervisor thread and close the listener.
+ *
+ * @par `openat` calls of the subjail fail with `ENOSYS` afterwards.
+ *
+ * @param supervisor Pointer to an open supervisor.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_opensupervisor_dtor(gh_opensupervisor * supervisor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
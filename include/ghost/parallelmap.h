@@ -0,0 +1,135 @@
+/** @defgroup parallelmap Parallel map
+ *
+ * @brief Distribution of a single Lua function call over an array of inputs across a set of identically configured sandbox threads.
+ *
+ * @{
+ */
+
+#ifndef GHOST_PARALLELMAP_H
+#define GHOST_PARALLELMAP_H
+
+#include <stddef.h>
+#include <ghost/result.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Number of chunks per sandbox thread used when the chunk size is chosen
+ *         automatically. @n
+ *         More chunks per thread balance skewed item costs better at the price of
+ *         more contention on the shared work counter.
+ */
+#define GH_PARALLELMAP_CHUNKSPERTHREAD 4
+
+/** @brief Value of @ref gh_parallelmapoptions.chunk_size that selects the chunk
+ *         size automatically.
+ */
+#define GH_PARALLELMAP_AUTOCHUNK 0
+
+/** @brief Callback type: prepare call frame for an input item.
+ *
+ * @note Called concurrently from multiple OS threads.
+ *
+ * @param index    Index of the input item.
+ * @param frame    Constructed, empty remote Lua call frame. Parameters should be
+ *                 added with `gh_thread_callframe_*` functions.
+ * @param userdata Arbitrary userdata passed through @ref gh_parallelmapoptions.
+ *
+ * @return Arbitrary result code. @ref GHR_OK indicates success. Any other value
+ *         aborts the map.
+ */
+typedef gh_result gh_parallelmap_args_func(size_t index, gh_thread_callframe * frame, void * userdata);
+
+/** @brief Callback type: consume the result of an input item.
+ *
+ * @note Called concurrently from multiple OS threads, not necessarily in input
+ *       order. Use @p index to store results in input order.
+ *
+ * @param index    Index of the input item.
+ * @param frame    Remote Lua call frame after the function has returned. Use
+ *                 `gh_thread_callframe_get*` functions to read the return value.
+ *                 The frame is destroyed after this callback returns.
+ * @param status   Result of the remote Lua function call.
+ * @param userdata Arbitrary userdata passed through @ref gh_parallelmapoptions.
+ *
+ * @return Arbitrary result code. @ref GHR_OK indicates success. Any other value
+ *         aborts the map.
+ */
+typedef gh_result gh_parallelmap_result_func(size_t index, gh_thread_callframe * frame, const gh_threadnotif_script * status, void * userdata);
+
+/** @brief Parallel map options. */
+typedef struct {
+    /** @brief Options used to construct every sandbox thread.
+     *         The `sandbox` field is ignored and replaced by the sandbox passed
+     *         to @ref gh_sandbox_parallelmap.
+     */
+    gh_threadoptions thread_options;
+
+    /** @brief Number of sandbox threads (subjails) to spawn. */
+    size_t thread_count;
+
+    /** @brief Lua script executed once in every sandbox thread before any item
+     *         is processed. Typically registers the function in `ghost.callbacks`.
+     *         May be `NULL`.
+     */
+    const char * script;
+
+    /** @brief Length (without null terminator) of @ref script. */
+    size_t script_len;
+
+    /** @brief Name of the Lua function in `ghost.callbacks` called for every item. */
+    const char * function_name;
+
+    /** @brief Number of input items. */
+    size_t item_count;
+
+    /** @brief Number of consecutive items handed out to a sandbox thread at once,
+     *         or @ref GH_PARALLELMAP_AUTOCHUNK.
+     */
+    size_t chunk_size;
+
+    /** @brief Callback preparing parameters for an item. See @ref gh_parallelmap_args_func. */
+    gh_parallelmap_args_func * args_func;
+
+    /** @brief Callback consuming the result of an item. May be `NULL`.
+     *         See @ref gh_parallelmap_result_func.
+     */
+    gh_parallelmap_result_func * result_func;
+
+    /** @brief Arbitrary userdata passed to callbacks. */
+    void * userdata;
+
+    /** @brief If not `NULL`, must point to an array of @ref item_count elements
+     *         that will hold the result of every remote call in input order.
+     */
+    gh_threadnotif_script * out_statuses;
+} gh_parallelmapoptions;
+
+/** @brief Call a Lua function for every item of an input array, distributing the
+ *         items across a set of newly spawned sandbox threads.
+ *
+ * @par Items are handed out dynamically in chunks of consecutive indices, so that a
+ *      sandbox thread that finishes its chunk early takes the next one. Sandbox threads
+ *      are spawned before and destroyed after the map.
+ *
+ * @par Lua errors raised by the function are reported per item through
+ *      @ref gh_parallelmapoptions.out_statuses and the result callback, *not* through
+ *      the return value.
+ *
+ * @param sandbox Pointer to a sandbox.
+ * @param options Parallel map options.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_sandbox_parallelmap(gh_sandbox * sandbox, const gh_parallelmapoptions * options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
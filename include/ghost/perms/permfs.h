@@ -228,6 +228,22 @@ gh_result gh_permfs_requestnode(gh_permfs * permfs, gh_permprompter * prompter,
 
 gh_result gh_permfs_fcntlflags2permfsmode(int fcntl_flags, mode_t create_accessmode, gh_pathfd pathfd, gh_permfs_mode * out_mode);
 gh_result gh_permfs_getmode(gh_permfs * permfs, int opath_fd, gh_abscanonicalpath canonical_path, gh_permfs_modeset * out_self_modeset, gh_permfs_modeset * out_children_modeset);
+
+/** @brief Find the modes that the policy accepts for the path of an entry and,
+ *         if it is a directory, for everything below it, without exception.
+ *
+ * @par A mode is left out if any entry at, above or below the path rejects it,
+ *      so the result can be granted to the whole hierarchy at once (see
+ *      @ref gh_thread_landlock). Modes that would be prompted for are never
+ *      included.
+ *
+ * @param permfs    Pointer to a constructed PermFS instance.
+ * @param entry     Entry of @p permfs.
+ * @param directory Whether the path of @p entry is a directory.
+ *
+ * @return Accepted modes or @ref GH_PERMFS_NONE.
+ */
+gh_permfs_mode gh_permfs_unconditionalmode(gh_permfs * permfs, gh_permfs_entry * entry, bool directory);
 gh_result gh_permfs_registerparser(gh_permfs * permfs, gh_permparser * parser);
 gh_result gh_permfs_write(gh_permfs * permfs, gh_permwriter * writer);
 
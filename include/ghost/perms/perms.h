@@ -195,6 +195,18 @@ gh_result gh_perms_ctor(gh_perms * perms, gh_alloc * alloc, gh_permprompter prom
  */
 gh_result gh_perms_dtor(gh_perms * perms);
 
+/** @brief Forget the whole security policy.
+ *
+ * @par Equivalent to destroying and constructing the permission system again with
+ *      the same allocator and prompter. Generic permission systems stay registered,
+ *      but their instances are destroyed and constructed again.
+ *
+ * @param perms Pointer to a constructed centralized permission system instance.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_perms_reset(gh_perms * perms);
+
 /** @brief Check whether an operation on a file is allowed by the security policy.
  *
  * See: @ref gh_permfs_gatefile. This function automatically passes the `prompter`
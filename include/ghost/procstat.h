@@ -0,0 +1,60 @@
+/** @defgroup procstat Process statistics
+ *
+ * @brief Resource usage of a process, as reported by procfs.
+ *
+ * @{
+ */
+
+#ifndef GHOST_PROCSTAT_H
+#define GHOST_PROCSTAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <ghost/result.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Resource usage of a process. */
+typedef struct {
+    /** @brief Resident set size in bytes. */
+    size_t rss_bytes;
+
+    /** @brief CPU time spent in user and kernel mode in nanoseconds. */
+    uint64_t cpu_ns;
+} gh_procstat;
+
+/** @brief Read the resource usage of a process.
+ *
+ * @par Parses `/proc/<pid>/stat`. The CPU time has the resolution of the
+ *      kernel clock tick (usually 10 ms).
+ *
+ * @param pid      PID of the process.
+ * @param[out] out Will hold the resource usage.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_procstat_read(pid_t pid, gh_procstat * out);
+
+/** @brief Find the PID of the process a pidfd refers to.
+ *
+ * @par Parses `/proc/self/fdinfo/<pidfd>`. Used to verify pidfds received
+ *      from other processes.
+ *
+ * @param pidfd        File descriptor.
+ * @param[out] out_pid Will hold the PID.
+ *
+ * @return @ref GHR_OK on success, @ref GHR_PROCSTAT_NOTPIDFD if @p pidfd is
+ *         not a pidfd of a live process, or a result code indicating an error.
+ */
+gh_result gh_procstat_pidfdpid(int pidfd, pid_t * out_pid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
@@ -9,8 +9,12 @@
 #define GHOST_SANDBOX_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <ghost/result.h>
 #include <ghost/ipc.h>
+#include <ghost/cgroup.h>
+#include <ghost/cpuset.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +23,9 @@ extern "C" {
 /** @brief Maximum size (with null terminator) of sandbox name. */
 #define GHOST_SANDBOXOPTIONS_NAME_MAX 256
 
+/** @brief Maximum size (with null terminator) of @ref gh_sandboxoptions.cgroup_path. */
+#define GHOST_SANDBOXOPTIONS_CGROUPPATH_MAX 4096
+
 /** @brief Value representing no limit when used as value of @ref gh_sandboxoptions and
  *         @ref gh_threadoptions fields related to limits.
  */
@@ -32,11 +39,28 @@ typedef struct {
     /** Name. */
     char name[GHOST_SANDBOXOPTIONS_NAME_MAX];
 
-    /** Limit of memory usage by sandbox in bytes. */
+    /** Limit of memory usage by sandbox in bytes. Enforced with `memory.max`
+     *  if @ref cgroup_path is set, otherwise with `RLIMIT_DATA` of the jail. */
     size_t memory_limit_bytes;
     /** Limit of RPC frame size inside sandbox in bytes. */
     size_t functioncall_frame_limit_bytes;
 
+    /** @brief Path of a delegated cgroup v2 directory the host may create
+     *         cgroups in, or an empty string to leave processes in the cgroup
+     *         of the host. @n
+     *         The sandbox and each of its threads get their own cgroup below it
+     *         (see @ref cgroup and @ref gh_threadoptions.cgroup_limits).
+     */
+    char cgroup_path[GHOST_SANDBOXOPTIONS_CGROUPPATH_MAX];
+
+    /** @brief CPUs the jail and all of its subjails may run on, or an empty
+     *         set to inherit the affinity of the host. @n
+     *         Applied by the jail before it locks itself down. Individual
+     *         sandbox threads can be narrowed further with
+     *         @ref gh_threadoptions.cpuset.
+     */
+    gh_cpuset cpuset;
+
     /** @brief File descriptor of jail IPC socket. Not intended to be set by user, will be reset during sandbox spawn. */
     int jail_ipc_sockfd;
 } gh_sandboxoptions;
@@ -49,8 +73,54 @@ typedef struct {
     gh_sandboxoptions options;
     /** @brief IPC instance. */
     gh_ipc ipc;
+
+    /** @brief Total traffic between the host and all subjails of the sandbox. */
+    gh_ipccounters thread_ipc;
+    /** @brief Total number of RPC function calls served for all sandbox threads. */
+    atomic_uint_least64_t rpc_calls;
+    /** @brief Total number of finished requests of all sandbox threads. */
+    atomic_uint_least64_t scripts_completed;
+    /** @brief Number of live sandbox threads (including ones being constructed). */
+    atomic_size_t thread_count;
+
+    /** @brief Directory of @ref gh_sandboxoptions.cgroup_path, or -1. */
+    int cgroup_rootfd;
+    /** @brief cgroup of the sandbox, parent of @ref jail_cgroup and the
+     *         cgroups of sandbox threads. Not active without a cgroup path.
+     */
+    gh_cgroup cgroup;
+    /** @brief cgroup of the jail process. Not active without a cgroup path. */
+    gh_cgroup jail_cgroup;
 } gh_sandbox;
 
+/** @brief Sandbox statistics. */
+typedef struct {
+    /** @brief Resident set size of the jail process in bytes (excluding subjails). */
+    size_t rss_bytes;
+    /** @brief CPU time used by the jail process in nanoseconds (excluding subjails). */
+    uint64_t cpu_ns;
+    /** @brief Traffic between the host and the jail process. */
+    gh_ipcstats ipc;
+    /** @brief Total traffic between the host and all subjails, including
+     *         sandbox threads that were already destroyed.
+     */
+    gh_ipcstats thread_ipc;
+    /** @brief Total number of RPC function calls served for all sandbox threads. */
+    uint64_t rpc_calls;
+    /** @brief Total number of finished requests of all sandbox threads. */
+    uint64_t scripts_completed;
+    /** @brief Number of live sandbox threads. */
+    size_t thread_count;
+    /** @brief Memory charged to the cgroup of the sandbox in bytes, including
+     *         all subjails, or 0 without @ref gh_sandboxoptions.cgroup_path.
+     */
+    uint64_t cgroup_memory_bytes;
+    /** @brief CPU time used by all processes of the cgroup of the sandbox in
+     *         nanoseconds, or 0 without @ref gh_sandboxoptions.cgroup_path.
+     */
+    uint64_t cgroup_cpu_ns;
+} gh_sandboxstats;
+
 /** @brief Construct a sandbox object.
  *
  * @note This function spawns a new jail process.
@@ -77,6 +147,18 @@ gh_result gh_sandboxoptions_readfrom(int fd, gh_sandboxoptions * out_options);
  */
 gh_result gh_sandbox_dtor(gh_sandbox * sandbox, gh_result * out_jailresult);
 
+/** @brief Retrieve statistics of a sandbox.
+ *
+ * @par Safe to call from any OS thread at any time. Statistics of individual
+ *      subjails can be retrieved with @ref gh_thread_stats.
+ *
+ * @param sandbox         Pointer to the sandbox object.
+ * @param[out] out_stats  Will hold the statistics.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_sandbox_stats(gh_sandbox * sandbox, gh_sandboxstats * out_stats);
+
 #ifdef __cplusplus
 }
 #endif
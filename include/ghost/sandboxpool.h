@@ -0,0 +1,117 @@
+/** @defgroup sandboxpool Sandbox pool
+ *
+ * @brief Set of identically configured sandboxes (jail processes) that sandbox threads are spread across.
+ *
+ * @{
+ */
+
+#ifndef GHOST_SANDBOXPOOL_H
+#define GHOST_SANDBOXPOOL_H
+
+#include <stdatomic.h>
+#include <ghost/result.h>
+#include <ghost/alloc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Policy deciding which sandbox of a pool a new sandbox thread is placed in. */
+typedef enum {
+    /** @brief Cycle through the sandboxes. */
+    GH_SANDBOXPOOL_ROUNDROBIN,
+    /** @brief Pick the sandbox with the fewest live sandbox threads. Ties are
+     *         broken round-robin.
+     */
+    GH_SANDBOXPOOL_LEASTLOAD
+} gh_sandboxpoolplacement;
+
+/** @brief Sandbox pool options. */
+typedef struct {
+    /** @brief Options used to construct every sandbox of the pool. */
+    gh_sandboxoptions sandbox_options;
+    /** @brief Number of sandboxes (jail processes). */
+    size_t sandbox_count;
+    /** @brief Placement policy of new sandbox threads. */
+    gh_sandboxpoolplacement placement;
+} gh_sandboxpooloptions;
+
+/** @brief Sandbox pool.
+ *
+ * @par Every jail spawns its subjails one at a time, so a single sandbox
+ *      limits how fast sandbox threads can be created, and a crashing jail
+ *      takes all of its subjails down with it. A pool spreads sandbox threads
+ *      across several jails, so subjail creation scales across cores and a
+ *      failing jail only affects its share of the threads.
+ */
+typedef struct {
+    /** @brief Allocator. */
+    gh_alloc * alloc;
+
+    /** @brief Sandboxes. */
+    gh_sandbox * sandboxes;
+    /** @brief Number of sandboxes. */
+    size_t sandbox_count;
+
+    /** @brief Placement policy of new sandbox threads. */
+    gh_sandboxpoolplacement placement;
+    /** @brief Round-robin cursor. */
+    atomic_size_t cursor;
+} gh_sandboxpool;
+
+/** @brief Create a sandbox pool and spawn its jails.
+ *
+ * @param pool    Pointer to uninitialized memory.
+ * @param alloc   Allocator.
+ * @param options Sandbox pool options.
+ *
+ * @return Result code.
+ */
+gh_result gh_sandboxpool_ctor(gh_sandboxpool * pool, gh_alloc * alloc, gh_sandboxpooloptions options);
+
+/** @brief Pick the sandbox the next sandbox thread should be placed in.
+ *
+ * @par Safe to call from any OS thread.
+ *
+ * @param pool Pointer to a sandbox pool.
+ *
+ * @return Sandbox of the pool.
+ */
+gh_sandbox * gh_sandboxpool_pick(gh_sandboxpool * pool);
+
+/** @brief Construct a sandbox thread in a sandbox of the pool.
+ *
+ * @par The sandbox is chosen with @ref gh_sandboxpool_pick. If the thread
+ *      can't be spawned there (e.g. because the jail has died), every other
+ *      sandbox of the pool is tried in turn. Safe to call from any OS thread.
+ *
+ * @param pool    Pointer to a sandbox pool.
+ * @param thread  Pointer to unconstructed sandbox thread.
+ * @param options Thread options. The `sandbox` field is ignored.
+ *
+ * @return Result code of the last attempt.
+ */
+gh_result gh_sandboxpool_threadctor(gh_sandboxpool * pool, gh_thread * thread, gh_threadoptions options);
+
+/** @brief Destroy a sandbox pool.
+ *
+ * @par All sandbox threads of the pool must have been destroyed. Every
+ *      sandbox is destroyed even if destroying one of them fails.
+ *
+ * @param pool           Pointer to a sandbox pool.
+ * @param out_jailresult If not `NULL`, will hold the first error reported by
+ *                       a jail process, or @ref GHR_OK.
+ *
+ * @return Result code.
+ */
+gh_result gh_sandboxpool_dtor(gh_sandboxpool * pool, gh_result * out_jailresult);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/** @} */
@@ -10,6 +10,8 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <ghost/result.h>
 #include <ghost/ipc.h>
 #include <ghost/fdmem.h>
@@ -18,6 +20,8 @@
 #include <ghost/alloc.h>
 #include <ghost/perms/perms.h>
 #include <ghost/variant.h>
+#include <ghost/opensupervisor.h>
+#include <ghost/cgroup.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +30,30 @@ extern "C" {
 #define GH_THREAD_MAXNAME 256
 #define GH_THREAD_MAXSAFEID 512
 
+/** @brief Maximum number of requests that may be in flight on a sandbox thread
+ *         at once. Matches the number of requests a subjail can suspend.
+ */
+#define GH_THREAD_MAXINFLIGHT 64
+
+/** @brief Maximum number of messages parked for other OS threads at once. Every
+ *         request in flight has at most a LUAINFO and a LUARESULT message parked.
+ */
+#define GH_THREAD_MAXPARKED (GH_THREAD_MAXINFLIGHT * 2)
+
+/** @brief Deadline representing no deadline. See @ref gh_threadoptions.default_deadline_ms. */
+#define GH_THREAD_NODEADLINE GH_IPC_NODEADLINE
+
+/** @brief Budget representing no limit. See @ref gh_threadoptions.cpu_budget_ns. */
+#define GH_THREAD_NOBUDGET 0
+
+/** @brief Garbage collector parameter value leaving the parameter unchanged.
+ *         See @ref gh_threadgcoptions.
+ */
+#define GH_THREAD_GCKEEP GH_IPC_GCKEEP
+
+/** @brief Value of @ref gh_threadoptions.idle_trim_ms that disables idle trimming. */
+#define GH_THREAD_NOIDLETRIM 0
+
 /** @brief Thread notification type. */
 typedef enum {
     /** @brief RPC function was called by remote Lua. */
@@ -51,6 +79,24 @@ typedef struct {
      *         directly, use @ref gh_thread_callframe functions.
      */
     gh_fdmem_ptr call_return_ptr;
+
+    /** @brief CPU time spent running the Lua code in nanoseconds. */
+    uint64_t cpu_ns;
+    /** @brief Approximate number of Lua VM instructions executed, in multiples of
+     *         @ref GH_IPCMSG_LUATENANT_SLICE. Only counted while the sandbox thread
+     *         hosts at least one tenant, has an instruction or CPU budget or runs a
+     *         request with a deadline, otherwise 0.
+     */
+    uint64_t instructions;
+
+    /** @brief CPU time spent running all requests of the sandbox thread so far,
+     *         including this one, in nanoseconds.
+     */
+    uint64_t total_cpu_ns;
+    /** @brief Lua VM instructions executed by all requests of the sandbox thread so
+     *         far, including this one. Counted the same way as @ref instructions.
+     */
+    uint64_t total_instructions;
 } gh_threadnotif_script;
 
 /** @brief Information about an RPC function call request. */
@@ -73,7 +119,27 @@ typedef struct {
     };
 } gh_threadnotif;
 
-/** @brief Sandbox thread. */
+/** @brief Message received on behalf of another OS thread, waiting to be picked up. */
+typedef struct gh_threadparkedmsg gh_threadparkedmsg;
+
+#ifndef GH_TYPEDEF_BYTECODECACHE
+typedef struct gh_bytecodecache gh_bytecodecache;
+#define GH_TYPEDEF_BYTECODECACHE
+#endif
+
+/** @brief Sandbox thread.
+ *
+ * @par The synchronous functions (@ref gh_thread_runstringsync, @ref gh_thread_runfilesync,
+ *      @ref gh_thread_call and the `gh_thread_set*` functions) may be used on the same sandbox
+ *      thread from multiple OS threads at once. Every request is tagged with a request ID and
+ *      the subjail runs each request in its own coroutine, so a request waiting for an RPC
+ *      function doesn't block the others. Whichever OS thread is currently receiving serves
+ *      RPC function calls and hands replies meant for other OS threads over to them.
+ *
+ * @par @ref gh_thread_process and the asynchronous functions (@ref gh_thread_runstring,
+ *      @ref gh_thread_runfile) receive messages directly and must not be used while other
+ *      OS threads are using the sandbox thread.
+ */
 struct gh_thread {
     /** @brief Parent sandbox. */
     gh_sandbox * sandbox;
@@ -92,6 +158,8 @@ struct gh_thread {
 
     /** @brief PID of the subjail process. */
     pid_t pid;
+    /** @brief pidfd of the subjail process, kept open for the lifetime of the thread. */
+    int pidfd;
 
     /** @brief IPC instance. */
     gh_ipc ipc;
@@ -102,13 +170,67 @@ struct gh_thread {
     /** @brief Centralized permission system. */
     gh_perms perms;
 
+    /** @brief Serves `openat` calls of the subjail if @ref gh_threadoptions.native_open
+     *         was set (and supported), otherwise not running.
+     */
+    gh_opensupervisor open_supervisor;
+
+    /** @brief True if the subjail is restricted with Landlock instead of handing
+     *         `openat` to the host (see @ref gh_threadoptions.landlock).
+     */
+    bool landlock;
+
+    /** @brief cgroup of the subjail if the sandbox has a cgroup (see
+     *         @ref gh_sandboxoptions.cgroup_path), otherwise not active.
+     */
+    gh_cgroup cgroup;
+
     /** @brief Maximum time to wait to receive a message back after executing
      *         Lua code or functions.
      */
     int default_timeout_ms;
 
+    /** @brief Deadline of requests that don't specify their own. */
+    int default_deadline_ms;
+
     /** @brief Arbitrary userdata. */
     void * userdata;
+
+    /** @brief Bytecode cache used to load scripts, or `NULL`. */
+    gh_bytecodecache * bytecode_cache;
+
+    /** @brief Last assigned request ID. */
+    atomic_int request_counter;
+    /** @brief Last assigned tenant ID. */
+    atomic_int tenant_counter;
+
+    /** @brief Protects the dispatcher state. */
+    pthread_mutex_t dispatch_mutex;
+    /** @brief Signalled when the receiving OS thread gives up its role or parks a message. */
+    pthread_cond_t dispatch_cond;
+    /** @brief If true, an OS thread is currently receiving messages from the subjail. */
+    bool dispatch_receiving;
+    /** @brief Messages received on behalf of other OS threads (oldest first). */
+    gh_threadparkedmsg * parked_head;
+    /** @brief Last parked message. */
+    gh_threadparkedmsg * parked_tail;
+    /** @brief Number of parked messages. */
+    size_t parked_count;
+    /** @brief IDs of requests waiting for replies through the dispatcher.
+     *         Replies to any other request aren't parked.
+     */
+    int inflight[GH_THREAD_MAXINFLIGHT];
+    /** @brief Number of valid entries of @ref inflight. */
+    size_t inflight_count;
+
+    /** @brief Size of the Lua heap in bytes, as of the last finished request. */
+    atomic_uint_least64_t lua_heap_bytes;
+    /** @brief Bytes allocated by the Lua allocator, as of the last finished request. */
+    atomic_uint_least64_t lua_alloc_bytes;
+    /** @brief Number of RPC function calls served. */
+    atomic_uint_least64_t rpc_calls;
+    /** @brief Number of finished requests (successful or not). */
+    atomic_uint_least64_t scripts_completed;
 };
 
 #ifndef GH_TYPEDEF_THREAD
@@ -148,6 +270,134 @@ typedef struct {
      *         Lua code or functions.
      */
     int default_timeout_ms;
+
+    /** @brief Maximum time in milliseconds a script or function call may run in the
+     *         subjail, or @ref GH_THREAD_NODEADLINE. @n
+     *         Requests that run past their deadline are aborted with @ref GHR_LUA_DEADLINE
+     *         reported in their status, without killing the subjail. See
+     *         @ref gh_threadrequestoptions.deadline_ms.
+     */
+    int default_deadline_ms;
+
+    /** @brief CPU time in nanoseconds all requests of the sandbox thread may use
+     *         together, or @ref GH_THREAD_NOBUDGET. @n
+     *         Once used up, the running request and every later request is aborted
+     *         with @ref GHR_LUA_BUDGET reported in its status. Checked the same way
+     *         as deadlines (see @ref gh_threadrequestoptions.deadline_ms).
+     */
+    uint64_t cpu_budget_ns;
+
+    /** @brief Number of Lua VM instructions all requests of the sandbox thread may
+     *         execute together, or @ref GH_THREAD_NOBUDGET. @n
+     *         Enforced like @ref cpu_budget_ns, with the granularity of
+     *         @ref GH_IPCMSG_LUATENANT_SLICE instructions. JIT-compiled code is not counted.
+     */
+    uint64_t instruction_budget;
+
+    /** @brief Time in milliseconds the subjail may be idle (not receive any message)
+     *         before it trims its memory like @ref gh_thread_trim, or
+     *         @ref GH_THREAD_NOIDLETRIM. @n
+     *         A subjail is trimmed at most once between two messages, so idle
+     *         subjails don't use any CPU time.
+     */
+    int idle_trim_ms;
+
+    /** @brief Maximum number of bytes the Lua state of the subjail may allocate,
+     *         or @ref GH_SANDBOX_NOLIMIT. @n
+     *         Allocations beyond the limit fail like the subjail was out of memory,
+     *         so the request is aborted with @ref GHR_LUA_MEM reported in its status
+     *         and the subjail stays usable. Ignored (with a message in the jail log)
+     *         if LuaJIT was built without support for custom allocators.
+     */
+    uint64_t memory_limit_bytes;
+
+    /** @brief Bytecode cache used to load scripts run with @ref gh_thread_runstring,
+     *         @ref gh_thread_runfile and their variants. May be `NULL`, in which case
+     *         every script is compiled by the subjail running it. @n
+     *         The cache must outlive the sandbox thread.
+     */
+    gh_bytecodecache * bytecode_cache;
+
+    /** @brief If true, `io.open` in the subjail calls `fopen` directly instead of
+     *         going through the `ghost.open` RPC function. @n
+     *         The subjail's `openat` calls are then served by a host OS thread
+     *         (see @ref gh_opensupervisor) with the same permission checks, which
+     *         saves the RPC round trip and argument marshalling. Falls back to
+     *         `ghost.open` if the kernel doesn't support seccomp user
+     *         notifications or the sandbox is disabled.
+     */
+    bool native_open;
+
+    /** @brief If true, the subjail is restricted with a Landlock ruleset built
+     *         from the accept entries of the PermFS policy (see
+     *         @ref gh_thread_landlock), and `io.open` calls `fopen` directly.
+     *         Files the ruleset covers are opened without involving the host,
+     *         the rest falls back to `ghost.open`. @n
+     *         Takes precedence over @ref native_open. Ignored if the kernel
+     *         doesn't support Landlock, in which case @ref gh_thread_landlock
+     *         fails with @ref GHR_LANDLOCK_UNAVAILABLE.
+     *
+     * @warning Scripts can tell whether paths outside of the ruleset exist,
+     *          since the kernel reports missing files before checking the
+     *          ruleset.
+     */
+    bool landlock;
+
+    /** @brief Limits of the cgroup the subjail is placed in. Ignored unless the
+     *         sandbox was constructed with @ref gh_sandboxoptions.cgroup_path. @n
+     *         Unlike @ref memory_limit_bytes, `memory_max_bytes` covers all
+     *         memory of the process and is enforced by the kernel.
+     */
+    gh_cgrouplimits cgroup_limits;
+
+    /** @brief Number of bytes of the subjail's Lua arena to back with memory
+     *         before the first request, or 0. @n
+     *         Blocks allocated from that part of the arena don't page fault on
+     *         first use. Limited to the arena chunk reserved at spawn (and after
+     *         @ref gh_thread_reset). Ignored if LuaJIT was built without support
+     *         for custom allocators.
+     */
+    uint64_t prefault_bytes;
+
+    /** @brief If true, the memory prefaulted according to @ref prefault_bytes is
+     *         also locked with `mlock`, so that it can't be swapped out. @n
+     *         Best effort - locking is subject to `RLIMIT_MEMLOCK` (unless the
+     *         host has `CAP_IPC_LOCK`), and failure is only reported in the
+     *         jail log.
+     */
+    bool prefault_lock;
+
+    /** @brief Null terminated Lua script run on the new subjail before
+     *         @ref gh_thread_ctor returns, or `NULL`. @n
+     *         Meant to exercise the code paths of real requests, so that the
+     *         JIT compiler and the Lua heap are warmed up before the first of
+     *         them. Runs like any other request (e.g. it's counted in
+     *         @ref gh_threadstats.scripts_completed). If it fails, the sandbox
+     *         thread is destroyed and its result is returned. @n
+     *         Can't be combined with @ref landlock, since the Landlock ruleset
+     *         would have to be in effect before the warm-up runs - construction
+     *         fails with @ref GHR_THREAD_WARMUPLANDLOCK.
+     */
+    const char * warmup_script;
+
+    /** @brief CPUs the subjail may run on, or an empty set to inherit the
+     *         affinity of the jail (see @ref gh_sandboxoptions.cpuset). @n
+     *         Narrowed to the CPUs of the sandbox's set. If none are left,
+     *         construction fails with @ref GHR_CPUSET_DISJOINT. @n
+     *         Applied by the host before the subjail runs any script, like
+     *         @ref gh_thread_setsched, so the subjail's seccomp filter doesn't
+     *         have to allow `sched_setaffinity`.
+     */
+    gh_cpuset cpuset;
+
+    /** @brief If true, the subjail is restricted to the CPU that the OS thread
+     *         constructing the sandbox thread runs on, so that wakeups for IPC
+     *         between the two stay on one CPU and its caches. Takes precedence
+     *         over @ref cpuset, but is narrowed the same way. @n
+     *         Only stable if the host thread itself is pinned to that CPU and
+     *         is the one servicing the sandbox thread afterwards.
+     */
+    bool pin_to_host;
 } gh_threadoptions;
 
 /** @brief Construct a new sandbox thread.
@@ -174,6 +424,40 @@ gh_result gh_thread_ctor(gh_thread * thread, gh_threadoptions options);
  */
 gh_result gh_thread_dtor(gh_thread * thread, gh_result * out_subjailresult);
 
+/** @brief Construct several sandbox threads at once.
+ *
+ * @par All subjails are requested before waiting for any of them, so
+ *      spawning N subjails takes about as long as a single round trip to the
+ *      jail instead of N. The sandboxes of the threads may differ.
+ *
+ * @par Either all threads are constructed or none are - if any of them
+ *      fails, the ones that were spawned are destroyed again.
+ *
+ * @param threads Array of @p count unconstructed sandbox threads.
+ * @param options Array of @p count thread options, one per thread.
+ * @param count   Number of threads.
+ *
+ * @return @ref GHR_OK on success or the first error encountered.
+ */
+gh_result gh_thread_ctormany(gh_thread * threads, const gh_threadoptions * options, size_t count);
+
+/** @brief Destroy several sandbox threads at once.
+ *
+ * @par All subjails are asked to quit first, then their exit is awaited
+ *      concurrently through pidfds, so shutting down N subjails takes about
+ *      as long as the slowest one instead of the sum. Every thread is
+ *      destroyed even if destroying one of them fails.
+ *
+ * @param threads Array of @p count sandbox threads.
+ * @param count   Number of threads.
+ * @param[out] out_subjailresults If not `NULL`, array of @p count result codes
+ *                                that will contain the result of each subjail's
+ *                                shutdown process, like in @ref gh_thread_dtor.
+ *
+ * @return @ref GHR_OK on success or the first error encountered.
+ */
+gh_result gh_thread_dtormany(gh_thread * threads, size_t count, gh_result * out_subjailresults);
+
 /** @brief Attach userdata to a sandbox thread.
  *
  * @param thread Pointer to a sandbox thread.
@@ -183,6 +467,30 @@ gh_result gh_thread_dtor(gh_thread * thread, gh_result * out_subjailresult);
  */
 gh_result gh_thread_attachuserdata(gh_thread * thread, void * userdata);
 
+/** @brief OS scheduling policy of a subjail process. */
+typedef enum {
+    /** @brief Default time-sharing policy (`SCHED_OTHER`). */
+    GH_THREADSCHED_NORMAL,
+    /** @brief CPU-bound batch policy (`SCHED_BATCH`). */
+    GH_THREADSCHED_BATCH,
+    /** @brief Only run when the CPU would otherwise be idle (`SCHED_IDLE`). */
+    GH_THREADSCHED_IDLE
+} gh_threadsched;
+
+/** @brief Apply an OS scheduling policy and niceness to the subjail process.
+ *
+ * @note The policy is applied by the host process to the subjail's PID, so
+ *       the subjail's seccomp filter doesn't have to allow scheduler syscalls.
+ *       Lowering niceness below its current value requires `CAP_SYS_NICE`.
+ *
+ * @param thread Pointer to a sandbox thread.
+ * @param policy Scheduling policy.
+ * @param nice   Niceness (-20 to 19). Ignored by @ref GH_THREADSCHED_IDLE.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_thread_setsched(gh_thread * thread, gh_threadsched policy, int nice);
+
 gh_result gh_thread_process(gh_thread * thread, gh_threadnotif * notif);
 
 gh_result gh_thread_runstring(gh_thread * thread, const char * s, size_t s_len, int * script_id);
@@ -391,6 +699,25 @@ bool gh_thread_callframe_getstring(gh_thread_callframe * frame, const char ** ou
 
 gh_result gh_thread_callframe_loadreturnvalue(gh_thread_callframe * frame, gh_fdmem_ptr return_value_ptr);
 
+/** @brief Options of a single request. */
+typedef struct {
+    /** @brief Maximum time in milliseconds the request may run in the subjail, counted
+     *         from the moment the subjail starts it, or @ref GH_THREAD_NODEADLINE. @n
+     *         The deadline is checked every @ref GH_IPCMSG_LUATENANT_SLICE interpreted VM
+     *         instructions and while the request is suspended. Only the request is aborted
+     *         (with @ref GHR_LUA_DEADLINE reported in its status) - the subjail, its global
+     *         state and its other requests are unaffected. JIT-compiled code and RPC
+     *         functions called by the request are not interrupted.
+     */
+    int deadline_ms;
+
+    /** @brief If not `NULL`, will hold the request ID as soon as the subjail has
+     *         acknowledged the request, so that another OS thread can cancel it with
+     *         @ref gh_thread_cancel.
+     */
+    atomic_int * out_request_id;
+} gh_threadrequestoptions;
+
 /** @brief Call remote Lua function.
  *
  * @param thread  Pointer to a sandbox thread.
@@ -404,6 +731,311 @@ gh_result gh_thread_callframe_loadreturnvalue(gh_thread_callframe * frame, gh_fd
  */
 gh_result gh_thread_call(gh_thread * thread, const char * name, gh_thread_callframe * frame, gh_threadnotif_script * out_status);
 
+/** @brief Call remote Lua function with per-request options.
+ *
+ * @par Same as @ref gh_thread_call, except that @ref gh_threadoptions.default_deadline_ms
+ *      is replaced by the deadline in @p options.
+ *
+ * @param thread  Pointer to a sandbox thread.
+ * @param name    Null terminated name.
+ * @param frame   Remote Lua call frame.
+ * @param options Request options.
+ * @param[out] out_status If not `NULL`, will contain the result of the function.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_thread_callopts(gh_thread * thread, const char * name, gh_thread_callframe * frame, gh_threadrequestoptions options, gh_threadnotif_script * out_status);
+
+/** @brief Run Lua string in sandbox thread with per-request options.
+ *
+ * @par Same as @ref gh_thread_runstringsync, except that @ref gh_threadoptions.default_deadline_ms
+ *      is replaced by the deadline in @p options.
+ *
+ * @param thread  Pointer to a sandbox thread.
+ * @param s       Pointer to a string containing Lua code.
+ * @param s_len   Length (without null terminator) of @p s.
+ * @param options Request options.
+ * @param[out] out_status If not `NULL`, will contain the result of the script.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_thread_runstringsyncopts(gh_thread * thread, const char * s, size_t s_len, gh_threadrequestoptions options, gh_threadnotif_script * out_status);
+
+/** @brief Cancel an in-flight request.
+ *
+ * @par The request is aborted at the next point where its deadline would be checked
+ *      (see @ref gh_threadrequestoptions.deadline_ms) and @ref GHR_LUA_CANCELLED is
+ *      reported in its status. A running request notices the cancellation right away
+ *      only while the subjail hosts tenants or a request with a deadline - otherwise
+ *      once it's suspended (e.g. by calling an RPC function). Cancelling a request that
+ *      already finished has no effect.
+ *
+ * @par Safe to call from any OS thread.
+ *
+ * @param thread     Pointer to a sandbox thread.
+ * @param request_id Request ID, see @ref gh_threadrequestoptions.out_request_id.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_thread_cancel(gh_thread * thread, int request_id);
+
+/** @brief Reset a sandbox thread to the state it was in right after construction.
+ *
+ * @par The subjail closes its Lua state and creates a fresh one, which drops all
+ *      globals, `ghost.callbacks`, host variables and tenants. The security policy
+ *      is forgotten (see @ref gh_perms_reset). The subjail process and IPC are kept,
+ *      which makes this much cheaper than destroying the sandbox thread and
+ *      constructing a new one. @n
+ *      Script IDs start over and budgets (see @ref gh_threadoptions.cpu_budget_ns)
+ *      are counted from the reset. Statistics (see @ref gh_thread_stats) are kept.
+ *
+ * @par All tenants of the sandbox thread must be destroyed first. No other request
+ *      may be in flight, otherwise @ref GHR_JAIL_RESETBUSY is returned and nothing
+ *      is reset.
+ *
+ * @par A subjail whose Landlock ruleset is in effect (see @ref gh_thread_landlock)
+ *      can't be reset, since the ruleset can't be removed from it and would keep
+ *      granting the old policy's access. Such a sandbox thread has to be destroyed
+ *      and constructed again instead.
+ *
+ * @param thread Pointer to a sandbox thread.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error. @n
+ *         @ref GHR_LANDLOCK_ENFORCED if the subjail's Landlock ruleset is in effect.
+ */
+gh_result gh_thread_reset(gh_thread * thread);
+
+/** @brief What the subjail's garbage collector does while the subjail is idle. */
+typedef enum {
+    /** @brief Nothing. Garbage is only collected when allocation triggers it. */
+    GH_THREADGCIDLE_NONE = GH_IPCMSG_LUAGC_IDLENONE,
+    /** @brief Take incremental steps until a cycle finishes or a message arrives. */
+    GH_THREADGCIDLE_STEP = GH_IPCMSG_LUAGC_IDLESTEP,
+    /** @brief Run a full collection. The next message waits until it finishes. */
+    GH_THREADGCIDLE_FULL = GH_IPCMSG_LUAGC_IDLEFULL
+} gh_threadgcidle;
+
+/** @brief Garbage collector settings of a sandbox thread. */
+typedef struct {
+    /** @brief Value of `collectgarbage('setpause')` in percent, or @ref GH_THREAD_GCKEEP. */
+    int pause;
+    /** @brief Value of `collectgarbage('setstepmul')` in percent, or @ref GH_THREAD_GCKEEP. */
+    int stepmul;
+    /** @brief If true, the collector is stopped while Lua functions called with
+     *         @ref gh_thread_call run, so that they are never interrupted by a
+     *         collection. Garbage produced by the calls is collected afterwards. @n
+     *         Calls that allocate a lot of memory will use more memory than usual.
+     */
+    bool stop_during_calls;
+    /** @brief What to do while the subjail is idle. Combined with a larger pause or
+     *         @ref stop_during_calls, this moves collection off the request path.
+     */
+    gh_threadgcidle idle;
+    /** @brief Size of a single step with @ref GH_THREADGCIDLE_STEP in KB, or 0 for
+     *         the default. Smaller steps let the subjail react to new messages sooner.
+     */
+    int idle_step_kb;
+} gh_threadgcoptions;
+
+/** @brief Configure the Lua garbage collector of a sandbox thread.
+ *
+ * @par The settings are kept by @ref gh_thread_reset.
+ *
+ * @param thread  Pointer to a sandbox thread.
+ * @param options Garbage collector settings.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_thread_setgc(gh_thread * thread, gh_threadgcoptions options);
+
+/** @brief Return as much memory of a sandbox thread to the system as possible.
+ *
+ * @par The subjail runs a full garbage collection and releases free memory of
+ *      its heap. Memory still used by the Lua state is unaffected. See also
+ *      @ref gh_threadoptions.idle_trim_ms.
+ *
+ * @param thread Pointer to a sandbox thread.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_thread_trim(gh_thread * thread);
+
+/** @brief Restrict the subjail of a sandbox thread with a Landlock ruleset built
+ *         from its PermFS policy.
+ *
+ * @par Reading and writing is allowed for the paths of policy entries with
+ *      the modes returned by @ref gh_permfs_unconditionalmode, so the subjail
+ *      opens them with `openat` directly. Everything else (including creating
+ *      files) is denied by the kernel, and `io.open` asks the host instead,
+ *      which applies the whole policy. @n
+ *      Entries added to the policy later don't change the ruleset.
+ *
+ * @par Requires @ref gh_threadoptions.landlock. Must be called after loading
+ *      the policy and before running anything in the sandbox thread - the
+ *      subjail enforces an empty ruleset before the first request otherwise.
+ *
+ * @param thread Pointer to a sandbox thread.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error. @n
+ *         @ref GHR_LANDLOCK_UNAVAILABLE if the subjail doesn't use Landlock. @n
+ *         @ref GHR_LANDLOCK_ENFORCED if the ruleset is already in effect.
+ */
+gh_result gh_thread_landlock(gh_thread * thread);
+
+/** @brief Compile Lua code to bytecode in sandbox thread without running it.
+ *
+ * @par The bytecode is the same as the output of `string.dump` and can be run
+ *      in any subjail with @ref gh_thread_runfile. See @ref bytecodecache.
+ *
+ * @param thread     Pointer to a sandbox thread.
+ * @param chunk_name Null terminated chunk name, used in error messages and tracebacks.
+ * @param source     Pointer to Lua source code.
+ * @param source_len Length of @p source.
+ * @param frame      Constructed, empty remote Lua call frame. On success, the bytecode
+ *                   can be retrieved with @ref gh_thread_callframe_getlstring.
+ * @param[out] out_status If not `NULL`, will contain the result of the compilation.
+ *                        Syntax errors will *not* be reported through the return value.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_thread_compile(gh_thread * thread, const char * chunk_name, const char * source, size_t source_len, gh_thread_callframe * frame, gh_threadnotif_script * out_status);
+
+/** @brief Sandbox thread statistics. */
+typedef struct {
+    /** @brief Size of the Lua heap in bytes, as reported by the subjail
+     *         at the end of the last finished request.
+     */
+    uint64_t lua_heap_bytes;
+    /** @brief Memory allocated by the Lua allocator in bytes, as reported by the
+     *         subjail at the end of the last finished request. Includes rounding
+     *         to size classes, so this is what counts against
+     *         @ref gh_threadoptions.memory_limit_bytes.
+     */
+    uint64_t lua_alloc_bytes;
+    /** @brief Resident set size of the subjail process in bytes. */
+    size_t rss_bytes;
+    /** @brief CPU time used by the subjail process in nanoseconds. */
+    uint64_t cpu_ns;
+    /** @brief Traffic between the host and the subjail, from the point of view of the host. */
+    gh_ipcstats ipc;
+    /** @brief Number of RPC function calls served. */
+    uint64_t rpc_calls;
+    /** @brief Number of finished requests (successful or not). */
+    uint64_t scripts_completed;
+    /** @brief Number of files opened directly by the subjail (see
+     *         @ref gh_threadoptions.native_open).
+     */
+    uint64_t native_opens;
+    /** @brief Memory charged to the cgroup of the subjail in bytes, or 0 if
+     *         the sandbox has no cgroup (see @ref gh_sandboxoptions.cgroup_path).
+     *         Doesn't include memory allocated before the subjail was moved
+     *         into the cgroup.
+     */
+    uint64_t cgroup_memory_bytes;
+    /** @brief CPU time used by the subjail since it was moved into its cgroup
+     *         in nanoseconds, or 0 if the sandbox has no cgroup.
+     */
+    uint64_t cgroup_cpu_ns;
+} gh_threadstats;
+
+/** @brief Retrieve statistics of a sandbox thread.
+ *
+ * @par Safe to call from any OS thread at any time. Reads procfs, but doesn't
+ *      communicate with the subjail.
+ *
+ * @param thread          Pointer to a sandbox thread.
+ * @param[out] out_stats  Will hold the statistics.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error. @n
+ *         @ref GHR_THREAD_EXITED if the subjail process is gone.
+ */
+gh_result gh_thread_stats(gh_thread * thread, gh_threadstats * out_stats);
+
+/** @brief Isolated Lua environment hosted by a sandbox thread. @n
+ *         A single subjail can host many tenants. Every tenant has its own global
+ *         table, copies of the standard library and `ghost` module tables, its own
+ *         `ghost.callbacks` and its own script IDs. Host variables are shared by all
+ *         tenants of a sandbox thread. @n
+ *         Requests of different tenants are interleaved by the subjail every
+ *         @ref GH_IPCMSG_LUATENANT_SLICE interpreted VM instructions, as long as the
+ *         request is not inside a nested coroutine or a C function. JIT-compiled
+ *         code is not interrupted. @n
+ *         Tenants share a process and a LuaJIT state, so they must only be used for
+ *         code of the same trust level - use separate sandbox threads otherwise.
+ */
+typedef struct {
+    /** @brief Sandbox thread hosting the tenant. */
+    gh_thread * thread;
+    /** @brief Tenant ID. */
+    int id;
+
+    /** @brief Number of completed requests. */
+    atomic_uint_least64_t requests;
+    /** @brief Sum of CPU time used by completed requests in nanoseconds. */
+    atomic_uint_least64_t cpu_ns;
+    /** @brief Sum of approximate instruction counts of completed requests. */
+    atomic_uint_least64_t instructions;
+} gh_threadtenant;
+
+/** @brief Resources used by a tenant. */
+typedef struct {
+    /** @brief Number of completed requests. */
+    uint64_t requests;
+    /** @brief CPU time in nanoseconds. */
+    uint64_t cpu_ns;
+    /** @brief Approximate number of Lua VM instructions. */
+    uint64_t instructions;
+} gh_threadtenantusage;
+
+/** @brief Create a tenant in a sandbox thread.
+ *
+ * @param tenant Pointer to uninitialized memory.
+ * @param thread Pointer to a sandbox thread. Must outlive the tenant.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_threadtenant_ctor(gh_threadtenant * tenant, gh_thread * thread);
+
+/** @brief Destroy a tenant.
+ *
+ * @par Requests of the tenant that are still running are allowed to finish.
+ *
+ * @param tenant Pointer to a tenant.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_threadtenant_dtor(gh_threadtenant * tenant);
+
+/** @brief Run Lua string in the environment of a tenant.
+ *
+ * @param tenant Pointer to a tenant.
+ * @param s      Pointer to a string containing Lua code.
+ * @param s_len  Length (without null terminator) of @p s.
+ * @param[out] out_status If not `NULL`, will contain the result of the script.
+ *                        Lua errors will *not* be reported through the return value.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_threadtenant_runstringsync(gh_threadtenant * tenant, const char * s, size_t s_len, gh_threadnotif_script * out_status);
+
+/** @brief Call a Lua function registered in the `ghost.callbacks` of a tenant.
+ *
+ * @param tenant  Pointer to a tenant.
+ * @param name    Null terminated name.
+ * @param frame   Remote Lua call frame.
+ * @param[out] out_status If not `NULL`, will contain the result of the function.
+ *
+ * @return @ref GHR_OK on success or a result code indicating an error.
+ */
+gh_result gh_threadtenant_call(gh_threadtenant * tenant, const char * name, gh_thread_callframe * frame, gh_threadnotif_script * out_status);
+
+/** @brief Retrieve resources used by a tenant so far.
+ *
+ * @param tenant    Pointer to a tenant.
+ * @param out_usage Will hold resource usage.
+ */
+void gh_threadtenant_usage(gh_threadtenant * tenant, gh_threadtenantusage * out_usage);
+
 
 #ifdef __cplusplus
 }
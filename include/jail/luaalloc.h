@@ -0,0 +1,103 @@
+#ifndef GHOST_JAIL_LUAALLOC_H
+#define GHOST_JAIL_LUAALLOC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <luajit-2.1/lua.h>
+
+// Allocations up to this size are served from size classes in the arena,
+// larger ones are mapped separately.
+#define GH_LUAALLOC_MAXCLASSSIZE (256 * 1024)
+#define GH_LUAALLOC_CLASSES 52
+
+// Size of address space reserved at once for the arena. Pages are only
+// backed by memory once touched.
+#define GH_LUAALLOC_CHUNKSIZE (64 * 1024 * 1024)
+// Size of the arena chunk reserved if a full one can't be (e.g. because of
+// the sandbox's memory limit).
+#define GH_LUAALLOC_MINCHUNKSIZE (1024 * 1024)
+
+#define GH_LUAALLOC_NOLIMIT 0
+
+typedef struct gh_luaallocchunk gh_luaallocchunk;
+
+/** @brief Allocator of a subjail's Lua state.
+ *
+ * @par Small blocks are carved out of a large pre-reserved arena and recycled
+ *      through per-size-class free lists, so that allocating doesn't make
+ *      system calls. Lua always passes the size of a block when resizing or
+ *      freeing it, so blocks carry no header.
+ *
+ * @par Allocations that would exceed the limit fail, which Lua reports as a
+ *      memory error (@ref GHR_LUA_MEM) instead of the subjail running out of
+ *      memory.
+ */
+typedef struct {
+    /** @brief Maximum number of bytes that may be allocated, or @ref GH_LUAALLOC_NOLIMIT. */
+    size_t limit;
+    /** @brief Number of bytes currently allocated (rounded up to size classes). */
+    size_t used;
+
+    /** @brief Chunks of the arena (most recent first). */
+    gh_luaallocchunk * chunks;
+    /** @brief Next free byte of the most recent chunk. */
+    char * bump;
+    /** @brief End of the most recent chunk. */
+    char * end;
+    /** @brief Range locked by @ref gh_luaalloc_prefault, or NULL. */
+    char * locked_start;
+    char * locked_end;
+
+    /** @brief Freed blocks of every size class. */
+    void * free_lists[GH_LUAALLOC_CLASSES];
+} gh_luaalloc;
+
+/** @brief Construct an allocator and reserve the first arena chunk.
+ *
+ * @return True on success.
+ */
+bool gh_luaalloc_ctor(gh_luaalloc * alloc);
+
+/** @brief Release all memory of the allocator.
+ *
+ * @par Every block must have been freed (i.e. the Lua state closed).
+ *      The limit is kept, the arena is reserved again on first use.
+ */
+void gh_luaalloc_reset(gh_luaalloc * alloc);
+
+/** @brief Return pages of free blocks to the kernel.
+ *
+ * @par Only blocks spanning whole pages are affected. They stay in their free
+ *      lists and are backed by zeroed pages again once reused. Pages locked
+ *      by @ref gh_luaalloc_prefault are kept.
+ */
+void gh_luaalloc_trim(gh_luaalloc * alloc);
+
+/** @brief Back the start of the unused part of the arena with memory.
+ *
+ * @par Blocks allocated from the prefaulted range don't page fault on first
+ *      use. Only the most recent chunk is prefaulted, so @p size is capped at
+ *      what's left of it.
+ *
+ * @param size Number of bytes to prefault.
+ * @param lock If true, the range is also locked into memory with `mlock`.
+ *
+ * @return False if locking failed. The range is prefaulted regardless.
+ */
+bool gh_luaalloc_prefault(gh_luaalloc * alloc, size_t size, bool lock);
+
+/** @brief `lua_Alloc` function. Userdata must point to a @ref gh_luaalloc. */
+void * gh_luaalloc_func(void * ud, void * ptr, size_t osize, size_t nsize);
+
+/** @brief Create a Lua state using the allocator.
+ *
+ * @par Falls back to LuaJIT's own allocator if this build of LuaJIT doesn't
+ *      support custom allocators (64 bit builds without GC64).
+ *
+ * @param[out] out_custom Set to true if the state uses the allocator.
+ *
+ * @return New Lua state or `NULL` if out of memory.
+ */
+lua_State * gh_luaalloc_newstate(gh_luaalloc * alloc, bool * out_custom);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef GHOST_JAIL_SECCOMP_H
+#define GHOST_JAIL_SECCOMP_H
+
+#include <linux/filter.h>
+
+// The filters are generated by tools/seccompgen.py from the syscall table in
+// intermediate/gh_seccomp.csv.
+
+/** @brief Seccomp filter installed by the jail process. */
+extern const struct sock_filter gh_seccomp_jail_filter[];
+/** @brief Number of instructions in @ref gh_seccomp_jail_filter. */
+extern const unsigned short gh_seccomp_jail_filter_len;
+
+/** @brief Seccomp filter stacked on top of the jail's one by subjails.
+ *
+ * @par Only rejects syscalls that the jail needs but subjails don't.
+ */
+extern const struct sock_filter gh_seccomp_subjail_filter[];
+/** @brief Number of instructions in @ref gh_seccomp_subjail_filter. */
+extern const unsigned short gh_seccomp_subjail_filter_len;
+
+/** @brief Seccomp filter installed by subjails with a user notification listener.
+ *
+ * @par Hands syscalls served by the host (`openat`) to the listener.
+ */
+extern const struct sock_filter gh_seccomp_subjail_notify_filter[];
+/** @brief Number of instructions in @ref gh_seccomp_subjail_notify_filter. */
+extern const unsigned short gh_seccomp_subjail_notify_filter_len;
+
+#endif
@@ -4,12 +4,19 @@
 #include <ghost/ipc.h>
 #include <luajit-2.1/lua.h>
 
+// maximum number of Lua requests a subjail can have suspended at once
+#define GH_SUBJAIL_MAXREQUESTS 64
+
+// size of a single garbage collector step taken while idle, in KB, if the host
+// doesn't specify one
+#define GH_SUBJAIL_GCIDLESTEPKB 64
+
 extern int gh_global_subjail_idx;
 extern int gh_global_script_idx;
 extern lua_State * L;
 
-void gh_subjail_spawn(int sockfd, int parent_pid, gh_ipc * parent_ipc);
-int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc);
-gh_result gh_subjail_lockdown(void);
+void gh_subjail_spawn(int sockfd, int parent_pid, gh_ipc * parent_ipc, bool landlock_requested);
+int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc, bool landlock_requested);
+gh_result gh_subjail_lockdown(bool landlock_requested, int * out_notifyfd, bool * out_landlock);
 
 #endif
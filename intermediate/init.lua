@@ -29,6 +29,15 @@ ffi.cdef[[
         void * return_arg,
         size_t return_arg_size
     );
+    gh_result gh_ipc_callsend(
+        gh_ipc * ipc,
+        int request_id,
+        const char * name,
+        size_t arg_count,
+        gh_ipcmsg_functioncall_arg * args,
+        void * return_arg,
+        size_t return_arg_size
+    );
 
     char * strcpy(char * restrict dst, const char * restrict src);
     struct FILE * fdopen(int fd, const char * mode);
@@ -151,29 +160,91 @@ function ghost.call(name, ret_type, ...)
         end
     end
 
-    local fd_ret = ffi.new("int[1]")
+    -- the call is tagged with the ID of the request running it; if this is
+    -- the request's own coroutine, it is suspended so that other requests can
+    -- run while the host handles the call, otherwise block until it returns
+    local request_id, can_await = c_support.request()
+
+    local result = ffi.C.gh_ipc_callsend(IPC, request_id, name, arg_count, args, ret_obj, ret_size)
+    handle_ghr(result)
 
-    local result = ffi.C.gh_ipc_call(IPC, name, arg_count, args, fd_ret, ret_obj, ret_size)
+    local fd
+    if can_await and coroutine.isyieldable ~= nil and coroutine.isyieldable() then
+        result, fd = c_support.await()
+    else
+        result, fd = c_support.wait(request_id)
+    end
     handle_ghr(result)
 
+    -- ret_obj and gc_protect must stay alive until the host has written the
+    -- return value
+    gc_protect = nil
+
     if ret_obj ~= nil then
         local ret_value = retbuffer_read(ret_obj, ret_size, ret_type)
-        if fd_ret[0] ~= -1 then
-            return ret_value, fd_ret[0]
+        if fd ~= -1 then
+            return ret_value, fd
         else
             return ret_value
         end
-    elseif fd_ret[0] ~= -1 then
-        return fd_ret[0]
+    elseif fd ~= -1 then
+        return fd
     end
 
     return nil
 end
 
 ghost._udptr = c_support.udptr
+ghost._loadstdliblazy = c_support.loadstdliblazy
+ghost._nativeopen = c_support.nativeopen
 
 __ghost_callbacks = {}
 __ghost_host = {}
 
 ghost.callbacks = __ghost_callbacks
 ghost.hostvars = __ghost_host
+
+-- builds the global table of a new tenant: a shallow copy of the globals in
+-- which every loaded library (including ghost) is replaced by a shallow copy,
+-- so that tenants can't modify each other's globals and libraries.
+-- host variables are shared by all tenants of the subjail.
+function c_support.newenv()
+    local env = {}
+    for k, v in pairs(_G) do
+        env[k] = v
+    end
+
+    local loaded = {}
+    for name, mod in pairs(package.loaded) do
+        if type(mod) == "table" and mod ~= _G then
+            local copy = {}
+            for k, v in pairs(mod) do
+                copy[k] = v
+            end
+            -- keeps lazily loaded functions (see stdlib.lua) reachable
+            setmetatable(copy, getmetatable(mod))
+
+            loaded[name] = copy
+            if _G[name] == mod then
+                env[name] = copy
+            end
+        end
+    end
+
+    env._G = env
+    loaded._G = env
+
+    env.__ghost_callbacks = {}
+    loaded.ghost.callbacks = env.__ghost_callbacks
+
+    local shared_require = require
+    env.require = function(name)
+        local mod = loaded[name]
+        if mod ~= nil then
+            return mod
+        end
+        return shared_require(name)
+    end
+
+    return env
+end
@@ -2,8 +2,10 @@ local ghost = require("ghost")
 local ffi = require("ffi")
 
 local udptr = ghost._udptr
+local native_open = ghost._nativeopen
 
 ffi.cdef[[
+    static const int EACCES = 13;
     static const int ESPIPE = 29;
     char *strerror(int errnum);
 
@@ -33,6 +35,7 @@ ffi.cdef[[
     FILE * stderr;
 
     FILE *fdopen(int fd, const char *mode);
+    FILE *fopen(const char *restrict path, const char *restrict mode);
     size_t fread(char * ptr, size_t size, size_t nmemb, FILE *restrict stream);
     size_t fwrite(const char * ptr, size_t size, size_t nmemb, FILE *restrict stream);
     ssize_t getline(char **restrict lineptr, size_t *restrict n, FILE *restrict stream);
@@ -66,10 +69,6 @@ ffi.cdef[[
         FILE * _ptr;
     };
 
-
-    typedef int gh_permfs_mode;
-    gh_permfs_mode gh_permfs_mode_fromident(const char * ident);
-
     // TODO: ONLY TRUE ON 64 BITS!
     typedef long time_t;
 
@@ -418,6 +417,24 @@ ghost_io.open = function(path, mode)
         return nil, err
     end
 
+    -- the openat call of fopen is either served by the host (see
+    -- gh_opensupervisor), with the same permission checks as ghost.open, or
+    -- restricted by the Landlock ruleset of the subjail (see
+    -- gh_thread_landlock), in which case files outside of the ruleset are
+    -- requested from the host
+    local direct, fallback = native_open()
+    if direct then
+        local fileptr = ffi.C.fopen(path, c_fopenmode(mode))
+        if fileptr ~= nil then
+            return FILE(fileptr)
+        end
+
+        local errno = ffi.errno()
+        if not fallback or errno ~= ffi.C.EACCES then
+            return nil, c_error(errno)
+        end
+    end
+
     local ok, fd = pcall(function()
         return ghost.call("ghost.open", nil, path, ffi.new("int", open_mode), ffi.new("int", DEFAULT_FILE_MODE))
     end)
@@ -446,48 +463,10 @@ ghost_io.output = function(file)
     end
 end
 
-ghost_io.popen = function(path, mode)
-    -- mode is ignored, returned file is a pty
-    
-    local fd = ghost.call("ghost.popen", nil, path)
-    local fileptr = ffi.C.fdopen(fd, "r")
-    return FILE(fileptr)
-end
-
 ghost_io.read = function(...)
     return ghost_io.input():read(...)
 end
 
-local tmp_files = {}
-
-ghost_io.tmpfile = function(prefix)
-    prefix = tostring(prefix)
-
-    local ok, path, fd = pcall(function()
-        return ghost.call("ghost.opentemp", "string", 4096, prefix or "", ffi.new("int", ffi.C.O_RDONLY + ffi.C.O_CREAT))
-    end)
-
-    if not ok then
-        return nil, path
-    end
-
-    if fd < 0 then
-        return nil, "got fd < 0 from opentemp"
-    end
-
-    local fileptr = ffi.C.fdopen(fd, "r+")
-    local file = FILE(fileptr)
-
-    local tmp_proxy = newproxy(true)
-    local tmp_meta = getmetatable(tmp_proxy)
-    tmp_meta.__gc = function(self)
-        ghost_os.remove(path)
-    end
-    table.insert(tmp_files, tmp_proxy)
-    
-    return file
-end
-
 ghost_io.type = function(obj)
     if type(obj) == "cdata" and ffi.typeof(obj) == FILE then
         if obj._ptr == nil then
@@ -554,80 +533,6 @@ ghost_os.time = function(tab)
     unimplemented()
 end
 
-ghost_os.tmpname = function(prefix)
-    prefix = tostring(prefix)
-
-    local ok, path, fd = pcall(function()
-        return ghost.call("ghost.opentemp", "string", 4096, prefix or "", ffi.new("int", ffi.C.O_CREAT))
-    end)
-
-    if not ok then
-        return nil, fd, path
-    end
-
-    if fd < 0 then
-        return nil, "got fd < 0 from opentemp"
-    end
-
-    if ffi.C.close(fd) < 0 then
-        error("failed closing temp file in os.tmpname: " .. c_error())
-    end
-
-    return path
-end
-
-local function permfs_mode(str_modes)
-    local c_mode = 0
-
-    for mode in string.gmatch(str_modes, "([^,]+)") do
-        local flag = ffi.C.gh_permfs_mode_fromident(mode)
-        if flag == 0 then
-            error("unknown filesystem permission mode: " .. tostring(mode))
-        end
-        c_mode = c_mode + flag
-    end
-
-    return c_mode
-end
-
-ghost.perm.askfile = function(path, modes)
-    local c_mode = permfs_mode(modes)
-
-    return pcall(function()
-        ghost.call("ghost.perm.fsrequest", nil, path, ffi.cast("int", c_mode), ffi.new("int", 0))
-    end)
-end
-
-ghost.perm.askdir = function(path, self_mode, children_mode)
-    local c_self_mode = self_mode and permfs_mode(self_mode) or 0
-    local c_children_mode = children_mode and permfs_mode(children_mode) or 0
-
-    if c_self_mode == 0 and c_children_mode == 0 then
-        return true
-    end
-
-    return pcall(function()
-        ghost.call("ghost.perm.fsrequest", nil, path, ffi.cast("int", c_self_mode), ffi.cast("int", c_children_mode))
-    end)
-end
-
-ghost.perm.filehas = function(path, modes)
-    local c_mode = permfs_mode(modes)
-
-    return ghost.call("ghost.perm.fshas", "boolean", path, ffi.cast("int", c_mode), ffi.new("int", 0))
-end
-
-ghost.perm.dirhas = function(path, self_mode, children_mode)
-    local c_self_mode = self_mode and permfs_mode(self_mode) or 0
-    local c_children_mode = children_mode and permfs_mode(children_mode) or 0
-
-    if c_self_mode == 0 and c_children_mode == 0 then
-        return true
-    end
-
-    return ghost.call("ghost.perm.fshas", "boolean", path, ffi.cast("int", c_self_mode), ffi.cast("int", c_children_mode))
-end
-
 ghost.require = function(path)
     if package.loaded[path] then return package.loaded[path] end
 
@@ -646,6 +551,34 @@ ghost.require = function(path)
     return module
 end
 
+-- RATIONALE: Every subjail runs this file on startup, but few scripts use
+-- popen, temporary files or permission requests. Those functions are only
+-- loaded the first time they are looked up, and copied into the library
+-- table (or the tenant's copy of it) they were looked up in.
+local load_lazy = ghost._loadstdliblazy
+ghost._loadstdliblazy = nil
+
+local lazy_libs = nil
+local function lazy_index(lib_name)
+    return {
+        __index = function(lib, key)
+            if lazy_libs == nil then
+                lazy_libs = load_lazy()(ghost, ffi, FILE, c_error, ghost_os)
+            end
+
+            local value = lazy_libs[lib_name][key]
+            if value ~= nil then
+                rawset(lib, key, value)
+            end
+            return value
+        end
+    }
+end
+
+setmetatable(ghost_io, lazy_index("io"))
+setmetatable(ghost_os, lazy_index("os"))
+setmetatable(ghost_perm, lazy_index("perm"))
+
 io = ghost_io
 package.loaded.io = ghost_io
 
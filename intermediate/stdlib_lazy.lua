@@ -0,0 +1,132 @@
+-- Rarely used parts of the standard library. This chunk is only run the
+-- first time one of the functions it defines is looked up in io, os or
+-- ghost.perm (see lazy_index in stdlib.lua). It receives the locals of
+-- stdlib.lua it depends on and returns the functions to add to each library.
+local ghost, ffi, FILE, c_error, ghost_os = ...
+
+ffi.cdef[[
+    typedef int gh_permfs_mode;
+    gh_permfs_mode gh_permfs_mode_fromident(const char * ident);
+]]
+
+local lazy_io = {}
+local lazy_os = {}
+local lazy_perm = {}
+
+lazy_io.popen = function(path, mode)
+    -- mode is ignored, returned file is a pty
+    
+    local fd = ghost.call("ghost.popen", nil, path)
+    local fileptr = ffi.C.fdopen(fd, "r")
+    return FILE(fileptr)
+end
+
+local tmp_files = {}
+
+lazy_io.tmpfile = function(prefix)
+    prefix = tostring(prefix)
+
+    local ok, path, fd = pcall(function()
+        return ghost.call("ghost.opentemp", "string", 4096, prefix or "", ffi.new("int", ffi.C.O_RDONLY + ffi.C.O_CREAT))
+    end)
+
+    if not ok then
+        return nil, path
+    end
+
+    if fd < 0 then
+        return nil, "got fd < 0 from opentemp"
+    end
+
+    local fileptr = ffi.C.fdopen(fd, "r+")
+    local file = FILE(fileptr)
+
+    local tmp_proxy = newproxy(true)
+    local tmp_meta = getmetatable(tmp_proxy)
+    tmp_meta.__gc = function(self)
+        ghost_os.remove(path)
+    end
+    table.insert(tmp_files, tmp_proxy)
+    
+    return file
+end
+
+lazy_os.tmpname = function(prefix)
+    prefix = tostring(prefix)
+
+    local ok, path, fd = pcall(function()
+        return ghost.call("ghost.opentemp", "string", 4096, prefix or "", ffi.new("int", ffi.C.O_CREAT))
+    end)
+
+    if not ok then
+        return nil, fd, path
+    end
+
+    if fd < 0 then
+        return nil, "got fd < 0 from opentemp"
+    end
+
+    if ffi.C.close(fd) < 0 then
+        error("failed closing temp file in os.tmpname: " .. c_error())
+    end
+
+    return path
+end
+
+local function permfs_mode(str_modes)
+    local c_mode = 0
+
+    for mode in string.gmatch(str_modes, "([^,]+)") do
+        local flag = ffi.C.gh_permfs_mode_fromident(mode)
+        if flag == 0 then
+            error("unknown filesystem permission mode: " .. tostring(mode))
+        end
+        c_mode = c_mode + flag
+    end
+
+    return c_mode
+end
+
+lazy_perm.askfile = function(path, modes)
+    local c_mode = permfs_mode(modes)
+
+    return pcall(function()
+        ghost.call("ghost.perm.fsrequest", nil, path, ffi.cast("int", c_mode), ffi.new("int", 0))
+    end)
+end
+
+lazy_perm.askdir = function(path, self_mode, children_mode)
+    local c_self_mode = self_mode and permfs_mode(self_mode) or 0
+    local c_children_mode = children_mode and permfs_mode(children_mode) or 0
+
+    if c_self_mode == 0 and c_children_mode == 0 then
+        return true
+    end
+
+    return pcall(function()
+        ghost.call("ghost.perm.fsrequest", nil, path, ffi.cast("int", c_self_mode), ffi.cast("int", c_children_mode))
+    end)
+end
+
+lazy_perm.filehas = function(path, modes)
+    local c_mode = permfs_mode(modes)
+
+    return ghost.call("ghost.perm.fshas", "boolean", path, ffi.cast("int", c_mode), ffi.new("int", 0))
+end
+
+lazy_perm.dirhas = function(path, self_mode, children_mode)
+    local c_self_mode = self_mode and permfs_mode(self_mode) or 0
+    local c_children_mode = children_mode and permfs_mode(children_mode) or 0
+
+    if c_self_mode == 0 and c_children_mode == 0 then
+        return true
+    end
+
+    return ghost.call("ghost.perm.fshas", "boolean", path, ffi.cast("int", c_self_mode), ffi.cast("int", c_children_mode))
+end
+
+return {
+    io = lazy_io,
+    os = lazy_os,
+    perm = lazy_perm
+}
@@ -0,0 +1,385 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ghost/result.h>
+#include <ghost/alloc.h>
+#include <ghost/dynamic_array.h>
+#include <ghost/sha256provider.h>
+#include <ghost/thread.h>
+#include <ghost/bytecodecache.h>
+
+#define BYTECODECACHE_INITIALCAPACITY 16
+#define BYTECODECACHE_HEXLEN (GH_SHA256_DIGESTLEN * 2)
+#define BYTECODECACHE_FILENAMEMAX 128
+
+static gh_result bytecodecache_dtorentry(gh_dynamicarray da, void * elem, void * userdata) {
+    (void)da;
+    (void)userdata;
+
+    gh_bytecodecacheentry * entry = (gh_bytecodecacheentry *)elem;
+    if (close(entry->fd) < 0) return ghr_errno(GHR_BYTECODECACHE_CLOSE);
+    return GHR_OK;
+}
+
+static const gh_dynamicarrayoptions bytecodecache_daopts = {
+    .initial_capacity = BYTECODECACHE_INITIALCAPACITY,
+    .max_capacity = GH_DYNAMICARRAY_NOMAXCAPACITY,
+    .element_size = sizeof(gh_bytecodecacheentry),
+
+    .dtorelement_func = bytecodecache_dtorentry,
+    .userdata = NULL
+};
+
+gh_result gh_bytecodecache_ctor(gh_bytecodecache * cache, gh_sandbox * sandbox, gh_bytecodecacheoptions options) {
+    *cache = (gh_bytecodecache) {
+        .alloc = options.thread_options.rpc->alloc,
+        .persist_dirfd = -1,
+        .max_entries = options.max_entries
+    };
+
+    gh_result res = GHR_OK;
+    gh_result inner_res = GHR_OK;
+
+    int pthread_res = pthread_mutex_init(&cache->mutex, NULL);
+    if (pthread_res != 0) return ghr_errnoval(GHR_BYTECODECACHE_MUTEXINIT, pthread_res);
+
+    res = gh_dynamicarray_ctor(GH_DYNAMICARRAY(cache), &bytecodecache_daopts);
+    if (ghr_iserr(res)) goto fail_entries;
+
+    if (options.persist_path != NULL) {
+        cache->persist_dirfd = open(options.persist_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cache->persist_dirfd < 0) {
+            res = ghr_errno(GHR_BYTECODECACHE_OPENDIR);
+            goto fail_persist;
+        }
+    }
+
+    // RATIONALE: The compiler never runs any code, so the bytecode it produces
+    // depends on nothing but the source it was given. Sandbox threads running
+    // scripts could hand back arbitrary bytecode.
+    gh_threadoptions thread_options = options.thread_options;
+    thread_options.sandbox = sandbox;
+    thread_options.bytecode_cache = NULL;
+
+    res = gh_thread_ctor(&cache->compiler, thread_options);
+    if (ghr_iserr(res)) goto fail_compiler;
+
+    return GHR_OK;
+
+fail_compiler:
+    if (cache->persist_dirfd >= 0 && close(cache->persist_dirfd) < 0) res = ghr_errno(GHR_BYTECODECACHE_CLOSE);
+
+fail_persist:
+    inner_res = gh_dynamicarray_dtor(GH_DYNAMICARRAY(cache), &bytecodecache_daopts);
+    if (ghr_iserr(inner_res)) res = inner_res;
+
+fail_entries:
+    pthread_mutex_destroy(&cache->mutex);
+    return res;
+}
+
+gh_result gh_bytecodecache_dtor(gh_bytecodecache * cache) {
+    gh_result res = gh_thread_dtor(&cache->compiler, NULL);
+
+    if (cache->persist_dirfd >= 0 && close(cache->persist_dirfd) < 0 && ghr_isok(res)) {
+        res = ghr_errno(GHR_BYTECODECACHE_CLOSE);
+    }
+
+    gh_result inner_res = gh_dynamicarray_dtor(GH_DYNAMICARRAY(cache), &bytecodecache_daopts);
+    if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+
+    int pthread_res = pthread_mutex_destroy(&cache->mutex);
+    if (pthread_res != 0 && ghr_isok(res)) res = ghr_errnoval(GHR_BYTECODECACHE_MUTEXDESTROY, pthread_res);
+
+    return res;
+}
+
+// The key covers the chunk name as well as the source, because the chunk
+// name is embedded in the bytecode and shows up in error messages.
+static gh_result bytecodecache_key(const char * chunk_name, const char * source, size_t source_len, gh_sha256 * out_key) {
+    size_t chunk_name_len = strlen(chunk_name);
+    if (chunk_name_len > GH_IPCMSG_LUAFILE_CHUNKNAMEMAX - 1) return GHR_BYTECODECACHE_LARGECHUNKNAME;
+
+    char buffer[GH_IPCMSG_LUAFILE_CHUNKNAMEMAX + GH_SHA256_DIGESTLEN];
+    memcpy(buffer, chunk_name, chunk_name_len + 1);
+
+    gh_sha256 source_hash;
+    gh_result res = gh_sha256_buffer(source_len, source, &source_hash);
+    if (ghr_iserr(res)) return res;
+
+    memcpy(buffer + chunk_name_len + 1, source_hash.hash, GH_SHA256_DIGESTLEN);
+    return gh_sha256_buffer(chunk_name_len + 1 + GH_SHA256_DIGESTLEN, buffer, out_key);
+}
+
+// Must be called with the mutex held.
+static gh_bytecodecacheentry * bytecodecache_find(gh_bytecodecache * cache, gh_sha256 * key) {
+    for (size_t i = 0; i < cache->size; i++) {
+        gh_bytecodecacheentry * entry = cache->buffer + i;
+        if (gh_sha256_eq(&entry->hash, key)) return entry;
+    }
+
+    return NULL;
+}
+
+// Must be called with the mutex held.
+static bool bytecodecache_full(gh_bytecodecache * cache) {
+    return cache->max_entries != GH_BYTECODECACHE_NOLIMIT && cache->size >= cache->max_entries;
+}
+
+static gh_result bytecodecache_writeall(int fd, const char * data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) return ghr_errno(GHR_BYTECODECACHE_WRITE);
+
+        data += written;
+        size -= (size_t)written;
+    }
+
+    return GHR_OK;
+}
+
+static gh_result bytecodecache_newmemfd(const char * data, size_t size, int * out_fd) {
+    int fd = memfd_create("ghost-bytecode", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return ghr_errno(GHR_BYTECODECACHE_MEMFD);
+
+    gh_result res = bytecodecache_writeall(fd, data, size);
+    if (ghr_iserr(res)) goto fail;
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) < 0) {
+        res = ghr_errno(GHR_BYTECODECACHE_SEAL);
+        goto fail;
+    }
+
+    *out_fd = fd;
+    return GHR_OK;
+
+fail:
+    close(fd);
+    return res;
+}
+
+static void bytecodecache_filename(gh_sha256 * key, const char * suffix, char * out_name) {
+    static const char hex[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < GH_SHA256_DIGESTLEN; i++) {
+        uint8_t byte = (uint8_t)key->hash[i];
+        out_name[i * 2 + 0] = hex[byte >> 4];
+        out_name[i * 2 + 1] = hex[byte & 0xf];
+    }
+
+    snprintf(out_name + BYTECODECACHE_HEXLEN, BYTECODECACHE_FILENAMEMAX - BYTECODECACHE_HEXLEN, "%s", suffix);
+}
+
+// Sets *out_fd to -1 if the chunk isn't in the persistent store.
+static gh_result bytecodecache_readpersisted(gh_bytecodecache * cache, gh_sha256 * key, int * out_fd, size_t * out_size) {
+    *out_fd = -1;
+
+    char name[BYTECODECACHE_FILENAMEMAX];
+    bytecodecache_filename(key, GH_BYTECODECACHE_FILEEXT, name);
+
+    int file_fd = openat(cache->persist_dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        if (errno == ENOENT) return GHR_OK;
+        return ghr_errno(GHR_BYTECODECACHE_OPENFILE);
+    }
+
+    gh_result res = GHR_OK;
+    char * data = NULL;
+    size_t size = 0;
+
+    struct stat file_stat;
+    if (fstat(file_fd, &file_stat) < 0) {
+        res = ghr_errno(GHR_BYTECODECACHE_READ);
+        goto cleanup_file;
+    }
+
+    size = (size_t)file_stat.st_size;
+    if (size == 0) goto cleanup_file;
+
+    res = gh_alloc_new(cache->alloc, (void**)&data, size);
+    if (ghr_iserr(res)) goto cleanup_file;
+
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t readn = pread(file_fd, data + offset, size - offset, (off_t)offset);
+        if (readn < 0) {
+            res = ghr_errno(GHR_BYTECODECACHE_READ);
+            goto cleanup_data;
+        }
+        if (readn == 0) {
+            res = GHR_BYTECODECACHE_READ;
+            goto cleanup_data;
+        }
+        offset += (size_t)readn;
+    }
+
+    res = bytecodecache_newmemfd(data, size, out_fd);
+    if (ghr_isok(res)) *out_size = size;
+
+cleanup_data:;
+    gh_result inner_res = gh_alloc_delete(cache->alloc, (void**)&data, size);
+    if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+
+cleanup_file:
+    if (close(file_fd) < 0 && ghr_isok(res)) res = ghr_errno(GHR_BYTECODECACHE_CLOSE);
+    return res;
+}
+
+// Written under a temporary name and renamed, so that other processes sharing
+// the store never see partially written files.
+static gh_result bytecodecache_persist(gh_bytecodecache * cache, gh_sha256 * key, const char * data, size_t size) {
+    static atomic_uint tmp_counter;
+
+    char name[BYTECODECACHE_FILENAMEMAX];
+    bytecodecache_filename(key, GH_BYTECODECACHE_FILEEXT, name);
+
+    char tmp_suffix[BYTECODECACHE_FILENAMEMAX - BYTECODECACHE_HEXLEN];
+    snprintf(tmp_suffix, sizeof(tmp_suffix), ".%d.%u.tmp", (int)getpid(), atomic_fetch_add(&tmp_counter, 1));
+
+    char tmp_name[BYTECODECACHE_FILENAMEMAX];
+    bytecodecache_filename(key, tmp_suffix, tmp_name);
+
+    int file_fd = openat(cache->persist_dirfd, tmp_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (file_fd < 0) return ghr_errno(GHR_BYTECODECACHE_OPENFILE);
+
+    gh_result res = bytecodecache_writeall(file_fd, data, size);
+
+    if (close(file_fd) < 0 && ghr_isok(res)) res = ghr_errno(GHR_BYTECODECACHE_CLOSE);
+
+    if (ghr_isok(res) && renameat(cache->persist_dirfd, tmp_name, cache->persist_dirfd, name) < 0) {
+        res = ghr_errno(GHR_BYTECODECACHE_RENAME);
+    }
+
+    if (ghr_iserr(res)) unlinkat(cache->persist_dirfd, tmp_name, 0);
+    return res;
+}
+
+static gh_result bytecodecache_compile(gh_bytecodecache * cache, gh_sha256 * key, const char * chunk_name, const char * source, size_t source_len, int * out_fd, size_t * out_size, bool * out_persist_failed) {
+    gh_thread_callframe frame;
+    gh_result res = gh_thread_callframe_ctor(&frame);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif_script status = {0};
+    res = gh_thread_compile(&cache->compiler, chunk_name, source, source_len, &frame, &status);
+    if (ghr_iserr(res)) goto cleanup_frame;
+
+    if (ghr_iserr(status.result)) {
+        res = GHR_BYTECODECACHE_COMPILE;
+        goto cleanup_frame;
+    }
+
+    size_t size;
+    const char * data;
+    if (!gh_thread_callframe_getlstring(&frame, &size, &data)) {
+        res = GHR_BYTECODECACHE_NOBYTECODE;
+        goto cleanup_frame;
+    }
+
+    if (cache->persist_dirfd >= 0) {
+        *out_persist_failed = ghr_iserr(bytecodecache_persist(cache, key, data, size));
+    }
+
+    res = bytecodecache_newmemfd(data, size, out_fd);
+    if (ghr_isok(res)) *out_size = size;
+
+cleanup_frame:;
+    gh_result inner_res = gh_thread_callframe_dtor(&frame);
+    if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+    return res;
+}
+
+gh_result gh_bytecodecache_load(gh_bytecodecache * cache, const char * chunk_name, const char * source, size_t source_len, int * out_fd) {
+    gh_sha256 key;
+    gh_result res = bytecodecache_key(chunk_name, source, source_len, &key);
+    if (ghr_iserr(res)) return res;
+
+    pthread_mutex_lock(&cache->mutex);
+    gh_bytecodecacheentry * entry = bytecodecache_find(cache, &key);
+    if (entry != NULL) {
+        cache->stats.hits += 1;
+        *out_fd = entry->fd;
+        pthread_mutex_unlock(&cache->mutex);
+        return GHR_OK;
+    }
+
+    cache->stats.misses += 1;
+    if (bytecodecache_full(cache)) {
+        pthread_mutex_unlock(&cache->mutex);
+        return GHR_BYTECODECACHE_FULL;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    // RATIONALE: Compiling may take a while and the compiler subjail multiplexes
+    // requests, so the mutex isn't held. If several OS threads miss on the same
+    // chunk at once, all of them compile it and the first one to finish wins.
+    int fd = -1;
+    size_t size = 0;
+    bool from_disk = false;
+    bool persist_failed = false;
+
+    if (cache->persist_dirfd >= 0) {
+        persist_failed = ghr_iserr(bytecodecache_readpersisted(cache, &key, &fd, &size));
+        from_disk = fd >= 0;
+    }
+
+    if (!from_disk) {
+        res = bytecodecache_compile(cache, &key, chunk_name, source, source_len, &fd, &size, &persist_failed);
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    if (persist_failed) cache->stats.persist_errors += 1;
+
+    if (ghr_iserr(res)) {
+        if (ghr_is(res, GHR_BYTECODECACHE_COMPILE)) cache->stats.compile_errors += 1;
+        pthread_mutex_unlock(&cache->mutex);
+        return res;
+    }
+
+    if (from_disk) cache->stats.disk_hits += 1;
+    else cache->stats.compiles += 1;
+
+    entry = bytecodecache_find(cache, &key);
+    if (entry != NULL) {
+        *out_fd = entry->fd;
+        pthread_mutex_unlock(&cache->mutex);
+
+        if (close(fd) < 0) return ghr_errno(GHR_BYTECODECACHE_CLOSE);
+        return GHR_OK;
+    }
+
+    if (bytecodecache_full(cache)) {
+        pthread_mutex_unlock(&cache->mutex);
+
+        if (close(fd) < 0) return ghr_errno(GHR_BYTECODECACHE_CLOSE);
+        return GHR_BYTECODECACHE_FULL;
+    }
+
+    gh_bytecodecacheentry new_entry = {
+        .hash = key,
+        .fd = fd,
+        .size = size
+    };
+    res = gh_dynamicarray_append(GH_DYNAMICARRAY(cache), &bytecodecache_daopts, &new_entry);
+    if (ghr_isok(res)) {
+        cache->stats.entries += 1;
+        cache->stats.bytes += size;
+        *out_fd = fd;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (ghr_iserr(res)) close(fd);
+    return res;
+}
+
+void gh_bytecodecache_stats(gh_bytecodecache * cache, gh_bytecodecachestats * out_stats) {
+    pthread_mutex_lock(&cache->mutex);
+    *out_stats = cache->stats;
+    pthread_mutex_unlock(&cache->mutex);
+}
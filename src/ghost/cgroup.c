@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ghost/cgroup.h>
+
+#define GH_CGROUP_BUFFERSIZE 1024
+#define GH_CGROUP_CONTROLLERS "+cpu +memory +pids"
+#define GH_CGROUP_RMDIRATTEMPTS 100
+#define GH_CGROUP_RMDIRDELAYNS 1000000
+
+static gh_result cgroup_write(int dir_fd, const char * file, const char * value) {
+    int fd = openat(dir_fd, file, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return ghr_errno(GHR_CGROUP_WRITE);
+
+    size_t len = strlen(value);
+    ssize_t write_res = write(fd, value, len);
+    int write_errno = errno;
+    close(fd);
+    if (write_res < 0) return ghr_errnoval(GHR_CGROUP_WRITE, write_errno);
+    if ((size_t)write_res != len) return GHR_CGROUP_WRITE;
+    return GHR_OK;
+}
+
+static gh_result cgroup_writeu64(int dir_fd, const char * file, uint64_t value) {
+    char buffer[sizeof("18446744073709551615")];
+    snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+    return cgroup_write(dir_fd, file, buffer);
+}
+
+static gh_result cgroup_read(int dir_fd, const char * file, char * buffer, size_t buffer_size) {
+    int fd = openat(dir_fd, file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ghr_errno(GHR_CGROUP_READ);
+
+    ssize_t read_res = read(fd, buffer, buffer_size - 1);
+    int read_errno = errno;
+    close(fd);
+    if (read_res < 0) return ghr_errnoval(GHR_CGROUP_READ, read_errno);
+    buffer[read_res] = '\0';
+    return GHR_OK;
+}
+
+void gh_cgroup_ctoridle(gh_cgroup * cgroup) {
+    cgroup->parent_fd = -1;
+    cgroup->fd = -1;
+    cgroup->name[0] = '\0';
+}
+
+gh_result gh_cgroup_ctor(gh_cgroup * cgroup, int parent_fd, const char * name) {
+    gh_cgroup_ctoridle(cgroup);
+
+    if (strlen(name) >= GH_CGROUP_MAXNAME) return GHR_CGROUP_NAMETOOLONG;
+
+    if (mkdirat(parent_fd, name, 0755) < 0) return ghr_errno(GHR_CGROUP_MKDIR);
+
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        gh_result res = ghr_errno(GHR_CGROUP_OPEN);
+        (void)unlinkat(parent_fd, name, AT_REMOVEDIR);
+        return res;
+    }
+
+    cgroup->parent_fd = parent_fd;
+    cgroup->fd = fd;
+    strcpy(cgroup->name, name);
+    return GHR_OK;
+}
+
+bool gh_cgroup_active(gh_cgroup * cgroup) {
+    return cgroup->fd >= 0;
+}
+
+gh_result gh_cgroup_dtor(gh_cgroup * cgroup) {
+    if (!gh_cgroup_active(cgroup)) return GHR_OK;
+
+    close(cgroup->fd);
+    cgroup->fd = -1;
+
+    // RATIONALE: An exited process keeps its cgroup populated until it's
+    // reaped. Subjails are reaped by the jail, so right after a sandbox
+    // thread is destroyed the removal may briefly fail with EBUSY.
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = GH_CGROUP_RMDIRDELAYNS };
+    for (int attempt = 1; unlinkat(cgroup->parent_fd, cgroup->name, AT_REMOVEDIR) < 0; attempt++) {
+        if (errno != EBUSY || attempt == GH_CGROUP_RMDIRATTEMPTS) return ghr_errno(GHR_CGROUP_RMDIR);
+        nanosleep(&delay, NULL);
+    }
+    return GHR_OK;
+}
+
+gh_result gh_cgroup_enablecontrollers(int fd) {
+    return cgroup_write(fd, "cgroup.subtree_control", GH_CGROUP_CONTROLLERS);
+}
+
+gh_result gh_cgroup_setlimits(gh_cgroup * cgroup, gh_cgrouplimits limits) {
+    gh_result res = GHR_OK;
+
+    if (limits.memory_max_bytes != GH_CGROUP_NOLIMIT) {
+        res = cgroup_writeu64(cgroup->fd, "memory.max", limits.memory_max_bytes);
+        if (ghr_iserr(res)) return res;
+    }
+
+    if (limits.cpu_quota_us != GH_CGROUP_NOLIMIT) {
+        char buffer[sizeof("18446744073709551615 18446744073709551615")];
+        snprintf(buffer, sizeof(buffer), "%" PRIu64 " %d", limits.cpu_quota_us, GH_CGROUP_CPUPERIODUS);
+        res = cgroup_write(cgroup->fd, "cpu.max", buffer);
+        if (ghr_iserr(res)) return res;
+    }
+
+    if (limits.pids_max != GH_CGROUP_NOLIMIT) {
+        res = cgroup_writeu64(cgroup->fd, "pids.max", limits.pids_max);
+        if (ghr_iserr(res)) return res;
+    }
+
+    return GHR_OK;
+}
+
+gh_result gh_cgroup_attach(gh_cgroup * cgroup, pid_t pid) {
+    return cgroup_writeu64(cgroup->fd, "cgroup.procs", (uint64_t)pid);
+}
+
+gh_result gh_cgroup_stats(gh_cgroup * cgroup, gh_cgroupstats * out_stats) {
+    char buffer[GH_CGROUP_BUFFERSIZE];
+
+    gh_result res = cgroup_read(cgroup->fd, "memory.current", buffer, sizeof(buffer));
+    if (ghr_iserr(res)) return res;
+    out_stats->memory_bytes = strtoull(buffer, NULL, 10);
+
+    res = cgroup_read(cgroup->fd, "cpu.stat", buffer, sizeof(buffer));
+    if (ghr_iserr(res)) return res;
+
+    // the first line is "usage_usec <n>" on every kernel so far, but the
+    // format only promises "<key> <value>" lines
+    char * save = NULL;
+    for (char * line = strtok_r(buffer, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+        if (strncmp(line, "usage_usec ", sizeof("usage_usec ") - 1) != 0) continue;
+
+        out_stats->cpu_ns = strtoull(line + sizeof("usage_usec ") - 1, NULL, 10) * 1000;
+        return GHR_OK;
+    }
+
+    return GHR_CGROUP_PARSE;
+}
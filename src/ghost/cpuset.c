@@ -0,0 +1,56 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <ghost/cpuset.h>
+
+gh_result gh_cpuset_add(gh_cpuset * cpuset, int cpu) {
+    if (cpu < 0 || cpu >= GH_CPUSET_MAXCPUS) return GHR_CPUSET_BADCPU;
+    cpuset->mask[cpu / 64] |= UINT64_C(1) << (cpu % 64);
+    return GHR_OK;
+}
+
+bool gh_cpuset_has(const gh_cpuset * cpuset, int cpu) {
+    if (cpu < 0 || cpu >= GH_CPUSET_MAXCPUS) return false;
+    return (cpuset->mask[cpu / 64] & (UINT64_C(1) << (cpu % 64))) != 0;
+}
+
+bool gh_cpuset_isempty(const gh_cpuset * cpuset) {
+    for (size_t i = 0; i < sizeof(cpuset->mask) / sizeof(cpuset->mask[0]); i++) {
+        if (cpuset->mask[i] != 0) return false;
+    }
+    return true;
+}
+
+void gh_cpuset_intersect(gh_cpuset * cpuset, const gh_cpuset * other) {
+    for (size_t i = 0; i < sizeof(cpuset->mask) / sizeof(cpuset->mask[0]); i++) {
+        cpuset->mask[i] &= other->mask[i];
+    }
+}
+
+gh_result gh_cpuset_current(gh_cpuset * out_cpuset) {
+    memset(out_cpuset, 0, sizeof(gh_cpuset));
+
+    int cpu = sched_getcpu();
+    if (cpu < 0) return ghr_errno(GHR_CPUSET_GETCPU);
+    return gh_cpuset_add(out_cpuset, cpu);
+}
+
+gh_result gh_cpuset_apply(const gh_cpuset * cpuset, pid_t pid) {
+    if (gh_cpuset_isempty(cpuset)) return GHR_CPUSET_EMPTY;
+
+    cpu_set_t * set = CPU_ALLOC(GH_CPUSET_MAXCPUS);
+    if (set == NULL) return ghr_errno(GHR_CPUSET_SETAFFINITY);
+    size_t set_size = CPU_ALLOC_SIZE(GH_CPUSET_MAXCPUS);
+
+    CPU_ZERO_S(set_size, set);
+    for (int cpu = 0; cpu < GH_CPUSET_MAXCPUS; cpu++) {
+        if (gh_cpuset_has(cpuset, cpu)) CPU_SET_S((size_t)cpu, set_size, set);
+    }
+
+    gh_result res = GHR_OK;
+    if (sched_setaffinity(pid, set_size, set) < 0) res = ghr_errno(GHR_CPUSET_SETAFFINITY);
+
+    CPU_FREE(set);
+    return res;
+}
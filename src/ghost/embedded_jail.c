@@ -1,6 +1,9 @@
 #define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <ghost/result.h>
@@ -17,15 +20,62 @@ bool gh_embeddedjail_available(void) {
 
 gh_result gh_embeddedjail_createfd(int * out_fd) {
     if (!gh_embeddedjail_available()) return GHR_EMBEDDEDJAIL_UNAVAILABLE;
-    int fd = memfd_create("gh-embeddedjail", 0);
+
+    // RATIONALE: Close-on-exec doesn't prevent executing the file itself (the
+    // jail is an ELF executable, not a script), but it keeps the descriptor
+    // from leaking into the jail.
+    int fd = memfd_create("gh-embeddedjail", MFD_CLOEXEC | MFD_ALLOW_SEALING);
     if (fd < 0) return ghr_errno(GHR_EMBEDDEDJAIL_CREATEFAIL);
 
-    ssize_t write_res = write(fd, gh_embeddedjail_exe_data, gh_embeddedjail_exe_data_len);
-    if (write_res < 0) return ghr_errno(GHR_EMBEDDEDJAIL_WRITEFAIL);
-    if (write_res != gh_embeddedjail_exe_data_len) return GHR_EMBEDDEDJAIL_WRITETRUNC;
+    gh_result res = GHR_OK;
+    const unsigned char * data = gh_embeddedjail_exe_data;
+    size_t size = gh_embeddedjail_exe_data_len;
+    while (size > 0) {
+        ssize_t write_res = write(fd, data, size);
+        if (write_res < 0) {
+            if (errno == EINTR) continue;
+            res = ghr_errno(GHR_EMBEDDEDJAIL_WRITEFAIL);
+            goto fail;
+        }
+        if (write_res == 0) {
+            res = GHR_EMBEDDEDJAIL_WRITETRUNC;
+            goto fail;
+        }
+
+        data += write_res;
+        size -= (size_t)write_res;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) < 0) {
+        res = ghr_errno(GHR_EMBEDDEDJAIL_SEALFAIL);
+        goto fail;
+    }
 
     *out_fd = fd;
+    return GHR_OK;
+
+fail:
+    close(fd);
+    return res;
+}
+
+static pthread_once_t embeddedjail_shared_once = PTHREAD_ONCE_INIT;
+static int embeddedjail_shared_fd = -1;
+static gh_result embeddedjail_shared_res = GHR_OK;
+
+static void embeddedjail_createshared(void) {
+    embeddedjail_shared_res = gh_embeddedjail_createfd(&embeddedjail_shared_fd);
+}
+
+gh_result gh_embeddedjail_sharedfd(int * out_fd) {
+    if (!gh_embeddedjail_available()) return GHR_EMBEDDEDJAIL_UNAVAILABLE;
+
+    if (pthread_once(&embeddedjail_shared_once, embeddedjail_createshared) != 0) {
+        return GHR_EMBEDDEDJAIL_CREATEFAIL;
+    }
+    if (ghr_iserr(embeddedjail_shared_res)) return embeddedjail_shared_res;
 
+    *out_fd = embeddedjail_shared_fd;
     return GHR_OK;
 }
 
@@ -33,7 +83,7 @@ extern char ** environ;
 
 gh_result gh_embeddedjail_exec(const char * name, int options_fd) {
     int fd = -1;
-    gh_result res = gh_embeddedjail_createfd(&fd);
+    gh_result res = gh_embeddedjail_sharedfd(&fd);
     if (ghr_iserr(res)) return res;
 
     int options_fd_str_len = snprintf(NULL, 0, "%d", options_fd);
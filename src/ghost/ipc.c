@@ -28,6 +28,8 @@ gh_result gh_ipc_ctor(gh_ipc * ipc, int * out_peerfd) {
     *out_peerfd = fds[1];
 
     ipc->mode = GH_IPCMODE_CONTROLLER;
+    gh_ipccounters_init(&ipc->counters);
+    ipc->aggregate = NULL;
 
     return GHR_OK;
 }
@@ -35,6 +37,8 @@ gh_result gh_ipc_ctor(gh_ipc * ipc, int * out_peerfd) {
 gh_result gh_ipc_ctorconnect(gh_ipc * ipc, int sockfd) {
     ipc->sockfd = sockfd;
     ipc->mode = GH_IPCMODE_CHILD;
+    gh_ipccounters_init(&ipc->counters);
+    ipc->aggregate = NULL;
     return GHR_OK;
 }
 
@@ -43,11 +47,44 @@ gh_result gh_ipc_dtor(gh_ipc * ipc) {
     return GHR_OK;
 }
 
+void gh_ipccounters_init(gh_ipccounters * counters) {
+    atomic_init(&counters->messages_sent, 0);
+    atomic_init(&counters->bytes_sent, 0);
+    atomic_init(&counters->messages_received, 0);
+    atomic_init(&counters->bytes_received, 0);
+}
+
+void gh_ipccounters_stats(gh_ipccounters * counters, gh_ipcstats * out_stats) {
+    out_stats->messages_sent = atomic_load(&counters->messages_sent);
+    out_stats->bytes_sent = atomic_load(&counters->bytes_sent);
+    out_stats->messages_received = atomic_load(&counters->messages_received);
+    out_stats->bytes_received = atomic_load(&counters->bytes_received);
+}
+
+static void ipc_countsent(gh_ipc * ipc, size_t size) {
+    atomic_fetch_add(&ipc->counters.messages_sent, 1);
+    atomic_fetch_add(&ipc->counters.bytes_sent, size);
+    if (ipc->aggregate != NULL) {
+        atomic_fetch_add(&ipc->aggregate->messages_sent, 1);
+        atomic_fetch_add(&ipc->aggregate->bytes_sent, size);
+    }
+}
+
+static void ipc_countreceived(gh_ipc * ipc, size_t size) {
+    atomic_fetch_add(&ipc->counters.messages_received, 1);
+    atomic_fetch_add(&ipc->counters.bytes_received, size);
+    if (ipc->aggregate != NULL) {
+        atomic_fetch_add(&ipc->aggregate->messages_received, 1);
+        atomic_fetch_add(&ipc->aggregate->bytes_received, size);
+    }
+}
+
 static gh_result prepare_cmsg(gh_ipc * ipc, gh_ipcmsg * msg, struct msghdr * msgh, char * cmsg_buf) {
     bool is_send = cmsg_buf != NULL;
 
     int * fd = NULL;
     bool required = false;
+    bool child_may_send = false;
 
     if (msg->type == GH_IPCMSG_NEWSUBJAIL) {
         fd = &((gh_ipcmsg_newsubjail *)msg)->sockfd;
@@ -61,10 +98,29 @@ static gh_result prepare_cmsg(gh_ipc * ipc, gh_ipcmsg * msg, struct msghdr * msg
     } else if (msg->type == GH_IPCMSG_LUACALL) {
         fd = &((gh_ipcmsg_luacall *)msg)->ipcfdmem_fd;
         required = true;
+    } else if (msg->type == GH_IPCMSG_LUACOMPILE) {
+        fd = &((gh_ipcmsg_luacompile *)msg)->ipcfdmem_fd;
+        required = true;
+    } else if (msg->type == GH_IPCMSG_LANDLOCK) {
+        fd = &((gh_ipcmsg_landlock *)msg)->fd;
+        required = false;
+    } else if (msg->type == GH_IPCMSG_SUBJAILPIDFD) {
+        fd = &((gh_ipcmsg_subjailpidfd *)msg)->pidfd;
+        required = false;
+        // RATIONALE: Sent by the jail, before the subjail runs any untrusted
+        // code. The host verifies that the pidfd refers to the subjail.
+        child_may_send = true;
+    } else if (msg->type == GH_IPCMSG_SUBJAILALIVE) {
+        fd = &((gh_ipcmsg_subjailalive *)msg)->notifyfd;
+        required = false;
+        // RATIONALE: Sent by the subjail before it receives HELLO, so before
+        // it runs any untrusted code. The host verifies that the fd is a
+        // seccomp listener.
+        child_may_send = true;
     }
 
     if (fd != NULL && (!is_send || *fd >= 0)) {
-        if (is_send && ipc->mode != GH_IPCMODE_CONTROLLER) {
+        if (is_send && ipc->mode != GH_IPCMODE_CONTROLLER && !child_may_send) {
             return GHR_IPC_NOCONTROLMSG;
         }
 
@@ -131,6 +187,7 @@ gh_result gh_ipc_send(gh_ipc * ipc, gh_ipcmsg * msg, size_t msg_size) {
         return ghr_errno(GHR_IPC_SENDMSGFAIL);
     }
 
+    ipc_countsent(ipc, (size_t)sendmsg_res);
     return GHR_OK;
 }
 
@@ -145,6 +202,9 @@ static void basic_sanitize_msg(gh_ipcmsg * msg) {
     case GH_IPCMSG_LUARESULT:
         ((gh_ipcmsg_luaresult * )msg)->error_msg[GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1] = '\0';
         break;
+    case GH_IPCMSG_LUACOMPILE:
+        ((gh_ipcmsg_luacompile * )msg)->chunk_name[GH_IPCMSG_LUAFILE_CHUNKNAMEMAX - 1] = '\0';
+        break;
     case GH_IPCMSG_FUNCTIONCALL: {
         gh_ipcmsg_functioncall * fc_msg = ((gh_ipcmsg_functioncall * )msg);
         fc_msg->name[GH_IPCMSG_FUNCTIONCALL_MAXNAME - 1] = '\0';
@@ -205,6 +265,8 @@ gh_result gh_ipc_recv(gh_ipc * ipc, gh_ipcmsg * msg, int timeout_ms) {
 
     if ((unsigned long)recv_size < sizeof(gh_ipcmsg)) return GHR_IPC_RECVTOOSMALL;
 
+    ipc_countreceived(ipc, (size_t)recv_size);
+
     basic_sanitize_msg(msg);
 
     gh_result res = prepare_cmsg(ipc, msg, &msgh, NULL);
@@ -213,9 +275,35 @@ gh_result gh_ipc_recv(gh_ipc * ipc, gh_ipcmsg * msg, int timeout_ms) {
     return GHR_OK;
 }
 
-gh_result gh_ipc_call(gh_ipc * ipc, const char * name, size_t argc, gh_ipcmsg_functioncall_arg * args, int * return_fd, void * return_arg, size_t return_arg_size) {
+int gh_ipc_requestid(const gh_ipcmsg * msg) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch-enum"
+    // RATIONALE: Only Lua request related messages carry a request ID.
+    switch(msg->type) {
+    case GH_IPCMSG_LUASTRING: return ((const gh_ipcmsg_luastring *)msg)->request_id;
+    case GH_IPCMSG_LUAFILE: return ((const gh_ipcmsg_luafile *)msg)->request_id;
+    case GH_IPCMSG_LUAHOSTVARIABLE: return ((const gh_ipcmsg_luahostvariable *)msg)->request_id;
+    case GH_IPCMSG_LUACALL: return ((const gh_ipcmsg_luacall *)msg)->request_id;
+    case GH_IPCMSG_LUATENANT: return ((const gh_ipcmsg_luatenant *)msg)->request_id;
+    case GH_IPCMSG_LUACOMPILE: return ((const gh_ipcmsg_luacompile *)msg)->request_id;
+    case GH_IPCMSG_LUACANCEL: return ((const gh_ipcmsg_luacancel *)msg)->request_id;
+    case GH_IPCMSG_LUARESET: return ((const gh_ipcmsg_luareset *)msg)->request_id;
+    case GH_IPCMSG_LUAGC: return ((const gh_ipcmsg_luagc *)msg)->request_id;
+    case GH_IPCMSG_LUATRIM: return ((const gh_ipcmsg_luatrim *)msg)->request_id;
+    case GH_IPCMSG_LANDLOCK: return ((const gh_ipcmsg_landlock *)msg)->request_id;
+    case GH_IPCMSG_LUAINFO: return ((const gh_ipcmsg_luainfo *)msg)->request_id;
+    case GH_IPCMSG_LUARESULT: return ((const gh_ipcmsg_luaresult *)msg)->request_id;
+    case GH_IPCMSG_FUNCTIONCALL: return ((const gh_ipcmsg_functioncall *)msg)->request_id;
+    case GH_IPCMSG_FUNCTIONRETURN: return ((const gh_ipcmsg_functionreturn *)msg)->request_id;
+    default: return GH_IPC_NOREQUEST;
+    }
+#pragma GCC diagnostic pop
+}
+
+gh_result gh_ipc_callsend(gh_ipc * ipc, int request_id, const char * name, size_t argc, gh_ipcmsg_functioncall_arg * args, void * return_arg, size_t return_arg_size) {
     gh_ipcmsg_functioncall funccall = {0};
     funccall.type = GH_IPCMSG_FUNCTIONCALL;
+    funccall.request_id = request_id;
     strncpy(funccall.name, name, GH_IPCMSG_FUNCTIONCALL_MAXNAME - 1);
     funccall.name[GH_IPCMSG_FUNCTIONCALL_MAXNAME - 1] = '\0';
     funccall.arg_count = argc;
@@ -230,7 +318,11 @@ gh_result gh_ipc_call(gh_ipc * ipc, const char * name, size_t argc, gh_ipcmsg_fu
     funccall.return_arg.addr = (uintptr_t)return_arg;
     funccall.return_arg.size = return_arg_size;
 
-    gh_result res = gh_ipc_send(ipc, (gh_ipcmsg*)&funccall, sizeof(gh_ipcmsg_functioncall));
+    return gh_ipc_send(ipc, (gh_ipcmsg*)&funccall, sizeof(gh_ipcmsg_functioncall));
+}
+
+gh_result gh_ipc_call(gh_ipc * ipc, const char * name, size_t argc, gh_ipcmsg_functioncall_arg * args, int * return_fd, void * return_arg, size_t return_arg_size) {
+    gh_result res = gh_ipc_callsend(ipc, GH_IPC_NOREQUEST, name, argc, args, return_arg, return_arg_size);
     if (ghr_iserr(res)) return res;
 
     GH_IPCMSG_BUFFER(msg_buf);
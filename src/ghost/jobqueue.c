@@ -0,0 +1,459 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ghost/result.h>
+#include <ghost/alloc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+#include <ghost/jobqueue.h>
+
+static uint64_t jobqueue_now(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Returns true if job a must be started before job b: higher priority class
+// first, then earliest deadline (no deadline sorts last), then submission order.
+static bool jobqueue_before(const gh_jobfuture * a, const gh_jobfuture * b) {
+    if (a->job.priority != b->job.priority) return a->job.priority > b->job.priority;
+
+    uint64_t a_deadline = a->deadline_ns == 0 ? UINT64_MAX : a->deadline_ns;
+    uint64_t b_deadline = b->deadline_ns == 0 ? UINT64_MAX : b->deadline_ns;
+    return a_deadline < b_deadline;
+}
+
+static void jobqueue_worker_insert(gh_jobqueueworker * worker, gh_jobfuture * future) {
+    gh_jobfuture * after = worker->tail;
+    while (after != NULL && jobqueue_before(future, after)) after = after->prev;
+
+    future->prev = after;
+    future->next = after != NULL ? after->next : worker->head;
+    if (future->next != NULL) future->next->prev = future;
+    else worker->tail = future;
+    if (after != NULL) after->next = future;
+    else worker->head = future;
+
+    atomic_fetch_add(&worker->depth, 1);
+}
+
+static void jobqueue_worker_unlink(gh_jobqueueworker * worker, gh_jobfuture * future) {
+    if (future->prev != NULL) future->prev->next = future->next;
+    else worker->head = future->next;
+    if (future->next != NULL) future->next->prev = future->prev;
+    else worker->tail = future->prev;
+    future->next = NULL;
+    future->prev = NULL;
+    atomic_fetch_sub(&worker->depth, 1);
+}
+
+// Takes the most urgent job from the queue of worker that can be run by taker.
+static gh_jobfuture * jobqueue_worker_take(gh_jobqueueworker * worker, gh_jobqueueworker * taker) {
+    pthread_mutex_lock(&worker->mutex);
+    gh_jobfuture * future = worker->head;
+    if (taker->batch_only) {
+        while (future != NULL && future->job.priority != GH_JOBPRIORITY_BATCH) future = future->next;
+    }
+
+    if (future != NULL) {
+        jobqueue_worker_unlink(worker, future);
+        atomic_fetch_sub(&worker->queue->pending, 1);
+        if (future->job.priority == GH_JOBPRIORITY_BATCH) atomic_fetch_sub(&worker->queue->pending_batch, 1);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return future;
+}
+
+static gh_jobfuture * jobqueue_steal(gh_jobqueue * queue, gh_jobqueueworker * thief) {
+    gh_jobqueueworker * victim = NULL;
+    size_t victim_depth = 0;
+
+    for (size_t i = 0; i < queue->worker_count; i++) {
+        gh_jobqueueworker * worker = queue->workers + i;
+        if (worker == thief) continue;
+
+        size_t depth = atomic_load(&worker->depth);
+        if (depth > victim_depth) {
+            victim = worker;
+            victim_depth = depth;
+        }
+    }
+
+    if (victim == NULL) return NULL;
+
+    gh_jobfuture * future = jobqueue_worker_take(victim, thief);
+
+    // The most loaded worker may not have any job the thief is allowed to run
+    // (batch-only thieves), so fall back to trying every other worker.
+    for (size_t i = 0; future == NULL && i < queue->worker_count; i++) {
+        gh_jobqueueworker * worker = queue->workers + i;
+        if (worker == thief || worker == victim) continue;
+        future = jobqueue_worker_take(worker, thief);
+    }
+
+    if (future != NULL) {
+        pthread_mutex_lock(&queue->stats_mutex);
+        queue->stats.stolen += 1;
+        pthread_mutex_unlock(&queue->stats_mutex);
+    }
+    return future;
+}
+
+static gh_result jobqueue_runcall(gh_thread * thread, gh_job * job, gh_threadnotif_script * out_status) {
+    gh_thread_callframe frame;
+    gh_result res = gh_thread_callframe_ctor(&frame);
+    if (ghr_iserr(res)) return res;
+
+    if (job->args_func != NULL) {
+        res = job->args_func(&frame, job->userdata);
+        if (ghr_iserr(res)) goto cleanup_frame;
+    }
+
+    res = gh_thread_call(thread, job->function_name, &frame, out_status);
+    if (ghr_iserr(res)) goto cleanup_frame;
+
+    if (job->result_func != NULL) {
+        res = job->result_func(&frame, out_status, job->userdata);
+    }
+
+cleanup_frame:;
+    gh_result inner_res = gh_thread_callframe_dtor(&frame);
+    if (ghr_isok(res)) res = inner_res;
+    return res;
+}
+
+static void jobqueue_complete(gh_jobqueue * queue, gh_jobfuture * future) {
+    uint64_t wait_ns = gh_jobfuture_waitns(future);
+    uint64_t run_ns = gh_jobfuture_runns(future);
+
+    pthread_mutex_lock(&queue->stats_mutex);
+    queue->stats.completed += 1;
+    if (future->result == GHR_JOBQUEUE_EXPIRED) queue->stats.expired += 1;
+    queue->stats.total_wait_ns += wait_ns;
+    queue->stats.total_run_ns += run_ns;
+    if (wait_ns > queue->stats.max_wait_ns) queue->stats.max_wait_ns = wait_ns;
+    if (run_ns > queue->stats.max_run_ns) queue->stats.max_run_ns = run_ns;
+    pthread_mutex_unlock(&queue->stats_mutex);
+
+    pthread_mutex_lock(&future->mutex);
+    future->done = true;
+    pthread_cond_broadcast(&future->cond);
+    pthread_mutex_unlock(&future->mutex);
+}
+
+static void jobqueue_run(gh_jobqueueworker * worker, gh_jobfuture * future) {
+    gh_jobqueue * queue = worker->queue;
+
+    future->start_ns = jobqueue_now();
+    if (future->deadline_ns != 0 && future->start_ns > future->deadline_ns) {
+        future->end_ns = future->start_ns;
+        future->result = GHR_JOBQUEUE_EXPIRED;
+        jobqueue_complete(queue, future);
+        return;
+    }
+
+    atomic_fetch_add(&queue->running, 1);
+
+    gh_threadnotif_script status = {0};
+    gh_result res;
+    if (future->job.type == GH_JOB_SCRIPT) {
+        res = gh_thread_runstringsync(&worker->thread, future->job.script, future->job.script_len, &status);
+    } else {
+        res = jobqueue_runcall(&worker->thread, &future->job, &status);
+    }
+
+    future->end_ns = jobqueue_now();
+    future->result = res;
+    future->status = status;
+    atomic_fetch_sub(&queue->running, 1);
+
+    jobqueue_complete(queue, future);
+}
+
+static void * jobqueue_workerfunc(void * worker_voidp) {
+    gh_jobqueueworker * worker = (gh_jobqueueworker *)worker_voidp;
+    gh_jobqueue * queue = worker->queue;
+
+    while (true) {
+        gh_jobfuture * future = jobqueue_worker_take(worker, worker);
+        if (future == NULL) future = jobqueue_steal(queue, worker);
+
+        if (future != NULL) {
+            jobqueue_run(worker, future);
+            continue;
+        }
+
+        atomic_size_t * pending = worker->batch_only ? &queue->pending_batch : &queue->pending;
+
+        pthread_mutex_lock(&queue->mutex);
+        while (atomic_load(pending) == 0 && !queue->stopping) {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+        bool exit = queue->stopping && atomic_load(pending) == 0;
+        pthread_mutex_unlock(&queue->mutex);
+
+        if (exit) break;
+    }
+
+    return NULL;
+}
+
+static gh_result jobqueue_teardown(gh_jobqueue * queue, size_t mutexes_inited, size_t threads_created, size_t pthreads_created) {
+    gh_result res = GHR_OK;
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->stopping = true;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+
+    for (size_t i = 0; i < pthreads_created; i++) {
+        int pthread_res = pthread_join(queue->workers[i].pthread, NULL);
+        if (pthread_res != 0 && ghr_isok(res)) res = ghr_errnoval(GHR_JOBQUEUE_PTHREADJOIN, pthread_res);
+    }
+
+    for (size_t i = 0; i < threads_created; i++) {
+        gh_result inner_res = gh_thread_dtor(&queue->workers[i].thread, NULL);
+        if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+    }
+
+    for (size_t i = 0; i < mutexes_inited; i++) {
+        pthread_mutex_destroy(&queue->workers[i].mutex);
+    }
+
+    gh_result inner_res = gh_alloc_delete(queue->alloc, (void**)&queue->workers, sizeof(gh_jobqueueworker) * queue->worker_count);
+    if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_mutex_destroy(&queue->stats_mutex);
+
+    return res;
+}
+
+gh_result gh_jobqueue_ctor(gh_jobqueue * queue, gh_sandbox * sandbox, gh_jobqueueoptions options) {
+    if (options.worker_count == 0) return GHR_JOBQUEUE_NOWORKERS;
+    if (options.batch_worker_count >= options.worker_count) return GHR_JOBQUEUE_BATCHWORKERS;
+
+    *queue = (gh_jobqueue) {0};
+    queue->alloc = options.thread_options.rpc->alloc;
+    queue->worker_count = options.worker_count;
+    atomic_store(&queue->pending, 0);
+    atomic_store(&queue->pending_batch, 0);
+    atomic_store(&queue->running, 0);
+    atomic_store(&queue->submit_cursor, 0);
+
+    int pthread_res = pthread_mutex_init(&queue->mutex, NULL);
+    if (pthread_res != 0) return ghr_errnoval(GHR_JOBQUEUE_MUTEXINIT, pthread_res);
+
+    pthread_res = pthread_mutex_init(&queue->stats_mutex, NULL);
+    if (pthread_res != 0) {
+        pthread_mutex_destroy(&queue->mutex);
+        return ghr_errnoval(GHR_JOBQUEUE_MUTEXINIT, pthread_res);
+    }
+
+    pthread_res = pthread_cond_init(&queue->cond, NULL);
+    if (pthread_res != 0) {
+        pthread_mutex_destroy(&queue->stats_mutex);
+        pthread_mutex_destroy(&queue->mutex);
+        return ghr_errnoval(GHR_JOBQUEUE_CONDINIT, pthread_res);
+    }
+
+    gh_result res = gh_alloc_new(queue->alloc, (void**)&queue->workers, sizeof(gh_jobqueueworker) * queue->worker_count);
+    if (ghr_iserr(res)) {
+        pthread_cond_destroy(&queue->cond);
+        pthread_mutex_destroy(&queue->stats_mutex);
+        pthread_mutex_destroy(&queue->mutex);
+        return res;
+    }
+    memset(queue->workers, 0, sizeof(gh_jobqueueworker) * queue->worker_count);
+
+    size_t mutexes_inited = 0;
+    size_t threads_created = 0;
+    size_t pthreads_created = 0;
+
+    for (; mutexes_inited < queue->worker_count; mutexes_inited++) {
+        gh_jobqueueworker * worker = queue->workers + mutexes_inited;
+        worker->queue = queue;
+        worker->batch_only = mutexes_inited >= queue->worker_count - options.batch_worker_count;
+        atomic_store(&worker->depth, 0);
+
+        pthread_res = pthread_mutex_init(&worker->mutex, NULL);
+        if (pthread_res != 0) {
+            res = ghr_errnoval(GHR_JOBQUEUE_MUTEXINIT, pthread_res);
+            goto fail;
+        }
+    }
+
+    // Threads are spawned from this OS thread only - the sandbox IPC
+    // connection is not safe to use concurrently.
+    for (; threads_created < queue->worker_count; threads_created++) {
+        gh_jobqueueworker * worker = queue->workers + threads_created;
+
+        gh_threadoptions thread_options = options.thread_options;
+        thread_options.sandbox = sandbox;
+
+        res = gh_thread_ctor(&worker->thread, thread_options);
+        if (ghr_iserr(res)) goto fail;
+
+        if (worker->batch_only) {
+            res = gh_thread_setsched(&worker->thread, options.batch_sched, options.batch_nice);
+            if (ghr_iserr(res)) {
+                threads_created += 1;
+                goto fail;
+            }
+        }
+
+        if (options.script != NULL) {
+            gh_threadnotif_script script_status = {0};
+            res = gh_thread_runstringsync(&worker->thread, options.script, options.script_len, &script_status);
+            if (ghr_isok(res)) res = script_status.result;
+            if (ghr_iserr(res)) {
+                threads_created += 1;
+                goto fail;
+            }
+        }
+    }
+
+    for (; pthreads_created < queue->worker_count; pthreads_created++) {
+        gh_jobqueueworker * worker = queue->workers + pthreads_created;
+
+        pthread_res = pthread_create(&worker->pthread, NULL, jobqueue_workerfunc, worker);
+        if (pthread_res != 0) {
+            res = ghr_errnoval(GHR_JOBQUEUE_PTHREADCREATE, pthread_res);
+            goto fail;
+        }
+    }
+
+    return GHR_OK;
+
+fail:
+    jobqueue_teardown(queue, mutexes_inited, threads_created, pthreads_created);
+    return res;
+}
+
+gh_result gh_jobqueue_submit(gh_jobqueue * queue, gh_job job, gh_jobfuture * out_future) {
+    if (job.type == GH_JOB_SCRIPT && job.script == NULL) return GHR_JOBQUEUE_INVALIDJOB;
+    if (job.type == GH_JOB_CALL && job.function_name == NULL) return GHR_JOBQUEUE_INVALIDJOB;
+    if (job.deadline_ms < 0) return GHR_JOBQUEUE_INVALIDJOB;
+
+    *out_future = (gh_jobfuture) {0};
+    out_future->job = job;
+    out_future->result = GHR_OK;
+
+    int pthread_res = pthread_mutex_init(&out_future->mutex, NULL);
+    if (pthread_res != 0) return ghr_errnoval(GHR_JOBQUEUE_MUTEXINIT, pthread_res);
+
+    pthread_res = pthread_cond_init(&out_future->cond, NULL);
+    if (pthread_res != 0) {
+        pthread_mutex_destroy(&out_future->mutex);
+        return ghr_errnoval(GHR_JOBQUEUE_CONDINIT, pthread_res);
+    }
+
+    bool batch = job.priority == GH_JOBPRIORITY_BATCH;
+    bool has_batch_workers = queue->workers[queue->worker_count - 1].batch_only;
+
+    // Place the job in the shortest eligible queue, starting the scan at a
+    // rotating position so that ties don't always favour the first worker.
+    // Batch jobs go to batch-only workers if there are any, so that they
+    // don't delay other jobs unless a regular worker is idle and steals them.
+    size_t start = atomic_fetch_add(&queue->submit_cursor, 1);
+    gh_jobqueueworker * target = NULL;
+    size_t target_depth = SIZE_MAX;
+    for (size_t i = 0; i < queue->worker_count; i++) {
+        gh_jobqueueworker * worker = queue->workers + ((start + i) % queue->worker_count);
+        if (worker->batch_only != (batch && has_batch_workers)) continue;
+
+        size_t depth = atomic_load(&worker->depth);
+        if (depth < target_depth) {
+            target = worker;
+            target_depth = depth;
+        }
+    }
+
+    out_future->submit_ns = jobqueue_now();
+    if (job.deadline_ms != GH_JOB_NODEADLINE) {
+        out_future->deadline_ns = out_future->submit_ns + (uint64_t)job.deadline_ms * 1000000ULL;
+    }
+
+    // RATIONALE: The queue mutex is held until the job is counted as pending.
+    // Otherwise the queue could start stopping in between, and its workers
+    // would exit without running the job (or the job would be inserted into
+    // freed workers).
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->stopping) {
+        pthread_mutex_unlock(&queue->mutex);
+        pthread_cond_destroy(&out_future->cond);
+        pthread_mutex_destroy(&out_future->mutex);
+        return GHR_JOBQUEUE_STOPPED;
+    }
+
+    pthread_mutex_lock(&queue->stats_mutex);
+    queue->stats.submitted += 1;
+    pthread_mutex_unlock(&queue->stats_mutex);
+
+    pthread_mutex_lock(&target->mutex);
+    jobqueue_worker_insert(target, out_future);
+    atomic_fetch_add(&queue->pending, 1);
+    if (batch) atomic_fetch_add(&queue->pending_batch, 1);
+    pthread_mutex_unlock(&target->mutex);
+
+    // Batch-only workers sleep on the same condition variable but may not be
+    // able to run the job, so every sleeping worker has to re-check.
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+
+    return GHR_OK;
+}
+
+void gh_jobqueue_stats(gh_jobqueue * queue, gh_jobqueuestats * out_stats) {
+    pthread_mutex_lock(&queue->stats_mutex);
+    *out_stats = queue->stats;
+    pthread_mutex_unlock(&queue->stats_mutex);
+
+    out_stats->queue_depth = atomic_load(&queue->pending);
+    out_stats->running = atomic_load(&queue->running);
+}
+
+gh_result gh_jobqueue_dtor(gh_jobqueue * queue) {
+    return jobqueue_teardown(queue, queue->worker_count, queue->worker_count, queue->worker_count);
+}
+
+gh_result gh_jobfuture_wait(gh_jobfuture * future, gh_threadnotif_script * out_status) {
+    pthread_mutex_lock(&future->mutex);
+    while (!future->done) {
+        pthread_cond_wait(&future->cond, &future->mutex);
+    }
+    pthread_mutex_unlock(&future->mutex);
+
+    if (out_status != NULL) *out_status = future->status;
+    return future->result;
+}
+
+bool gh_jobfuture_done(gh_jobfuture * future) {
+    pthread_mutex_lock(&future->mutex);
+    bool done = future->done;
+    pthread_mutex_unlock(&future->mutex);
+    return done;
+}
+
+uint64_t gh_jobfuture_waitns(const gh_jobfuture * future) {
+    if (future->start_ns < future->submit_ns) return 0;
+    return future->start_ns - future->submit_ns;
+}
+
+uint64_t gh_jobfuture_runns(const gh_jobfuture * future) {
+    if (future->end_ns < future->start_ns) return 0;
+    return future->end_ns - future->start_ns;
+}
+
+gh_result gh_jobfuture_dtor(gh_jobfuture * future) {
+    int pthread_res = pthread_cond_destroy(&future->cond);
+    if (pthread_res != 0) return ghr_errnoval(GHR_JOBQUEUE_CONDDESTROY, pthread_res);
+
+    pthread_res = pthread_mutex_destroy(&future->mutex);
+    if (pthread_res != 0) return ghr_errnoval(GHR_JOBQUEUE_MUTEXDESTROY, pthread_res);
+
+    return GHR_OK;
+}
@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/seccomp.h>
+#include <ghost/opensupervisor.h>
+#include <ghost/thread.h>
+#include <ghost/stdlib.h>
+
+#define GH_OPENSUPERVISOR_FDPATHSIZE sizeof("/proc/self/fd/2147483647")
+#define GH_OPENSUPERVISOR_LISTENERNAME "anon_inode:seccomp notify"
+// a path of PATH_MAX bytes spans at most this many pages
+#define GH_OPENSUPERVISOR_MAXPATHPAGES 3
+
+static bool opensupervisor_islistener(int fd) {
+    char path[GH_OPENSUPERVISOR_FDPATHSIZE];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+    char link[sizeof(GH_OPENSUPERVISOR_LISTENERNAME)];
+    ssize_t link_len = readlink(path, link, sizeof(link));
+    if (link_len != sizeof(link) - 1) return false;
+
+    return memcmp(link, GH_OPENSUPERVISOR_LISTENERNAME, sizeof(link) - 1) == 0;
+}
+
+// Copies the null terminated string at addr in the subjail's memory into
+// buf. The string may end right before unmapped memory, so the read is split
+// at page boundaries and stops at the first page that can't be read.
+static int opensupervisor_readpath(pid_t pid, uint64_t addr, char * buf, size_t buf_size) {
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    struct iovec local_iovec = { .iov_base = buf, .iov_len = buf_size };
+    struct iovec remote_iovec[GH_OPENSUPERVISOR_MAXPATHPAGES];
+    unsigned long remote_iovec_count = 0;
+
+    uintptr_t remote_addr = (uintptr_t)addr;
+    size_t remaining = buf_size;
+    while (remaining > 0 && remote_iovec_count < GH_OPENSUPERVISOR_MAXPATHPAGES) {
+        size_t len = page_size - (remote_addr & (page_size - 1));
+        if (len > remaining) len = remaining;
+
+        remote_iovec[remote_iovec_count++] = (struct iovec) { .iov_base = (void *)remote_addr, .iov_len = len };
+        remote_addr += len;
+        remaining -= len;
+    }
+
+    ssize_t read_res = process_vm_readv(pid, &local_iovec, 1, remote_iovec, remote_iovec_count, 0);
+    if (read_res <= 0) return read_res < 0 ? errno : EFAULT;
+
+    if (memchr(buf, '\0', (size_t)read_res) == NULL) {
+        return (size_t)read_res == buf_size ? ENAMETOOLONG : EFAULT;
+    }
+    return 0;
+}
+
+// errno reported to the subjail for a failed open
+static int opensupervisor_errno(gh_result res) {
+    int err = ghr_frag_errno(res);
+    // permission rejections carry no errno
+    if (err == 0 || err == 0xFFFF) return EACCES;
+    return err;
+}
+
+static void opensupervisor_respond(gh_opensupervisor * supervisor, struct seccomp_notif_resp * resp, uint64_t id, int64_t val, int err) {
+    memset(resp, 0, supervisor->notif_resp_size);
+    resp->id = id;
+    resp->val = val;
+    resp->error = -err;
+
+    // ENOENT means that the subjail is gone or its call was interrupted
+    (void)ioctl(supervisor->notify_fd, SECCOMP_IOCTL_NOTIF_SEND, resp);
+}
+
+static void opensupervisor_handle(gh_opensupervisor * supervisor, struct seccomp_notif * req, struct seccomp_notif_resp * resp) {
+    gh_thread * thread = supervisor->thread;
+
+    if (req->data.nr != SYS_openat) {
+        opensupervisor_respond(supervisor, resp, req->id, 0, ENOSYS);
+        return;
+    }
+
+    int dirfd = (int)req->data.args[0];
+    int flags = (int)req->data.args[2];
+    mode_t create_mode = (mode_t)req->data.args[3];
+
+    char path[PATH_MAX];
+    int err = opensupervisor_readpath(req->pid, req->data.args[1], path, sizeof(path));
+
+    // RATIONALE: The PID may have been reused by another process between
+    // receiving the notification and reading its memory. If the notification
+    // is still valid, the PID still belongs to the subjail.
+    if (ioctl(supervisor->notify_fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &req->id) < 0) return;
+
+    if (err != 0) {
+        opensupervisor_respond(supervisor, resp, req->id, 0, err);
+        return;
+    }
+
+    if (dirfd != AT_FDCWD && path[0] != '/') {
+        opensupervisor_respond(supervisor, resp, req->id, 0, EBADF);
+        return;
+    }
+
+    int fd;
+    gh_result res = gh_std_openat(thread, AT_FDCWD, path, flags, create_mode, &fd);
+    if (ghr_iserr(res)) {
+        opensupervisor_respond(supervisor, resp, req->id, 0, opensupervisor_errno(res));
+        return;
+    }
+
+    // the new fd is installed and returned from openat in one step
+    struct seccomp_notif_addfd addfd = {
+        .id = req->id,
+        .flags = SECCOMP_ADDFD_FLAG_SEND,
+        .srcfd = (uint32_t)fd,
+        .newfd = 0,
+        .newfd_flags = (uint32_t)(flags & O_CLOEXEC)
+    };
+    int addfd_res = ioctl(supervisor->notify_fd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+    if (addfd_res < 0 && errno == EINVAL) {
+        // kernels before 5.14 can't combine installing and responding
+        addfd.flags = 0;
+        addfd_res = ioctl(supervisor->notify_fd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+        if (addfd_res >= 0) opensupervisor_respond(supervisor, resp, req->id, addfd_res, 0);
+    }
+    int addfd_errno = errno;
+    close(fd);
+
+    if (addfd_res >= 0) {
+        atomic_fetch_add(&supervisor->opens, 1);
+    } else if (addfd_errno != ENOENT) {
+        opensupervisor_respond(supervisor, resp, req->id, 0, addfd_errno);
+    }
+}
+
+static void * opensupervisor_main(void * userdata) {
+    gh_opensupervisor * supervisor = (gh_opensupervisor *)userdata;
+
+    // RATIONALE: The kernel may expect larger structures than the ones this
+    // was compiled with. uint64_t keeps them aligned.
+    uint64_t req_buf[(supervisor->notif_size + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    uint64_t resp_buf[(supervisor->notif_resp_size + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    struct seccomp_notif * req = (struct seccomp_notif *)req_buf;
+    struct seccomp_notif_resp * resp = (struct seccomp_notif_resp *)resp_buf;
+
+    struct pollfd pollfd[2] = {
+        { .fd = supervisor->notify_fd, .events = POLLIN, .revents = 0 },
+        { .fd = supervisor->stop_fd, .events = POLLIN, .revents = 0 }
+    };
+
+    while (true) {
+        int poll_res = poll(pollfd, 2, -1);
+        if (poll_res < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (pollfd[1].revents != 0) break;
+        // the subjail exited
+        if ((pollfd[0].revents & POLLIN) == 0) break;
+
+        memset(req, 0, supervisor->notif_size);
+        if (ioctl(supervisor->notify_fd, SECCOMP_IOCTL_NOTIF_RECV, req) < 0) {
+            if (errno == EINTR || errno == ENOENT) continue;
+            break;
+        }
+
+        opensupervisor_handle(supervisor, req, resp);
+    }
+
+    return NULL;
+}
+
+gh_result gh_opensupervisor_ctor(gh_opensupervisor * supervisor, gh_thread * thread, int notify_fd) {
+    gh_result res = GHR_OK;
+    gh_opensupervisor_ctoridle(supervisor);
+    supervisor->thread = thread;
+
+    if (!opensupervisor_islistener(notify_fd)) {
+        res = GHR_OPENSUPERVISOR_NOTLISTENER;
+        goto fail_listener;
+    }
+
+    struct seccomp_notif_sizes sizes;
+    if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) < 0) {
+        res = ghr_errno(GHR_OPENSUPERVISOR_NOTIFSIZES);
+        goto fail_listener;
+    }
+    supervisor->notif_size = sizes.seccomp_notif > sizeof(struct seccomp_notif) ? sizes.seccomp_notif : sizeof(struct seccomp_notif);
+    supervisor->notif_resp_size = sizes.seccomp_notif_resp > sizeof(struct seccomp_notif_resp) ? sizes.seccomp_notif_resp : sizeof(struct seccomp_notif_resp);
+
+    supervisor->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (supervisor->stop_fd < 0) {
+        res = ghr_errno(GHR_OPENSUPERVISOR_STOPFD);
+        goto fail_listener;
+    }
+
+    supervisor->notify_fd = notify_fd;
+
+    int pthread_res = pthread_create(&supervisor->os_thread, NULL, opensupervisor_main, supervisor);
+    if (pthread_res != 0) {
+        res = ghr_errnoval(GHR_OPENSUPERVISOR_THREADCREATE, pthread_res);
+        goto fail_thread;
+    }
+
+    return GHR_OK;
+
+fail_thread:
+    close(supervisor->stop_fd);
+    supervisor->stop_fd = -1;
+    supervisor->notify_fd = -1;
+
+fail_listener:
+    close(notify_fd);
+    return res;
+}
+
+void gh_opensupervisor_ctoridle(gh_opensupervisor * supervisor) {
+    supervisor->thread = NULL;
+    supervisor->notify_fd = -1;
+    supervisor->stop_fd = -1;
+    supervisor->notif_size = 0;
+    supervisor->notif_resp_size = 0;
+    atomic_init(&supervisor->opens, 0);
+}
+
+bool gh_opensupervisor_running(gh_opensupervisor * supervisor) {
+    return supervisor->notify_fd >= 0;
+}
+
+gh_result gh_opensupervisor_dtor(gh_opensupervisor * supervisor) {
+    if (!gh_opensupervisor_running(supervisor)) return GHR_OK;
+
+    gh_result res = GHR_OK;
+
+    uint64_t one = 1;
+    if (write(supervisor->stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        // RATIONALE: The thread can't be stopped, and the supervisor's memory
+        // may be freed after returning, so there is no way to clean up safely.
+        return ghr_errno(GHR_OPENSUPERVISOR_STOP);
+    }
+
+    int pthread_res = pthread_join(supervisor->os_thread, NULL);
+    if (pthread_res != 0) res = ghr_errnoval(GHR_OPENSUPERVISOR_THREADJOIN, pthread_res);
+
+    close(supervisor->stop_fd);
+    close(supervisor->notify_fd);
+    supervisor->stop_fd = -1;
+    supervisor->notify_fd = -1;
+    return res;
+}
@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ghost/result.h>
+#include <ghost/alloc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+#include <ghost/parallelmap.h>
+
+typedef struct {
+    const gh_parallelmapoptions * options;
+    size_t chunk_size;
+
+    atomic_size_t next_index;
+    atomic_bool abort;
+} parallelmap_shared;
+
+typedef struct {
+    gh_thread thread;
+    bool thread_created;
+
+    pthread_t pthread;
+    bool pthread_created;
+
+    parallelmap_shared * shared;
+    gh_result result;
+} parallelmap_worker;
+
+static gh_result parallelmap_item(parallelmap_worker * worker, size_t index) {
+    const gh_parallelmapoptions * options = worker->shared->options;
+
+    gh_thread_callframe frame;
+    gh_result res = gh_thread_callframe_ctor(&frame);
+    if (ghr_iserr(res)) return res;
+
+    res = options->args_func(index, &frame, options->userdata);
+    if (ghr_iserr(res)) goto cleanup_frame;
+
+    gh_threadnotif_script status = {0};
+    res = gh_thread_call(&worker->thread, options->function_name, &frame, &status);
+    if (ghr_iserr(res)) goto cleanup_frame;
+
+    if (options->out_statuses != NULL) options->out_statuses[index] = status;
+
+    if (options->result_func != NULL) {
+        res = options->result_func(index, &frame, &status, options->userdata);
+    }
+
+cleanup_frame:;
+    gh_result inner_res = gh_thread_callframe_dtor(&frame);
+    if (ghr_isok(res)) res = inner_res;
+    return res;
+}
+
+static void * parallelmap_workerfunc(void * worker_voidp) {
+    parallelmap_worker * worker = (parallelmap_worker *)worker_voidp;
+    parallelmap_shared * shared = worker->shared;
+    size_t item_count = shared->options->item_count;
+
+    while (!atomic_load(&shared->abort)) {
+        size_t start = atomic_fetch_add(&shared->next_index, shared->chunk_size);
+        if (start >= item_count) break;
+
+        size_t end = shared->chunk_size > item_count - start ? item_count : start + shared->chunk_size;
+
+        for (size_t i = start; i < end; i++) {
+            if (atomic_load(&shared->abort)) return NULL;
+
+            gh_result res = parallelmap_item(worker, i);
+            if (ghr_iserr(res)) {
+                worker->result = res;
+                atomic_store(&shared->abort, true);
+                return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static size_t parallelmap_chunksize(const gh_parallelmapoptions * options) {
+    // RATIONALE: Every worker adds the chunk size to the shared index once
+    // more after the items run out. Larger chunks than the whole input could
+    // wrap it around, so that items are handed out again.
+    if (options->chunk_size != GH_PARALLELMAP_AUTOCHUNK) {
+        return options->chunk_size > options->item_count ? options->item_count : options->chunk_size;
+    }
+
+    size_t chunk_size = options->item_count / (options->thread_count * GH_PARALLELMAP_CHUNKSPERTHREAD);
+    if (chunk_size == 0) chunk_size = 1;
+    return chunk_size;
+}
+
+gh_result gh_sandbox_parallelmap(gh_sandbox * sandbox, const gh_parallelmapoptions * options) {
+    if (options->thread_count == 0) return GHR_PARALLELMAP_NOTHREADS;
+    if (options->function_name == NULL || options->args_func == NULL) return GHR_PARALLELMAP_NOFUNCTION;
+    if (options->item_count == 0) return GHR_OK;
+
+    gh_alloc * alloc = options->thread_options.rpc->alloc;
+
+    parallelmap_shared shared = {
+        .options = options,
+        .chunk_size = parallelmap_chunksize(options)
+    };
+    atomic_store(&shared.next_index, 0);
+    atomic_store(&shared.abort, false);
+
+    // RATIONALE: Spawning more subjails than there are items only wastes
+    // startup time - every extra subjail would exit without doing any work.
+    size_t worker_count = options->thread_count;
+    if (worker_count > options->item_count) worker_count = options->item_count;
+
+    parallelmap_worker * workers = NULL;
+    gh_result res = gh_alloc_new(alloc, (void**)&workers, sizeof(parallelmap_worker) * worker_count);
+    if (ghr_iserr(res)) return res;
+    memset(workers, 0, sizeof(parallelmap_worker) * worker_count);
+
+    // Threads are spawned from this OS thread only - the sandbox IPC
+    // connection is not safe to use concurrently.
+    for (size_t i = 0; i < worker_count; i++) {
+        gh_threadoptions thread_options = options->thread_options;
+        thread_options.sandbox = sandbox;
+
+        workers[i].shared = &shared;
+        workers[i].result = GHR_OK;
+
+        res = gh_thread_ctor(&workers[i].thread, thread_options);
+        if (ghr_iserr(res)) goto cleanup_workers;
+        workers[i].thread_created = true;
+
+        if (options->script != NULL) {
+            gh_threadnotif_script script_status = {0};
+            res = gh_thread_runstringsync(&workers[i].thread, options->script, options->script_len, &script_status);
+            if (ghr_iserr(res)) goto cleanup_workers;
+
+            res = script_status.result;
+            if (ghr_iserr(res)) goto cleanup_workers;
+        }
+    }
+
+    for (size_t i = 0; i < worker_count; i++) {
+        int pthread_res = pthread_create(&workers[i].pthread, NULL, parallelmap_workerfunc, &workers[i]);
+        if (pthread_res != 0) {
+            res = ghr_errnoval(GHR_PARALLELMAP_PTHREADCREATE, pthread_res);
+            atomic_store(&shared.abort, true);
+            break;
+        }
+        workers[i].pthread_created = true;
+    }
+
+cleanup_workers:
+    for (size_t i = 0; i < worker_count; i++) {
+        if (!workers[i].pthread_created) continue;
+
+        int pthread_res = pthread_join(workers[i].pthread, NULL);
+        if (pthread_res != 0 && ghr_isok(res)) res = ghr_errnoval(GHR_PARALLELMAP_PTHREADJOIN, pthread_res);
+        if (ghr_iserr(workers[i].result) && ghr_isok(res)) res = workers[i].result;
+    }
+
+    for (size_t i = 0; i < worker_count; i++) {
+        if (!workers[i].thread_created) continue;
+
+        gh_result inner_res = gh_thread_dtor(&workers[i].thread, NULL);
+        if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+    }
+
+    gh_result inner_res = gh_alloc_delete(alloc, (void**)&workers, sizeof(parallelmap_worker) * worker_count);
+    if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+
+    return res;
+}
@@ -201,6 +201,35 @@ gh_result gh_permfs_getmode(gh_permfs * permfs, int opath_fd, gh_abscanonicalpat
     return GHR_OK;
 }
 
+// same rule as the directory match of gh_permfs_getmode
+static bool permfs_isbelow(gh_abscanonicalpath path, gh_abscanonicalpath dir_path) {
+    if (path.len <= dir_path.len) return false;
+    if (strncmp(dir_path.ptr, path.ptr, dir_path.len) != 0) return false;
+    return path.ptr[dir_path.len] == '/';
+}
+
+gh_permfs_mode gh_permfs_unconditionalmode(gh_permfs * permfs, gh_permfs_entry * entry, bool directory) {
+    // no path is below the root by the rule of gh_permfs_getmode, so its
+    // children modeset doesn't apply to anything
+    if (directory && entry->ident.path.len == 1) return GH_PERMFS_NONE;
+
+    gh_permfs_mode mode = entry->self.mode_accept;
+    if (directory) mode &= entry->children.mode_accept;
+
+    for (size_t i = 0; i < permfs->file_perms.size; i++) {
+        gh_permfs_entry * other = permfs->file_perms.buffer + i;
+
+        bool related = other == entry ||
+            permfs_isbelow(other->ident.path, entry->ident.path) ||
+            permfs_isbelow(entry->ident.path, other->ident.path);
+        if (!related) continue;
+
+        mode &= ~(other->self.mode_reject | other->children.mode_reject);
+    }
+
+    return mode;
+}
+
 static gh_result permfs_actmode(gh_permfs * permfs, gh_permfs_modeset modeset, gh_permfs_mode mode, gh_permfs_actionresult * out_result) {
     (void)permfs;
 
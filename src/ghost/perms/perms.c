@@ -70,6 +70,28 @@ gh_result gh_perms_dtor(gh_perms * perms) {
     return res;
 }
 
+gh_result gh_perms_reset(gh_perms * perms) {
+    gh_alloc * alloc = perms->procfd.alloc;
+    gh_permprompter prompter = perms->prompter;
+
+    size_t generic_count = perms->generic_count;
+    gh_permgeneric_instance generic[GH_PERMS_MAXGENERIC];
+    memcpy(generic, perms->generic, sizeof(gh_permgeneric_instance) * generic_count);
+
+    gh_result res = gh_perms_dtor(perms);
+    if (ghr_iserr(res)) return res;
+
+    res = gh_perms_ctor(perms, alloc, prompter);
+    if (ghr_iserr(res)) return res;
+
+    for (size_t i = 0; i < generic_count; i++) {
+        res = gh_perms_registergeneric(perms, generic[i].id, generic[i].vtable);
+        if (ghr_iserr(res)) return res;
+    }
+
+    return res;
+}
+
 static gh_result permgeneric_matches(gh_permparser * parser, gh_permrequest_id group_id, gh_permrequest_id resource_id, void * userdata) {
     (void)parser;
 
@@ -0,0 +1,95 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/procstat.h>
+
+#define GH_PROCSTAT_PATHSIZE sizeof("/proc/2147483647/stat")
+#define GH_PROCSTAT_FDINFOPATHSIZE sizeof("/proc/self/fdinfo/2147483647")
+#define GH_PROCSTAT_BUFFERSIZE 1024
+
+// Field numbers as documented in proc(5), counting from 1.
+// The fields following the command name start at 3 (state).
+#define GH_PROCSTAT_FIELD_FIRSTAFTERCOMM 3
+#define GH_PROCSTAT_FIELD_UTIME 14
+#define GH_PROCSTAT_FIELD_STIME 15
+#define GH_PROCSTAT_FIELD_RSS 24
+
+gh_result gh_procstat_read(pid_t pid, gh_procstat * out) {
+    char path[GH_PROCSTAT_PATHSIZE];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ghr_errno(GHR_PROCSTAT_OPEN);
+
+    char buffer[GH_PROCSTAT_BUFFERSIZE];
+    ssize_t read_res = read(fd, buffer, sizeof(buffer) - 1);
+    int read_errno = errno;
+    close(fd);
+    if (read_res < 0) return ghr_errnoval(GHR_PROCSTAT_READ, read_errno);
+    buffer[read_res] = '\0';
+
+    // RATIONALE: The command name (field 2) is enclosed in parentheses, but may
+    // itself contain spaces and parentheses. It is never followed by another ')',
+    // so everything after the last one can be split on spaces.
+    char * fields = strrchr(buffer, ')');
+    if (fields == NULL) return GHR_PROCSTAT_PARSE;
+    fields += 1;
+
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    long long rss = 0;
+    bool found_rss = false;
+
+    char * save = NULL;
+    int field = GH_PROCSTAT_FIELD_FIRSTAFTERCOMM;
+    for (char * token = strtok_r(fields, " ", &save); token != NULL; token = strtok_r(NULL, " ", &save), field += 1) {
+        if (field == GH_PROCSTAT_FIELD_UTIME) utime = strtoull(token, NULL, 10);
+        else if (field == GH_PROCSTAT_FIELD_STIME) stime = strtoull(token, NULL, 10);
+        else if (field == GH_PROCSTAT_FIELD_RSS) {
+            rss = strtoll(token, NULL, 10);
+            found_rss = true;
+            break;
+        }
+    }
+    if (!found_rss) return GHR_PROCSTAT_PARSE;
+
+    long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (ticks_per_sec <= 0 || page_size <= 0) return GHR_PROCSTAT_PARSE;
+
+    out->cpu_ns = (uint64_t)(utime + stime) * (1000000000ULL / (uint64_t)ticks_per_sec);
+    out->rss_bytes = rss > 0 ? (size_t)rss * (size_t)page_size : 0;
+    return GHR_OK;
+}
+
+gh_result gh_procstat_pidfdpid(int pidfd, pid_t * out_pid) {
+    char path[GH_PROCSTAT_FDINFOPATHSIZE];
+    snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", pidfd);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ghr_errno(GHR_PROCSTAT_OPEN);
+
+    char buffer[GH_PROCSTAT_BUFFERSIZE];
+    ssize_t read_res = read(fd, buffer, sizeof(buffer) - 1);
+    int read_errno = errno;
+    close(fd);
+    if (read_res < 0) return ghr_errnoval(GHR_PROCSTAT_READ, read_errno);
+    buffer[read_res] = '\0';
+
+    // only pidfds have a "Pid:" line, which is -1 once the process was reaped
+    char * line = strstr(buffer, "\nPid:");
+    if (line == NULL) return GHR_PROCSTAT_NOTPIDFD;
+
+    char * end = NULL;
+    long pid = strtol(line + sizeof("\nPid:") - 1, &end, 10);
+    if (end == line + sizeof("\nPid:") - 1) return GHR_PROCSTAT_PARSE;
+    if (pid <= 0) return GHR_PROCSTAT_NOTPIDFD;
+
+    *out_pid = (pid_t)pid;
+    return GHR_OK;
+}
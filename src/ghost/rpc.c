@@ -233,6 +233,7 @@ gh_result gh_rpc_respondtomsg(gh_rpc * rpc, gh_ipcmsg_functioncall * funccall_ms
 
     gh_ipcmsg_functionreturn ret_msg = {0};
     ret_msg.type = GH_IPCMSG_FUNCTIONRETURN;
+    ret_msg.request_id = funccall_msg->request_id;
     ret_msg.result = frame->result;
     ret_msg.fd = frame->fd;
     if (!ghr_isok(frame->result)) ret_msg.fd = -1;
@@ -260,11 +261,12 @@ gh_result gh_rpc_respondtomsg(gh_rpc * rpc, gh_ipcmsg_functioncall * funccall_ms
     return GHR_OK;
 }
 
-gh_result gh_rpc_respondmissing(gh_rpc * rpc, gh_ipc * ipc) {
+gh_result gh_rpc_respondmissing(gh_rpc * rpc, gh_ipc * ipc, gh_ipcmsg_functioncall * funccall_msg) {
     (void)rpc;
 
     gh_ipcmsg_functionreturn ret_msg = {0};
     ret_msg.type = GH_IPCMSG_FUNCTIONRETURN;
+    ret_msg.request_id = funccall_msg->request_id;
     ret_msg.result = GHR_RPC_MISSINGFUNC;
     ret_msg.fd = -1;
 
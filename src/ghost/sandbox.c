@@ -3,7 +3,9 @@
 #include <sys/syscall.h>
 #include <sys/signal.h>
 #include <poll.h>
+#include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
@@ -14,11 +16,65 @@
 #include <ghost/result.h>
 #include <ghost/sandbox.h>
 #include <ghost/embedded_jail.h>
+#include <ghost/procstat.h>
+#include <ghost/cgroup.h>
+
+// Places the jail in <cgroup_path>/sandbox.<pid>/jail. The caller must
+// kill the jail and call sandbox_cgroupdtor on failure.
+static gh_result sandbox_cgroupctor(gh_sandbox * sandbox, const gh_sandboxoptions * options, pid_t pid) {
+    sandbox->cgroup_rootfd = -1;
+    gh_cgroup_ctoridle(&sandbox->cgroup);
+    gh_cgroup_ctoridle(&sandbox->jail_cgroup);
+    if (options->cgroup_path[0] == '\0') return GHR_OK;
+
+    sandbox->cgroup_rootfd = open(options->cgroup_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (sandbox->cgroup_rootfd < 0) return ghr_errno(GHR_CGROUP_OPEN);
+
+    gh_result res = gh_cgroup_enablecontrollers(sandbox->cgroup_rootfd);
+    if (ghr_iserr(res)) return res;
+
+    char name[GH_CGROUP_MAXNAME];
+    snprintf(name, sizeof(name), "sandbox.%d", (int)pid);
+    res = gh_cgroup_ctor(&sandbox->cgroup, sandbox->cgroup_rootfd, name);
+    if (ghr_iserr(res)) return res;
+
+    res = gh_cgroup_enablecontrollers(sandbox->cgroup.fd);
+    if (ghr_iserr(res)) return res;
+
+    res = gh_cgroup_setlimits(&sandbox->cgroup, (gh_cgrouplimits) {
+        .memory_max_bytes = options->memory_limit_bytes
+    });
+    if (ghr_iserr(res)) return res;
+
+    // RATIONALE: Processes may only live in leaf cgroups once controllers are
+    // enabled for the children, so the jail can't share the sandbox cgroup
+    // with the cgroups of subjails.
+    res = gh_cgroup_ctor(&sandbox->jail_cgroup, sandbox->cgroup.fd, "jail");
+    if (ghr_iserr(res)) return res;
+
+    return gh_cgroup_attach(&sandbox->jail_cgroup, pid);
+}
+
+static gh_result sandbox_cgroupdtor(gh_sandbox * sandbox) {
+    gh_result res = gh_cgroup_dtor(&sandbox->jail_cgroup);
+
+    gh_result inner_res = gh_cgroup_dtor(&sandbox->cgroup);
+    if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+
+    if (sandbox->cgroup_rootfd >= 0) close(sandbox->cgroup_rootfd);
+    sandbox->cgroup_rootfd = -1;
+    return res;
+}
 
 static gh_result gh_sandbox_ctor_parent(gh_sandbox * sandbox, gh_sandboxoptions options, pid_t pid) {
     memcpy(&sandbox->options, &options, sizeof(gh_sandboxoptions));
     sandbox->pid = pid;
 
+    gh_ipccounters_init(&sandbox->thread_ipc);
+    atomic_init(&sandbox->rpc_calls, 0);
+    atomic_init(&sandbox->scripts_completed, 0);
+    atomic_init(&sandbox->thread_count, 0);
+
     gh_ipcmsg_hello hello_msg;
     memset(&hello_msg, 0, sizeof(gh_ipcmsg_hello));
     hello_msg.type = GH_IPCMSG_HELLO;
@@ -50,6 +106,11 @@ gh_result gh_sandbox_ctor(gh_sandbox * sandbox, gh_sandboxoptions options) {
     if (!gh_embeddedjail_available()) return GHR_EMBEDDEDJAIL_UNAVAILABLE;
     gh_result res = GHR_OK;
 
+    // the child inherits the executable, instead of copying it into a new file
+    int jail_fd;
+    res = gh_embeddedjail_sharedfd(&jail_fd);
+    if (ghr_iserr(res)) return res;
+
     int child_sockfd;
     res = gh_ipc_ctor(&sandbox->ipc, &child_sockfd);
     if (ghr_iserr(res)) return res;
@@ -84,6 +145,15 @@ gh_result gh_sandbox_ctor(gh_sandbox * sandbox, gh_sandboxoptions options) {
             return ghr_errno(GHR_SANDBOX_CLOSESOCKFAIL);
         }
 
+        res = sandbox_cgroupctor(sandbox, &options, child_pid);
+        if (ghr_iserr(res)) {
+            if (kill(child_pid, SIGKILL) < 0) return ghr_errno(GHR_SANDBOX_KILLCHILDFAIL);
+            (void)gh_ipc_dtor(&sandbox->ipc);
+            (void)waitpid(child_pid, NULL, 0);
+            (void)sandbox_cgroupdtor(sandbox);
+            return res;
+        }
+
         return gh_sandbox_ctor_parent(sandbox, options, child_pid);
     }
 }
@@ -154,5 +224,31 @@ gh_result gh_sandbox_dtor(gh_sandbox * sandbox, gh_result * out_jailresult) {
     gh_result res = gh_ipc_dtor(&sandbox->ipc);
     if (ghr_iserr(res)) return res;
 
+    res = sandbox_cgroupdtor(sandbox);
+    if (ghr_iserr(res)) return res;
+
+    return GHR_OK;
+}
+
+gh_result gh_sandbox_stats(gh_sandbox * sandbox, gh_sandboxstats * out_stats) {
+    gh_procstat procstat;
+    gh_result res = gh_procstat_read(sandbox->pid, &procstat);
+    if (ghr_iserr(res)) return res;
+
+    out_stats->rss_bytes = procstat.rss_bytes;
+    out_stats->cpu_ns = procstat.cpu_ns;
+    gh_ipccounters_stats(&sandbox->ipc.counters, &out_stats->ipc);
+    gh_ipccounters_stats(&sandbox->thread_ipc, &out_stats->thread_ipc);
+    out_stats->rpc_calls = atomic_load(&sandbox->rpc_calls);
+    out_stats->scripts_completed = atomic_load(&sandbox->scripts_completed);
+    out_stats->thread_count = atomic_load(&sandbox->thread_count);
+
+    gh_cgroupstats cgroupstats = {0};
+    if (gh_cgroup_active(&sandbox->cgroup)) {
+        res = gh_cgroup_stats(&sandbox->cgroup, &cgroupstats);
+        if (ghr_iserr(res)) return res;
+    }
+    out_stats->cgroup_memory_bytes = cgroupstats.memory_bytes;
+    out_stats->cgroup_cpu_ns = cgroupstats.cpu_ns;
     return GHR_OK;
 }
@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdatomic.h>
+#include <ghost/result.h>
+#include <ghost/alloc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+#include <ghost/sandboxpool.h>
+
+static gh_result sandboxpool_teardown(gh_sandboxpool * pool, size_t sandboxes_created, gh_result * out_jailresult) {
+    gh_result res = GHR_OK;
+    if (out_jailresult != NULL) *out_jailresult = GHR_OK;
+
+    for (size_t i = 0; i < sandboxes_created; i++) {
+        gh_result jail_res = GHR_OK;
+        gh_result inner_res = gh_sandbox_dtor(pool->sandboxes + i, &jail_res);
+        if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+        if (out_jailresult != NULL && ghr_iserr(jail_res) && ghr_isok(*out_jailresult)) *out_jailresult = jail_res;
+    }
+
+    gh_result inner_res = gh_alloc_delete(pool->alloc, (void**)&pool->sandboxes, sizeof(gh_sandbox) * pool->sandbox_count);
+    if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+
+    return res;
+}
+
+gh_result gh_sandboxpool_ctor(gh_sandboxpool * pool, gh_alloc * alloc, gh_sandboxpooloptions options) {
+    if (options.sandbox_count == 0) return GHR_SANDBOXPOOL_NOSANDBOXES;
+    if (options.placement != GH_SANDBOXPOOL_ROUNDROBIN && options.placement != GH_SANDBOXPOOL_LEASTLOAD) {
+        return GHR_SANDBOXPOOL_BADPLACEMENT;
+    }
+
+    *pool = (gh_sandboxpool) {0};
+    pool->alloc = alloc;
+    pool->sandbox_count = options.sandbox_count;
+    pool->placement = options.placement;
+    atomic_store(&pool->cursor, 0);
+
+    gh_result res = gh_alloc_new(pool->alloc, (void**)&pool->sandboxes, sizeof(gh_sandbox) * pool->sandbox_count);
+    if (ghr_iserr(res)) return res;
+    memset(pool->sandboxes, 0, sizeof(gh_sandbox) * pool->sandbox_count);
+
+    size_t sandboxes_created = 0;
+    for (; sandboxes_created < pool->sandbox_count; sandboxes_created++) {
+        res = gh_sandbox_ctor(pool->sandboxes + sandboxes_created, options.sandbox_options);
+        if (ghr_iserr(res)) goto fail;
+    }
+
+    return GHR_OK;
+
+fail:
+    (void)sandboxpool_teardown(pool, sandboxes_created, NULL);
+    return res;
+}
+
+static size_t sandboxpool_pickidx(gh_sandboxpool * pool) {
+    size_t start = atomic_fetch_add(&pool->cursor, 1) % pool->sandbox_count;
+    if (pool->placement == GH_SANDBOXPOOL_ROUNDROBIN) return start;
+
+    size_t best = start;
+    size_t best_count = atomic_load(&pool->sandboxes[start].thread_count);
+    for (size_t i = 1; i < pool->sandbox_count && best_count > 0; i++) {
+        size_t idx = (start + i) % pool->sandbox_count;
+        size_t count = atomic_load(&pool->sandboxes[idx].thread_count);
+        if (count < best_count) {
+            best = idx;
+            best_count = count;
+        }
+    }
+
+    return best;
+}
+
+gh_sandbox * gh_sandboxpool_pick(gh_sandboxpool * pool) {
+    return pool->sandboxes + sandboxpool_pickidx(pool);
+}
+
+gh_result gh_sandboxpool_threadctor(gh_sandboxpool * pool, gh_thread * thread, gh_threadoptions options) {
+    size_t start = sandboxpool_pickidx(pool);
+
+    gh_result res = GHR_OK;
+    for (size_t i = 0; i < pool->sandbox_count; i++) {
+        options.sandbox = pool->sandboxes + (start + i) % pool->sandbox_count;
+        res = gh_thread_ctor(thread, options);
+        if (ghr_isok(res)) return res;
+    }
+
+    return res;
+}
+
+gh_result gh_sandboxpool_dtor(gh_sandboxpool * pool, gh_result * out_jailresult) {
+    return sandboxpool_teardown(pool, pool->sandbox_count, out_jailresult);
+}
@@ -6,45 +6,214 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <ghost/result.h>
 #include <ghost/sandbox.h>
 #include <ghost/thread.h>
 #include <ghost/rpc.h>
 #include <ghost/ipc.h>
+#include <ghost/bytecodecache.h>
+#include <ghost/procstat.h>
+#include <ghost/opensupervisor.h>
 #include <ghost/perms/perms.h>
 #include <ghost/perms/prompt.h>
 
-gh_result gh_thread_ctor(gh_thread * thread, gh_threadoptions options) {
-    gh_ipc direct_ipc;
+struct gh_threadparkedmsg {
+    gh_threadparkedmsg * next;
+    size_t size;
+    char data[];
+};
+
+static gh_result thread_dispatch_ctor(gh_thread * thread) {
+    atomic_store(&thread->request_counter, GH_IPC_NOREQUEST);
+    atomic_store(&thread->tenant_counter, GH_IPC_NOTENANT);
+    thread->dispatch_receiving = false;
+    thread->parked_head = NULL;
+    thread->parked_tail = NULL;
+    thread->parked_count = 0;
+    thread->inflight_count = 0;
+
+    int pthread_res = pthread_mutex_init(&thread->dispatch_mutex, NULL);
+    if (pthread_res != 0) return ghr_errnoval(GHR_THREAD_DISPATCHINIT, pthread_res);
+
+    pthread_condattr_t condattr;
+    pthread_res = pthread_condattr_init(&condattr);
+    if (pthread_res == 0) pthread_res = pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    if (pthread_res == 0) {
+        pthread_res = pthread_cond_init(&thread->dispatch_cond, &condattr);
+        pthread_condattr_destroy(&condattr);
+    }
+
+    if (pthread_res != 0) {
+        pthread_mutex_destroy(&thread->dispatch_mutex);
+        return ghr_errnoval(GHR_THREAD_DISPATCHINIT, pthread_res);
+    }
+
+    return GHR_OK;
+}
+
+static gh_result thread_dispatch_dtor(gh_thread * thread) {
+    gh_result res = GHR_OK;
+
+    gh_threadparkedmsg * parked = thread->parked_head;
+    while (parked != NULL) {
+        gh_threadparkedmsg * next = parked->next;
+        gh_result inner_res = gh_alloc_delete(thread->rpc->alloc, (void**)&parked, sizeof(gh_threadparkedmsg) + parked->size);
+        if (ghr_iserr(inner_res)) res = inner_res;
+        parked = next;
+    }
+    thread->parked_head = NULL;
+    thread->parked_tail = NULL;
+    thread->parked_count = 0;
+
+    pthread_cond_destroy(&thread->dispatch_cond);
+    pthread_mutex_destroy(&thread->dispatch_mutex);
+    return res;
+}
+
+static int thread_newrequestid(gh_thread * thread) {
+    int request_id;
+    do {
+        request_id = (atomic_fetch_add(&thread->request_counter, 1) + 1) & INT_MAX;
+    } while (request_id == GH_IPC_NOREQUEST);
+    return request_id;
+}
+
+static gh_threadrequestoptions thread_defaultrequestoptions(gh_thread * thread) {
+    return (gh_threadrequestoptions) {
+        .deadline_ms = thread->default_deadline_ms,
+        .out_request_id = NULL
+    };
+}
+
+// Undoes thread_ctor_spawn.
+static gh_result thread_ctor_abort(gh_thread * thread, const gh_threadoptions * options, int direct_peerfd, gh_result res) {
+    gh_result inner_res = gh_ipc_dtor(&thread->ipc);
+    if (ghr_iserr(inner_res)) res = inner_res;
+    if (direct_peerfd >= 0) close(direct_peerfd);
+
+    pthread_cond_destroy(&thread->dispatch_cond);
+    pthread_mutex_destroy(&thread->dispatch_mutex);
+
+    inner_res = gh_perms_dtor(&thread->perms);
+    if (ghr_iserr(inner_res)) res = inner_res;
+
+    atomic_fetch_sub(&options->sandbox->thread_count, 1);
+    return res;
+}
+
+// First half of gh_thread_ctor: asks the jail to spawn the subjail, without
+// waiting for it. Cleans up after itself on failure.
+static gh_result thread_ctor_spawn(gh_thread * thread, const gh_threadoptions * options, int * out_direct_peerfd) {
     int direct_peerfd;
 
     gh_result res = GHR_OK;
     gh_result inner_res = GHR_OK;
 
-    res = gh_perms_ctor(&thread->perms, options.rpc->alloc, options.prompter);
-    if (ghr_iserr(res)) return res;
+    // counted from the start, so that sandbox pools placing threads
+    // concurrently see threads that are still being spawned
+    atomic_fetch_add(&options->sandbox->thread_count, 1);
+
+    res = gh_perms_ctor(&thread->perms, options->rpc->alloc, options->prompter);
+    if (ghr_iserr(res)) goto fail_perms;
 
-    res = gh_ipc_ctor(&direct_ipc, &direct_peerfd);
+    res = thread_dispatch_ctor(thread);
+    if (ghr_iserr(res)) goto fail_dispatch;
+
+    res = gh_ipc_ctor(&thread->ipc, &direct_peerfd);
     if (ghr_iserr(res)) goto fail_ipc;
+    thread->ipc.aggregate = &options->sandbox->thread_ipc;
 
     gh_ipcmsg_newsubjail newsubjail_msg;
     memset(&newsubjail_msg, 0, sizeof(gh_ipcmsg_newsubjail));
     newsubjail_msg.type = GH_IPCMSG_NEWSUBJAIL;
     newsubjail_msg.sockfd = direct_peerfd;
-    res = gh_ipc_send(&options.sandbox->ipc, (gh_ipcmsg*)&newsubjail_msg, sizeof(gh_ipcmsg_newsubjail));
-    if (ghr_iserr(res)) goto fail_send;
+    newsubjail_msg.landlock = options->landlock;
+    res = gh_ipc_send(&options->sandbox->ipc, (gh_ipcmsg*)&newsubjail_msg, sizeof(gh_ipcmsg_newsubjail));
+    if (ghr_iserr(res)) return thread_ctor_abort(thread, options, direct_peerfd, res);
+
+    *out_direct_peerfd = direct_peerfd;
+    return GHR_OK;
+
+fail_ipc:
+    pthread_cond_destroy(&thread->dispatch_cond);
+    pthread_mutex_destroy(&thread->dispatch_mutex);
+
+fail_dispatch:
+    inner_res = gh_perms_dtor(&thread->perms);
+    if (ghr_iserr(inner_res)) res = inner_res;
+
+fail_perms:
+    atomic_fetch_sub(&options->sandbox->thread_count, 1);
+    return res;
+}
+
+// Second half of gh_thread_ctor: waits for the subjail requested by
+// thread_ctor_spawn and greets it. Cleans up after itself on failure.
+static gh_result thread_ctor_finish(gh_thread * thread, const gh_threadoptions * options, int direct_peerfd) {
+    gh_result res = GHR_OK;
 
+    pid_t subjail_pid = 0;
+    pid_t jail_reported_pid = 0;
+    int pidfd = -1;
+    int notify_fd = -1;
+    bool landlock = false;
+    bool received_alive = false;
+    bool received_pidfd = false;
+    gh_cgroup_ctoridle(&thread->cgroup);
+
+    // SUBJAILPIDFD comes from the jail and SUBJAILALIVE from the subjail
+    // itself, so they may arrive in either order
     char recvmsg_buf[GH_IPCMSG_MAXSIZE];
     gh_ipcmsg * recvmsg = (gh_ipcmsg *)recvmsg_buf;
-    res = gh_ipc_recv(&direct_ipc, recvmsg, GH_SANDBOX_MAXWAITSUBJAILMS);
+    while (!received_alive || !received_pidfd) {
+        res = gh_ipc_recv(&thread->ipc, recvmsg, GH_SANDBOX_MAXWAITSUBJAILMS);
+        if (ghr_iserr(res)) goto fail_recv;
+
+        if (recvmsg->type == GH_IPCMSG_SUBJAILPIDFD && !received_pidfd) {
+            gh_ipcmsg_subjailpidfd * pidfd_msg = (gh_ipcmsg_subjailpidfd *)recvmsg;
+            jail_reported_pid = pidfd_msg->pid;
+            pidfd = pidfd_msg->pidfd;
+            received_pidfd = true;
+        } else if (recvmsg->type == GH_IPCMSG_SUBJAILALIVE && !received_alive) {
+            gh_ipcmsg_subjailalive * subjailalive_msg = (gh_ipcmsg_subjailalive * )recvmsg;
+            subjail_pid = subjailalive_msg->pid;
+            notify_fd = subjailalive_msg->notifyfd;
+            landlock = subjailalive_msg->landlock;
+            received_alive = true;
+        } else {
+            res = GHR_SANDBOX_EXPECTEDSUBJAILALIVE;
+            goto fail_recv;
+        }
+    }
+
+    // Without clone3 in the jail, the pidfd is opened by PID here instead.
+    // That's racy (the jail reaps subjails automatically, so a subjail that
+    // died right away may have had its PID reused), but the best that can be
+    // done on such kernels.
+    if (pidfd < 0) {
+        pidfd = (int)syscall(SYS_pidfd_open, subjail_pid, 0);
+        if (pidfd < 0) {
+            res = ghr_errno(GHR_SANDBOX_PIDFD);
+            goto fail_recv;
+        }
+        jail_reported_pid = subjail_pid;
+    }
+
+    pid_t pidfd_pid;
+    res = gh_procstat_pidfdpid(pidfd, &pidfd_pid);
     if (ghr_iserr(res)) goto fail_recv;
-    if (recvmsg->type != GH_IPCMSG_SUBJAILALIVE) {
-        res = GHR_SANDBOX_EXPECTEDSUBJAILALIVE;
+    if (pidfd_pid != subjail_pid || jail_reported_pid != subjail_pid) {
+        res = GHR_SANDBOX_SUBJAILPIDFDMISMATCH;
         goto fail_recv;
     }
-
-    gh_ipcmsg_subjailalive * subjailalive_msg = (gh_ipcmsg_subjailalive * )recvmsg;
-    pid_t subjail_pid = subjailalive_msg->pid;
     
     int close_res = close(direct_peerfd);
     if (close_res < 0) {
@@ -52,129 +221,317 @@ gh_result gh_thread_ctor(gh_thread * thread, gh_threadoptions options) {
         goto fail_close;
     }
 
+    thread->pid = subjail_pid;
+    thread->pidfd = pidfd;
+    memcpy(thread->name, options->name, GH_THREAD_MAXNAME);
+    thread->sandbox = options->sandbox;
+
+    memcpy(thread->safe_id, options->safe_id, GH_THREAD_MAXSAFEID);
+    thread->landlock = landlock;
+
+    // the subjail starts out in the cgroup of the jail, which the host moves
+    // it out of before it runs any scripts
+    if (gh_cgroup_active(&options->sandbox->cgroup)) {
+        char cgroup_name[GH_CGROUP_MAXNAME];
+        snprintf(cgroup_name, sizeof(cgroup_name), "subjail.%d", (int)subjail_pid);
+        res = gh_cgroup_ctor(&thread->cgroup, options->sandbox->cgroup.fd, cgroup_name);
+        if (ghr_iserr(res)) goto fail_close;
+
+        res = gh_cgroup_setlimits(&thread->cgroup, options->cgroup_limits);
+        if (ghr_iserr(res)) goto fail_close;
+
+        res = gh_cgroup_attach(&thread->cgroup, subjail_pid);
+        if (ghr_iserr(res)) goto fail_close;
+    }
+
+    gh_cpuset cpuset = options->cpuset;
+    if (options->pin_to_host) {
+        res = gh_cpuset_current(&cpuset);
+        if (ghr_iserr(res)) goto fail_close;
+    }
+    if (!gh_cpuset_isempty(&cpuset)) {
+        // RATIONALE: sched_setaffinity would happily move the subjail onto
+        // CPUs that the rest of the sandbox is kept off of.
+        const gh_cpuset * sandbox_cpuset = &options->sandbox->options.cpuset;
+        if (!gh_cpuset_isempty(sandbox_cpuset)) {
+            gh_cpuset_intersect(&cpuset, sandbox_cpuset);
+            if (gh_cpuset_isempty(&cpuset)) {
+                res = GHR_CPUSET_DISJOINT;
+                goto fail_close;
+            }
+        }
+
+        res = gh_cpuset_apply(&cpuset, subjail_pid);
+        if (ghr_iserr(res)) goto fail_close;
+    }
+
+    // without a listener, the subjail's openat fails with ENOSYS
+    gh_opensupervisor_ctoridle(&thread->open_supervisor);
+    if (options->native_open && notify_fd >= 0) {
+        res = gh_opensupervisor_ctor(&thread->open_supervisor, thread, notify_fd);
+        notify_fd = -1;
+        if (ghr_iserr(res)) goto fail_close;
+    }
+    if (notify_fd >= 0) {
+        close(notify_fd);
+        notify_fd = -1;
+    }
+
     gh_ipcmsg_hello hello_msg;
     memset(&hello_msg, 0, sizeof(gh_ipcmsg_hello));
     hello_msg.type = GH_IPCMSG_HELLO;
     hello_msg.pid = getpid();
-    res = gh_ipc_send(&direct_ipc, (gh_ipcmsg*)&hello_msg, sizeof(gh_ipcmsg_hello));
+    hello_msg.cpu_budget_ns = options->cpu_budget_ns;
+    hello_msg.instruction_budget = options->instruction_budget;
+    hello_msg.idle_trim_ms = options->idle_trim_ms;
+    hello_msg.memory_limit_bytes = options->memory_limit_bytes;
+    hello_msg.native_open = gh_opensupervisor_running(&thread->open_supervisor);
+    hello_msg.prefault_bytes = options->prefault_bytes;
+    hello_msg.prefault_lock = options->prefault_lock;
+    res = gh_ipc_send(&thread->ipc, (gh_ipcmsg*)&hello_msg, sizeof(gh_ipcmsg_hello));
     if (ghr_iserr(res)) goto fail_hello;
 
-    thread->ipc = direct_ipc;
-    thread->pid = subjail_pid;
-    memcpy(thread->name, options.name, GH_THREAD_MAXNAME);
-    thread->sandbox = options.sandbox;
+    thread->userdata = NULL;
 
-    memcpy(thread->safe_id, options.safe_id, GH_THREAD_MAXSAFEID);
+    thread->rpc = options->rpc;
+    gh_rpc_incthreadrefcount(options->rpc);
 
-    thread->userdata = NULL;
+    thread->default_timeout_ms = options->default_timeout_ms;
+    thread->default_deadline_ms = options->default_deadline_ms;
 
-    thread->rpc = options.rpc;
-    gh_rpc_incthreadrefcount(options.rpc);
+    thread->bytecode_cache = options->bytecode_cache;
 
-    thread->default_timeout_ms = options.default_timeout_ms;
+    atomic_init(&thread->lua_heap_bytes, 0);
+    atomic_init(&thread->lua_alloc_bytes, 0);
+    atomic_init(&thread->rpc_calls, 0);
+    atomic_init(&thread->scripts_completed, 0);
 
     return res;
 
 fail_hello:
+    if (syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0) < 0) res = ghr_errno(GHR_SANDBOX_THREADRECOVERYKILLFAIL);
+    (void)gh_opensupervisor_dtor(&thread->open_supervisor);
+    (void)gh_cgroup_dtor(&thread->cgroup);
+    close(pidfd);
+    return thread_ctor_abort(thread, options, -1, res);
+
 fail_close:
-    if (kill(subjail_pid, SIGKILL) < 0) res = ghr_errno(GHR_SANDBOX_THREADRECOVERYKILLFAIL);
+    if (syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0) < 0) res = ghr_errno(GHR_SANDBOX_THREADRECOVERYKILLFAIL);
+    if (notify_fd >= 0) close(notify_fd);
+    (void)gh_cgroup_dtor(&thread->cgroup);
+    close(pidfd);
+    return thread_ctor_abort(thread, options, -1, res);
+
 fail_recv:
-fail_send:
-    inner_res = gh_ipc_dtor(&direct_ipc);
-    if (ghr_iserr(inner_res)) res = inner_res;
+    if (pidfd >= 0) close(pidfd);
+    if (notify_fd >= 0) close(notify_fd);
+    return thread_ctor_abort(thread, options, direct_peerfd, res);
+}
 
-fail_ipc:
-    return res;
+// Rejects options that can't be used together, before anything is spawned.
+static gh_result thread_ctor_check(const gh_threadoptions * options) {
+    // RATIONALE: The subjail enforces its Landlock ruleset before the first
+    // request, so the warm-up would lock it down with an empty ruleset before
+    // the caller gets to load a policy and call gh_thread_landlock.
+    if (options->landlock && options->warmup_script != NULL) return GHR_THREAD_WARMUPLANDLOCK;
+    return GHR_OK;
 }
 
-static gh_result thread_wait(gh_thread * thread, int timeout_ms) {
-    int pidfd = (int)syscall(SYS_pidfd_open, thread->pid, 0);
-    if (pidfd < 0) return ghr_errno(GHR_SANDBOX_PIDFD);
-
-    struct pollfd pollfd[2] = {
-        {
-            .fd = pidfd,
-            .events = POLLHUP | POLLIN,
-            .revents = 0
-        },
-
-        {
-            .fd = thread->ipc.sockfd,
-            .events = POLLHUP | POLLIN,
-            .revents = 0
-        }
-    };
-    nfds_t pollfd_count = 2;
+// Runs the warm-up script of a constructed thread. The caller destroys the
+// thread on failure.
+static gh_result thread_ctor_warmup(gh_thread * thread, const gh_threadoptions * options) {
+    if (options->warmup_script == NULL) return GHR_OK;
+
+    gh_threadnotif_script status = {0};
+    gh_result res = gh_thread_runstringsync(thread, options->warmup_script, strlen(options->warmup_script), &status);
+    if (ghr_iserr(res)) return res;
+    return status.result;
+}
+
+gh_result gh_thread_ctor(gh_thread * thread, gh_threadoptions options) {
+    gh_result res = thread_ctor_check(&options);
+    if (ghr_iserr(res)) return res;
+
+    int direct_peerfd;
+    res = thread_ctor_spawn(thread, &options, &direct_peerfd);
+    if (ghr_iserr(res)) return res;
+
+    res = thread_ctor_finish(thread, &options, direct_peerfd);
+    if (ghr_iserr(res)) return res;
+
+    res = thread_ctor_warmup(thread, &options);
+    if (ghr_iserr(res)) {
+        (void)gh_thread_dtor(thread, NULL);
+        return res;
+    }
+
+    return GHR_OK;
+}
+
+gh_result gh_thread_ctormany(gh_thread * threads, const gh_threadoptions * options, size_t count) {
+    if (count == 0) return GHR_OK;
+    int direct_peerfds[count];
 
     gh_result res = GHR_OK;
+    for (size_t i = 0; i < count; i++) {
+        res = thread_ctor_check(options + i);
+        if (ghr_iserr(res)) return res;
+    }
+
+    size_t spawned = 0;
+    for (; spawned < count; spawned++) {
+        res = thread_ctor_spawn(threads + spawned, options + spawned, direct_peerfds + spawned);
+        if (ghr_iserr(res)) break;
+    }
+
+    // RATIONALE: Subjails that were already requested are finished even if a
+    // later request failed. They are going to be spawned by the jail anyway,
+    // and finishing them is the only way to learn their PIDs and shut them
+    // down cleanly.
+    size_t finished = 0;
+    for (size_t i = 0; i < spawned; i++) {
+        gh_result inner_res = thread_ctor_finish(threads + i, options + i, direct_peerfds[i]);
+        if (ghr_iserr(inner_res)) {
+            threads[i].pid = 0;
+            if (ghr_isok(res)) res = inner_res;
+        } else {
+            finished += 1;
+        }
+    }
+    for (size_t i = spawned; i < count; i++) threads[i].pid = 0;
+
+    for (size_t i = 0; i < count && ghr_isok(res); i++) {
+        res = thread_ctor_warmup(threads + i, options + i);
+    }
+
+    if (ghr_isok(res)) return res;
+
+    if (finished > 0) (void)gh_thread_dtormany(threads, count, NULL);
+    return res;
+}
+
+// Waits for the subjails of threads marked in waiting to exit, while
+// processing their messages. Subjails still alive once timeout_ms runs out
+// (not counting time spent processing messages) are killed. Results are
+// written to out_results for every thread that was waited for.
+static void thread_waitmany(gh_thread * threads, size_t count, const bool * waiting, gh_result * out_results, int timeout_ms) {
+    // pidfd of thread i at index 2i, IPC socket at 2i + 1
+    struct pollfd pollfd[count * 2];
+    size_t remaining = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        pollfd[i * 2] = (struct pollfd) { .fd = -1, .events = POLLHUP | POLLIN, .revents = 0 };
+        pollfd[i * 2 + 1] = (struct pollfd) { .fd = -1, .events = POLLHUP | POLLIN, .revents = 0 };
+        if (!waiting[i]) continue;
+
+        out_results[i] = GHR_OK;
+        pollfd[i * 2].fd = threads[i].pidfd;
+        pollfd[i * 2 + 1].fd = threads[i].ipc.sockfd;
+        remaining += 1;
+    }
 
+    bool clock_ok = true;
     struct timespec start_time;
     if (clock_gettime(CLOCK_MONOTONIC, &start_time) < 0) {
-        // clock is not going to work
-        // we fallback to just polling the pidfd
-        // the subjail process will crash if it attempts to run RPC functions
+        clock_ok = false;
 
-        pollfd_count = 1;
-        res = ghr_errno(GHR_THREAD_WAITCLOCK);
+        // clock is not going to work
+        // we fallback to just polling the pidfds
+        // the subjail processes will crash if they attempt to run RPC functions
+        for (size_t i = 0; i < count; i++) {
+            if (pollfd[i * 2].fd < 0) continue;
+            pollfd[i * 2 + 1].fd = -1;
+            out_results[i] = ghr_errno(GHR_THREAD_WAITCLOCK);
+        }
     }
 
-    while (true) {
-        int pollres = poll(pollfd, pollfd_count, timeout_ms);
-        if (pollres < 0) return ghr_errno(GHR_SANDBOX_PIDFDPOLL);
+    while (remaining > 0) {
+        int pollres = poll(pollfd, count * 2, timeout_ms);
+        if (pollres <= 0) {
+            gh_result poll_res = pollres < 0 ? ghr_errno(GHR_SANDBOX_PIDFDPOLL) : GHR_THREAD_FORCEKILL;
+            for (size_t i = 0; i < count; i++) {
+                int pidfd = pollfd[i * 2].fd;
+                if (pidfd < 0) continue;
+
+                out_results[i] = poll_res;
+                if (pollres == 0 && syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0) < 0) {
+                    out_results[i] = ghr_errno(GHR_SANDBOX_PIDFDKILL);
+                }
+            }
+            return;
+        }
 
-        if (pollres == 0) {
-            if (syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0) < 0) return ghr_errno(GHR_SANDBOX_PIDFDKILL);
-            return GHR_THREAD_FORCEKILL;
-        } else {
-            if (pollfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
-                return res;
+        for (size_t i = 0; i < count; i++) {
+            if (pollfd[i * 2].fd >= 0 && (pollfd[i * 2].revents & (POLLIN | POLLHUP | POLLERR))) {
+                pollfd[i * 2].fd = -1;
+                pollfd[i * 2 + 1].fd = -1;
+                remaining -= 1;
             }
+        }
 
-            struct timespec poll_end_time;
-            if (pollfd_count >= 2) {
-                if (clock_gettime(CLOCK_MONOTONIC, &poll_end_time) < 0) {
-                    pollfd_count = 1;
-                    res = ghr_errno(GHR_THREAD_WAITCLOCK);
-                } else {
-                    int64_t msec_diff = (poll_end_time.tv_sec - start_time.tv_sec) * 1000 + (poll_end_time.tv_nsec - start_time.tv_nsec) / 1000000;
-                    timeout_ms -= (int)msec_diff;
+        struct timespec poll_end_time;
+        if (clock_ok) {
+            if (clock_gettime(CLOCK_MONOTONIC, &poll_end_time) < 0) {
+                clock_ok = false;
+            } else {
+                int64_t msec_diff = (poll_end_time.tv_sec - start_time.tv_sec) * 1000 + (poll_end_time.tv_nsec - start_time.tv_nsec) / 1000000;
+                timeout_ms -= (int)msec_diff;
 
-                    if (timeout_ms < 0) timeout_ms = 0;
+                if (timeout_ms < 0) timeout_ms = 0;
 
-                    start_time = poll_end_time;
-                }
+                start_time = poll_end_time;
             }
+        }
 
-            if (pollfd_count >= 2 && (pollfd[1].revents & (POLLIN | POLLHUP | POLLERR))) {
-                gh_threadnotif notif;
-                gh_result inner_res = gh_thread_process(thread, &notif);
-                if (ghr_is(inner_res, GHR_IPC_PEERSHUTDOWN)) {
-                    pollfd_count = 1;
-                    inner_res = GHR_OK;
-                }
-                if (ghr_iserr(inner_res)) res = inner_res;
-
-                // When we give the script an alloted time to shutdown before we force kill it,
-                // we do NOT want to count the time that it takes **us** to process messages from
-                // the thread.
-                // For example, if a destructor on a Lua object calls a function that ends up
-                // triggering a permission prompt, we absolutely do not want to kill the process
-                // just because the user took a little bit too long to answer.
-                // For this reason, we reset the start time after processing the message here,
-                // so that the difference calculated between the time pre-poll and post-poll (that
-                // determines the poll timeout_ms argument) will not include the time spent in this
-                // branch.
-                if (clock_gettime(CLOCK_MONOTONIC, &poll_end_time) < 0) {
-                    pollfd_count = 1;
-                    res = ghr_errno(GHR_THREAD_WAITCLOCK);
-                } else {
-                    start_time = poll_end_time;
-                }
+        bool processed = false;
+        for (size_t i = 0; i < count; i++) {
+            if (pollfd[i * 2 + 1].fd < 0 || !(pollfd[i * 2 + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            gh_threadnotif notif;
+            gh_result inner_res = gh_thread_process(threads + i, &notif);
+            if (ghr_is(inner_res, GHR_IPC_PEERSHUTDOWN)) {
+                pollfd[i * 2 + 1].fd = -1;
+                inner_res = GHR_OK;
+            }
+            if (ghr_iserr(inner_res)) out_results[i] = inner_res;
+            processed = true;
+        }
+
+        // When we give the script an alloted time to shutdown before we force kill it,
+        // we do NOT want to count the time that it takes **us** to process messages from
+        // the thread.
+        // For example, if a destructor on a Lua object calls a function that ends up
+        // triggering a permission prompt, we absolutely do not want to kill the process
+        // just because the user took a little bit too long to answer.
+        // For this reason, we reset the start time after processing the message here,
+        // so that the difference calculated between the time pre-poll and post-poll (that
+        // determines the poll timeout_ms argument) will not include the time spent in this
+        // branch.
+        if (processed && clock_ok) {
+            if (clock_gettime(CLOCK_MONOTONIC, &poll_end_time) < 0) {
+                clock_ok = false;
+            } else {
+                start_time = poll_end_time;
+            }
+        }
+
+        if (!clock_ok) {
+            for (size_t i = 0; i < count; i++) {
+                if (pollfd[i * 2 + 1].fd < 0) continue;
+                pollfd[i * 2 + 1].fd = -1;
+                out_results[i] = ghr_errno(GHR_THREAD_WAITCLOCK);
             }
         }
     }
 }
 
+static gh_result thread_wait(gh_thread * thread, int timeout_ms) {
+    bool waiting = true;
+    gh_result res = GHR_OK;
+    thread_waitmany(thread, 1, &waiting, &res, timeout_ms);
+    return res;
+}
+
 static gh_result thread_requestquit(gh_thread * thread) {
     gh_ipcmsg_quit quit_msg;
     memset(&quit_msg, 0, sizeof(gh_ipcmsg_quit));
@@ -192,34 +549,112 @@ static gh_result thread_requestquit(gh_thread * thread) {
 }
 
 
-gh_result gh_thread_dtor(gh_thread * thread, gh_result * out_subjailresult) {
-    if (thread->pid == 0) return GHR_OK;
+// Second half of gh_thread_dtor, once the subjail has exited.
+static gh_result thread_release(gh_thread * thread) {
+    atomic_fetch_sub(&thread->sandbox->thread_count, 1);
+    close(thread->pidfd);
 
-    gh_rpc_decthreadrefcount(thread->rpc);
+    // uses the permissions, so it has to be stopped first
+    gh_result res = gh_opensupervisor_dtor(&thread->open_supervisor);
+    if (ghr_iserr(res)) return res;
 
-    gh_result quit_res = thread_requestquit(thread);
-    if (out_subjailresult != NULL) *out_subjailresult = quit_res;
+    res = thread_dispatch_dtor(thread);
+    if (ghr_iserr(res)) return res;
 
-    gh_result res = gh_perms_dtor(&thread->perms);
+    res = gh_perms_dtor(&thread->perms);
     if (ghr_iserr(res)) return res;
 
     res = gh_ipc_dtor(&thread->ipc);
     if (ghr_iserr(res)) return res;
+
+    res = gh_cgroup_dtor(&thread->cgroup);
+    if (ghr_iserr(res)) return res;
     
     return GHR_OK;
 }
 
+gh_result gh_thread_dtor(gh_thread * thread, gh_result * out_subjailresult) {
+    if (thread->pid == 0) return GHR_OK;
+
+    gh_rpc_decthreadrefcount(thread->rpc);
+
+    gh_result quit_res = thread_requestquit(thread);
+    if (out_subjailresult != NULL) *out_subjailresult = quit_res;
+
+    return thread_release(thread);
+}
+
+gh_result gh_thread_dtormany(gh_thread * threads, size_t count, gh_result * out_subjailresults) {
+    if (count == 0) return GHR_OK;
+    bool waiting[count];
+    gh_result quit_results[count];
+
+    for (size_t i = 0; i < count; i++) {
+        waiting[i] = false;
+        quit_results[i] = GHR_OK;
+        if (threads[i].pid == 0) continue;
+
+        gh_rpc_decthreadrefcount(threads[i].rpc);
+
+        gh_ipcmsg_quit quit_msg;
+        memset(&quit_msg, 0, sizeof(gh_ipcmsg_quit));
+        quit_msg.type = GH_IPCMSG_QUIT;
+        gh_result res = gh_ipc_send(&threads[i].ipc, (gh_ipcmsg*)&quit_msg, sizeof(gh_ipcmsg_quit));
+
+        // if peer is already dead, there is nothing to wait for
+        if (ghr_is(res, GHR_IPC_PEERSHUTDOWN)) continue;
+        if (ghr_iserr(res)) quit_results[i] = res;
+        else waiting[i] = true;
+    }
+
+    thread_waitmany(threads, count, waiting, quit_results, GH_SANDBOX_TIMETOQUITMS);
+
+    gh_result res = GHR_OK;
+    for (size_t i = 0; i < count; i++) {
+        if (out_subjailresults != NULL) out_subjailresults[i] = quit_results[i];
+        if (threads[i].pid == 0) continue;
+
+        gh_result inner_res = thread_release(threads + i);
+        if (ghr_iserr(inner_res) && ghr_isok(res)) res = inner_res;
+    }
+
+    return res;
+}
+
 gh_result gh_thread_attachuserdata(gh_thread * thread, void * userdata) {
     thread->userdata = userdata;
     return GHR_OK;
 }
 
+gh_result gh_thread_setsched(gh_thread * thread, gh_threadsched policy, int nice) {
+    int sched_policy;
+    switch (policy) {
+    case GH_THREADSCHED_NORMAL: sched_policy = SCHED_OTHER; break;
+    case GH_THREADSCHED_BATCH: sched_policy = SCHED_BATCH; break;
+    case GH_THREADSCHED_IDLE: sched_policy = SCHED_IDLE; break;
+    default: return GHR_THREAD_BADSCHED;
+    }
+
+    struct sched_param param = { .sched_priority = 0 };
+    if (sched_setscheduler(thread->pid, sched_policy, &param) < 0) {
+        return ghr_errno(GHR_THREAD_SETSCHED);
+    }
+
+    if (policy != GH_THREADSCHED_IDLE) {
+        if (setpriority(PRIO_PROCESS, (id_t)thread->pid, nice) < 0) {
+            return ghr_errno(GHR_THREAD_SETPRIORITY);
+        }
+    }
+
+    return GHR_OK;
+}
+
 static gh_result thread_handlemsg_functioncall(gh_thread * thread, gh_ipcmsg_functioncall * msg) {
     gh_rpc * rpc = thread->rpc;
     gh_rpcframe frame;
     gh_result res = gh_rpc_newframefrommsg(rpc, thread, msg, &frame);
     if (ghr_is(res, GHR_RPC_MISSINGFUNC)) {
-        gh_result inner_res = gh_rpc_respondmissing(rpc, &thread->ipc);
+        gh_result inner_res = gh_rpc_respondmissing(rpc, &thread->ipc, msg);
         if (ghr_iserr(inner_res)) return inner_res;
     }
     if (ghr_iserr(res)) return res;
@@ -237,7 +672,6 @@ static gh_result thread_handlemsg_functioncall(gh_thread * thread, gh_ipcmsg_fun
 }
 
 static gh_result thread_handlemsg(gh_thread * thread, gh_ipcmsg * msg, gh_threadnotif * notif) {
-    (void)thread;
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wswitch-enum"
     // RATIONALE: Only a select few messages should ever be received by threads for security reasons.
@@ -250,6 +684,8 @@ static gh_result thread_handlemsg(gh_thread * thread, gh_ipcmsg * msg, gh_thread
             strncpy(notif->function.name, call_msg->name, GH_IPCMSG_FUNCTIONCALL_MAXNAME);
             notif->function.name[GH_IPCMSG_FUNCTIONCALL_MAXNAME - 1] = '\0';
         }
+        atomic_fetch_add(&thread->rpc_calls, 1);
+        atomic_fetch_add(&thread->sandbox->rpc_calls, 1);
         gh_result res = thread_handlemsg_functioncall(thread, call_msg);
         if (ghr_is(res, GHR_RPC_MISSINGFUNC)) {
             if (notif != NULL) notif->function.missing = true;
@@ -258,17 +694,27 @@ static gh_result thread_handlemsg(gh_thread * thread, gh_ipcmsg * msg, gh_thread
 
         return res;
 
-    case GH_IPCMSG_LUARESULT:
+    case GH_IPCMSG_LUARESULT: {
+        gh_ipcmsg_luaresult * result_msg = (gh_ipcmsg_luaresult *)msg;
+        atomic_store(&thread->lua_heap_bytes, result_msg->lua_heap_bytes);
+        atomic_store(&thread->lua_alloc_bytes, result_msg->lua_alloc_bytes);
+        atomic_fetch_add(&thread->scripts_completed, 1);
+        atomic_fetch_add(&thread->sandbox->scripts_completed, 1);
+
         if (notif != NULL) {
             notif->type = GH_THREADNOTIF_SCRIPTRESULT;
-            gh_ipcmsg_luaresult * result_msg = (gh_ipcmsg_luaresult *)msg;
             notif->script.result = result_msg->result;
             notif->script.id = result_msg->script_id;
             strncpy(notif->script.error_msg, result_msg->error_msg, GH_THREADNOTIF_SCRIPT_ERRORMSGMAX);
             notif->script.error_msg[GH_THREADNOTIF_SCRIPT_ERRORMSGMAX - 1] = '\0';
             notif->script.call_return_ptr = result_msg->return_ptr;
+            notif->script.cpu_ns = result_msg->cpu_ns;
+            notif->script.instructions = result_msg->instructions;
+            notif->script.total_cpu_ns = result_msg->total_cpu_ns;
+            notif->script.total_instructions = result_msg->total_instructions;
         }
         return GHR_OK;
+    }
 
     default:
         return GHR_THREAD_UNKNOWNMESSAGE;
@@ -289,99 +735,565 @@ gh_result gh_thread_process(gh_thread * thread, gh_threadnotif * notif) {
     return thread_handlemsg(thread, msg, notif);
 }
 
-gh_result gh_thread_runstring(gh_thread * thread, const char * s, size_t s_len, int * script_id) {
+static size_t thread_parkablesize(gh_ipcmsg * msg) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch-enum"
+    // RATIONALE: Only replies to requests are ever handed over between OS threads.
+    switch(msg->type) {
+    case GH_IPCMSG_LUAINFO: return sizeof(gh_ipcmsg_luainfo);
+    case GH_IPCMSG_LUARESULT: return sizeof(gh_ipcmsg_luaresult);
+    default: return 0;
+    }
+#pragma GCC diagnostic pop
+}
+
+// Must be called with dispatch_mutex held.
+static bool thread_isinflight(gh_thread * thread, int request_id) {
+    for (size_t i = 0; i < thread->inflight_count; i++) {
+        if (thread->inflight[i] == request_id) return true;
+    }
+    return false;
+}
+
+// Registers a request, so that replies to it are parked if another OS thread
+// receives them.
+static gh_result thread_addinflight(gh_thread * thread, int request_id) {
+    gh_result res = GHR_OK;
+
+    pthread_mutex_lock(&thread->dispatch_mutex);
+    if (thread->inflight_count == GH_THREAD_MAXINFLIGHT) res = GHR_THREAD_TOOMANYINFLIGHT;
+    else thread->inflight[thread->inflight_count++] = request_id;
+    pthread_mutex_unlock(&thread->dispatch_mutex);
+
+    return res;
+}
+
+static void thread_removeinflight(gh_thread * thread, int request_id) {
+    pthread_mutex_lock(&thread->dispatch_mutex);
+    for (size_t i = 0; i < thread->inflight_count; i++) {
+        if (thread->inflight[i] != request_id) continue;
+
+        thread->inflight[i] = thread->inflight[--thread->inflight_count];
+        break;
+    }
+    pthread_mutex_unlock(&thread->dispatch_mutex);
+}
+
+// Must be called with dispatch_mutex held.
+static bool thread_isparked(gh_thread * thread, int request_id, gh_ipcmsg_type type) {
+    for (gh_threadparkedmsg * parked = thread->parked_head; parked != NULL; parked = parked->next) {
+        gh_ipcmsg * msg = (gh_ipcmsg *)parked->data;
+        if (msg->type == type && gh_ipc_requestid(msg) == request_id) return true;
+    }
+    return false;
+}
+
+// Must be called with dispatch_mutex held.
+static gh_result thread_park(gh_thread * thread, gh_ipcmsg * msg) {
+    size_t size = thread_parkablesize(msg);
+    if (size == 0) return GHR_THREAD_UNEXPECTEDMESSAGE;
+
+    // RATIONALE: The subjail is untrusted. Replies nobody is waiting for (or
+    // duplicates) are dropped, so that it can't make the host allocate
+    // memory without bound.
+    int request_id = gh_ipc_requestid(msg);
+    if (!thread_isinflight(thread, request_id)) return GHR_OK;
+    if (thread_isparked(thread, request_id, msg->type)) return GHR_OK;
+    if (thread->parked_count >= GH_THREAD_MAXPARKED) return GHR_THREAD_TOOMANYPARKED;
+
+    gh_threadparkedmsg * parked;
+    gh_result res = gh_alloc_new(thread->rpc->alloc, (void**)&parked, sizeof(gh_threadparkedmsg) + size);
+    if (ghr_iserr(res)) return res;
+
+    parked->next = NULL;
+    parked->size = size;
+    memcpy(parked->data, msg, size);
+
+    if (thread->parked_tail != NULL) thread->parked_tail->next = parked;
+    else thread->parked_head = parked;
+    thread->parked_tail = parked;
+    thread->parked_count += 1;
+
+    return GHR_OK;
+}
+
+// Must be called with dispatch_mutex held.
+static bool thread_takeparked(gh_thread * thread, int request_id, gh_ipcmsg_type type, gh_ipcmsg * out_msg, gh_result * out_res) {
+    gh_threadparkedmsg * prev = NULL;
+    gh_threadparkedmsg * parked = thread->parked_head;
+
+    while (parked != NULL) {
+        gh_ipcmsg * msg = (gh_ipcmsg *)parked->data;
+        if (msg->type == type && gh_ipc_requestid(msg) == request_id) break;
+        prev = parked;
+        parked = parked->next;
+    }
+
+    if (parked == NULL) return false;
+
+    if (prev != NULL) prev->next = parked->next;
+    else thread->parked_head = parked->next;
+    if (thread->parked_tail == parked) thread->parked_tail = prev;
+    thread->parked_count -= 1;
+
+    memcpy(out_msg, parked->data, parked->size);
+    *out_res = gh_alloc_delete(thread->rpc->alloc, (void**)&parked, sizeof(gh_threadparkedmsg) + parked->size);
+    return true;
+}
+
+static bool thread_timedwait(gh_thread * thread, int timeout_ms) {
+    if (timeout_ms == GH_IPC_NOTIMEOUT) {
+        pthread_cond_wait(&thread->dispatch_cond, &thread->dispatch_mutex);
+        return true;
+    }
+
+    struct timespec deadline;
+    if (clock_gettime(CLOCK_MONOTONIC, &deadline) < 0) {
+        pthread_cond_wait(&thread->dispatch_cond, &thread->dispatch_mutex);
+        return true;
+    }
+
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    return pthread_cond_timedwait(&thread->dispatch_cond, &thread->dispatch_mutex, &deadline) != ETIMEDOUT;
+}
+
+// Waits for the message of the given type belonging to the given request.
+// At most one OS thread receives from the subjail at a time - it serves RPC
+// function calls and parks replies meant for other requests. The remaining
+// OS threads wait until their reply is parked or until they can take over
+// receiving. As with gh_ipc_recv, timeout_ms applies to every single message.
+static gh_result thread_await(gh_thread * thread, int request_id, gh_ipcmsg_type type, int timeout_ms, gh_ipcmsg * out_msg) {
+    gh_result res = GHR_OK;
+
+    pthread_mutex_lock(&thread->dispatch_mutex);
+    while (true) {
+        if (thread_takeparked(thread, request_id, type, out_msg, &res)) break;
+
+        if (thread->dispatch_receiving) {
+            if (!thread_timedwait(thread, timeout_ms)) {
+                res = GHR_IPC_RECVMSGTIMEOUT;
+                break;
+            }
+            continue;
+        }
+
+        thread->dispatch_receiving = true;
+        pthread_mutex_unlock(&thread->dispatch_mutex);
+
+        res = gh_ipc_recv(&thread->ipc, out_msg, timeout_ms);
+
+        pthread_mutex_lock(&thread->dispatch_mutex);
+        thread->dispatch_receiving = false;
+        pthread_cond_broadcast(&thread->dispatch_cond);
+
+        if (ghr_iserr(res)) break;
+
+        // The receiver role is handed over before serving the call, so that
+        // other requests can make progress while the RPC function runs.
+        if (out_msg->type == GH_IPCMSG_FUNCTIONCALL) {
+            pthread_mutex_unlock(&thread->dispatch_mutex);
+            res = thread_handlemsg(thread, out_msg, NULL);
+            pthread_mutex_lock(&thread->dispatch_mutex);
+
+            if (ghr_iserr(res)) break;
+            continue;
+        }
+
+        if (out_msg->type == type && gh_ipc_requestid(out_msg) == request_id) break;
+
+        res = thread_park(thread, out_msg);
+        if (ghr_iserr(res)) break;
+    }
+    pthread_mutex_unlock(&thread->dispatch_mutex);
+
+    return res;
+}
+
+// Sends a request and waits for the LUAINFO message that acknowledges it.
+// The request stays in flight until thread_syncscript picks up its result or
+// thread_removeinflight is called.
+static gh_result thread_request(gh_thread * thread, gh_ipcmsg * msg, size_t msg_size, int request_id, int * out_script_id) {
+    gh_result res = thread_addinflight(thread, request_id);
+    if (ghr_iserr(res)) return res;
+
+    res = gh_ipc_send(&thread->ipc, msg, msg_size);
+    if (ghr_iserr(res)) {
+        thread_removeinflight(thread, request_id);
+        return res;
+    }
+
+    GH_IPCMSG_BUFFER(response_msgbuf);
+    res = thread_await(thread, request_id, GH_IPCMSG_LUAINFO, GH_THREAD_LUAINFO_TIMEOUTMS, (gh_ipcmsg *)response_msgbuf);
+    if (ghr_iserr(res)) thread_removeinflight(thread, request_id);
+    if (ghr_is(res, GHR_THREAD_UNEXPECTEDMESSAGE)) return GHR_THREAD_EXPECTEDLUAINFO;
+    if (ghr_iserr(res)) return res;
+
+    if (out_script_id != NULL) *out_script_id = ((gh_ipcmsg_luainfo *)response_msgbuf)->script_id;
+    return GHR_OK;
+}
+
+static gh_result thread_syncscript(gh_thread * thread, int request_id, gh_threadnotif_script * out_status) {
+    if (out_status != NULL) *out_status = (gh_threadnotif_script) {0};
+
+    GH_IPCMSG_BUFFER(msg_buf);
+    gh_result res = thread_await(thread, request_id, GH_IPCMSG_LUARESULT, thread->default_timeout_ms, (gh_ipcmsg *)msg_buf);
+    thread_removeinflight(thread, request_id);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif notif = {0};
+    res = thread_handlemsg(thread, (gh_ipcmsg *)msg_buf, &notif);
+    if (ghr_iserr(res)) return res;
+
+    if (out_status != NULL) *out_status = notif.script;
+    return res;
+}
+
+static gh_result thread_runbytecode(gh_thread * thread, int tenant_id, int deadline_ms, int fd, const char * chunk_name, int * out_request_id, int * script_id) {
+    gh_ipcmsg_luafile msg = {0};
+    msg.type = GH_IPCMSG_LUAFILE;
+    msg.request_id = thread_newrequestid(thread);
+    msg.tenant_id = tenant_id;
+    msg.deadline_ms = deadline_ms;
+    msg.fd = fd;
+    msg.positional = true;
+    strncpy(msg.chunk_name, chunk_name, GH_IPCMSG_LUAFILE_CHUNKNAMEMAX);
+    msg.chunk_name[GH_IPCMSG_LUAFILE_CHUNKNAMEMAX - 1] = '\0';
+
+    *out_request_id = msg.request_id;
+    return thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luafile), msg.request_id, script_id);
+}
+
+// Returns true if the script should be compiled by the subjail instead,
+// because it didn't compile (so that the subjail reports the error) or
+// because the cache is full.
+static bool thread_bytecodefallback(gh_result res) {
+    return ghr_is(res, GHR_BYTECODECACHE_COMPILE) || ghr_is(res, GHR_BYTECODECACHE_FULL);
+}
+
+static gh_result thread_runstring(gh_thread * thread, int tenant_id, int deadline_ms, const char * s, size_t s_len, int * out_request_id, int * script_id) {
     if (s_len > GH_IPCMSG_LUASTRING_MAXSIZE - 1) {
         return GHR_THREAD_LARGESTRING;
     }
 
+    if (thread->bytecode_cache != NULL) {
+        // same chunk name as the subjail uses for strings
+        int bytecode_fd;
+        gh_result res = gh_bytecodecache_load(thread->bytecode_cache, "string", s, s_len, &bytecode_fd);
+        if (ghr_isok(res)) return thread_runbytecode(thread, tenant_id, deadline_ms, bytecode_fd, "string", out_request_id, script_id);
+        if (!thread_bytecodefallback(res)) return res;
+    }
+
     gh_ipcmsg_luastring msg = {0};
     msg.type = GH_IPCMSG_LUASTRING;
+    msg.request_id = thread_newrequestid(thread);
+    msg.tenant_id = tenant_id;
+    msg.deadline_ms = deadline_ms;
     strncpy(msg.content, s, s_len);
     msg.content[s_len] = '\0';
 
-    gh_result res = gh_ipc_send(&thread->ipc, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luastring));
+    *out_request_id = msg.request_id;
+    return thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luastring), msg.request_id, script_id);
+}
+
+gh_result gh_thread_runstring(gh_thread * thread, const char * s, size_t s_len, int * script_id) {
+    int request_id;
+    gh_result res = thread_runstring(thread, GH_IPC_NOTENANT, thread->default_deadline_ms, s, s_len, &request_id, script_id);
     if (ghr_iserr(res)) return res;
 
-    GH_IPCMSG_BUFFER(response_msgbuf);
-    res = gh_ipc_recv(&thread->ipc, (gh_ipcmsg *)response_msgbuf, GH_THREAD_LUAINFO_TIMEOUTMS);
+    // the result is received with gh_thread_process instead
+    thread_removeinflight(thread, request_id);
+    return GHR_OK;
+}
+
+gh_result gh_thread_runstringsync(gh_thread * thread, const char * s, size_t s_len, gh_threadnotif_script * out_status) {
+    return gh_thread_runstringsyncopts(thread, s, s_len, thread_defaultrequestoptions(thread), out_status);
+}
+
+gh_result gh_thread_runstringsyncopts(gh_thread * thread, const char * s, size_t s_len, gh_threadrequestoptions options, gh_threadnotif_script * out_status) {
+    int request_id;
+    gh_result res = thread_runstring(thread, GH_IPC_NOTENANT, options.deadline_ms, s, s_len, &request_id, NULL);
+    if (ghr_iserr(res)) return res;
+
+    if (options.out_request_id != NULL) atomic_store(options.out_request_id, request_id);
+    return thread_syncscript(thread, request_id, out_status);
+}
+
+gh_result gh_thread_cancel(gh_thread * thread, int request_id) {
+    gh_ipcmsg_luacancel msg = {
+        .type = GH_IPCMSG_LUACANCEL,
+        .request_id = request_id
+    };
+    return gh_ipc_send(&thread->ipc, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luacancel));
+}
+
+gh_result gh_thread_reset(gh_thread * thread) {
+    gh_ipcmsg_luareset msg = {
+        .type = GH_IPCMSG_LUARESET,
+        .request_id = thread_newrequestid(thread)
+    };
+
+    gh_result res = thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luareset), msg.request_id, NULL);
     if (ghr_iserr(res)) return res;
-    if (((gh_ipcmsg *)response_msgbuf)->type != GH_IPCMSG_LUAINFO) return GHR_THREAD_EXPECTEDLUAINFO;
 
-    if (script_id != NULL) *script_id = ((gh_ipcmsg_luainfo *)response_msgbuf)->script_id;
+    gh_threadnotif_script status = {0};
+    res = thread_syncscript(thread, msg.request_id, &status);
+    if (ghr_iserr(res)) return res;
+    if (ghr_iserr(status.result)) return status.result;
+
+    return gh_perms_reset(&thread->perms);
+}
+
+gh_result gh_thread_setgc(gh_thread * thread, gh_threadgcoptions options) {
+    gh_ipcmsg_luagc msg = {
+        .type = GH_IPCMSG_LUAGC,
+        .request_id = thread_newrequestid(thread),
+        .pause = options.pause,
+        .stepmul = options.stepmul,
+        .stop_during_calls = options.stop_during_calls,
+        .idle = (gh_ipcmsg_luagc_idle)options.idle,
+        .idle_step_kb = options.idle_step_kb
+    };
+
+    gh_result res = thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luagc), msg.request_id, NULL);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif_script status = {0};
+    res = thread_syncscript(thread, msg.request_id, &status);
+    if (ghr_iserr(res)) return res;
+
+    return status.result;
+}
+
+gh_result gh_thread_trim(gh_thread * thread) {
+    gh_ipcmsg_luatrim msg = {
+        .type = GH_IPCMSG_LUATRIM,
+        .request_id = thread_newrequestid(thread)
+    };
+
+    gh_result res = thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luatrim), msg.request_id, NULL);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif_script status = {0};
+    res = thread_syncscript(thread, msg.request_id, &status);
+    if (ghr_iserr(res)) return res;
+
+    return status.result;
+}
+
+// Opens the path of a PermFS entry for a Landlock rule, or sets out_fd to -1
+// if there's nothing at the path the entry applies to.
+static gh_result thread_landlockopen(gh_thread * thread, gh_abscanonicalpath path, int * out_fd, bool * out_directory) {
+    *out_fd = -1;
+    *out_directory = false;
+
+    int fd = open(path.ptr, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT || errno == ENOTDIR || errno == ELOOP) return GHR_OK;
+        return ghr_errno(GHR_LANDLOCK_OPENPATH);
+    }
+
+    gh_result res = GHR_OK;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) {
+        res = ghr_errno(GHR_LANDLOCK_OPENPATH);
+        goto fail;
+    }
+    if (!S_ISREG(statbuf.st_mode) && !S_ISDIR(statbuf.st_mode)) goto fail;
+
+    // RATIONALE: If the path contains symlinks by now, the fd refers to
+    // another node, and the entry doesn't match anything (see gh_permfs_ident).
+    gh_pathfd pathfd = { .fd = fd, .trailing_name = {0} };
+    gh_abscanonicalpath fd_path;
+    res = gh_procfd_fdpathctor(&thread->perms.procfd, pathfd, &fd_path);
+    if (ghr_iserr(res)) goto fail;
+    bool same_path = fd_path.len == path.len && strncmp(fd_path.ptr, path.ptr, path.len) == 0;
+    res = gh_procfd_fdpathdtor(&thread->perms.procfd, &fd_path);
+    if (ghr_iserr(res) || !same_path) goto fail;
+
+    *out_fd = fd;
+    *out_directory = S_ISDIR(statbuf.st_mode);
     return GHR_OK;
+
+fail:
+    close(fd);
+    return res;
 }
 
-static gh_result thread_syncscript(gh_thread * thread, int script_id, gh_threadnotif_script * out_status) {
-    if (out_status != NULL) *out_status = (gh_threadnotif_script) {0};
+gh_result gh_thread_landlock(gh_thread * thread) {
+    if (!thread->landlock) return GHR_LANDLOCK_UNAVAILABLE;
+
+    gh_ipcmsg_landlock msg = {
+        .type = GH_IPCMSG_LANDLOCK,
+        .request_id = thread_newrequestid(thread),
+        .op = GH_IPCMSG_LANDLOCK_ADDRULE,
+        .fd = -1,
+        .mode = GH_PERMFS_NONE
+    };
+
     gh_result res = GHR_OK;
+    gh_permfs * permfs = &thread->perms.filesystem;
+    for (size_t i = 0; i < permfs->file_perms.size; i++) {
+        gh_permfs_entry * entry = permfs->file_perms.buffer + i;
+        // most entries of a typical policy don't accept anything
+        if (entry->self.mode_accept == GH_PERMFS_NONE) continue;
+
+        int fd;
+        bool directory;
+        res = thread_landlockopen(thread, entry->ident.path, &fd, &directory);
+        if (ghr_iserr(res)) return res;
+        if (fd < 0) continue;
 
-    while (true) {
-        gh_threadnotif notif = {0};
-        res = gh_thread_process(thread, &notif);
+        msg.fd = fd;
+        msg.mode = gh_permfs_unconditionalmode(permfs, entry, directory);
+        if (msg.mode != GH_PERMFS_NONE) {
+            res = gh_ipc_send(&thread->ipc, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_landlock));
+        }
+        close(fd);
         if (ghr_iserr(res)) return res;
+    }
+
+    msg.op = GH_IPCMSG_LANDLOCK_RESTRICT;
+    msg.fd = -1;
+    msg.mode = GH_PERMFS_NONE;
+    res = thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_landlock), msg.request_id, NULL);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif_script status = {0};
+    res = thread_syncscript(thread, msg.request_id, &status);
+    if (ghr_iserr(res)) return res;
+
+    return status.result;
+}
+
+#define THREAD_READFILE_INITIALSIZE 4096
+
+// Reads the rest of the file starting at its current offset.
+static gh_result thread_readfile(gh_thread * thread, int fd, char ** out_buffer, size_t * out_capacity, size_t * out_size) {
+    size_t capacity = THREAD_READFILE_INITIALSIZE;
+    size_t size = 0;
+    char * buffer = NULL;
+
+    gh_result res = gh_alloc_new(thread->rpc->alloc, (void**)&buffer, capacity);
+    if (ghr_iserr(res)) return res;
+
+    while (true) {
+        if (size == capacity) {
+            res = gh_alloc_resize(thread->rpc->alloc, (void**)&buffer, capacity, capacity * 2);
+            if (ghr_iserr(res)) goto fail;
+            capacity *= 2;
+        }
 
-        if (notif.type == GH_THREADNOTIF_SCRIPTRESULT && notif.script.id == script_id) {
-            if (out_status != NULL) *out_status = notif.script;
-            break;
+        ssize_t readn = read(fd, buffer + size, capacity - size);
+        if (readn < 0) {
+            res = ghr_errno(GHR_THREAD_READFILE);
+            goto fail;
         }
+        if (readn == 0) break;
+
+        size += (size_t)readn;
     }
 
+    *out_buffer = buffer;
+    *out_capacity = capacity;
+    *out_size = size;
+    return GHR_OK;
+
+fail:
+    gh_alloc_delete(thread->rpc->alloc, (void**)&buffer, capacity);
     return res;
 }
 
-gh_result gh_thread_runstringsync(gh_thread * thread, const char * s, size_t s_len, gh_threadnotif_script * out_status) {
-    int script_id = -1;
-    gh_result res = gh_thread_runstring(thread, s, s_len, &script_id);
+// Sets *out_handled to false if the file should be sent to the subjail as is.
+static gh_result thread_runfilecached(gh_thread * thread, int fd, int * out_request_id, int * script_id, bool * out_handled) {
+    *out_handled = false;
+
+    // RATIONALE: Files that can't be rewound (pipes, sockets) can't be passed
+    // on to the subjail after they have been read, so they aren't cached.
+    off_t start_offset = lseek(fd, 0, SEEK_CUR);
+    if (start_offset < 0) return GHR_OK;
+
+    char * buffer;
+    size_t capacity;
+    size_t size;
+    gh_result res = thread_readfile(thread, fd, &buffer, &capacity, &size);
     if (ghr_iserr(res)) return res;
 
-    return thread_syncscript(thread, script_id, out_status);
+    int bytecode_fd;
+    res = gh_bytecodecache_load(thread->bytecode_cache, thread->safe_id, buffer, size, &bytecode_fd);
+
+    gh_result inner_res = gh_alloc_delete(thread->rpc->alloc, (void**)&buffer, capacity);
+    if (ghr_isok(res) && ghr_iserr(inner_res)) res = inner_res;
+
+    if (ghr_isok(res)) {
+        *out_handled = true;
+        return thread_runbytecode(thread, GH_IPC_NOTENANT, thread->default_deadline_ms, bytecode_fd, thread->safe_id, out_request_id, script_id);
+    }
+
+    if (!thread_bytecodefallback(res)) return res;
+
+    if (lseek(fd, start_offset, SEEK_SET) < 0) return ghr_errno(GHR_THREAD_SEEKFILE);
+    return GHR_OK;
 }
 
-gh_result gh_thread_runfile(gh_thread * thread, int fd, int * script_id) {
+static gh_result thread_runfile(gh_thread * thread, int fd, int * out_request_id, int * script_id) {
+    if (thread->bytecode_cache != NULL) {
+        bool handled;
+        gh_result res = thread_runfilecached(thread, fd, out_request_id, script_id, &handled);
+        if (ghr_iserr(res) || handled) return res;
+    }
+
     gh_ipcmsg_luafile msg = {0};
     msg.type = GH_IPCMSG_LUAFILE;
+    msg.request_id = thread_newrequestid(thread);
+    msg.tenant_id = GH_IPC_NOTENANT;
+    msg.deadline_ms = thread->default_deadline_ms;
     msg.fd = fd;
+    msg.positional = false;
     strncpy(msg.chunk_name, thread->safe_id, GH_IPCMSG_LUAFILE_CHUNKNAMEMAX);
     msg.chunk_name[GH_IPCMSG_LUAFILE_CHUNKNAMEMAX - 1] = '\0';
 
-    gh_result res = gh_ipc_send(&thread->ipc, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luafile));
-    if (ghr_iserr(res)) return res;
+    *out_request_id = msg.request_id;
+    return thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luafile), msg.request_id, script_id);
+}
 
-    GH_IPCMSG_BUFFER(response_msgbuf);
-    res = gh_ipc_recv(&thread->ipc, (gh_ipcmsg *)response_msgbuf, GH_THREAD_LUAINFO_TIMEOUTMS);
+gh_result gh_thread_runfile(gh_thread * thread, int fd, int * script_id) {
+    int request_id;
+    gh_result res = thread_runfile(thread, fd, &request_id, script_id);
     if (ghr_iserr(res)) return res;
-    if (((gh_ipcmsg *)response_msgbuf)->type != GH_IPCMSG_LUAINFO) return GHR_THREAD_EXPECTEDLUAINFO;
 
-    if (script_id != NULL) *script_id = ((gh_ipcmsg_luainfo *)response_msgbuf)->script_id;
+    // the result is received with gh_thread_process instead
+    thread_removeinflight(thread, request_id);
     return GHR_OK;
 }
 
 gh_result gh_thread_runfilesync(gh_thread * thread, int fd, gh_threadnotif_script * out_status) {
-    int script_id = -1;
-    gh_result res = gh_thread_runfile(thread, fd, &script_id);
+    int request_id;
+    gh_result res = thread_runfile(thread, fd, &request_id, NULL);
     if (ghr_iserr(res)) return res;
 
-    return thread_syncscript(thread, script_id, out_status);
+    return thread_syncscript(thread, request_id, out_status);
 }
 
-static gh_result thread_sethostvariable(gh_thread * thread, const char * name, const int table_index, gh_ipcmsg_luahostvariable * msg, int * out_script_id) {
+static gh_result thread_sethostvariable(gh_thread * thread, const char * name, const int table_index, gh_ipcmsg_luahostvariable * msg) {
     if (strlen(name) >= GH_IPCMSG_LUAHOSTVARIABLE_NAMEMAX - 1) {
         return GHR_THREAD_LARGEHOSTVARNAME;
     }
     strcpy(msg->name, name);
 
     msg->table_index = table_index;
+    msg->request_id = thread_newrequestid(thread);
 
-    gh_result res = gh_ipc_send(&thread->ipc, (gh_ipcmsg*)msg, sizeof(gh_ipcmsg_luahostvariable));
+    gh_result res = thread_request(thread, (gh_ipcmsg*)msg, sizeof(gh_ipcmsg_luahostvariable), msg->request_id, NULL);
     if (ghr_iserr(res)) return res;
 
-    GH_IPCMSG_BUFFER(response_msgbuf);
-    res = gh_ipc_recv(&thread->ipc, (gh_ipcmsg *)response_msgbuf, GH_THREAD_LUAINFO_TIMEOUTMS);
-    if (ghr_iserr(res)) return res;
-    if (((gh_ipcmsg *)response_msgbuf)->type != GH_IPCMSG_LUAINFO) return GHR_THREAD_EXPECTEDLUAINFO;
-
-    if (out_script_id != NULL) *out_script_id = ((gh_ipcmsg_luainfo *)response_msgbuf)->script_id;
-    return GHR_OK;
+    return thread_syncscript(thread, msg->request_id, NULL);
 }
 
 gh_result gh_thread_setint(gh_thread * thread, const char * name, int value) {
@@ -391,10 +1303,7 @@ gh_result gh_thread_setint(gh_thread * thread, const char * name, int value) {
     };
     msg.t_integer = value;
 
-    int script_id = -1;
-    gh_result res = thread_sethostvariable(thread, name, 0, &msg, &script_id);
-    if (ghr_iserr(res)) return res;
-    return thread_syncscript(thread, script_id, NULL);
+    return thread_sethostvariable(thread, name, 0, &msg);
 }
 
 
@@ -405,10 +1314,7 @@ gh_result gh_thread_setdouble(gh_thread * thread, const char * name, double valu
     };
     msg.t_double = value;
 
-    int script_id = -1;
-    gh_result res = thread_sethostvariable(thread, name, 0, &msg, &script_id);
-    if (ghr_iserr(res)) return res;
-    return thread_syncscript(thread, script_id, NULL);
+    return thread_sethostvariable(thread, name, 0, &msg);
 }
 
 static gh_result thread_setlstring_table(gh_thread * thread, const char * name, const char * string, size_t len, int table_index) {
@@ -423,10 +1329,7 @@ static gh_result thread_setlstring_table(gh_thread * thread, const char * name,
     msg.t_string.len = len;
     strncpy(msg.t_string.buffer, string, len);
 
-    int script_id = -1;
-    gh_result res = thread_sethostvariable(thread, name, table_index, &msg, &script_id);
-    if (ghr_iserr(res)) return res;
-    return thread_syncscript(thread, script_id, NULL);
+    return thread_sethostvariable(thread, name, table_index, &msg);
 }
 
 gh_result gh_thread_setlstring(gh_thread * thread, const char * name, const char * string, size_t len) {
@@ -599,7 +1502,7 @@ gh_result gh_thread_callframe_dtor(gh_thread_callframe * frame) {
     return gh_fdmem_dtor(&frame->fdmem);
 }
 
-gh_result gh_thread_call(gh_thread * thread, const char * name, gh_thread_callframe * frame, gh_threadnotif_script * out_script_result) {
+static gh_result thread_call(gh_thread * thread, int tenant_id, const char * name, gh_thread_callframe * frame, gh_threadrequestoptions options, gh_threadnotif_script * out_script_result) {
     if (out_script_result != NULL) *out_script_result = (gh_threadnotif_script){0};
 
     size_t name_len = strlen(name);
@@ -607,6 +1510,9 @@ gh_result gh_thread_call(gh_thread * thread, const char * name, gh_thread_callfr
 
     gh_ipcmsg_luacall msg = {
         .type = GH_IPCMSG_LUACALL,
+        .request_id = thread_newrequestid(thread),
+        .tenant_id = tenant_id,
+        .deadline_ms = options.deadline_ms,
         .ipcfdmem_fd = frame->fdmem.fd
     };
 
@@ -616,21 +1522,162 @@ gh_result gh_thread_call(gh_thread * thread, const char * name, gh_thread_callfr
 
     msg.ipcfdmem_occupied = frame->fdmem.occupied;
 
-    gh_result res = gh_ipc_send(&thread->ipc, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luacall));
+    gh_result res = thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luacall), msg.request_id, NULL);
     if (ghr_iserr(res)) return res;
 
-    GH_IPCMSG_BUFFER(response_msgbuf);
-    res = gh_ipc_recv(&thread->ipc, (gh_ipcmsg *)response_msgbuf, GH_THREAD_LUAINFO_TIMEOUTMS);
-    if (ghr_iserr(res)) return res;
-    if (((gh_ipcmsg *)response_msgbuf)->type != GH_IPCMSG_LUAINFO) {
-        return GHR_THREAD_EXPECTEDLUAINFO;
-    }
+    if (options.out_request_id != NULL) atomic_store(options.out_request_id, msg.request_id);
 
-    int script_id = ((gh_ipcmsg_luainfo *)response_msgbuf)->script_id;
     gh_threadnotif_script script_result = {0};
-    res = thread_syncscript(thread, script_id, &script_result);
+    res = thread_syncscript(thread, msg.request_id, &script_result);
     if (ghr_iserr(res)) return res;
 
     if (out_script_result != NULL) *out_script_result = script_result;
     return gh_thread_callframe_loadreturnvalue(frame, script_result.call_return_ptr);
 }
+
+gh_result gh_thread_call(gh_thread * thread, const char * name, gh_thread_callframe * frame, gh_threadnotif_script * out_script_result) {
+    return thread_call(thread, GH_IPC_NOTENANT, name, frame, thread_defaultrequestoptions(thread), out_script_result);
+}
+
+gh_result gh_thread_callopts(gh_thread * thread, const char * name, gh_thread_callframe * frame, gh_threadrequestoptions options, gh_threadnotif_script * out_script_result) {
+    return thread_call(thread, GH_IPC_NOTENANT, name, frame, options, out_script_result);
+}
+
+gh_result gh_thread_compile(gh_thread * thread, const char * chunk_name, const char * source, size_t source_len, gh_thread_callframe * frame, gh_threadnotif_script * out_status) {
+    if (out_status != NULL) *out_status = (gh_threadnotif_script){0};
+
+    if (strlen(chunk_name) > GH_IPCMSG_LUAFILE_CHUNKNAMEMAX - 1) return GHR_BYTECODECACHE_LARGECHUNKNAME;
+
+    gh_ipcmsg_luacompile msg = {
+        .type = GH_IPCMSG_LUACOMPILE,
+        .request_id = thread_newrequestid(thread),
+        .ipcfdmem_fd = frame->fdmem.fd,
+        .source_size = source_len
+    };
+    strcpy(msg.chunk_name, chunk_name);
+
+    // the source is placed at the very beginning of the frame
+    if (frame->fdmem.occupied != 0) return GHR_THREAD_CALLPARAMFAIL;
+    if (source_len > 0) {
+        void * source_copy;
+        gh_result res = gh_fdmem_new(&frame->fdmem, source_len, &source_copy);
+        if (ghr_iserr(res)) return res;
+        memcpy(source_copy, source, source_len);
+    }
+    msg.ipcfdmem_occupied = frame->fdmem.occupied;
+
+    gh_result res = thread_request(thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luacompile), msg.request_id, NULL);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif_script status = {0};
+    res = thread_syncscript(thread, msg.request_id, &status);
+    if (ghr_iserr(res)) return res;
+
+    if (out_status != NULL) *out_status = status;
+    return gh_thread_callframe_loadreturnvalue(frame, status.call_return_ptr);
+}
+
+static gh_result threadtenant_request(gh_threadtenant * tenant, gh_ipcmsg_luatenant_op op) {
+    gh_ipcmsg_luatenant msg = {
+        .type = GH_IPCMSG_LUATENANT,
+        .request_id = thread_newrequestid(tenant->thread),
+        .tenant_id = tenant->id,
+        .op = op
+    };
+
+    gh_result res = thread_request(tenant->thread, (gh_ipcmsg*)&msg, sizeof(gh_ipcmsg_luatenant), msg.request_id, NULL);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif_script status = {0};
+    res = thread_syncscript(tenant->thread, msg.request_id, &status);
+    if (ghr_iserr(res)) return res;
+
+    return status.result;
+}
+
+gh_result gh_thread_stats(gh_thread * thread, gh_threadstats * out_stats) {
+    gh_procstat procstat;
+    gh_result res = gh_procstat_read(thread->pid, &procstat);
+    if (ghr_iserr(res)) return res;
+
+    // RATIONALE: Once the subjail is reaped, its PID may be reused and the
+    // numbers read may be those of an unrelated process. The pidfd only
+    // reports the PID until then, so checking it after the read covers it.
+    pid_t pidfd_pid;
+    res = gh_procstat_pidfdpid(thread->pidfd, &pidfd_pid);
+    if (ghr_is(res, GHR_PROCSTAT_NOTPIDFD)) return GHR_THREAD_EXITED;
+    if (ghr_iserr(res)) return res;
+    if (pidfd_pid != thread->pid) return GHR_THREAD_EXITED;
+
+    out_stats->lua_heap_bytes = atomic_load(&thread->lua_heap_bytes);
+    out_stats->lua_alloc_bytes = atomic_load(&thread->lua_alloc_bytes);
+    out_stats->rss_bytes = procstat.rss_bytes;
+    out_stats->cpu_ns = procstat.cpu_ns;
+    gh_ipccounters_stats(&thread->ipc.counters, &out_stats->ipc);
+    out_stats->rpc_calls = atomic_load(&thread->rpc_calls);
+    out_stats->scripts_completed = atomic_load(&thread->scripts_completed);
+    out_stats->native_opens = atomic_load(&thread->open_supervisor.opens);
+
+    gh_cgroupstats cgroupstats = {0};
+    if (gh_cgroup_active(&thread->cgroup)) {
+        res = gh_cgroup_stats(&thread->cgroup, &cgroupstats);
+        if (ghr_iserr(res)) return res;
+    }
+    out_stats->cgroup_memory_bytes = cgroupstats.memory_bytes;
+    out_stats->cgroup_cpu_ns = cgroupstats.cpu_ns;
+    return GHR_OK;
+}
+
+static void threadtenant_account(gh_threadtenant * tenant, const gh_threadnotif_script * status) {
+    atomic_fetch_add(&tenant->requests, 1);
+    atomic_fetch_add(&tenant->cpu_ns, status->cpu_ns);
+    atomic_fetch_add(&tenant->instructions, status->instructions);
+}
+
+gh_result gh_threadtenant_ctor(gh_threadtenant * tenant, gh_thread * thread) {
+    tenant->thread = thread;
+
+    int id;
+    do {
+        id = (atomic_fetch_add(&thread->tenant_counter, 1) + 1) & INT_MAX;
+    } while (id == GH_IPC_NOTENANT);
+    tenant->id = id;
+
+    atomic_store(&tenant->requests, 0);
+    atomic_store(&tenant->cpu_ns, 0);
+    atomic_store(&tenant->instructions, 0);
+
+    return threadtenant_request(tenant, GH_IPCMSG_LUATENANT_NEW);
+}
+
+gh_result gh_threadtenant_dtor(gh_threadtenant * tenant) {
+    return threadtenant_request(tenant, GH_IPCMSG_LUATENANT_FREE);
+}
+
+gh_result gh_threadtenant_runstringsync(gh_threadtenant * tenant, const char * s, size_t s_len, gh_threadnotif_script * out_status) {
+    int request_id;
+    gh_result res = thread_runstring(tenant->thread, tenant->id, tenant->thread->default_deadline_ms, s, s_len, &request_id, NULL);
+    if (ghr_iserr(res)) return res;
+
+    gh_threadnotif_script status = {0};
+    res = thread_syncscript(tenant->thread, request_id, &status);
+    if (ghr_iserr(res)) return res;
+
+    threadtenant_account(tenant, &status);
+    if (out_status != NULL) *out_status = status;
+    return res;
+}
+
+gh_result gh_threadtenant_call(gh_threadtenant * tenant, const char * name, gh_thread_callframe * frame, gh_threadnotif_script * out_status) {
+    gh_threadnotif_script status = {0};
+    gh_result res = thread_call(tenant->thread, tenant->id, name, frame, thread_defaultrequestoptions(tenant->thread), &status);
+    if (ghr_isok(res)) threadtenant_account(tenant, &status);
+    if (out_status != NULL) *out_status = status;
+    return res;
+}
+
+void gh_threadtenant_usage(gh_threadtenant * tenant, gh_threadtenantusage * out_usage) {
+    out_usage->requests = atomic_load(&tenant->requests);
+    out_usage->cpu_ns = atomic_load(&tenant->cpu_ns);
+    out_usage->instructions = atomic_load(&tenant->instructions);
+}
@@ -5,10 +5,7 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <limits.h>
-#include <linux/bpf_common.h>
 #include <linux/seccomp.h>
-#include <linux/filter.h>
-#include <linux/audit.h>
 #include <sys/wait.h>
 #include <sys/ptrace.h>
 #include <sys/prctl.h>
@@ -16,6 +13,7 @@
 #include <sys/syscall.h>
 #include <sys/resource.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <stddef.h>
 #include <unistd.h>
 #include <string.h>
@@ -23,9 +21,11 @@
 #include <ghost/sandbox.h>
 #include <ghost/ipc.h>
 #include <ghost/alloc.h>
+#include <ghost/cpuset.h>
 
 #include <jail/jail.h>
 #include <jail/subjail.h>
+#include <jail/seccomp.h>
 
 gh_sandboxoptions gh_global_sandboxoptions;
 
@@ -39,11 +39,12 @@ static bool message_recv(gh_ipc * ipc, gh_ipcmsg * msg) {
         gh_jail_printf("jail: received request to exit\n");
         return true;
 
+    case GH_IPCMSG_SUBJAILPIDFD: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
     case GH_IPCMSG_SUBJAILALIVE: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
     case GH_IPCMSG_NEWSUBJAIL:
         gh_jail_printf("jail: creating new subjail\n");
         int sockfd = ((gh_ipcmsg_newsubjail *)msg)->sockfd;
-        gh_subjail_spawn(sockfd, getpid(), ipc);
+        gh_subjail_spawn(sockfd, getpid(), ipc, ((gh_ipcmsg_newsubjail *)msg)->landlock);
         if (close(sockfd) < 0) ghr_fail(GHR_JAIL_CLOSEFDFAIL);
         break;
 
@@ -139,99 +140,26 @@ int main(int argc, char ** argv) {
 }
 
 gh_result gh_jail_lockdown(gh_sandboxoptions * options) {
+    // RATIONALE: Not part of the security policy, but sched_setaffinity isn't
+    // allowed by the filter. Subjails inherit the affinity of the jail.
+    if (!gh_cpuset_isempty(&options->cpuset)) {
+        gh_result res = gh_cpuset_apply(&options->cpuset, 0);
+        if (ghr_iserr(res)) return res;
+    }
+
     char * gh_sandbox = getenv("GH_SANDBOX_DISABLED");
     if (gh_sandbox != NULL && strcmp(gh_sandbox, "1") == 0) {
         gh_jail_printf("jail: SANDBOX DISABLED\n");
         return GHR_OK;
     }
 
-    static const struct sock_filter filter[] = {
-        BPF_STMT(BPF_LD + BPF_W + BPF_ABS, (offsetof(struct seccomp_data, arch))),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, AUDIT_ARCH_X86_64, 1, 0),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL_PROCESS),
-
-
-        BPF_STMT(BPF_LD + BPF_W + BPF_ABS, (offsetof(struct seccomp_data, nr))),
-        /* BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_mmap, 0, 1), */
-        /* BPF_STMT(BPF_LD + BPF_W + BPF_ABS, (offsetof(struct seccomp_data, ar))), */
-        
-
-        // fcntl is used by fdopen (which we want), but glibc fdopen calls
-        // fnctl to verify that the fd is readable/writable per the mode
-        // so we let fcntl through only if the second argument is F_GETFL
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_fcntl, 0, 4),
-        BPF_STMT(BPF_LD + BPF_W + BPF_ABS, (offsetof(struct seccomp_data, args[1]))),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, F_GETFL, 0, 1),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL_PROCESS),
-
-        // When a pseudoterminal is used with fdopen, ioctl with TCGETS
-        // is used instead of the fcntl above
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_ioctl, 0, 4),
-        BPF_STMT(BPF_LD + BPF_W + BPF_ABS, (offsetof(struct seccomp_data, args[1]))),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, TCGETS, 0, 1),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL_PROCESS),
-
-        // clock_gettime is likely to be in vDSO anyway
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_clock_gettime, 32, 0),
-
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_mremap, 31, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_ftruncate, 30, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_fsync, 29, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_lseek, 28, 0),
-
-        // allow installing additional seccomp filters
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_seccomp, 27, 0),
-
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_wait4, 26, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_kill, 25, 0),
-        // loadbuffer crashes the process on error without futex
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_futex, 24, 0),
-
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_recvmsg, 23, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_sendmsg, 22, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_close, 21, 0),
-        // fork
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_set_robust_list, 20, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_clone, 19, 0),
-
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_poll, 18, 0),
-
-        // luajit
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_fstat, 17, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_msync, 16, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_munmap, 15, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_mprotect, 14, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_mmap, 13, 0),
-        /* BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_rt_sigprocmask, 14, 0), */
-        /* BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_tgkill, 13, 0), */
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_gettid, 12, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_getpid, 11, 0),
-
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_recvfrom, 10, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_recvmsg, 9, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_sendto, 8, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_clock_nanosleep, 7, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_getrandom, 6, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_brk, 5, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_write, 4, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_read, 3, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_exit, 2, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_exit_group, 1, 0),
-
-        /* BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ERRNO | (SECCOMP_RET_DATA & GH_BOGUS_ERRNO)), */
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL_PROCESS),
-
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW)
-    };
-
+    // the filter is generated from intermediate/gh_seccomp.csv
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-qual"
     // RATIONALE: Field .filter will never be modified. This struct is only passed to seccomp.
-    static const struct sock_fprog prog = {
-        .len = (unsigned short)(sizeof(filter) / sizeof(filter[0])),
-        .filter = (struct sock_filter*)filter
+    const struct sock_fprog prog = {
+        .len = gh_seccomp_jail_filter_len,
+        .filter = (struct sock_filter*)gh_seccomp_jail_filter
     };
 #pragma GCC diagnostic pop
 
@@ -240,7 +168,8 @@ gh_result gh_jail_lockdown(gh_sandboxoptions * options) {
         return ghr_errno(GHR_JAIL_NONEWPRIVSFAIL);
     }
 
-    if (options->memory_limit_bytes != GH_SANDBOX_NOLIMIT) {
+    // with a cgroup, memory.max set by the host limits the whole sandbox
+    if (options->memory_limit_bytes != GH_SANDBOX_NOLIMIT && options->cgroup_path[0] == '\0') {
         struct rlimit mem_limit = (struct rlimit){
             .rlim_cur = options->memory_limit_bytes,
             .rlim_max = options->memory_limit_bytes
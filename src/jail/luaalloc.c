@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <luajit-2.1/lauxlib.h>
+#include <jail/luaalloc.h>
+
+struct gh_luaallocchunk {
+    gh_luaallocchunk * next;
+    size_t size;
+};
+
+#define LUAALLOC_ALIGN 16
+#define LUAALLOC_CHUNKHEADERSIZE ((sizeof(gh_luaallocchunk) + LUAALLOC_ALIGN - 1) & ~(size_t)(LUAALLOC_ALIGN - 1))
+
+// Classes are multiples of 16 bytes up to 128 bytes, then four classes per
+// power of two up to GH_LUAALLOC_MAXCLASSSIZE, which wastes at most 25%.
+#define LUAALLOC_LINEARMAX 128
+#define LUAALLOC_LINEARCLASSES (LUAALLOC_LINEARMAX / LUAALLOC_ALIGN)
+#define LUAALLOC_LINEARMAXLOG2 7
+
+static size_t luaalloc_class(size_t size, size_t * out_class_size) {
+    if (size <= LUAALLOC_LINEARMAX) {
+        size_t idx = (size + LUAALLOC_ALIGN - 1) / LUAALLOC_ALIGN;
+        if (idx == 0) idx = 1;
+        *out_class_size = idx * LUAALLOC_ALIGN;
+        return idx - 1;
+    }
+
+    size_t log2 = (size_t)(63 - __builtin_clzll((unsigned long long)(size - 1)));
+    size_t step = (size_t)1 << (log2 - 2);
+    size_t sub = ((size - 1) >> (log2 - 2)) & 3;
+    *out_class_size = ((size_t)1 << log2) + (sub + 1) * step;
+    return LUAALLOC_LINEARCLASSES + (log2 - LUAALLOC_LINEARMAXLOG2) * 4 + sub;
+}
+
+static size_t luaalloc_classsize(size_t idx) {
+    if (idx < LUAALLOC_LINEARCLASSES) return (idx + 1) * LUAALLOC_ALIGN;
+
+    size_t log2 = LUAALLOC_LINEARMAXLOG2 + (idx - LUAALLOC_LINEARCLASSES) / 4;
+    size_t sub = (idx - LUAALLOC_LINEARCLASSES) % 4;
+    return ((size_t)1 << log2) + (sub + 1) * ((size_t)1 << (log2 - 2));
+}
+
+static size_t luaalloc_pagesize(void) {
+    static size_t page_size = 0;
+    if (page_size == 0) page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+static size_t luaalloc_pageround(size_t size) {
+    size_t page_size = luaalloc_pagesize();
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+// Number of bytes counted towards the limit for a block of the given size.
+static size_t luaalloc_accounted(size_t size) {
+    if (size > GH_LUAALLOC_MAXCLASSSIZE) return luaalloc_pageround(size);
+
+    size_t class_size;
+    luaalloc_class(size, &class_size);
+    return class_size;
+}
+
+static bool luaalloc_canuse(gh_luaalloc * alloc, size_t size) {
+    if (alloc->limit == GH_LUAALLOC_NOLIMIT) return true;
+    return alloc->used <= alloc->limit && size <= alloc->limit - alloc->used;
+}
+
+static bool luaalloc_newchunk(gh_luaalloc * alloc) {
+    size_t size = GH_LUAALLOC_CHUNKSIZE;
+    void * mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        size = GH_LUAALLOC_MINCHUNKSIZE;
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) return false;
+    }
+
+    // RATIONALE: The rest of the previous chunk is abandoned. It's smaller
+    // than the largest size class, which is negligible next to a chunk.
+    gh_luaallocchunk * chunk = (gh_luaallocchunk *)mem;
+    chunk->next = alloc->chunks;
+    chunk->size = size;
+    alloc->chunks = chunk;
+
+    alloc->bump = (char *)mem + LUAALLOC_CHUNKHEADERSIZE;
+    alloc->end = (char *)mem + size;
+    return true;
+}
+
+// If limited is false, the allocation may go over the limit.
+static void * luaalloc_malloc(gh_luaalloc * alloc, size_t size, bool limited) {
+    if (size > GH_LUAALLOC_MAXCLASSSIZE) {
+        size_t mapped_size = luaalloc_pageround(size);
+        if (limited && !luaalloc_canuse(alloc, mapped_size)) return NULL;
+
+        void * mem = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return NULL;
+
+        alloc->used += mapped_size;
+        return mem;
+    }
+
+    size_t class_size;
+    size_t idx = luaalloc_class(size, &class_size);
+    if (limited && !luaalloc_canuse(alloc, class_size)) return NULL;
+
+    void * block = alloc->free_lists[idx];
+    if (block != NULL) {
+        alloc->free_lists[idx] = *(void **)block;
+    } else {
+        if ((size_t)(alloc->end - alloc->bump) < class_size && !luaalloc_newchunk(alloc)) return NULL;
+        block = alloc->bump;
+        alloc->bump += class_size;
+    }
+
+    alloc->used += class_size;
+    return block;
+}
+
+static void luaalloc_free(gh_luaalloc * alloc, void * ptr, size_t size) {
+    if (ptr == NULL) return;
+
+    if (size > GH_LUAALLOC_MAXCLASSSIZE) {
+        size_t mapped_size = luaalloc_pageround(size);
+        munmap(ptr, mapped_size);
+        alloc->used -= mapped_size;
+        return;
+    }
+
+    size_t class_size;
+    size_t idx = luaalloc_class(size, &class_size);
+    *(void **)ptr = alloc->free_lists[idx];
+    alloc->free_lists[idx] = ptr;
+    alloc->used -= class_size;
+}
+
+// Lua assumes that shrinking never fails, so if a smaller block can't be
+// allocated, the old one is kept. Lua frees it with the new size later, so
+// it's accounted with the new size from now on and the rest of it is lost.
+static void * luaalloc_keep(gh_luaalloc * alloc, void * ptr, size_t osize, size_t nsize) {
+    alloc->used -= luaalloc_accounted(osize) - luaalloc_accounted(nsize);
+    return ptr;
+}
+
+void * gh_luaalloc_func(void * ud, void * ptr, size_t osize, size_t nsize) {
+    gh_luaalloc * alloc = (gh_luaalloc *)ud;
+    if (ptr == NULL) osize = 0;
+
+    if (nsize == 0) {
+        luaalloc_free(alloc, ptr, osize);
+        return NULL;
+    }
+
+    if (ptr == NULL) return luaalloc_malloc(alloc, nsize, true);
+
+    if (osize <= GH_LUAALLOC_MAXCLASSSIZE && nsize <= GH_LUAALLOC_MAXCLASSSIZE) {
+        size_t old_class_size;
+        size_t new_class_size;
+        if (luaalloc_class(osize, &old_class_size) == luaalloc_class(nsize, &new_class_size)) return ptr;
+    } else if (osize > GH_LUAALLOC_MAXCLASSSIZE && nsize > GH_LUAALLOC_MAXCLASSSIZE) {
+        size_t old_mapped_size = luaalloc_pageround(osize);
+        size_t new_mapped_size = luaalloc_pageround(nsize);
+        if (old_mapped_size == new_mapped_size) return ptr;
+        if (new_mapped_size > old_mapped_size && !luaalloc_canuse(alloc, new_mapped_size - old_mapped_size)) return NULL;
+
+        void * mem = mremap(ptr, old_mapped_size, new_mapped_size, MREMAP_MAYMOVE);
+        if (mem == MAP_FAILED) return nsize < osize ? luaalloc_keep(alloc, ptr, osize, nsize) : NULL;
+
+        alloc->used = alloc->used - old_mapped_size + new_mapped_size;
+        return mem;
+    }
+
+    // RATIONALE: A shrink frees more than it allocates, so it's not held to
+    // the limit. The state may be right at the limit when it shrinks.
+    bool shrink = nsize < osize;
+    void * block = luaalloc_malloc(alloc, nsize, !shrink);
+    if (block == NULL) return shrink ? luaalloc_keep(alloc, ptr, osize, nsize) : NULL;
+
+    memcpy(block, ptr, osize < nsize ? osize : nsize);
+    luaalloc_free(alloc, ptr, osize);
+    return block;
+}
+
+bool gh_luaalloc_ctor(gh_luaalloc * alloc) {
+    *alloc = (gh_luaalloc) {
+        .limit = GH_LUAALLOC_NOLIMIT,
+        .used = 0,
+        .chunks = NULL,
+        .bump = NULL,
+        .end = NULL,
+        .locked_start = NULL,
+        .locked_end = NULL,
+        .free_lists = {0}
+    };
+    return luaalloc_newchunk(alloc);
+}
+
+void gh_luaalloc_reset(gh_luaalloc * alloc) {
+    gh_luaallocchunk * chunk = alloc->chunks;
+    while (chunk != NULL) {
+        gh_luaallocchunk * next = chunk->next;
+        munmap(chunk, chunk->size);
+        chunk = next;
+    }
+
+    alloc->used = 0;
+    alloc->chunks = NULL;
+    alloc->bump = NULL;
+    alloc->end = NULL;
+    alloc->locked_start = NULL;
+    alloc->locked_end = NULL;
+    memset(alloc->free_lists, 0, sizeof(alloc->free_lists));
+}
+
+// madvise fails with EINVAL on locked pages, so the locked range is cut out.
+static void luaalloc_dontneed(gh_luaalloc * alloc, uintptr_t start, uintptr_t end) {
+    uintptr_t locked_start = (uintptr_t)alloc->locked_start;
+    uintptr_t locked_end = (uintptr_t)alloc->locked_end;
+    if (start < locked_end && locked_start < end) {
+        if (start < locked_start) madvise((void *)start, locked_start - start, MADV_DONTNEED);
+        if (locked_end < end) madvise((void *)locked_end, end - locked_end, MADV_DONTNEED);
+        return;
+    }
+    madvise((void *)start, end - start, MADV_DONTNEED);
+}
+
+void gh_luaalloc_trim(gh_luaalloc * alloc) {
+    size_t page_size = luaalloc_pagesize();
+
+    for (size_t idx = 0; idx < GH_LUAALLOC_CLASSES; idx++) {
+        size_t class_size = luaalloc_classsize(idx);
+        if (class_size < page_size * 2) continue;
+
+        for (void * block = alloc->free_lists[idx]; block != NULL; block = *(void **)block) {
+            // the link to the next free block has to stay
+            uintptr_t start = ((uintptr_t)block + sizeof(void *) + page_size - 1) & ~(uintptr_t)(page_size - 1);
+            uintptr_t end = ((uintptr_t)block + class_size) & ~(uintptr_t)(page_size - 1);
+            if (end > start) luaalloc_dontneed(alloc, start, end);
+        }
+    }
+}
+
+bool gh_luaalloc_prefault(gh_luaalloc * alloc, size_t size, bool lock) {
+    if (alloc->bump == NULL && !luaalloc_newchunk(alloc)) return !lock;
+
+    size_t available = (size_t)(alloc->end - alloc->bump);
+    if (size > available) size = available;
+    if (size == 0) return true;
+
+    size_t page_size = luaalloc_pagesize();
+    uintptr_t start = (uintptr_t)alloc->bump & ~(uintptr_t)(page_size - 1);
+    uintptr_t end = ((uintptr_t)alloc->bump + size + page_size - 1) & ~(uintptr_t)(page_size - 1);
+
+    // RATIONALE: Reading would only map the shared zero page, so every page
+    // is written. The first one may already hold blocks, so the byte written
+    // is the one read.
+    for (uintptr_t page = start; page < end; page += page_size) {
+        volatile char * p = (volatile char *)page;
+        *p = *p;
+    }
+
+    if (!lock) return true;
+    if (mlock((void *)start, end - start) < 0) return false;
+
+    // RATIONALE: The arena is prefaulted once after construction and after
+    // every reset, which unmaps it, so there's only ever one locked range.
+    alloc->locked_start = (char *)start;
+    alloc->locked_end = (char *)end;
+    return true;
+}
+
+static int luaalloc_panic(lua_State * state) {
+    const char * msg = lua_tostring(state, -1);
+    fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg != NULL ? msg : "?");
+    fflush(stderr);
+    return 0;
+}
+
+lua_State * gh_luaalloc_newstate(gh_luaalloc * alloc, bool * out_custom) {
+    lua_State * state = lua_newstate(gh_luaalloc_func, alloc);
+    if (state != NULL) {
+        lua_atpanic(state, luaalloc_panic);
+        *out_custom = true;
+        return state;
+    }
+
+    // 64 bit builds of LuaJIT without GC64 refuse custom allocators
+    *out_custom = false;
+    return luaL_newstate();
+}
@@ -75,6 +75,7 @@
 // diagnostics that cause problems.
 
 #include "luajit/src/lj_obj.h"
+#include "luajit/src/lj_frame.h"
 
 struct gh_luajit_file {
   FILE *fp;		/* File handle. */
@@ -103,4 +104,12 @@ void gh_luajit_pushfile(lua_State *L, FILE * fp)
     iof->type = IOFILE_TYPE_FILE;
 }
 
+/* Same check as the one done by lua_yield, which raises an error instead of
+ * returning false. Used by hooks that may only yield when a yield is possible.
+ */
+bool gh_luajit_canyield(lua_State *L)
+{
+    return cframe_canyield(L->cframe) != 0;
+}
+
 #pragma GCC diagnostic pop
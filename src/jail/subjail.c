@@ -1,12 +1,10 @@
 #define _GNU_SOURCE
-#include <linux/bpf_common.h>
 #include <linux/seccomp.h>
-#include <linux/filter.h>
-#include <linux/audit.h>
 #include <execinfo.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <malloc.h>
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -14,18 +12,229 @@
 #include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/sched.h>
+#include <linux/landlock.h>
+#include <poll.h>
 #include <ghost/ipc.h>
 #include <ghost/variant.h>
 #include <ghost/result.h>
+#include <ghost/generated/gh_permfs_mode.h>
 #include <jail/jail.h>
 #include <jail/subjail.h>
 #include <jail/lua.h>
+#include <jail/luaalloc.h>
+#include <jail/seccomp.h>
 #include <jail/luajit-glue.h>
 
+// rights of newer Landlock ABIs, which older kernel headers lack
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_IOCTL_DEV
+#define LANDLOCK_ACCESS_FS_IOCTL_DEV (1ULL << 15)
+#endif
+
 int gh_global_subjail_idx = -1;
 int gh_global_script_idx = -1;
 lua_State * L;
 
+// allocator of L, unless LuaJIT doesn't support custom allocators
+static gh_luaalloc lua_alloc;
+static bool lua_customalloc = false;
+
+// Lua requests (strings, files and function calls) run in their own
+// coroutines, so that a request waiting for the host to respond to an
+// RPC function call can be suspended while other requests make progress.
+typedef struct subjail_request {
+    bool used;
+    int request_id;
+    int script_id;
+
+    lua_State * co;
+    int co_ref;
+
+    // registry reference to the tenant's global table, or LUA_NOREF
+    int env_ref;
+
+    // true if suspended by ghost.call until FUNCTIONRETURN arrives
+    bool awaiting;
+
+    // tenant requests are preempted by the instruction count hook and
+    // queued as runnable until the main loop resumes them
+    bool preemptible;
+    bool preempted;
+    struct subjail_request * ready_next;
+
+    uint64_t cpu_ns;
+    uint64_t instructions;
+
+    // CLOCK_MONOTONIC time after which the request is aborted, or 0
+    uint64_t deadline_ns;
+    // set to GHR_LUA_DEADLINE or GHR_LUA_CANCELLED once the request has to be
+    // aborted; the request is then dropped as soon as it's suspended
+    gh_result abort_result;
+
+    // only set for LUACALL requests
+    bool is_call;
+    gh_fdmem mem;
+    // true if the collector is stopped until this request finishes
+    bool stops_gc;
+} subjail_request;
+
+static subjail_request requests[GH_SUBJAIL_MAXREQUESTS];
+static subjail_request * current_request = NULL;
+
+static subjail_request * ready_head = NULL;
+static subjail_request * ready_tail = NULL;
+
+// Tenants are isolated global environments hosted in this subjail's Lua
+// state. Their requests are scheduled like any other request, but they are
+// also preempted every GH_IPCMSG_LUATENANT_SLICE instructions.
+typedef struct subjail_tenant {
+    struct subjail_tenant * next;
+    int tenant_id;
+    int env_ref;
+    int script_idx;
+} subjail_tenant;
+
+static subjail_tenant * tenants = NULL;
+static size_t tenant_count = 0;
+
+// number of in-flight requests with a deadline
+static size_t deadline_count = 0;
+
+// budgets of the sandbox thread (0 if unlimited) and resources used so far
+// by all requests
+static uint64_t budget_cpu_ns = 0;
+static uint64_t budget_instructions = 0;
+static uint64_t total_cpu_ns = 0;
+static uint64_t total_instructions = 0;
+
+// CPU time at which the running request was resumed
+static uint64_t resume_start_ns = 0;
+
+// garbage collector settings requested by the host (see gh_ipcmsg_luagc)
+static int gc_pause = GH_IPC_GCKEEP;
+static int gc_stepmul = GH_IPC_GCKEEP;
+static bool gc_stopduringcalls = false;
+static gh_ipcmsg_luagc_idle gc_idle = GH_IPCMSG_LUAGC_IDLENONE;
+static int gc_idlestepkb = GH_SUBJAIL_GCIDLESTEPKB;
+
+// number of in-flight LUACALL requests that stopped the collector
+static size_t gc_stopcount = 0;
+// true if anything ran since the last idle collection finished
+static bool gc_idlepending = false;
+
+// time without messages after which memory is trimmed, or 0
+static int idle_trim_ms = 0;
+// true if anything ran since memory was last trimmed
+static bool trim_pending = false;
+
+// bytes of the Lua arena backed with memory whenever a Lua state is created,
+// and whether they are also locked
+static size_t prefault_bytes = 0;
+static bool prefault_lock = false;
+
+// true if the host serves openat through the user notification listener,
+// so that io.open can call fopen directly
+static bool native_open = false;
+
+// true if openat is restricted by a Landlock domain instead (see
+// gh_ipcmsg_landlock), so that io.open calls fopen directly and only asks the
+// host about files the domain doesn't allow
+static bool landlock = false;
+// Landlock ABI version of the kernel
+static int landlock_abi = 0;
+// true until the domain is enforced - no request may run before that
+static bool landlock_pending = false;
+// ruleset being built by ADDRULE messages, or -1
+static int landlock_rulesetfd = -1;
+// first error of an ADDRULE message, reported by RESTRICT
+static gh_result landlock_result = GHR_OK;
+
+static void subjail_updatehook(void);
+static gh_result lua_init(gh_ipc * ipc);
+
+// size of the Lua heap of the subjail in bytes (shared by all tenants)
+static uint64_t subjail_heapbytes(void) {
+    return (uint64_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + (uint64_t)lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+// registry reference to the c_support table, which holds newenv
+static int csupport_ref = LUA_NOREF;
+
+// Messages received while blocked waiting for a specific FUNCTIONRETURN,
+// processed by the main loop afterwards in the order they arrived.
+typedef struct subjail_deferredmsg {
+    struct subjail_deferredmsg * next;
+    char data[GH_IPCMSG_MAXSIZE];
+} subjail_deferredmsg;
+
+static subjail_deferredmsg * deferred_head = NULL;
+static subjail_deferredmsg * deferred_tail = NULL;
+
+static gh_ipc * subjail_ipc = NULL;
+
+static bool subjail_defer(gh_ipcmsg * msg) {
+    subjail_deferredmsg * deferred = malloc(sizeof(subjail_deferredmsg));
+    if (deferred == NULL) return false;
+
+    deferred->next = NULL;
+    memcpy(deferred->data, msg, GH_IPCMSG_MAXSIZE);
+
+    if (deferred_tail != NULL) deferred_tail->next = deferred;
+    else deferred_head = deferred;
+    deferred_tail = deferred;
+    return true;
+}
+
+static bool subjail_popdeferred(gh_ipcmsg * out_msg) {
+    subjail_deferredmsg * deferred = deferred_head;
+    if (deferred == NULL) return false;
+
+    deferred_head = deferred->next;
+    if (deferred_head == NULL) deferred_tail = NULL;
+
+    memcpy(out_msg, deferred->data, GH_IPCMSG_MAXSIZE);
+    free(deferred);
+    return true;
+}
+
+// Removes the deferred FUNCTIONRETURN of the given request, if there is one.
+static bool subjail_takedeferredreturn(int request_id, gh_ipcmsg * out_msg) {
+    subjail_deferredmsg ** link = &deferred_head;
+    subjail_deferredmsg * prev = NULL;
+    while (*link != NULL) {
+        subjail_deferredmsg * deferred = *link;
+        gh_ipcmsg * msg = (gh_ipcmsg *)deferred->data;
+        if (msg->type == GH_IPCMSG_FUNCTIONRETURN && ((gh_ipcmsg_functionreturn *)msg)->request_id == request_id) {
+            *link = deferred->next;
+            if (deferred_tail == deferred) deferred_tail = prev;
+
+            memcpy(out_msg, deferred->data, GH_IPCMSG_MAXSIZE);
+            free(deferred);
+            return true;
+        }
+        prev = deferred;
+        link = &deferred->next;
+    }
+    return false;
+}
+
+static bool subjail_msgpending(gh_ipc * ipc) {
+    struct pollfd pfd = { .fd = ipc->sockfd, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+static void lua_copyerror(lua_State * state, char * error_msg_buf) {
+    const char * s = lua_tostring(state, -1);
+    if (s == NULL) s = "(error object is not a string)";
+    strncpy(error_msg_buf, s, GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1);
+    error_msg_buf[GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1] = '\0';
+}
+
 static gh_result lua_poperror(int r, char * error_msg_buf) {
     const char * s = lua_tostring(L, -1);
     lua_pop(L, 1);
@@ -40,12 +249,16 @@ static gh_result lua_poperror(int r, char * error_msg_buf) {
     return gh_lua2result(r);
 }
 
-static gh_result lua_sendinfomsg(gh_ipc * ipc, int * out_script_id) {
+static gh_result lua_sendinfomsg(gh_ipc * ipc, int request_id, subjail_tenant * tenant, int * out_script_id) {
     gh_ipcmsg_luainfo msg = {0};
     msg.type = GH_IPCMSG_LUAINFO;
-    gh_global_script_idx += 1;
-    int script_idx = gh_global_script_idx;
-    msg.script_id = gh_global_script_idx;
+    msg.request_id = request_id;
+
+    // every tenant numbers its scripts separately
+    int * script_idx_ptr = tenant != NULL ? &tenant->script_idx : &gh_global_script_idx;
+    *script_idx_ptr += 1;
+    int script_idx = *script_idx_ptr;
+    msg.script_id = script_idx;
 
     gh_result res = gh_ipc_send(ipc, (gh_ipcmsg *)&msg, sizeof(gh_ipcmsg_luainfo));
     if (ghr_iserr(res)) return res;
@@ -55,54 +268,448 @@ static gh_result lua_sendinfomsg(gh_ipc * ipc, int * out_script_id) {
     return GHR_OK;
 }
 
-static gh_result lua_execute(gh_ipc * ipc, int script_id) {
-    gh_ipcmsg_luaresult result_msg = {0};
+static gh_result lua_sendresult(gh_ipc * ipc, int request_id, int script_id, gh_result result, const char * error_msg) {
+    gh_ipcmsg_luaresult msg = {
+        .type = GH_IPCMSG_LUARESULT,
+        .request_id = request_id,
+        .result = result,
+        .script_id = script_id,
+        .error_msg = {0},
+
+        .total_cpu_ns = total_cpu_ns,
+        .total_instructions = total_instructions,
 
-    gh_result lua_result = GHR_OK;
-    int r = gh_lua_pcall(L, 0, 0);
-    if (r != 0) {
-        const char * err = lua_tostring(L, -1);
-        strncpy(result_msg.error_msg, err, GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1);
-        result_msg.error_msg[GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1] = '\0';
-        lua_pop(L, 1);
+        .lua_heap_bytes = subjail_heapbytes(),
+        .lua_alloc_bytes = lua_alloc.used
+    };
 
-        lua_result = gh_lua2result(r);
+    if (error_msg != NULL) {
+        strncpy(msg.error_msg, error_msg, GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1);
+        msg.error_msg[GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1] = '\0';
     }
 
-    result_msg.type = GH_IPCMSG_LUARESULT;
-    result_msg.result = lua_result;
-    result_msg.script_id = script_id;
+    return gh_ipc_send(ipc, (gh_ipcmsg *)&msg, sizeof(gh_ipcmsg_luaresult));
+}
+
+static gh_result lua_callfunction_pushparam(lua_State * state, gh_fdmem * mem, gh_variant * param) {
+    (void)mem;
+
+    switch(param->type) {
+    case GH_VARIANT_NIL: {
+        lua_pushnil(state);
+        return GHR_OK;
+    }
+    case GH_VARIANT_INT: {
+        lua_pushnumber(state, (lua_Number)param->t_int);
+        return GHR_OK;
+    }
+    case GH_VARIANT_DOUBLE: {
+        lua_pushnumber(state, (lua_Number)param->t_double);
+        return GHR_OK;
+    }
+    case GH_VARIANT_STRING: {
+        lua_pushlstring(state, param->t_string_data, param->t_string_len);
+        return GHR_OK;
+    }
+    default: return GHR_JAIL_LUACALLPARAM;
+    }
+}
+
+static gh_result lua_callfunction_getreturn(lua_State * state, gh_fdmem * mem, gh_fdmem_ptr * out_virtptr) {
+    int type = lua_type(state, -1);
+    gh_result res = GHR_OK;
+
+    switch(type) {
+    case LUA_TNUMBER: {
+        gh_variant * param;
+        res = gh_fdmem_new(mem, sizeof(gh_variant), (void**)&param);
+        if (ghr_iserr(res)) return res;
+
+        *out_virtptr = gh_fdmem_virtptr(mem, param, sizeof(gh_variant));
+        if (*out_virtptr == 0) return GHR_JAIL_LUACALLRETURN;
+
+        param->type = GH_VARIANT_DOUBLE;
+        param->t_double = (double)lua_tonumber(state, -1);
+        break;
+    }
+
+    case LUA_TSTRING: {
+        size_t len;
+        const char * str = lua_tolstring(state, -1, &len);
+
+        gh_variant * param;
+        res = gh_fdmem_new(mem, sizeof(gh_variant) + len + 1, (void**)&param);
+        if (ghr_iserr(res)) return res;
+
+        *out_virtptr = gh_fdmem_virtptr(mem, param, sizeof(gh_variant) + len + 1);
+        if (*out_virtptr == 0) return GHR_JAIL_LUACALLRETURN;
+
+        param->type = GH_VARIANT_STRING;
+
+        param->t_string_len = len;
+        // strings may contain null bytes (e.g. bytecode)
+        memcpy(param->t_string_data, str, len);
+        param->t_string_data[len] = '\0';
+        break;
+    }
 
-    gh_result res = gh_ipc_send(ipc, (gh_ipcmsg *)&result_msg, sizeof(gh_ipcmsg_luaresult));
+    default:
+    case LUA_TNIL: {
+        gh_variant * param;
+        res = gh_fdmem_new(mem, sizeof(gh_variant), (void**)&param);
+        if (ghr_iserr(res)) return res;
+
+        *out_virtptr = gh_fdmem_virtptr(mem, param, sizeof(gh_variant));
+        if (*out_virtptr == 0) return GHR_UNKNOWN;
+
+        param->type = GH_VARIANT_NIL;
+        break;
+    }
+    }
+
+    return res;
+}
+
+static subjail_tenant * tenant_find(int tenant_id) {
+    for (subjail_tenant * tenant = tenants; tenant != NULL; tenant = tenant->next) {
+        if (tenant->tenant_id == tenant_id) return tenant;
+    }
+    return NULL;
+}
+
+// Monotonic time in nanoseconds, 0 if the clock can't be read.
+static uint64_t request_monotime(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Sends LUAINFO and reserves a request slot with a fresh coroutine.
+// If no slot is available or the tenant doesn't exist, the request is
+// answered with an error right away and *out_request is set to NULL.
+static gh_result request_new(gh_ipc * ipc, int request_id, int tenant_id, int deadline_ms, subjail_request ** out_request) {
+    *out_request = NULL;
+
+    subjail_tenant * tenant = NULL;
+    if (tenant_id != GH_IPC_NOTENANT) tenant = tenant_find(tenant_id);
+
+    int script_id;
+    gh_result res = lua_sendinfomsg(ipc, request_id, tenant, &script_id);
     if (ghr_iserr(res)) return res;
 
+    if (tenant_id != GH_IPC_NOTENANT && tenant == NULL) {
+        return lua_sendresult(ipc, request_id, script_id, GHR_JAIL_NOTENANT, NULL);
+    }
+
+    subjail_request * request = NULL;
+    for (size_t i = 0; i < GH_SUBJAIL_MAXREQUESTS; i++) {
+        if (!requests[i].used) {
+            request = requests + i;
+            break;
+        }
+    }
+
+    if (request == NULL) {
+        return lua_sendresult(ipc, request_id, script_id, GHR_JAIL_TOOMANYREQUESTS, NULL);
+    }
+
+    *request = (subjail_request) {
+        .used = true,
+        .request_id = request_id,
+        .script_id = script_id,
+        .awaiting = false,
+        .preemptible = tenant != NULL,
+        .preempted = false,
+        .ready_next = NULL,
+        .cpu_ns = 0,
+        .instructions = 0,
+        .deadline_ns = 0,
+        .abort_result = GHR_OK,
+        .is_call = false,
+        .stops_gc = false
+    };
+
+    request->co = lua_newthread(L);
+    request->co_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    request->env_ref = tenant != NULL ? tenant->env_ref : LUA_NOREF;
+
+    if (deadline_ms > 0) {
+        request->deadline_ns = request_monotime() + (uint64_t)deadline_ms * 1000000ULL;
+        deadline_count += 1;
+        subjail_updatehook();
+    }
+
+    *out_request = request;
     return GHR_OK;
 }
 
-static gh_result lua_executestring(gh_ipc * ipc, const char * s) {
-    int script_id;
-    gh_result res = lua_sendinfomsg(ipc, &script_id);
+// Releases the request slot and the request's resources.
+static gh_result request_release(subjail_request * request) {
+    gh_result res = GHR_OK;
+    if (request->is_call) res = gh_fdmem_dtor(&request->mem);
+
+    luaL_unref(L, LUA_REGISTRYINDEX, request->co_ref);
+    request->used = false;
+    request->co = NULL;
+
+    if (request->stops_gc) {
+        request->stops_gc = false;
+        gc_stopcount -= 1;
+        if (gc_stopcount == 0) lua_gc(L, LUA_GCRESTART, 0);
+    }
+
+    if (request->deadline_ns != 0) {
+        deadline_count -= 1;
+        subjail_updatehook();
+    }
+    return res;
+}
+
+static const char * request_abortmsg(subjail_request * request) {
+    if (ghr_is(request->abort_result, GHR_LUA_DEADLINE)) return "request deadline exceeded";
+    if (ghr_is(request->abort_result, GHR_LUA_BUDGET)) return "sandbox thread budget exhausted";
+    return "request cancelled";
+}
+
+// Sends LUARESULT for a request whose coroutine finished (r == 0), failed
+// or has to be aborted, and releases the request slot.
+static gh_result request_finish(gh_ipc * ipc, subjail_request * request, int r) {
+    gh_ipcmsg_luaresult result_msg = {
+        .type = GH_IPCMSG_LUARESULT,
+        .request_id = request->request_id,
+        .result = GHR_OK,
+        .script_id = request->script_id,
+        .error_msg = {0},
+
+        .return_ptr = 0,
+
+        .cpu_ns = request->cpu_ns,
+        .instructions = request->instructions,
+
+        .total_cpu_ns = total_cpu_ns,
+        .total_instructions = total_instructions,
+
+        .lua_heap_bytes = subjail_heapbytes(),
+        .lua_alloc_bytes = lua_alloc.used
+    };
+
+    gh_result res = GHR_OK;
+    if (ghr_iserr(request->abort_result)) {
+        result_msg.result = request->abort_result;
+        strncpy(result_msg.error_msg, request_abortmsg(request), GH_IPCMSG_LUARESULT_ERRORMSGMAX - 1);
+    } else if (r != 0) {
+        luaL_traceback(L, request->co, lua_tostring(request->co, -1), 0);
+        lua_copyerror(L, result_msg.error_msg);
+        lua_pop(L, 1);
+        result_msg.result = gh_lua2result(r);
+    } else if (request->is_call) {
+        // only the first return value is passed back to the host
+        if (lua_gettop(request->co) == 0) lua_pushnil(request->co);
+        else lua_settop(request->co, 1);
+
+        res = lua_callfunction_getreturn(request->co, &request->mem, &result_msg.return_ptr);
+        if (ghr_iserr(res)) result_msg.result = res;
+    }
+
+    gh_result mem_res = request_release(request);
+
+    res = gh_ipc_send(ipc, (gh_ipcmsg *)&result_msg, sizeof(gh_ipcmsg_luaresult));
     if (ghr_iserr(res)) return res;
+    return mem_res;
+}
 
-    int r = luaL_loadbuffer(L, s, strlen(s), "string");
-    if (r != 0) {
-        gh_result lua_result = gh_lua2result(r);
+// Pushes the global table the request runs with.
+static void request_pushenv(subjail_request * request) {
+    if (request->env_ref == LUA_NOREF) lua_pushvalue(request->co, LUA_GLOBALSINDEX);
+    else lua_rawgeti(request->co, LUA_REGISTRYINDEX, request->env_ref);
+}
 
-        gh_ipcmsg_luaresult msg = {
-            .type = GH_IPCMSG_LUARESULT,
-            .result = lua_result,
-            .script_id = script_id,
-            .error_msg = {0}
-        };
-        res = gh_ipc_send(ipc, (gh_ipcmsg *)&msg, sizeof(gh_ipcmsg_luaresult));
-        if (ghr_iserr(res)) return res;
+// Makes the function on top of the request's stack run with its global table.
+static void request_setenv(subjail_request * request) {
+    if (request->env_ref == LUA_NOREF) return;
+    request_pushenv(request);
+    lua_setfenv(request->co, -2);
+}
+
+static uint64_t request_cputime(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void request_makeready(subjail_request * request) {
+    request->ready_next = NULL;
+    if (ready_tail != NULL) ready_tail->ready_next = request;
+    else ready_head = request;
+    ready_tail = request;
+}
+
+static subjail_request * request_popready(void) {
+    subjail_request * request = ready_head;
+    if (request == NULL) return NULL;
+
+    ready_head = request->ready_next;
+    if (ready_head == NULL) ready_tail = NULL;
+    request->ready_next = NULL;
+    return request;
+}
+
+static bool subjail_overbudget(void) {
+    if (budget_instructions != 0 && total_instructions >= budget_instructions) return true;
+    if (budget_cpu_ns == 0) return false;
+
+    uint64_t cpu_ns = total_cpu_ns;
+    if (current_request != NULL) cpu_ns += request_cputime() - resume_start_ns;
+    return cpu_ns >= budget_cpu_ns;
+}
+
+// Returns true if the request was cancelled, ran past its deadline or the
+// sandbox thread used up its budget.
+static bool request_mustabort(subjail_request * request) {
+    if (ghr_isok(request->abort_result) && request->deadline_ns != 0 && request_monotime() >= request->deadline_ns) {
+        request->abort_result = GHR_LUA_DEADLINE;
+    }
+    if (ghr_isok(request->abort_result) && subjail_overbudget()) {
+        request->abort_result = GHR_LUA_BUDGET;
+    }
+    return ghr_iserr(request->abort_result);
+}
+
+// Marks the request as cancelled. It's aborted by the count hook if it's
+// running, otherwise before it would be resumed.
+static void request_cancel(int request_id) {
+    for (size_t i = 0; i < GH_SUBJAIL_MAXREQUESTS; i++) {
+        subjail_request * request = requests + i;
+        if (request->used && request->request_id == request_id) {
+            if (ghr_isok(request->abort_result)) request->abort_result = GHR_LUA_CANCELLED;
+            return;
+        }
+    }
+}
+
+// Resumes the request coroutine with nargs values on top of its stack.
+static gh_result request_resume(gh_ipc * ipc, subjail_request * request, int nargs) {
+    // requests aborted while suspended never run again
+    if (request_mustabort(request)) return request_finish(ipc, request, 0);
+
+    current_request = request;
+    request->awaiting = false;
+    request->preempted = false;
+
+    resume_start_ns = request_cputime();
+    int r = lua_resume(request->co, nargs);
+    uint64_t used_ns = request_cputime() - resume_start_ns;
+    request->cpu_ns += used_ns;
+    total_cpu_ns += used_ns;
+
+    current_request = NULL;
+
+    if (r == LUA_YIELD) {
+        lua_settop(request->co, 0);
+        if (ghr_iserr(request->abort_result)) return request_finish(ipc, request, r);
+        if (request->awaiting) return GHR_OK;
+        if (request->preempted) {
+            request_makeready(request);
+            return GHR_OK;
+        }
+
+        lua_pushstring(request->co, "attempt to yield from a request outside of a coroutine");
+        r = LUA_ERRRUN;
     }
 
-    return lua_execute(ipc, script_id);
+    return request_finish(ipc, request, r);
+}
+
+// Receives messages that arrived while a request is running, so that a
+// LUACANCEL takes effect without waiting for the request to be suspended.
+// Every other message is deferred until the main loop.
+static void request_pollcancel(void) {
+    char msg_buf[GH_IPCMSG_MAXSIZE];
+    gh_ipcmsg * msg = (gh_ipcmsg *)msg_buf;
+
+    while (subjail_msgpending(subjail_ipc)) {
+        // errors (e.g. the host shutting down) are left to the main loop
+        if (ghr_iserr(gh_ipc_recv(subjail_ipc, msg, 0))) return;
+
+        if (msg->type == GH_IPCMSG_LUACANCEL) {
+            request_cancel(((gh_ipcmsg_luacancel *)msg)->request_id);
+            continue;
+        }
+
+        if (!subjail_defer(msg)) ghr_fail(GHR_LUA_MEM);
+    }
+}
+
+// Instruction count hook, only installed while tenants, requests with a
+// deadline or budgets exist. LuaJIT hooks are global, so the hook has to check that it's
+// running directly in the coroutine of the request before it can suspend it.
+static void request_counthook(lua_State * state, lua_Debug * ar) {
+    (void)ar;
+
+    subjail_request * request = current_request;
+    if (request == NULL) return;
+
+    request->instructions += GH_IPCMSG_LUATENANT_SLICE;
+    total_instructions += GH_IPCMSG_LUATENANT_SLICE;
+
+    request_pollcancel();
+
+    if (request_mustabort(request)) {
+        // RATIONALE: The script can catch errors with pcall, but not a yield.
+        // Inside nested coroutines and C functions, where the request can't be
+        // suspended, the error is raised again on every slice until it reaches
+        // the request's own coroutine.
+        if (request->co == state && gh_luajit_canyield(state)) {
+            lua_yield(state, 0);
+            return;
+        }
+
+        luaL_error(state, "ghost: %s", request_abortmsg(request));
+        return;
+    }
+
+    if (!request->preemptible || request->co != state) return;
+    if (!gh_luajit_canyield(state)) return;
+
+    request->preempted = true;
+    lua_yield(state, 0);
+}
+
+static void subjail_updatehook(void) {
+    bool needed = tenant_count > 0 || deadline_count > 0 || budget_cpu_ns != 0 || budget_instructions != 0;
+    if (needed) lua_sethook(L, request_counthook, LUA_MASKCOUNT, GH_IPCMSG_LUATENANT_SLICE);
+    else lua_sethook(L, NULL, 0, 0);
+}
+
+static gh_result request_fail(gh_ipc * ipc, subjail_request * request, gh_result result, const char * error_msg) {
+    gh_result res = request_release(request);
+
+    gh_result send_res = lua_sendresult(ipc, request->request_id, request->script_id, result, error_msg);
+    if (ghr_iserr(send_res)) return send_res;
+    return res;
+}
+
+static gh_result lua_executestring(gh_ipc * ipc, gh_ipcmsg_luastring * msg) {
+    subjail_request * request;
+    gh_result res = request_new(ipc, msg->request_id, msg->tenant_id, msg->deadline_ms, &request);
+    if (ghr_iserr(res) || request == NULL) return res;
+
+    int r = luaL_loadbuffer(request->co, msg->content, strlen(msg->content), "string");
+    if (r != 0) {
+        char error_msg[GH_IPCMSG_LUARESULT_ERRORMSGMAX];
+        lua_copyerror(request->co, error_msg);
+        return request_fail(ipc, request, gh_lua2result(r), error_msg);
+    }
+    request_setenv(request);
+
+    return request_resume(ipc, request, 0);
 }
 
 typedef struct {
     int fd;
+    bool positional;
+    off_t offset;
     size_t buffer_size;
     char * buffer;
     int errno_result;
@@ -113,271 +720,623 @@ static const char * lua_fdreader(lua_State * state, void * data_voidp, size_t *
 
     lua_fdreader_data * data = (lua_fdreader_data *)data_voidp;
 
-    ssize_t readn = read(data->fd, data->buffer, data->buffer_size);
+    ssize_t readn;
+    if (data->positional) readn = pread(data->fd, data->buffer, data->buffer_size, data->offset);
+    else readn = read(data->fd, data->buffer, data->buffer_size);
     if (readn < 0) {
         data->errno_result = errno;
         return NULL;
     }
 
+    data->offset += readn;
     *out_size = (size_t)readn;
     return data->buffer;
 }
 
+// RATIONALE: Loading a chunk through lua_fdreader takes a read() per 4 KB of
+// source. Regular files (including sealed memfds from the bytecode cache) are
+// instead mapped and loaded in one go, which also avoids copying the text.
+// Files are read from the current offset unless the message is positional,
+// same as with read(). Returns false if the file can't be mapped (e.g. pipes),
+// in which case the caller falls back to lua_fdreader. Truncating the file
+// while it's being loaded kills the subjail with SIGBUS, same as any other
+// fault in it.
+static bool lua_loadmapped(lua_State * state, gh_ipcmsg_luafile * msg, int * out_r) {
+    struct stat statbuf;
+    if (fstat(msg->fd, &statbuf) < 0) return false;
+    if (!S_ISREG(statbuf.st_mode)) return false;
+
+    off_t offset = 0;
+    if (!msg->positional) {
+        offset = lseek(msg->fd, 0, SEEK_CUR);
+        if (offset < 0) return false;
+    }
+    if (statbuf.st_size <= offset) return false;
+
+    size_t map_size = (size_t)statbuf.st_size;
+    char * map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, msg->fd, 0);
+    if (map == MAP_FAILED) return false;
+
+    *out_r = luaL_loadbuffer(state, map + offset, map_size - (size_t)offset, msg->chunk_name);
+
+    // the loaded chunk doesn't reference the source
+    (void)munmap(map, map_size);
+
+    // leave the offset where read() would have
+    if (!msg->positional) (void)lseek(msg->fd, statbuf.st_size, SEEK_SET);
+    return true;
+}
+
 #define LUA_EXECUTEFILE_BUFFERSIZE 4096
-static gh_result lua_executefile(gh_ipc * ipc, int fd, const char * chunk_name) {
+static gh_result lua_executefile(gh_ipc * ipc, gh_ipcmsg_luafile * msg) {
+    subjail_request * request;
+    gh_result res = request_new(ipc, msg->request_id, msg->tenant_id, msg->deadline_ms, &request);
+    if (ghr_iserr(res)) return res;
+    if (request == NULL) {
+        if (close(msg->fd) < 0) return ghr_errno(GHR_JAIL_CLOSEFDFAIL);
+        return GHR_OK;
+    }
+
+    int r = 0;
+    if (!lua_loadmapped(request->co, msg, &r)) {
+        char read_buffer[LUA_EXECUTEFILE_BUFFERSIZE];
+        lua_fdreader_data fdreader_ud = {
+            .errno_result = -1,
+            .fd = msg->fd,
+            .positional = msg->positional,
+            .offset = 0,
+            .buffer = read_buffer,
+            .buffer_size = LUA_EXECUTEFILE_BUFFERSIZE
+        };
+        r = lua_load(request->co, lua_fdreader, (void*)&fdreader_ud, msg->chunk_name);
+    }
+
+    // the chunk is fully loaded, the received descriptor is no longer needed
+    if (close(msg->fd) < 0) {
+        lua_settop(request->co, 0);
+        return request_fail(ipc, request, ghr_errno(GHR_JAIL_CLOSEFDFAIL), NULL);
+    }
+
+    if (r != 0) {
+        char error_msg[GH_IPCMSG_LUARESULT_ERRORMSGMAX];
+        lua_copyerror(request->co, error_msg);
+        return request_fail(ipc, request, gh_lua2result(r), error_msg);
+    }
+    request_setenv(request);
+
+    return request_resume(ipc, request, 0);
+}
+
+static gh_result lua_sethostvariable(gh_ipc * ipc, gh_ipcmsg_luahostvariable * msg) {
     int script_id;
-    gh_result res = lua_sendinfomsg(ipc, &script_id);
+    gh_result res = lua_sendinfomsg(ipc, msg->request_id, NULL, &script_id);
     if (ghr_iserr(res)) return res;
 
-    char read_buffer[LUA_EXECUTEFILE_BUFFERSIZE];
-    lua_fdreader_data fdreader_ud = {
-        .errno_result = -1,
-        .fd = fd,
-        .buffer = read_buffer,
-        .buffer_size = LUA_EXECUTEFILE_BUFFERSIZE
-    };
-    int r = lua_load(L, lua_fdreader, (void*)&fdreader_ud, chunk_name);
+    int prev_top = lua_gettop(L);
+
+    lua_getglobal(L, "__ghost_host");
+    if (lua_type(L, -1) == LUA_TNIL) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 1);
+        lua_pushvalue(L, -1);
+        lua_setglobal(L, "__ghost_host");
+    }
+
+    if (msg->table_index > 0) {
+        lua_pushstring(L, msg->name);
+        lua_gettable(L, -2);
+        if (lua_type(L, -1) == LUA_TNIL) {
+            lua_pop(L, 1);
+            lua_createtable(L, 1, 0);
+            lua_pushstring(L, msg->name);
+            lua_pushvalue(L, -2);
+            lua_settable(L, -4);
+        }
+        lua_pushnumber(L, msg->table_index);
+    } else {
+        lua_pushstring(L, msg->name);
+    }
+
+    switch(msg->datatype) {
+    case GH_IPCMSG_LUAHOSTVARIABLE_INT:
+        lua_pushnumber(L, (lua_Number)msg->t_integer);
+        break;
+    case GH_IPCMSG_LUAHOSTVARIABLE_DOUBLE:
+        lua_pushnumber(L, (lua_Number)msg->t_double);
+        break;
+    case GH_IPCMSG_LUAHOSTVARIABLE_STRING: {
+        size_t len = msg->t_string.len;
+        if (len + 1 > GH_IPCMSG_LUAHOSTVARIABLE_STRINGMAX) {
+            len = GH_IPCMSG_LUAHOSTVARIABLE_STRINGMAX - 1;
+        }
+        lua_pushlstring(L, msg->t_string.buffer, msg->t_string.len);
+        break;
+    }
+    default:
+        lua_pushnil(L);
+    }
+
+    lua_settable(L, -3);
+
+    lua_settop(L, prev_top);
+
+    return lua_sendresult(ipc, msg->request_id, script_id, GHR_OK, NULL);
+}
+
+static gh_result lua_callfunction(gh_ipc * ipc, gh_ipcmsg_luacall * msg) {
+    subjail_request * request;
+    gh_result res = request_new(ipc, msg->request_id, msg->tenant_id, msg->deadline_ms, &request);
+    if (ghr_iserr(res)) return res;
+    if (request == NULL) {
+        if (close(msg->ipcfdmem_fd) < 0) return ghr_errno(GHR_IPCFDMEM_CLOSE);
+        return GHR_OK;
+    }
+
+    res = gh_fdmem_ctorfdo(&request->mem, msg->ipcfdmem_fd, msg->ipcfdmem_occupied);
+    if (ghr_iserr(res)) return request_fail(ipc, request, res, NULL);
+    request->is_call = true;
+
+    if (gc_stopduringcalls) {
+        request->stops_gc = true;
+        gc_stopcount += 1;
+        if (gc_stopcount == 1) lua_gc(L, LUA_GCSTOP, 0);
+    }
+
+    lua_State * co = request->co;
+
+    request_pushenv(request);
+    lua_getfield(co, -1, "__ghost_callbacks");
+    lua_remove(co, -2);
+    if (lua_type(co, -1) == LUA_TNIL) {
+        return request_fail(ipc, request, GHR_JAIL_LUACALLMISSING, NULL);
+    }
+
+    lua_getfield(co, -1, msg->name);
+    lua_remove(co, -2);
+    if (lua_type(co, -1) == LUA_TNIL) {
+        return request_fail(ipc, request, GHR_JAIL_LUACALLMISSING, NULL);
+    }
+
+    int nargs = 0;
+    for (size_t i = 0; i < GH_IPCMSG_LUACALL_MAXPARAMS; i++) {
+        gh_fdmem_ptr param_ptr = msg->params[i];
+        if (param_ptr == 0) break;
+
+        gh_variant * param = (gh_variant *)gh_fdmem_realptr(&request->mem, param_ptr, 1);
+        if (param == NULL) {
+            return request_fail(ipc, request, GHR_JAIL_LUACALLPARAM, NULL);
+        }
+
+        res = lua_callfunction_pushparam(co, &request->mem, param);
+        if (ghr_iserr(res)) return request_fail(ipc, request, res, NULL);
+
+        nargs += 1;
+    }
+
+    return request_resume(ipc, request, nargs);
+}
+
+static gh_result tenant_new(gh_ipc * ipc, gh_ipcmsg_luatenant * msg, int script_id) {
+    if (msg->tenant_id == GH_IPC_NOTENANT || tenant_find(msg->tenant_id) != NULL) {
+        return lua_sendresult(ipc, msg->request_id, script_id, GHR_JAIL_TENANTEXISTS, NULL);
+    }
+
+    subjail_tenant * tenant = malloc(sizeof(subjail_tenant));
+    if (tenant == NULL) return lua_sendresult(ipc, msg->request_id, script_id, GHR_LUA_MEM, NULL);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, csupport_ref);
+    lua_getfield(L, -1, "newenv");
+    lua_remove(L, -2);
+
+    int r = gh_lua_pcall(L, 0, 1);
     if (r != 0) {
-        gh_result lua_result = gh_lua2result(r);
+        free(tenant);
 
-        gh_ipcmsg_luaresult msg = {
-            .type = GH_IPCMSG_LUARESULT,
-            .result = lua_result,
-            .script_id = script_id,
-            .error_msg = {0}
-        };
-        res = gh_ipc_send(ipc, (gh_ipcmsg *)&msg, sizeof(gh_ipcmsg_luaresult));
-        if (ghr_iserr(res)) return res;
+        char error_msg[GH_IPCMSG_LUARESULT_ERRORMSGMAX];
+        gh_result lua_result = lua_poperror(r, error_msg);
+        return lua_sendresult(ipc, msg->request_id, script_id, lua_result, error_msg);
+    }
+
+    tenant->tenant_id = msg->tenant_id;
+    tenant->env_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    tenant->script_idx = -1;
+
+    tenant->next = tenants;
+    tenants = tenant;
+    tenant_count += 1;
+    subjail_updatehook();
+
+    return lua_sendresult(ipc, msg->request_id, script_id, GHR_OK, NULL);
+}
+
+// Requests of the tenant that are still running keep its global table alive.
+static gh_result tenant_free(gh_ipc * ipc, gh_ipcmsg_luatenant * msg, int script_id) {
+    subjail_tenant ** link = &tenants;
+    while (*link != NULL && (*link)->tenant_id != msg->tenant_id) link = &(*link)->next;
+
+    subjail_tenant * tenant = *link;
+    if (tenant == NULL) return lua_sendresult(ipc, msg->request_id, script_id, GHR_JAIL_NOTENANT, NULL);
+
+    *link = tenant->next;
+    luaL_unref(L, LUA_REGISTRYINDEX, tenant->env_ref);
+    free(tenant);
+    tenant_count -= 1;
+    subjail_updatehook();
+
+    return lua_sendresult(ipc, msg->request_id, script_id, GHR_OK, NULL);
+}
+
+static gh_result lua_tenant(gh_ipc * ipc, gh_ipcmsg_luatenant * msg) {
+    int script_id;
+    gh_result res = lua_sendinfomsg(ipc, msg->request_id, NULL, &script_id);
+    if (ghr_iserr(res)) return res;
+
+    if (msg->op == GH_IPCMSG_LUATENANT_NEW) return tenant_new(ipc, msg, script_id);
+    if (msg->op == GH_IPCMSG_LUATENANT_FREE) return tenant_free(ipc, msg, script_id);
+    return lua_sendresult(ipc, msg->request_id, script_id, GHR_JAIL_UNSUPPORTEDMSG, NULL);
+}
+
+static void subjail_applygc(void) {
+    if (gc_pause >= 0) lua_gc(L, LUA_GCSETPAUSE, gc_pause);
+    if (gc_stepmul >= 0) lua_gc(L, LUA_GCSETSTEPMUL, gc_stepmul);
+}
+
+static gh_result lua_setgc(gh_ipc * ipc, gh_ipcmsg_luagc * msg) {
+    int script_id;
+    gh_result res = lua_sendinfomsg(ipc, msg->request_id, NULL, &script_id);
+    if (ghr_iserr(res)) return res;
+
+    if (msg->pause >= 0) gc_pause = msg->pause;
+    if (msg->stepmul >= 0) gc_stepmul = msg->stepmul;
+    subjail_applygc();
+
+    // requests already running keep the collector stopped until they finish
+    gc_stopduringcalls = msg->stop_during_calls;
+    gc_idle = msg->idle;
+    gc_idlestepkb = msg->idle_step_kb > 0 ? msg->idle_step_kb : GH_SUBJAIL_GCIDLESTEPKB;
+
+    return lua_sendresult(ipc, msg->request_id, script_id, GHR_OK, NULL);
+}
+
+// Runs the collector while no message is waiting, so that its pauses happen
+// between requests instead of in the middle of them. Returns as soon as a
+// message arrives; the rest of the cycle is done the next time the subjail
+// is idle.
+static void subjail_idlegc(gh_ipc * ipc) {
+    if (!gc_idlepending || gc_stopcount > 0) return;
+
+    if (gc_idle == GH_IPCMSG_LUAGC_IDLEFULL) {
+        if (subjail_msgpending(ipc)) return;
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        gc_idlepending = false;
+    } else if (gc_idle == GH_IPCMSG_LUAGC_IDLESTEP) {
+        while (!subjail_msgpending(ipc)) {
+            if (lua_gc(L, LUA_GCSTEP, gc_idlestepkb) == 1) {
+                gc_idlepending = false;
+                return;
+            }
+        }
     }
+}
+
+// Prefaults (and locks) the start of the Lua arena as requested by the host.
+static void subjail_prefault(void) {
+    if (prefault_bytes == 0) return;
+
+    if (!lua_customalloc) {
+        gh_jail_printf("subjail %d: luajit doesn't support custom allocators, not prefaulting\n", gh_global_subjail_idx);
+        return;
+    }
+
+    if (!gh_luaalloc_prefault(&lua_alloc, prefault_bytes, prefault_lock)) {
+        gh_jail_printf("subjail %d: failed locking prefaulted lua arena: %s\n", gh_global_subjail_idx, strerror(errno));
+    }
+}
+
+// Collects all garbage and returns free memory to the kernel. Free blocks of
+// the Lua allocator are dropped with MADV_DONTNEED, malloc_trim does the same
+// for the C heap, including free pages in the middle of it. (LuaJIT's own
+// allocator, if used instead, unmaps unused chunks by itself.)
+static void subjail_trim(void) {
+    // a full collection would restart the collector stopped by a running call
+    if (gc_stopcount == 0) lua_gc(L, LUA_GCCOLLECT, 0);
+    if (lua_customalloc) gh_luaalloc_trim(&lua_alloc);
+    malloc_trim(0);
+    trim_pending = false;
+}
+
+static gh_result lua_trim(gh_ipc * ipc, gh_ipcmsg_luatrim * msg) {
+    int script_id;
+    gh_result res = lua_sendinfomsg(ipc, msg->request_id, NULL, &script_id);
+    if (ghr_iserr(res)) return res;
 
-    return lua_execute(ipc, script_id);
+    subjail_trim();
+
+    return lua_sendresult(ipc, msg->request_id, script_id, GHR_OK, NULL);
+}
+
+// Every filesystem right the kernel can restrict, so that only what the rules
+// allow is possible.
+static uint64_t landlock_handledaccess(void) {
+    uint64_t access = (LANDLOCK_ACCESS_FS_MAKE_SYM << 1) - 1;
+    if (landlock_abi >= 2) access |= LANDLOCK_ACCESS_FS_REFER;
+    if (landlock_abi >= 3) access |= LANDLOCK_ACCESS_FS_TRUNCATE;
+    if (landlock_abi >= 5) access |= LANDLOCK_ACCESS_FS_IOCTL_DEV;
+    return access;
+}
+
+// Only rights needed by openat are granted. Creating files still goes through
+// the host, which also checks the access mode of the new file.
+static uint64_t landlock_modeaccess(gh_permfs_mode mode, bool directory) {
+    uint64_t access = 0;
+    if ((mode & GH_PERMFS_READ) != 0) {
+        access |= LANDLOCK_ACCESS_FS_READ_FILE;
+        if (directory) access |= LANDLOCK_ACCESS_FS_READ_DIR;
+    }
+    if ((mode & GH_PERMFS_WRITE) != 0) {
+        access |= LANDLOCK_ACCESS_FS_WRITE_FILE;
+        if (landlock_abi >= 3) access |= LANDLOCK_ACCESS_FS_TRUNCATE;
+    }
+    return access;
+}
+
+static gh_result landlock_ruleset(void) {
+    if (landlock_rulesetfd >= 0) return GHR_OK;
+
+    struct landlock_ruleset_attr attr = {
+        .handled_access_fs = landlock_handledaccess()
+    };
+    landlock_rulesetfd = (int)syscall(SYS_landlock_create_ruleset, &attr, sizeof(attr), 0);
+    if (landlock_rulesetfd < 0) return ghr_errno(GHR_LANDLOCK_RULESET);
+    return GHR_OK;
 }
 
-static gh_result lua_sethostvariable(gh_ipc * ipc, gh_ipcmsg_luahostvariable * msg) {
-    int script_id;
-    gh_result res = lua_sendinfomsg(ipc, &script_id);
+static gh_result landlock_addrule(int fd, gh_permfs_mode mode) {
+    gh_result res = landlock_ruleset();
     if (ghr_iserr(res)) return res;
 
-    int prev_top = lua_gettop(L);
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) return ghr_errno(GHR_LANDLOCK_ADDRULE);
 
-    lua_getglobal(L, "__ghost_host");
-    if (lua_type(L, -1) == LUA_TNIL) {
-        lua_pop(L, 1);
-        lua_createtable(L, 0, 1);
-        lua_pushvalue(L, -1);
-        lua_setglobal(L, "__ghost_host");
-    }
+    struct landlock_path_beneath_attr attr = {
+        .allowed_access = landlock_modeaccess(mode, S_ISDIR(statbuf.st_mode)),
+        .parent_fd = fd
+    };
+    if (attr.allowed_access == 0) return GHR_OK;
 
-    if (msg->table_index > 0) {
-        lua_pushstring(L, msg->name);
-        lua_gettable(L, -2);
-        if (lua_type(L, -1) == LUA_TNIL) {
-            lua_pop(L, 1);
-            lua_createtable(L, 1, 0);
-            lua_pushstring(L, msg->name);
-            lua_pushvalue(L, -2);
-            lua_settable(L, -4);
-        }
-        lua_pushnumber(L, msg->table_index);
-    } else {
-        lua_pushstring(L, msg->name);
+    if (syscall(SYS_landlock_add_rule, landlock_rulesetfd, LANDLOCK_RULE_PATH_BENEATH, &attr, 0) < 0) {
+        return ghr_errno(GHR_LANDLOCK_ADDRULE);
     }
+    return GHR_OK;
+}
 
-    switch(msg->datatype) {
-    case GH_IPCMSG_LUAHOSTVARIABLE_INT:
-        lua_pushnumber(L, (lua_Number)msg->t_integer);
-        break;
-    case GH_IPCMSG_LUAHOSTVARIABLE_DOUBLE:
-        lua_pushnumber(L, (lua_Number)msg->t_double);
-        break;
-    case GH_IPCMSG_LUAHOSTVARIABLE_STRING: {
-        size_t len = msg->t_string.len;
-        if (len + 1 > GH_IPCMSG_LUAHOSTVARIABLE_STRINGMAX) {
-            len = GH_IPCMSG_LUAHOSTVARIABLE_STRINGMAX - 1;
-        }
-        lua_pushlstring(L, msg->t_string.buffer, msg->t_string.len);
-        break;
-    }
-    default:
-        lua_pushnil(L);
-    }
+// Enforces the rules added so far. Without any, no file can be opened
+// directly.
+static gh_result landlock_restrict(void) {
+    gh_result res = landlock_ruleset();
+    if (ghr_iserr(res)) return res;
 
-    lua_settable(L, -3);
+    // no_new_privs was set by the jail
+    if (syscall(SYS_landlock_restrict_self, landlock_rulesetfd, 0) < 0) {
+        return ghr_errno(GHR_LANDLOCK_RESTRICT);
+    }
 
-    lua_settop(L, prev_top);
+    close(landlock_rulesetfd);
+    landlock_rulesetfd = -1;
+    landlock_pending = false;
 
-    gh_ipcmsg_luaresult result_msg = {
-        .type = GH_IPCMSG_LUARESULT,
-        .result = GHR_OK,
-        .script_id = script_id,
-        .error_msg = {0}
-    };
-    res = gh_ipc_send(ipc, (gh_ipcmsg *)&result_msg, sizeof(gh_ipcmsg_luaresult));
-    if (ghr_iserr(res)) return res;
+    gh_jail_printf("subjail %d: landlock ruleset in effect\n", gh_global_subjail_idx);
     return GHR_OK;
 }
 
-static gh_result lua_callfunction_pushparam(gh_ipc * ipc, gh_fdmem * mem, gh_variant * param) {
-    (void)ipc;
-    (void)mem;
+static gh_result lua_landlock(gh_ipc * ipc, gh_ipcmsg_landlock * msg) {
+    gh_result res = GHR_OK;
 
-    switch(param->type) {
-    case GH_VARIANT_NIL: {
-        lua_pushnil(L);
-        return GHR_OK;
-    }
-    case GH_VARIANT_INT: {
-        lua_pushnumber(L, (lua_Number)param->t_int);
-        return GHR_OK;
-    }
-    case GH_VARIANT_DOUBLE: {
-        lua_pushnumber(L, (lua_Number)param->t_double);
-        return GHR_OK;
-    }
-    case GH_VARIANT_STRING: {
-        lua_pushlstring(L, param->t_string_data, param->t_string_len);
+    if (msg->op == GH_IPCMSG_LANDLOCK_ADDRULE) {
+        if (!landlock) res = GHR_LANDLOCK_UNAVAILABLE;
+        else if (!landlock_pending) res = GHR_LANDLOCK_ENFORCED;
+        else res = landlock_addrule(msg->fd, msg->mode);
+
+        if (msg->fd >= 0) close(msg->fd);
+        if (ghr_iserr(res) && ghr_isok(landlock_result)) landlock_result = res;
         return GHR_OK;
     }
-    default: return GHR_JAIL_LUACALLPARAM;
+
+    int script_id;
+    res = lua_sendinfomsg(ipc, msg->request_id, NULL, &script_id);
+    if (ghr_iserr(res)) return res;
+
+    gh_result result = landlock_result;
+    landlock_result = GHR_OK;
+
+    if (!landlock) {
+        result = GHR_LANDLOCK_UNAVAILABLE;
+    } else if (!landlock_pending) {
+        result = GHR_LANDLOCK_ENFORCED;
+    } else {
+        // rules that failed are left out, which only makes the domain stricter
+        res = landlock_restrict();
+        if (ghr_iserr(res) || ghr_isok(result)) result = res;
     }
-}
 
-static gh_result lua_callfunction_getreturn(gh_ipc * ipc, gh_fdmem * mem, gh_fdmem_ptr * out_virtptr) {
-    (void)ipc;
+    return lua_sendresult(ipc, msg->request_id, script_id, result, NULL);
+}
 
-    int type = lua_type(L, -1);
-    gh_result res = GHR_OK;
+// Replaces the Lua state with a fresh one, as if the subjail was just spawned.
+// Budgets are counted from the reset, as the state is typically handed over to
+// a new tenant.
+static gh_result lua_reset(gh_ipc * ipc, gh_ipcmsg_luareset * msg) {
+    int script_id;
+    gh_result res = lua_sendinfomsg(ipc, msg->request_id, NULL, &script_id);
+    if (ghr_iserr(res)) return res;
 
-    switch(type) {
-    case LUA_TNUMBER: {
-        gh_variant * param;
-        res = gh_fdmem_new(mem, sizeof(gh_variant), (void**)&param);
-        if (ghr_iserr(res)) return res;
+    for (size_t i = 0; i < GH_SUBJAIL_MAXREQUESTS; i++) {
+        if (requests[i].used) return lua_sendresult(ipc, msg->request_id, script_id, GHR_JAIL_RESETBUSY, NULL);
+    }
 
-        *out_virtptr = gh_fdmem_virtptr(mem, param, sizeof(gh_variant));
-        if (*out_virtptr == 0) return GHR_JAIL_LUACALLRETURN;
+    // RATIONALE: A Landlock domain can't be lifted, so the fresh state would
+    // keep opening everything the old policy accepted without asking the host.
+    if (landlock && !landlock_pending) {
+        return lua_sendresult(ipc, msg->request_id, script_id, GHR_LANDLOCK_ENFORCED, NULL);
+    }
 
-        param->type = GH_VARIANT_DOUBLE;
-        param->t_double = (double)lua_tonumber(L, -1);
-        break;
+    // registry references die with the state
+    while (tenants != NULL) {
+        subjail_tenant * next = tenants->next;
+        free(tenants);
+        tenants = next;
     }
+    tenant_count = 0;
 
-    case LUA_TSTRING: {
-        size_t len;
-        const char * str = lua_tolstring(L, -1, &len);
+    lua_close(L);
+    if (lua_customalloc) gh_luaalloc_reset(&lua_alloc);
+    L = gh_luaalloc_newstate(&lua_alloc, &lua_customalloc);
+    if (L == NULL) return GHR_LUA_MEM;
 
-        gh_variant * param;
-        res = gh_fdmem_new(mem, sizeof(gh_variant) + len + 1, (void**)&param);
-        if (ghr_iserr(res)) return res;
+    res = lua_init(ipc);
+    if (ghr_iserr(res)) return res;
 
-        *out_virtptr = gh_fdmem_virtptr(mem, param, sizeof(gh_variant) + len + 1);
-        if (*out_virtptr == 0) return GHR_JAIL_LUACALLRETURN;
+    gh_global_script_idx = -1;
+    total_cpu_ns = 0;
+    total_instructions = 0;
+    subjail_updatehook();
+    subjail_applygc();
+    // the arena was released with the old state
+    subjail_prefault();
 
-        param->type = GH_VARIANT_STRING;
+    return lua_sendresult(ipc, msg->request_id, script_id, GHR_OK, NULL);
+}
 
-        param->t_string_len = len;
-        strncpy(param->t_string_data, str, len);
-        param->t_string_data[len] = '\0';
-        break;
-    }
+typedef struct {
+    char * data;
+    size_t size;
+    size_t capacity;
+} lua_dumpbuffer;
 
-    default:
-    case LUA_TNIL: {
-        gh_variant * param;
-        res = gh_fdmem_new(mem, sizeof(gh_variant), (void**)&param);
-        if (ghr_iserr(res)) return res;
+static int lua_dumpwriter(lua_State * state, const void * p, size_t size, void * data_voidp) {
+    (void)state;
 
-        *out_virtptr = gh_fdmem_virtptr(mem, param, sizeof(gh_variant));
-        if (*out_virtptr == 0) return GHR_UNKNOWN;
+    lua_dumpbuffer * buffer = (lua_dumpbuffer *)data_voidp;
+    if (buffer->size + size > buffer->capacity) {
+        size_t new_capacity = buffer->capacity == 0 ? LUA_EXECUTEFILE_BUFFERSIZE : buffer->capacity;
+        while (buffer->size + size > new_capacity) new_capacity *= 2;
 
-        param->type = GH_VARIANT_NIL;
-        break;
-    }
+        char * new_data = realloc(buffer->data, new_capacity);
+        if (new_data == NULL) return 1;
+
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
     }
 
-    return res;
+    memcpy(buffer->data + buffer->size, p, size);
+    buffer->size += size;
+    return 0;
 }
 
-static gh_result lua_callfunction(gh_ipc * ipc, gh_ipcmsg_luacall * msg) {
+// Compiles a chunk without running it and passes back its bytecode. Used by
+// the host to fill the bytecode cache, see ghost/bytecodecache.h.
+static gh_result lua_compile(gh_ipc * ipc, gh_ipcmsg_luacompile * msg) {
     int script_id;
-    gh_result inner_res = GHR_OK;
-    gh_result ipcfdmem_dtor_res = GHR_OK;
-
-    gh_result res = lua_sendinfomsg(ipc, &script_id);
-    if (ghr_iserr(res)) return res;
+    gh_result res = lua_sendinfomsg(ipc, msg->request_id, NULL, &script_id);
+    if (ghr_iserr(res)) {
+        close(msg->ipcfdmem_fd);
+        return res;
+    }
 
     gh_fdmem mem;
     res = gh_fdmem_ctorfdo(&mem, msg->ipcfdmem_fd, msg->ipcfdmem_occupied);
-    if (ghr_iserr(res)) return res;
-    
-    int prev_top = lua_gettop(L);
+    if (ghr_iserr(res)) {
+        if (close(msg->ipcfdmem_fd) < 0) return ghr_errno(GHR_JAIL_CLOSEFDFAIL);
+        return lua_sendresult(ipc, msg->request_id, script_id, res, NULL);
+    }
 
     gh_ipcmsg_luaresult result_msg = {
         .type = GH_IPCMSG_LUARESULT,
+        .request_id = msg->request_id,
         .result = GHR_OK,
         .script_id = script_id,
         .error_msg = {0},
-        
         .return_ptr = 0
     };
 
-    lua_getglobal(L, "__ghost_callbacks");
-    if (lua_type(L, -1) == LUA_TNIL) {
-        result_msg.result = GHR_JAIL_LUACALLMISSING;
-        goto respond;
-    }
-
-    lua_getfield(L, -1, msg->name);
-    if (lua_type(L, -1) == LUA_TNIL) {
-        result_msg.result = GHR_JAIL_LUACALLMISSING;
-        goto respond;
-    }
-
-    int nargs = 0;
-    for (size_t i = 0; i < GH_IPCMSG_LUACALL_MAXPARAMS; i++) {
-        gh_fdmem_ptr param_ptr = msg->params[i];
-        if (param_ptr == 0) break;
-
-        gh_variant * param = (gh_variant *)gh_fdmem_realptr(&mem, param_ptr, 1);
-        if (param == NULL) {
-            result_msg.result = GHR_JAIL_LUACALLPARAM;
-            goto respond;
-        }
-
-        res = lua_callfunction_pushparam(ipc, &mem, param);
-        if (ghr_iserr(res)) goto respond;
+    int prev_top = lua_gettop(L);
 
-        nargs += 1;
+    const char * source = "";
+    if (msg->source_size > 0) source = (const char *)gh_fdmem_realptr(&mem, 1, msg->source_size);
+    if (source == NULL) {
+        result_msg.result = GHR_JAIL_LUACOMPILESOURCE;
+        goto send;
     }
 
-    int r = gh_lua_pcall(L, nargs, 1);
+    // RATIONALE: The output is shared with every sandbox using the cache,
+    // so only text is compiled. Loading crafted bytecode would pass it on
+    // as if the compiler had produced it.
+    int r = luaL_loadbufferx(L, source, msg->source_size, msg->chunk_name, "t");
     if (r != 0) {
-        result_msg.result = lua_poperror(r, result_msg.error_msg);
-        goto respond;
+        lua_copyerror(L, result_msg.error_msg);
+        result_msg.result = gh_lua2result(r);
+        goto send;
     }
 
-    res = lua_callfunction_getreturn(ipc, &mem, &result_msg.return_ptr);
-    if (ghr_iserr(res)) {
-        goto respond;
+    lua_dumpbuffer dump = {0};
+    if (lua_dump(L, lua_dumpwriter, &dump) != 0) {
+        free(dump.data);
+        result_msg.result = GHR_LUA_MEM;
+        goto send;
     }
 
-respond:
+    lua_pushlstring(L, dump.data, dump.size);
+    free(dump.data);
+
+    res = lua_callfunction_getreturn(L, &mem, &result_msg.return_ptr);
     if (ghr_iserr(res)) result_msg.result = res;
 
+send:
     lua_settop(L, prev_top);
 
-    ipcfdmem_dtor_res = gh_fdmem_dtor(&mem);
+    gh_result mem_res = gh_fdmem_dtor(&mem);
+
+    res = gh_ipc_send(ipc, (gh_ipcmsg *)&result_msg, sizeof(gh_ipcmsg_luaresult));
+    if (ghr_iserr(res)) return res;
+    return mem_res;
+}
 
-    inner_res = gh_ipc_send(ipc, (gh_ipcmsg *)&result_msg, sizeof(gh_ipcmsg_luaresult));
-    if (ghr_iserr(inner_res)) return inner_res;
-    if (ghr_iserr(ipcfdmem_dtor_res)) return ipcfdmem_dtor_res;
+static gh_result lua_functionreturn(gh_ipc * ipc, gh_ipcmsg_functionreturn * msg) {
+    subjail_request * request = NULL;
+    for (size_t i = 0; i < GH_SUBJAIL_MAXREQUESTS; i++) {
+        if (requests[i].used && requests[i].awaiting && requests[i].request_id == msg->request_id) {
+            request = requests + i;
+            break;
+        }
+    }
 
-    return res;
+    if (request == NULL) {
+        gh_jail_printf("subjail %d: received function return for unknown request %d\n", gh_global_subjail_idx, msg->request_id);
+        if (msg->fd >= 0 && close(msg->fd) < 0) return ghr_errno(GHR_JAIL_CLOSEFDFAIL);
+        return GHR_OK;
+    }
+
+    if (request_mustabort(request)) {
+        if (msg->fd >= 0 && close(msg->fd) < 0) return ghr_errno(GHR_JAIL_CLOSEFDFAIL);
+        return request_finish(ipc, request, 0);
+    }
+
+    lua_pushnumber(request->co, (lua_Number)msg->result);
+    lua_pushnumber(request->co, (lua_Number)msg->fd);
+    return request_resume(ipc, request, 2);
 }
 
 static bool message_recv(gh_ipc * ipc, gh_ipcmsg * msg) {
     (void)ipc;
 
+    // RATIONALE: openat is only restricted by the Landlock domain, so nothing
+    // may run before it's in place, even if the host never sent RESTRICT.
+    // A reset runs no scripts, and the fresh state still needs the domain.
+    if (landlock_pending && msg->type != GH_IPCMSG_LANDLOCK && msg->type != GH_IPCMSG_LUARESET && msg->type != GH_IPCMSG_QUIT) {
+        gh_jail_printf("subjail %d: enforcing landlock ruleset before the first request\n", gh_global_subjail_idx);
+        ghr_assert(landlock_restrict());
+    }
+
     switch(msg->type) {
     case GH_IPCMSG_HELLO: ghr_fail(GHR_JAIL_MULTIHELLO); break;
 
@@ -387,15 +1346,14 @@ static bool message_recv(gh_ipc * ipc, gh_ipcmsg * msg) {
 
     case GH_IPCMSG_LUASTRING:
         gh_jail_printf("subjail %d: running lua (string)\n", gh_global_subjail_idx);
-        ghr_assert(lua_executestring(ipc, ((gh_ipcmsg_luastring *)msg)->content));
+        ghr_assert(lua_executestring(ipc, (gh_ipcmsg_luastring *)msg));
         gh_jail_printf("subjail %d: finished running lua (string)\n", gh_global_subjail_idx);
 
         return false;
 
     case GH_IPCMSG_LUAFILE: {
         gh_jail_printf("subjail %d: running lua (file)\n", gh_global_subjail_idx);
-        gh_ipcmsg_luafile * file_msg = (gh_ipcmsg_luafile *)msg;
-        ghr_assert(lua_executefile(ipc, file_msg->fd, file_msg->chunk_name));
+        ghr_assert(lua_executefile(ipc, (gh_ipcmsg_luafile *)msg));
         gh_jail_printf("subjail %d: finished running lua (file)\n", gh_global_subjail_idx);
 
         return false;
@@ -419,14 +1377,59 @@ static bool message_recv(gh_ipc * ipc, gh_ipcmsg * msg) {
         return false;
     }
 
+    case GH_IPCMSG_FUNCTIONRETURN:
+        ghr_assert(lua_functionreturn(ipc, (gh_ipcmsg_functionreturn *)msg));
+        return false;
+
+    case GH_IPCMSG_LUATENANT: {
+        gh_ipcmsg_luatenant * tenant_msg = (gh_ipcmsg_luatenant *)msg;
+        gh_jail_printf("subjail %d: %s tenant %d\n", gh_global_subjail_idx, tenant_msg->op == GH_IPCMSG_LUATENANT_NEW ? "creating" : "freeing", tenant_msg->tenant_id);
+        ghr_assert(lua_tenant(ipc, tenant_msg));
+
+        return false;
+    }
+
+    case GH_IPCMSG_LUACOMPILE: {
+        gh_ipcmsg_luacompile * compile_msg = (gh_ipcmsg_luacompile *)msg;
+        gh_jail_printf("subjail %d: compiling lua chunk '%s'\n", gh_global_subjail_idx, compile_msg->chunk_name);
+        ghr_assert(lua_compile(ipc, compile_msg));
+
+        return false;
+    }
+
+    case GH_IPCMSG_LUARESET:
+        gh_jail_printf("subjail %d: resetting lua state\n", gh_global_subjail_idx);
+        ghr_assert(lua_reset(ipc, (gh_ipcmsg_luareset *)msg));
+        gh_jail_printf("subjail %d: finished resetting lua state\n", gh_global_subjail_idx);
+        return false;
+
+    case GH_IPCMSG_LUAGC:
+        gh_jail_printf("subjail %d: configuring garbage collector\n", gh_global_subjail_idx);
+        ghr_assert(lua_setgc(ipc, (gh_ipcmsg_luagc *)msg));
+        return false;
+
+    case GH_IPCMSG_LUATRIM:
+        gh_jail_printf("subjail %d: trimming memory\n", gh_global_subjail_idx);
+        ghr_assert(lua_trim(ipc, (gh_ipcmsg_luatrim *)msg));
+        return false;
+
+    case GH_IPCMSG_LUACANCEL:
+        gh_jail_printf("subjail %d: cancelling request %d\n", gh_global_subjail_idx, ((gh_ipcmsg_luacancel *)msg)->request_id);
+        request_cancel(((gh_ipcmsg_luacancel *)msg)->request_id);
+        return false;
+
+    case GH_IPCMSG_LANDLOCK:
+        ghr_assert(lua_landlock(ipc, (gh_ipcmsg_landlock *)msg));
+        return false;
+
     case GH_IPCMSG_LUAINFO: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
     case GH_IPCMSG_LUARESULT: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
 
+    case GH_IPCMSG_SUBJAILPIDFD: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
     case GH_IPCMSG_SUBJAILALIVE: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
     case GH_IPCMSG_NEWSUBJAIL: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
 
     case GH_IPCMSG_FUNCTIONCALL: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
-    case GH_IPCMSG_FUNCTIONRETURN: ghr_fail(GHR_JAIL_UNSUPPORTEDMSG);
 
     default:
         gh_jail_printf("subjail %d: received unknown message of type %d\n", gh_global_subjail_idx, (int)msg->type);
@@ -437,16 +1440,50 @@ static bool message_recv(gh_ipc * ipc, gh_ipcmsg * msg) {
     return false;
 }
 
-void gh_subjail_spawn(int sockfd, int parent_pid, gh_ipc * parent_ipc) {
+void gh_subjail_spawn(int sockfd, int parent_pid, gh_ipc * parent_ipc, bool landlock_requested) {
     gh_global_subjail_idx += 1;
 
-    pid_t pid = fork();
+    int pidfd = -1;
+    struct clone_args clone_args = {
+        .flags = CLONE_PIDFD,
+        .pidfd = (uint64_t)(uintptr_t)&pidfd,
+        .exit_signal = SIGCHLD
+    };
+    pid_t pid = (pid_t)syscall(SYS_clone3, &clone_args, sizeof(clone_args));
+    if (pid < 0 && errno == ENOSYS) {
+        pidfd = -1;
+        pid = fork();
+    }
 
     if (pid == 0) {
         gh_ipc ipc;
         gh_ipc_ctorconnect(&ipc, sockfd);
-        _exit(gh_subjail_main(&ipc, parent_pid, parent_ipc));
+        _exit(gh_subjail_main(&ipc, parent_pid, parent_ipc, landlock_requested));
+    }
+
+    if (pid < 0) {
+        gh_jail_printf("jail: failed spawning subjail %d: %s\n", gh_global_subjail_idx, strerror(errno));
+        return;
+    }
+
+    // RATIONALE: The subjail's end of the socket is still open in the jail,
+    // so the host can receive the pidfd on the same connection as every other
+    // message of the subjail.
+    gh_ipc subjail_ipc;
+    gh_ipc_ctorconnect(&subjail_ipc, sockfd);
+
+    gh_ipcmsg_subjailpidfd pidfd_msg;
+    memset(&pidfd_msg, 0, sizeof(gh_ipcmsg_subjailpidfd));
+    pidfd_msg.type = GH_IPCMSG_SUBJAILPIDFD;
+    pidfd_msg.pid = pid;
+    pidfd_msg.pidfd = pidfd;
+    gh_result res = gh_ipc_send(&subjail_ipc, (gh_ipcmsg *)&pidfd_msg, sizeof(gh_ipcmsg_subjailpidfd));
+    if (ghr_iserr(res)) {
+        gh_jail_printf("jail: failed sending pidfd of subjail %d: ", gh_global_subjail_idx);
+        ghr_fputs(stderr, res);
     }
+
+    if (pidfd >= 0) close(pidfd);
 }
 
 static int luafunc_fdopen(lua_State * state) {
@@ -480,11 +1517,94 @@ static int luafunc_udptr(lua_State * state) {
     return 1;
 }
 
+// returns whether io.open should call fopen directly, and whether files it
+// can't open for lack of permission should be requested from the host
+static int luafunc_nativeopen(lua_State * state) {
+    lua_pushboolean(state, native_open || landlock);
+    lua_pushboolean(state, landlock);
+    return 2;
+}
+
+// returns the chunk of rarely used stdlib functions (see stdlib.lua)
+static int luafunc_loadstdliblazy(lua_State * state) {
+    if (luaL_loadbuffer(state, gh_luastdliblazy_script_data, gh_luastdliblazy_script_data_len, "stdlib_lazy") != 0) {
+        return lua_error(state);
+    }
+    return 1;
+}
+
+// returns the ID of the request being run (or 0 outside of requests), and
+// whether the caller is the request's own coroutine (i.e. it can await)
+static int luafunc_request(lua_State * state) {
+    if (current_request == NULL) {
+        lua_pushnumber(state, GH_IPC_NOREQUEST);
+        lua_pushboolean(state, false);
+        return 2;
+    }
+
+    lua_pushnumber(state, (lua_Number)current_request->request_id);
+    lua_pushboolean(state, current_request->co == state);
+    return 2;
+}
+
+// suspends the current request until the host sends FUNCTIONRETURN for it;
+// resumed with the result code and fd of the function call
+static int luafunc_await(lua_State * state) {
+    if (current_request == NULL || current_request->co != state) {
+        return luaL_error(state, "ghost: await outside of a request coroutine");
+    }
+
+    current_request->awaiting = true;
+    return lua_yield(state, 0);
+}
+
+// blocks until the host sends FUNCTIONRETURN for the given request ID,
+// deferring every other message until the main loop
+static int luafunc_wait(lua_State * state) {
+    int request_id = (int)lua_tonumber(state, 1);
+
+    char msg_buf[GH_IPCMSG_MAXSIZE];
+    gh_ipcmsg * msg = (gh_ipcmsg *)msg_buf;
+
+    // the count hook may have received it already
+    if (subjail_takedeferredreturn(request_id, msg)) {
+        gh_ipcmsg_functionreturn * return_msg = (gh_ipcmsg_functionreturn *)msg;
+        lua_pushnumber(state, (lua_Number)return_msg->result);
+        lua_pushnumber(state, (lua_Number)return_msg->fd);
+        return 2;
+    }
+
+    while (true) {
+        gh_result res = gh_ipc_recv(subjail_ipc, msg, 0);
+        if (ghr_iserr(res)) {
+            return luaL_error(state, "ghost: failed receiving function return");
+        }
+
+        if (msg->type == GH_IPCMSG_FUNCTIONRETURN) {
+            gh_ipcmsg_functionreturn * return_msg = (gh_ipcmsg_functionreturn *)msg;
+            if (return_msg->request_id == request_id) {
+                lua_pushnumber(state, (lua_Number)return_msg->result);
+                lua_pushnumber(state, (lua_Number)return_msg->fd);
+                return 2;
+            }
+        }
+
+        if (!subjail_defer(msg)) {
+            return luaL_error(state, "ghost: out of memory deferring message");
+        }
+    }
+}
+
 static gh_result lua_init(gh_ipc * ipc) {
+    subjail_ipc = ipc;
+
     luaL_openlibs(L);
 
     lua_createtable(L, 0, 1);
 
+    lua_pushvalue(L, -1);
+    csupport_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
     lua_pushvalue(L, -1);
     lua_setglobal(L, "c_support");
 
@@ -495,6 +1615,21 @@ static gh_result lua_init(gh_ipc * ipc) {
     lua_pushcfunction(L, luafunc_udptr);
     lua_setfield(L, -2, "udptr");
 
+    lua_pushcfunction(L, luafunc_loadstdliblazy);
+    lua_setfield(L, -2, "loadstdliblazy");
+
+    lua_pushcfunction(L, luafunc_nativeopen);
+    lua_setfield(L, -2, "nativeopen");
+
+    lua_pushcfunction(L, luafunc_request);
+    lua_setfield(L, -2, "request");
+
+    lua_pushcfunction(L, luafunc_await);
+    lua_setfield(L, -2, "await");
+
+    lua_pushcfunction(L, luafunc_wait);
+    lua_setfield(L, -2, "wait");
+
     int r = 0;
 
 #pragma GCC diagnostic push
@@ -536,7 +1671,7 @@ err:
     return GHR_OK;
 }
 
-int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc) {
+int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc, bool landlock_requested) {
     (void)parent_pid;
 
     ghr_assert(gh_ipc_dtor(parent_ipc));
@@ -544,10 +1679,24 @@ int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc) {
     gh_jail_printf("subjail %d: started by jail pid %d\n", gh_global_subjail_idx, parent_pid);
 
     gh_jail_printf("subjail %d: installing second seccomp filter\n", gh_global_subjail_idx);
-    ghr_assert(gh_subjail_lockdown());
+    int notify_fd = -1;
+    ghr_assert(gh_subjail_lockdown(landlock_requested, &notify_fd, &landlock));
+    landlock_pending = landlock;
     gh_jail_printf("subjail %d: security policy in effect\n", gh_global_subjail_idx);
 
-    L = luaL_newstate();
+    if (!gh_luaalloc_ctor(&lua_alloc)) {
+        gh_jail_printf("subjail %d: failed reserving lua arena\n", gh_global_subjail_idx);
+        return 1;
+    }
+
+    L = gh_luaalloc_newstate(&lua_alloc, &lua_customalloc);
+    if (L == NULL) {
+        gh_jail_printf("subjail %d: failed creating lua state\n", gh_global_subjail_idx);
+        return 1;
+    }
+    if (!lua_customalloc) {
+        gh_jail_printf("subjail %d: luajit doesn't support custom allocators, memory limit disabled\n", gh_global_subjail_idx);
+    }
 
     gh_result res = lua_init(ipc);
     if (ghr_iserr(res)) {
@@ -562,7 +1711,10 @@ int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc) {
     subjailalive_msg.type = GH_IPCMSG_SUBJAILALIVE;
     subjailalive_msg.index = gh_global_subjail_idx;
     subjailalive_msg.pid = getpid();
+    subjailalive_msg.notifyfd = notify_fd;
+    subjailalive_msg.landlock = landlock;
     ghr_assert(gh_ipc_send(ipc, (gh_ipcmsg *)&subjailalive_msg, sizeof(gh_ipcmsg_subjailalive)));
+    if (notify_fd >= 0) close(notify_fd);
 
     gh_jail_printf("subjail %d: waiting for hello\n", gh_global_subjail_idx);
 
@@ -583,11 +1735,46 @@ int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc) {
 
     gh_jail_printf("subjail %d: received hello message\n", gh_global_subjail_idx);
 
+    gh_ipcmsg_hello * hello_msg = (gh_ipcmsg_hello *)msg;
+    budget_cpu_ns = hello_msg->cpu_budget_ns;
+    budget_instructions = hello_msg->instruction_budget;
+    idle_trim_ms = hello_msg->idle_trim_ms;
+    lua_alloc.limit = (size_t)hello_msg->memory_limit_bytes;
+    native_open = hello_msg->native_open;
+    prefault_bytes = (size_t)hello_msg->prefault_bytes;
+    prefault_lock = hello_msg->prefault_lock;
+    subjail_updatehook();
+    subjail_prefault();
+
     gh_jail_printf("subjail %d: entering main message loop\n", gh_global_subjail_idx);
 
     while (true) {
-        ghr_assert(gh_ipc_recv(ipc, msg, 0));
+        if (!subjail_popdeferred(msg)) {
+            // preempted tenant requests run whenever no message is waiting
+            if (ready_head != NULL && !subjail_msgpending(ipc)) {
+                gc_idlepending = true;
+                trim_pending = true;
+                ghr_assert(request_resume(ipc, request_popready(), 0));
+                continue;
+            }
+
+            subjail_idlegc(ipc);
+
+            if (idle_trim_ms > 0 && trim_pending) {
+                res = gh_ipc_recv(ipc, msg, idle_trim_ms);
+                if (ghr_is(res, GHR_IPC_RECVMSGTIMEOUT)) {
+                    gh_jail_printf("subjail %d: idle for %d ms, trimming memory\n", gh_global_subjail_idx, idle_trim_ms);
+                    subjail_trim();
+                    continue;
+                }
+                ghr_assert(res);
+            } else {
+                ghr_assert(gh_ipc_recv(ipc, msg, 0));
+            }
+        }
 
+        gc_idlepending = true;
+        trim_pending = true;
         if (message_recv(ipc, msg)) break;
     }
 
@@ -597,36 +1784,24 @@ int gh_subjail_main(gh_ipc * ipc, int parent_pid, gh_ipc * parent_ipc) {
     return 0;
 }
 
-gh_result gh_subjail_lockdown(void) {
+gh_result gh_subjail_lockdown(bool landlock_requested, int * out_notifyfd, bool * out_landlock) {
+    *out_notifyfd = -1;
+    *out_landlock = false;
+
     char * gh_sandbox = getenv("GH_SANDBOX_DISABLED");
     if (gh_sandbox != NULL && strcmp(gh_sandbox, "1") == 0) {
         gh_jail_printf("jail: SANDBOX DISABLED\n");
         return GHR_OK;
     }
 
-    // additional filter to block fork, kill and ather syscalls in subjail,
+    // additional filter to block kill and other syscalls in subjail,
     // that are only needed by the jail process
-    static const struct sock_filter filter[] = {
-        BPF_STMT(BPF_LD + BPF_W + BPF_ABS, (offsetof(struct seccomp_data, arch))),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, AUDIT_ARCH_X86_64, 1, 0),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL_PROCESS),
-
-        BPF_STMT(BPF_LD + BPF_W + BPF_ABS, (offsetof(struct seccomp_data, nr))),
-        
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_wait4, 3, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_fork, 2, 0),
-        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_kill, 1, 0),
-
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),
-        BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL_PROCESS)
-    };
-
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-qual"
     // RATIONALE: Field .filter will never be modified. This struct is only passed to seccomp.
-    static const struct sock_fprog prog = {
-        .len = (unsigned short)(sizeof(filter) / sizeof(filter[0])),
-        .filter = (struct sock_filter*)filter
+    const struct sock_fprog prog = {
+        .len = gh_seccomp_subjail_filter_len,
+        .filter = (struct sock_filter*)gh_seccomp_subjail_filter
     };
 #pragma GCC diagnostic pop
 
@@ -635,5 +1810,35 @@ gh_result gh_subjail_lockdown(void) {
         return ghr_errno(GHR_JAIL_SECCOMPFAIL);
     }
 
+    if (landlock_requested) {
+        int abi = (int)syscall(SYS_landlock_create_ruleset, NULL, 0, LANDLOCK_CREATE_RULESET_VERSION);
+        if (abi >= 1) {
+            // openat is left to the Landlock domain
+            landlock_abi = abi;
+            *out_landlock = true;
+            return GHR_OK;
+        }
+        gh_jail_printf("subjail %d: no landlock support, openat is handed to the host\n", gh_global_subjail_idx);
+    }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+    // RATIONALE: Field .filter will never be modified. This struct is only passed to seccomp.
+    const struct sock_fprog notify_prog = {
+        .len = gh_seccomp_subjail_notify_filter_len,
+        .filter = (struct sock_filter*)gh_seccomp_subjail_notify_filter
+    };
+#pragma GCC diagnostic pop
+
+    // the listener is handed to the host, which decides whether to serve
+    // openat or to close it (then openat fails with ENOSYS)
+    int notify_fd = (int)syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &notify_prog);
+    if (notify_fd < 0) {
+        // RATIONALE: The jail allows openat, so without this filter the
+        // subjail could open any file.
+        return ghr_errno(GHR_JAIL_SECCOMPFAIL);
+    }
+
+    *out_notifyfd = notify_fd;
     return GHR_OK;
 }
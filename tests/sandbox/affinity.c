@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <ghost/alloc.h>
+#include <ghost/cpuset.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+static bool pinned_to(pid_t pid, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    assert(sched_getaffinity(pid, sizeof(set), &set) == 0);
+    return CPU_COUNT(&set) == 1 && CPU_ISSET(cpu, &set);
+}
+
+int main(void) {
+    // pin the test itself, so that pin_to_host picks a predictable CPU
+    gh_cpuset host_cpuset;
+    ghr_assert(gh_cpuset_current(&host_cpuset));
+    ghr_assert(gh_cpuset_apply(&host_cpuset, 0));
+
+    int cpu = -1;
+    for (int i = 0; i < GH_CPUSET_MAXCPUS; i++) {
+        if (gh_cpuset_has(&host_cpuset, i)) cpu = i;
+    }
+    assert(cpu >= 0);
+    printf("host pinned to cpu %d\n", cpu);
+
+    gh_cpuset bad_cpuset = {0};
+    assert(ghr_is(gh_cpuset_add(&bad_cpuset, GH_CPUSET_MAXCPUS), GHR_CPUSET_BADCPU));
+    assert(gh_cpuset_isempty(&bad_cpuset));
+
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .cpuset = host_cpuset
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .name = "affinity",
+        .safe_id = "affinity thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .pin_to_host = true
+    }));
+
+    const char * s = "return 1 + 1";
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread, s, strlen(s), &status));
+    ghr_assert(status.result);
+
+    assert(pinned_to(sandbox.pid, cpu));
+    assert(pinned_to(thread.pid, cpu));
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+
+    // the set of a thread is narrowed to the set of the sandbox
+    int other_cpu = (cpu + 1) % GH_CPUSET_MAXCPUS;
+    gh_cpuset wide_cpuset = host_cpuset;
+    ghr_assert(gh_cpuset_add(&wide_cpuset, other_cpu));
+
+    ghr_assert(gh_thread_ctor(&thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .name = "affinity wide",
+        .safe_id = "affinity wide thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .cpuset = wide_cpuset
+    }));
+    assert(pinned_to(thread.pid, cpu));
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+
+    // and construction fails if nothing is left of it
+    gh_cpuset other_cpuset = {0};
+    ghr_assert(gh_cpuset_add(&other_cpuset, other_cpu));
+
+    assert(ghr_is(gh_thread_ctor(&thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .name = "affinity disjoint",
+        .safe_id = "affinity disjoint thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .cpuset = other_cpuset
+    }), GHR_CPUSET_DISJOINT));
+
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#define INSTRUCTION_BUDGET (GH_IPCMSG_LUATENANT_SLICE * 100)
+#define CPU_BUDGET_NS (200ULL * 1000000ULL)
+
+static gh_threadoptions thread_options(gh_sandbox * sandbox, gh_rpc * rpc, const char * name) {
+    gh_threadoptions options = (gh_threadoptions) {
+        .sandbox = sandbox,
+        .rpc = rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .cpu_budget_ns = GH_THREAD_NOBUDGET,
+        .instruction_budget = GH_THREAD_NOBUDGET
+    };
+    strcpy(options.name, name);
+    strcpy(options.safe_id, name);
+    return options;
+}
+
+static gh_threadnotif_script run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    return status;
+}
+
+static const char spin_script[] =
+    "jit.off()\n"
+    "while true do end\n"
+    ;
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    // instruction budget
+    gh_threadoptions instr_options = thread_options(&sandbox, &rpc, "instructions");
+    instr_options.instruction_budget = INSTRUCTION_BUDGET;
+    gh_thread instr_thread;
+    ghr_assert(gh_thread_ctor(&instr_thread, instr_options));
+
+    gh_threadnotif_script status = run(&instr_thread, "jit.off(); for i = 1, 200000 do end");
+    ghr_assert(status.result);
+    assert(status.instructions > 0);
+    assert(status.total_instructions == status.instructions);
+    uint64_t first_instructions = status.instructions;
+
+    status = run(&instr_thread, spin_script);
+    assert(ghr_is(status.result, GHR_LUA_BUDGET));
+    assert(status.total_instructions >= INSTRUCTION_BUDGET);
+    assert(status.total_instructions == first_instructions + status.instructions);
+    printf("instruction budget used up after %llu instructions\n", (unsigned long long)status.total_instructions);
+
+    // once used up, nothing runs anymore
+    status = run(&instr_thread, "");
+    assert(ghr_is(status.result, GHR_LUA_BUDGET));
+
+    ghr_assert(gh_thread_dtor(&instr_thread, NULL));
+
+    // CPU time budget
+    gh_threadoptions cpu_options = thread_options(&sandbox, &rpc, "cpu");
+    cpu_options.cpu_budget_ns = CPU_BUDGET_NS;
+    gh_thread cpu_thread;
+    ghr_assert(gh_thread_ctor(&cpu_thread, cpu_options));
+
+    status = run(&cpu_thread, spin_script);
+    assert(ghr_is(status.result, GHR_LUA_BUDGET));
+    assert(status.total_cpu_ns >= CPU_BUDGET_NS);
+    printf("cpu budget used up after %llu ns\n", (unsigned long long)status.total_cpu_ns);
+
+    ghr_assert(gh_thread_dtor(&cpu_thread, NULL));
+
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
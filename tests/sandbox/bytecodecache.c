@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+#include <ghost/bytecodecache.h>
+
+static gh_threadoptions thread_options(gh_sandbox * sandbox, gh_rpc * rpc, gh_bytecodecache * cache, const char * name) {
+    gh_threadoptions options = (gh_threadoptions) {
+        .sandbox = sandbox,
+        .rpc = rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .bytecode_cache = cache
+    };
+    strcpy(options.name, name);
+    strcpy(options.safe_id, name);
+    return options;
+}
+
+static void run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+static int call_value(gh_thread * thread) {
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_call(thread, "value", &frame, &status));
+    ghr_assert(status.result);
+
+    int value;
+    assert(gh_thread_callframe_getint(&frame, &value));
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+    return value;
+}
+
+static const char script[] =
+    "local ghost = require('ghost')\n"
+    "ghost.callbacks.value = function() return 42 end\n"
+    ;
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    char persist_path[] = "/tmp/ghost-bytecodecache-XXXXXX";
+    assert(mkdtemp(persist_path) != NULL);
+
+    gh_bytecodecache cache;
+    ghr_assert(gh_bytecodecache_ctor(&cache, &sandbox, (gh_bytecodecacheoptions) {
+        .thread_options = thread_options(&sandbox, &rpc, NULL, "compiler"),
+        .persist_path = persist_path,
+        .max_entries = GH_BYTECODECACHE_NOLIMIT
+    }));
+
+    gh_thread thread_a;
+    gh_thread thread_b;
+    ghr_assert(gh_thread_ctor(&thread_a, thread_options(&sandbox, &rpc, &cache, "a")));
+    ghr_assert(gh_thread_ctor(&thread_b, thread_options(&sandbox, &rpc, &cache, "b")));
+
+    // compiled once, loaded from the cache by the second subjail
+    run(&thread_a, script);
+    run(&thread_b, script);
+    assert(call_value(&thread_a) == 42);
+    assert(call_value(&thread_b) == 42);
+
+    gh_bytecodecachestats stats;
+    gh_bytecodecache_stats(&cache, &stats);
+    assert(stats.compiles == 1);
+    assert(stats.hits == 1);
+    assert(stats.entries == 1);
+
+    // syntax errors are still reported by the subjail running the script
+    const char bad_script[] = "this is not lua";
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread_a, bad_script, strlen(bad_script), &status));
+    assert(ghr_iserr(status.result));
+    assert(strstr(status.error_msg, "[string \"string\"]") != NULL);
+
+    gh_bytecodecache_stats(&cache, &stats);
+    assert(stats.compile_errors == 1);
+    assert(stats.entries == 1);
+
+    // precompiled chunks are rejected, the compiler only accepts text
+    const char binary_chunk[] = "\x1bLJ\x02\x00return 1";
+    int binary_fd;
+    assert(ghr_is(
+        gh_bytecodecache_load(&cache, "binary", binary_chunk, sizeof(binary_chunk) - 1, &binary_fd),
+        GHR_BYTECODECACHE_COMPILE
+    ));
+
+    gh_bytecodecache_stats(&cache, &stats);
+    assert(stats.compile_errors == 2);
+    assert(stats.entries == 1);
+
+    // runtime errors point at the original source
+    const char error_script[] = "\n\nerror('boom')";
+    ghr_assert(gh_thread_runstringsync(&thread_b, error_script, strlen(error_script), &status));
+    assert(ghr_iserr(status.result));
+    assert(strstr(status.error_msg, ":3: boom") != NULL);
+
+    // files are cached too
+    int file_fd = memfd_create("script", MFD_CLOEXEC);
+    assert(file_fd >= 0);
+    assert(write(file_fd, script, strlen(script)) == (ssize_t)strlen(script));
+    for (int i = 0; i < 2; i++) {
+        assert(lseek(file_fd, 0, SEEK_SET) == 0);
+        ghr_assert(gh_thread_runfilesync(&thread_a, file_fd, &status));
+        ghr_assert(status.result);
+    }
+    assert(close(file_fd) == 0);
+
+    gh_bytecodecache_stats(&cache, &stats);
+    printf("bytecode cache: %zu entries, %zu bytes, %llu hits, %llu compiles\n",
+        stats.entries,
+        stats.bytes,
+        (unsigned long long)stats.hits,
+        (unsigned long long)stats.compiles
+    );
+    assert(stats.hits == 2);
+    assert(stats.persist_errors == 0);
+
+    ghr_assert(gh_thread_dtor(&thread_a, NULL));
+    ghr_assert(gh_thread_dtor(&thread_b, NULL));
+    ghr_assert(gh_bytecodecache_dtor(&cache));
+
+    // a new cache picks up bytecode from the persistent store
+    ghr_assert(gh_bytecodecache_ctor(&cache, &sandbox, (gh_bytecodecacheoptions) {
+        .thread_options = thread_options(&sandbox, &rpc, NULL, "compiler"),
+        .persist_path = persist_path,
+        .max_entries = GH_BYTECODECACHE_NOLIMIT
+    }));
+    ghr_assert(gh_thread_ctor(&thread_a, thread_options(&sandbox, &rpc, &cache, "a")));
+
+    run(&thread_a, script);
+    assert(call_value(&thread_a) == 42);
+
+    gh_bytecodecache_stats(&cache, &stats);
+    assert(stats.disk_hits == 1);
+    assert(stats.compiles == 0);
+
+    ghr_assert(gh_thread_dtor(&thread_a, NULL));
+    ghr_assert(gh_bytecodecache_dtor(&cache));
+
+    char rm_command[sizeof(persist_path) + 16];
+    snprintf(rm_command, sizeof(rm_command), "rm -rf '%s'", persist_path);
+    assert(system(rm_command) == 0);
+
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+// Needs a delegated cgroup v2 directory that the test may create cgroups in
+// and move processes into, e.g. a sibling of the cgroup the test runs in.
+#define CGROUP_ENV "GHOST_TEST_CGROUP"
+
+int main(void) {
+    const char * cgroup_path = getenv(CGROUP_ENV);
+    if (cgroup_path == NULL || cgroup_path[0] == '\0') {
+        printf(CGROUP_ENV " is not set, skipping\n");
+        return 0;
+    }
+
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = 512 * 1024 * 1024,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    assert(strlen(cgroup_path) < sizeof(options.cgroup_path));
+    strcpy(options.cgroup_path, cgroup_path);
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .name = "cgroup",
+        .safe_id = "cgroup thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .cgroup_limits = {
+            .memory_max_bytes = 64 * 1024 * 1024,
+            .cpu_quota_us = GH_CGROUP_CPUPERIODUS,
+            .pids_max = 1
+        }
+    }));
+    assert(gh_cgroup_active(&thread.cgroup));
+
+    const char * s =
+        "local t = {}\n"
+        "for i = 1, 100000 do t[i] = tostring(i) end\n";
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread, s, strlen(s), &status));
+    ghr_assert(status.result);
+
+    gh_threadstats stats;
+    ghr_assert(gh_thread_stats(&thread, &stats));
+    printf("subjail cgroup: %llu bytes, %llu ns\n", (unsigned long long)stats.cgroup_memory_bytes, (unsigned long long)stats.cgroup_cpu_ns);
+    assert(stats.cgroup_memory_bytes > 0);
+    assert(stats.cgroup_cpu_ns > 0);
+
+    gh_sandboxstats sandbox_stats;
+    ghr_assert(gh_sandbox_stats(&sandbox, &sandbox_stats));
+    printf("sandbox cgroup: %llu bytes, %llu ns\n", (unsigned long long)sandbox_stats.cgroup_memory_bytes, (unsigned long long)sandbox_stats.cgroup_cpu_ns);
+    assert(sandbox_stats.cgroup_memory_bytes >= stats.cgroup_memory_bytes);
+    assert(sandbox_stats.cgroup_cpu_ns >= stats.cgroup_cpu_ns);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+static gh_thread thread;
+static atomic_int spin_request_id;
+static gh_threadnotif_script spin_status;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void run(const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+static gh_result run_deadline(const char * s, int deadline_ms) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsyncopts(&thread, s, strlen(s), (gh_threadrequestoptions) {
+        .deadline_ms = deadline_ms,
+        .out_request_id = NULL
+    }, &status));
+    return status.result;
+}
+
+static int call_value(void) {
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_call(&thread, "value", &frame, &status));
+    ghr_assert(status.result);
+
+    int value;
+    assert(gh_thread_callframe_getint(&frame, &value));
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+    return value;
+}
+
+static void * spin_func(void * unused) {
+    (void)unused;
+
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+
+    // the deadline keeps the count hook installed, so the cancellation
+    // is noticed while the function is running
+    ghr_assert(gh_thread_callopts(&thread, "spin", &frame, (gh_threadrequestoptions) {
+        .deadline_ms = 60000,
+        .out_request_id = &spin_request_id
+    }, &spin_status));
+
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+    return NULL;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "deadline",
+        .safe_id = "deadline thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .default_deadline_ms = GH_THREAD_NODEADLINE
+    };
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+
+    run(
+        "jit.off()\n"
+        "local ghost = require('ghost')\n"
+        "counter = 0\n"
+        "ghost.callbacks.value = function() return counter end\n"
+        "ghost.callbacks.spin = function() while true do end end\n"
+    );
+
+    // runaway scripts are aborted without losing the subjail's state
+    uint64_t start_ms = monotonic_ms();
+    assert(ghr_is(run_deadline("counter = 1; while true do end", 100), GHR_LUA_DEADLINE));
+    uint64_t elapsed_ms = monotonic_ms() - start_ms;
+    printf("runaway script aborted after %llu ms\n", (unsigned long long)elapsed_ms);
+    assert(elapsed_ms < 2000);
+    assert(call_value() == 1);
+
+    // the deadline can't be caught with pcall
+    assert(ghr_is(run_deadline(
+        "while true do\n"
+        "    pcall(function() while true do end end)\n"
+        "end\n",
+        100
+    ), GHR_LUA_DEADLINE));
+
+    // nor escaped with coroutines
+    assert(ghr_is(run_deadline(
+        "local co = coroutine.wrap(function() while true do end end)\n"
+        "co()\n",
+        100
+    ), GHR_LUA_DEADLINE));
+
+    // scripts that finish in time are unaffected
+    ghr_assert(run_deadline("counter = 2", 1000));
+    assert(call_value() == 2);
+
+    // in-flight requests can be cancelled from another OS thread
+    atomic_store(&spin_request_id, GH_IPC_NOREQUEST);
+    pthread_t spinner;
+    assert(pthread_create(&spinner, NULL, spin_func, NULL) == 0);
+
+    while (atomic_load(&spin_request_id) == GH_IPC_NOREQUEST) usleep(1000);
+    usleep(100000);
+    ghr_assert(gh_thread_cancel(&thread, atomic_load(&spin_request_id)));
+
+    assert(pthread_join(spinner, NULL) == 0);
+    assert(ghr_is(spin_status.result, GHR_LUA_CANCELLED));
+
+    // cancelling a finished request does nothing
+    ghr_assert(gh_thread_cancel(&thread, atomic_load(&spin_request_id)));
+    assert(call_value() == 2);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
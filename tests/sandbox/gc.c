@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+static void run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+static int call_int(gh_thread * thread, const char * name) {
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_call(thread, name, &frame, &status));
+    ghr_assert(status.result);
+
+    int value;
+    assert(gh_thread_callframe_getint(&frame, &value));
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+    return value;
+}
+
+static const char script[] =
+    "local ghost = require('ghost')\n"
+    // KB of garbage left behind by a single call
+    "ghost.callbacks.garbage = function()\n"
+    "    local before = collectgarbage('count')\n"
+    "    local keep = {}\n"
+    "    for i = 1, 100000 do keep[i % 2] = {} end\n"
+    "    return math.floor(collectgarbage('count') - before)\n"
+    "end\n"
+    "ghost.callbacks.heap = function()\n"
+    "    return math.floor(collectgarbage('count'))\n"
+    "end\n"
+    ;
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "gc",
+        .safe_id = "gc thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT
+    };
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+
+    ghr_assert(gh_thread_setgc(&thread, (gh_threadgcoptions) {
+        .pause = 300,
+        .stepmul = GH_THREAD_GCKEEP,
+        .stop_during_calls = true,
+        .idle = GH_THREADGCIDLE_FULL
+    }));
+    run(&thread, "assert(collectgarbage('setpause', 300) == 300)");
+
+    run(&thread, script);
+    int heap_kb = call_int(&thread, "heap");
+
+    // no collection happens during the call, so all of the garbage is still there
+    int garbage_kb = call_int(&thread, "garbage");
+    printf("garbage left by call: %d KB\n", garbage_kb);
+    assert(garbage_kb > 1000);
+
+    // and it's collected once the subjail is idle
+    usleep(200000);
+    int idle_heap_kb = call_int(&thread, "heap");
+    printf("heap before call: %d KB, after idle collection: %d KB\n", heap_kb, idle_heap_kb);
+    assert(idle_heap_kb < heap_kb + garbage_kb / 2);
+
+    // settings survive a reset
+    ghr_assert(gh_thread_reset(&thread));
+    run(&thread, "assert(collectgarbage('setpause', 300) == 300)");
+
+    // incremental idle steps
+    ghr_assert(gh_thread_setgc(&thread, (gh_threadgcoptions) {
+        .pause = GH_THREAD_GCKEEP,
+        .stepmul = GH_THREAD_GCKEEP,
+        .stop_during_calls = false,
+        .idle = GH_THREADGCIDLE_STEP,
+        .idle_step_kb = 16
+    }));
+    run(&thread, script);
+    run(&thread, "local keep = {}; for i = 1, 100000 do keep[i % 2] = {} end");
+    usleep(200000);
+    assert(call_int(&thread, "heap") < heap_kb + garbage_kb / 2);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
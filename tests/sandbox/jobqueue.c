@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+#include <ghost/jobqueue.h>
+
+#define JOBS_COUNT 32
+#define WORKERS_COUNT 3
+
+static gh_result args_func(gh_thread_callframe * frame, void * userdata) {
+    return gh_thread_callframe_int(frame, (int)(size_t)userdata);
+}
+
+static int results[JOBS_COUNT];
+
+static gh_result result_func(gh_thread_callframe * frame, const gh_threadnotif_script * status, void * userdata) {
+    if (ghr_iserr(status->result)) return status->result;
+
+    int value;
+    if (!gh_thread_callframe_getint(frame, &value)) return GHR_TEST_GENERIC;
+    results[(size_t)userdata] = value;
+    return GHR_OK;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    const char setup[] =
+        "local ghost = require('ghost')\n"
+        "ghost.callbacks.double = function(x) return x * 2 end\n"
+        ;
+
+    gh_jobqueue queue;
+    ghr_assert(gh_jobqueue_ctor(&queue, &sandbox, (gh_jobqueueoptions) {
+        .thread_options = {
+            .rpc = &rpc,
+            .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+            .name = "worker",
+            .safe_id = "job queue worker",
+            .default_timeout_ms = GH_IPC_NOTIMEOUT
+        },
+        .worker_count = WORKERS_COUNT,
+        .script = setup,
+        .script_len = strlen(setup),
+        .batch_worker_count = 1,
+        .batch_sched = GH_THREADSCHED_IDLE
+    }));
+
+    const char slow_script[] =
+        "local n = 0\n"
+        "for i = 1, 1000000 do n = n + i end\n"
+        ;
+    const char failing_script[] = "error('expected failure')\n";
+
+    gh_jobfuture futures[JOBS_COUNT];
+    for (size_t i = 0; i < JOBS_COUNT; i++) {
+        gh_jobpriority priority = (i & 1) == 0 ? GH_JOBPRIORITY_INTERACTIVE : GH_JOBPRIORITY_NORMAL;
+        int deadline_ms = (i & 3) == 0 ? 60000 : GH_JOB_NODEADLINE;
+
+        ghr_assert(gh_jobqueue_submit(&queue, (gh_job) {
+            .type = GH_JOB_CALL,
+            .function_name = "double",
+            .args_func = args_func,
+            .result_func = result_func,
+            .userdata = (void *)i,
+            .priority = priority,
+            .deadline_ms = deadline_ms
+        }, futures + i));
+    }
+
+    gh_jobfuture slow_future;
+    ghr_assert(gh_jobqueue_submit(&queue, (gh_job) {
+        .type = GH_JOB_SCRIPT,
+        .script = slow_script,
+        .script_len = strlen(slow_script),
+        .priority = GH_JOBPRIORITY_BATCH
+    }, &slow_future));
+
+    gh_jobfuture failing_future;
+    ghr_assert(gh_jobqueue_submit(&queue, (gh_job) {
+        .type = GH_JOB_SCRIPT,
+        .script = failing_script,
+        .script_len = strlen(failing_script)
+    }, &failing_future));
+
+    for (size_t i = 0; i < JOBS_COUNT; i++) {
+        gh_threadnotif_script status;
+        ghr_assert(gh_jobfuture_wait(futures + i, &status));
+        ghr_assert(status.result);
+        assert(results[i] == (int)i * 2);
+        ghr_assert(gh_jobfuture_dtor(futures + i));
+    }
+
+    gh_threadnotif_script status;
+    ghr_assert(gh_jobfuture_wait(&slow_future, &status));
+    ghr_assert(status.result);
+    ghr_assert(gh_jobfuture_dtor(&slow_future));
+
+    ghr_assert(gh_jobfuture_wait(&failing_future, &status));
+    assert(ghr_iserr(status.result));
+    ghr_assert(gh_jobfuture_dtor(&failing_future));
+
+    gh_jobqueuestats stats;
+    gh_jobqueue_stats(&queue, &stats);
+    assert(stats.submitted == JOBS_COUNT + 2);
+    assert(stats.completed == JOBS_COUNT + 2);
+    assert(stats.queue_depth == 0);
+    assert(stats.expired == 0);
+    fprintf(stderr, "stolen: %llu, max wait: %llu ns, max run: %llu ns\n",
+        (unsigned long long)stats.stolen,
+        (unsigned long long)stats.max_wait_ns,
+        (unsigned long long)stats.max_run_ns
+    );
+
+    ghr_assert(gh_jobqueue_dtor(&queue));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
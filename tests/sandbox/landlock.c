@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/stdlib.h>
+#include <ghost/thread.h>
+
+static void run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    // the pipe will emulate STDIN for the simpletui prompter - the only
+    // prompt is for the file outside of the ruleset
+    int pipefd[2];
+    assert(pipe(pipefd) >= 0);
+    assert(write(pipefd[1], "n\n", 2) == 2);
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+    ghr_assert(gh_std_registerinrpc(&rpc));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(pipefd[0]),
+        .name = "landlock",
+        .safe_id = "landlock thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .landlock = true
+    };
+
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+
+    char cwd[PATH_MAX];
+    assert(realpath(".", cwd) != NULL);
+    ghr_assert(gh_permfs_add(
+        &thread.perms.filesystem,
+        (gh_permfs_ident) { .path = { .ptr = cwd, .len = strlen(cwd) } },
+        (gh_permfs_modeset) { .mode_accept = GH_PERMFS_READ },
+        (gh_permfs_modeset) { .mode_accept = GH_PERMFS_READ },
+        NULL
+    ));
+
+    gh_result res = gh_thread_landlock(&thread);
+    if (ghr_is(res, GHR_LANDLOCK_UNAVAILABLE)) {
+        printf("landlock is not supported by the kernel, skipping\n");
+    } else {
+        ghr_assert(res);
+
+        run(&thread,
+            "local f = assert(io.open('Test.txt', 'r'))\n"
+            "assert(#f:read('*a') > 0)\n"
+            "f:close()\n"
+            "local missing, err = io.open('does-not-exist.txt', 'r')\n"
+            "assert(missing == nil)\n"
+            "assert(string.find(err, 'No such file'), err)\n"
+        );
+
+        gh_threadstats stats;
+        ghr_assert(gh_thread_stats(&thread, &stats));
+        assert(stats.rpc_calls == 0);
+
+        // outside of the ruleset, io.open asks the host, which prompts
+        run(&thread,
+            "local f, err = io.open('/etc/passwd', 'r')\n"
+            "assert(f == nil)\n"
+        );
+
+        ghr_assert(gh_thread_stats(&thread, &stats));
+        printf("%llu rpc calls\n", (unsigned long long)stats.rpc_calls);
+        assert(stats.rpc_calls == 1);
+
+        assert(ghr_is(gh_thread_landlock(&thread), GHR_LANDLOCK_ENFORCED));
+
+        // the ruleset can't be lifted, so the thread can't be reset and
+        // handed to a tenant with another policy
+        assert(ghr_is(gh_thread_reset(&thread), GHR_LANDLOCK_ENFORCED));
+        run(&thread, "assert(io.open('Test.txt', 'r')):close()");
+
+        // a new subjail can, as long as the ruleset isn't in effect yet
+        ghr_assert(gh_thread_dtor(&thread, NULL));
+        ghr_assert(gh_thread_ctor(&thread, thread_options));
+        ghr_assert(gh_thread_reset(&thread));
+
+        ghr_assert(gh_permfs_add(
+            &thread.perms.filesystem,
+            (gh_permfs_ident) { .path = { .ptr = cwd, .len = strlen(cwd) } },
+            (gh_permfs_modeset) { .mode_reject = GH_PERMFS_READ },
+            (gh_permfs_modeset) { .mode_reject = GH_PERMFS_READ },
+            NULL
+        ));
+        ghr_assert(gh_thread_landlock(&thread));
+
+        // the ruleset is empty, so the host is asked and refuses
+        run(&thread,
+            "local f, err = io.open('Test.txt', 'r')\n"
+            "assert(f == nil)\n"
+        );
+
+        ghr_assert(gh_thread_stats(&thread, &stats));
+        assert(stats.rpc_calls == 1);
+    }
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return 0;
+}
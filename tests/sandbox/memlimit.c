@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#define MEMORY_LIMIT (32 * 1024 * 1024)
+
+static const char grow_script[] = "big = {}; for i = 1, 1000000 do big[i] = { i } end";
+
+// Coroutine stacks grown by deep recursion are shrunk by the collector while
+// the state is at the limit. Afterwards, just as much has to fit as before.
+static const char shrink_script[] =
+    "local function fill()\n"
+    "    local head, count = nil, 0\n"
+    "    pcall(function() while true do head, count = { head }, count + 1 end end)\n"
+    "    return head, count\n"
+    "end\n"
+    "local function deep(n) if n == 0 then return 0 end return 1 + deep(n - 1) end\n"
+    "collectgarbage()\n"
+    "local _, capacity = fill()\n"
+    "collectgarbage()\n"
+    "local threads = {}\n"
+    "for i = 1, 64 do\n"
+    "    threads[i] = coroutine.wrap(function() deep(2000); coroutine.yield() end)\n"
+    "    threads[i]()\n"
+    "end\n"
+    "local head = fill()\n"
+    "for i = 1, 8 do collectgarbage() end\n"
+    "head, threads = nil, nil\n"
+    "collectgarbage()\n"
+    "local _, count = fill()\n"
+    "assert(count >= capacity * 0.99, 'lost ' .. tostring(capacity - count) .. ' tables')\n";
+
+static gh_result run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    return status.result;
+}
+
+static uint64_t alloc_bytes(gh_thread * thread) {
+    gh_threadstats stats;
+    ghr_assert(gh_thread_stats(thread, &stats));
+    return stats.lua_alloc_bytes;
+}
+
+static gh_threadoptions thread_options(gh_sandbox * sandbox, gh_rpc * rpc, const char * name, uint64_t memory_limit_bytes) {
+    gh_threadoptions options = (gh_threadoptions) {
+        .sandbox = sandbox,
+        .rpc = rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .memory_limit_bytes = memory_limit_bytes
+    };
+    strcpy(options.name, name);
+    strcpy(options.safe_id, name);
+    return options;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    // roughly a hundred MB don't fit in the limit
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, thread_options(&sandbox, &rpc, "memlimit", MEMORY_LIMIT)));
+
+    ghr_assert(run(&thread, "x = 1"));
+    uint64_t base = alloc_bytes(&thread);
+    printf("limited: base %llu bytes\n", (unsigned long long)base);
+    assert(base > 0);
+    assert(base <= MEMORY_LIMIT);
+
+    assert(ghr_is(run(&thread, grow_script), GHR_LUA_MEM));
+
+    // the subjail recovers once the memory is released
+    ghr_assert(run(&thread, "big = nil; collectgarbage()"));
+    ghr_assert(run(&thread, "assert(x == 1)"));
+    printf("limited: after release %llu bytes\n", (unsigned long long)alloc_bytes(&thread));
+    assert(alloc_bytes(&thread) <= MEMORY_LIMIT);
+
+    // and after a reset
+    ghr_assert(gh_thread_reset(&thread));
+    assert(ghr_is(run(&thread, grow_script), GHR_LUA_MEM));
+    ghr_assert(run(&thread, "big = nil; collectgarbage()"));
+
+    // shrinking right at the limit doesn't leak
+    ghr_assert(gh_thread_reset(&thread));
+    ghr_assert(run(&thread, shrink_script));
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+
+    // the same script runs fine without a limit
+    ghr_assert(gh_thread_ctor(&thread, thread_options(&sandbox, &rpc, "nolimit", GH_SANDBOX_NOLIMIT)));
+    ghr_assert(run(&thread, grow_script));
+    printf("unlimited: %llu bytes\n", (unsigned long long)alloc_bytes(&thread));
+    assert(alloc_bytes(&thread) > MEMORY_LIMIT);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#define CALLERS_COUNT 4
+#define SLOWCALL_SLEEP_US 200000
+
+static gh_thread thread;
+static pthread_barrier_t callers_barrier;
+
+static atomic_int inflight;
+static atomic_int max_inflight;
+
+// Both the host function and the Lua callback calling it take long enough that
+// calls issued by different OS threads on the same sandbox thread overlap
+// if (and only if) the subjail multiplexes requests.
+static void func_slowcall(gh_rpc * rpc, gh_rpcframe * frame) {
+    (void)rpc;
+    (void)frame;
+
+    int now = atomic_fetch_add(&inflight, 1) + 1;
+    int prev_max = atomic_load(&max_inflight);
+    while (now > prev_max && !atomic_compare_exchange_weak(&max_inflight, &prev_max, now));
+
+    usleep(SLOWCALL_SLEEP_US);
+
+    atomic_fetch_sub(&inflight, 1);
+}
+
+static void * caller_func(void * index_voidp) {
+    int index = (int)(intptr_t)index_voidp;
+
+    pthread_barrier_wait(&callers_barrier);
+
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+    ghr_assert(gh_thread_callframe_int(&frame, index));
+
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_call(&thread, "twice", &frame, &status));
+    ghr_assert(status.result);
+
+    int value;
+    assert(gh_thread_callframe_getint(&frame, &value));
+    assert(value == index * 2);
+
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+    return NULL;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+    ghr_assert(gh_rpc_register(&rpc, "slowcall", func_slowcall, GH_RPCFUNCTION_THREADSAFE));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "multiplexed",
+        .safe_id = "multiplexed thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT
+    };
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+
+    const char script[] =
+        "local ghost = require('ghost')\n"
+        "ghost.callbacks.twice = function(x)\n"
+        "    ghost.call('slowcall', nil)\n"
+        "    return x * 2\n"
+        "end\n"
+        ;
+    gh_threadnotif_script script_status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread, script, strlen(script), &script_status));
+    ghr_assert(script_status.result);
+
+    atomic_store(&inflight, 0);
+    atomic_store(&max_inflight, 0);
+    pthread_barrier_init(&callers_barrier, NULL, CALLERS_COUNT);
+
+    pthread_t callers[CALLERS_COUNT];
+    for (int i = 0; i < CALLERS_COUNT; i++) {
+        assert(pthread_create(callers + i, NULL, caller_func, (void*)(intptr_t)i) == 0);
+    }
+
+    for (int i = 0; i < CALLERS_COUNT; i++) {
+        assert(pthread_join(callers[i], NULL) == 0);
+    }
+
+    printf("max concurrent host calls from one subjail: %d\n", atomic_load(&max_inflight));
+    assert(atomic_load(&max_inflight) > 1);
+
+    pthread_barrier_destroy(&callers_barrier);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/stdlib.h>
+#include <ghost/thread.h>
+
+static void run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    // the pipe will emulate STDIN for the simpletui prompter
+    int pipefd[2];
+    assert(pipe(pipefd) >= 0);
+    assert(write(pipefd[1], "y\ny\ny\ny\n", 8) == 8);
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+    ghr_assert(gh_std_registerinrpc(&rpc));
+
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(pipefd[0]),
+        .name = "nativeopen",
+        .safe_id = "nativeopen thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .native_open = true
+    }));
+    assert(gh_opensupervisor_running(&thread.open_supervisor));
+
+    run(&thread,
+        "local f = assert(io.open('Test.txt', 'r'))\n"
+        "assert(#f:read('*a') > 0)\n"
+        "f:close()\n"
+        "local missing, err = io.open('does-not-exist.txt', 'r')\n"
+        "assert(missing == nil)\n"
+        "assert(string.find(err, 'No such file'), err)\n"
+    );
+
+    // the file was opened by the supervisor, not through ghost.open
+    gh_threadstats stats;
+    ghr_assert(gh_thread_stats(&thread, &stats));
+    printf("%llu native opens, %llu rpc calls\n", (unsigned long long)stats.native_opens, (unsigned long long)stats.rpc_calls);
+    assert(stats.native_opens == 1);
+    assert(stats.rpc_calls == 0);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+#include <ghost/parallelmap.h>
+
+#define ITEMS_COUNT 100
+#define THREADS_COUNT 4
+
+static int results[ITEMS_COUNT];
+
+static gh_result args_func(size_t index, gh_thread_callframe * frame, void * userdata) {
+    (void)userdata;
+    return gh_thread_callframe_int(frame, (int)index);
+}
+
+static gh_result result_func(size_t index, gh_thread_callframe * frame, const gh_threadnotif_script * status, void * userdata) {
+    (void)userdata;
+    if (ghr_iserr(status->result)) return status->result;
+
+    int value;
+    if (!gh_thread_callframe_getint(frame, &value)) return GHR_TEST_GENERIC;
+    results[index] = value;
+    return GHR_OK;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    // Items with a multiple-of-10 index are much more expensive than the rest,
+    // so that threads finish their chunks at different times.
+    const char script[] =
+        "local ghost = require('ghost')\n"
+        "ghost.callbacks.square = function(x)\n"
+        "    if x % 10 == 0 then\n"
+        "        local n = 0\n"
+        "        for i = 1, 1000000 do n = n + i end\n"
+        "    end\n"
+        "    return x * x\n"
+        "end\n"
+        ;
+
+    gh_threadnotif_script statuses[ITEMS_COUNT];
+
+    gh_parallelmapoptions map_options = {
+        .thread_options = {
+            .rpc = &rpc,
+            .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+            .name = "worker",
+            .safe_id = "parallel map worker",
+            .default_timeout_ms = GH_IPC_NOTIMEOUT
+        },
+        .thread_count = THREADS_COUNT,
+        .script = script,
+        .script_len = strlen(script),
+        .function_name = "square",
+        .item_count = ITEMS_COUNT,
+        .chunk_size = GH_PARALLELMAP_AUTOCHUNK,
+        .args_func = args_func,
+        .result_func = result_func,
+        .userdata = NULL,
+        .out_statuses = statuses
+    };
+
+    ghr_assert(gh_sandbox_parallelmap(&sandbox, &map_options));
+
+    for (int i = 0; i < ITEMS_COUNT; i++) {
+        ghr_assert(statuses[i].result);
+        assert(results[i] == i * i);
+    }
+
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+static gh_thread thread;
+static sem_t blocking_entered;
+static sem_t blocking_release;
+
+static void func_block(gh_rpc * rpc, gh_rpcframe * frame) {
+    (void)rpc;
+    (void)frame;
+
+    sem_post(&blocking_entered);
+    sem_wait(&blocking_release);
+}
+
+static void run(const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+static void * blocking_func(void * unused) {
+    (void)unused;
+    run("require('ghost').call('block', nil)");
+    return NULL;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+    ghr_assert(gh_rpc_register(&rpc, "block", func_block, GH_RPCFUNCTION_THREADSAFE));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "reset",
+        .safe_id = "reset thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT
+    };
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+    pid_t pid = thread.pid;
+
+    run(
+        "counter = 1\n"
+        "string.upper = nil\n"
+        "require('ghost').callbacks.value = function() return 1 end\n"
+    );
+    ghr_assert(gh_thread_setint(&thread, "answer", 42));
+    run("assert(require('ghost').hostvars.answer == 42)");
+
+    gh_threadtenant tenant;
+    ghr_assert(gh_threadtenant_ctor(&tenant, &thread));
+    ghr_assert(gh_threadtenant_dtor(&tenant));
+
+    ghr_assert(gh_thread_reset(&thread));
+    assert(thread.pid == pid);
+
+    // globals, libraries, callbacks and host variables are gone
+    run(
+        "assert(counter == nil)\n"
+        "assert(string.upper('a') == 'A')\n"
+        "assert(require('ghost').callbacks.value == nil)\n"
+        "assert(require('ghost').hostvars.answer == nil)\n"
+    );
+
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_call(&thread, "value", &frame, &status));
+    assert(ghr_is(status.result, GHR_JAIL_LUACALLMISSING));
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+
+    // script IDs start over
+    ghr_assert(gh_thread_reset(&thread));
+    ghr_assert(gh_thread_runstringsync(&thread, "", 0, &status));
+    assert(status.id == 0);
+
+    // tenants work after a reset
+    ghr_assert(gh_threadtenant_ctor(&tenant, &thread));
+    ghr_assert(gh_threadtenant_runstringsync(&tenant, "x = 1", strlen("x = 1"), &status));
+    ghr_assert(status.result);
+    ghr_assert(gh_threadtenant_dtor(&tenant));
+
+    // a subjail with a request in flight is left alone
+    sem_init(&blocking_entered, 0, 0);
+    sem_init(&blocking_release, 0, 0);
+
+    pthread_t blocking;
+    assert(pthread_create(&blocking, NULL, blocking_func, NULL) == 0);
+    sem_wait(&blocking_entered);
+
+    assert(ghr_is(gh_thread_reset(&thread), GHR_JAIL_RESETBUSY));
+
+    sem_post(&blocking_release);
+    assert(pthread_join(blocking, NULL) == 0);
+
+    ghr_assert(gh_thread_reset(&thread));
+
+    sem_destroy(&blocking_entered);
+    sem_destroy(&blocking_release);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+static int call_value(gh_thread * thread) {
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_call(thread, "value", &frame, &status));
+    ghr_assert(status.result);
+
+    int value;
+    assert(gh_thread_callframe_getint(&frame, &value));
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+    return value;
+}
+
+static void runfile(gh_thread * thread, int fd) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runfilesync(thread, fd, &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+static const char header[] = "error('header must be skipped')\n";
+
+static const char script_a[] =
+    "local ghost = require('ghost')\n"
+    "ghost.callbacks.value = function() return 1 end\n"
+    ;
+
+static const char script_b[] =
+    "local ghost = require('ghost')\n"
+    "ghost.callbacks.value = function() return 2 end\n"
+    ;
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "runfile",
+        .safe_id = "runfile thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT
+    };
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+
+    // regular files are mapped, starting at the current offset
+    int file_fd = memfd_create("script", MFD_CLOEXEC);
+    assert(file_fd >= 0);
+    assert(write(file_fd, header, strlen(header)) == (ssize_t)strlen(header));
+    assert(write(file_fd, script_a, strlen(script_a)) == (ssize_t)strlen(script_a));
+    assert(lseek(file_fd, (off_t)strlen(header), SEEK_SET) == (off_t)strlen(header));
+
+    runfile(&thread, file_fd);
+    assert(call_value(&thread) == 1);
+    assert(lseek(file_fd, 0, SEEK_CUR) == (off_t)(strlen(header) + strlen(script_a)));
+
+    // empty (remainders of) files are empty chunks
+    runfile(&thread, file_fd);
+    assert(call_value(&thread) == 1);
+    assert(close(file_fd) == 0);
+
+    // pipes are read
+    int pipefd[2];
+    assert(pipe(pipefd) == 0);
+    assert(write(pipefd[1], script_b, strlen(script_b)) == (ssize_t)strlen(script_b));
+    assert(close(pipefd[1]) == 0);
+
+    runfile(&thread, pipefd[0]);
+    assert(call_value(&thread) == 2);
+    assert(close(pipefd[0]) == 0);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/sandboxpool.h>
+#include <ghost/thread.h>
+
+#define SANDBOX_COUNT 3
+#define THREADS_PER_SANDBOX 2
+#define THREAD_COUNT (SANDBOX_COUNT * THREADS_PER_SANDBOX)
+
+static size_t thread_count(gh_sandbox * sandbox) {
+    gh_sandboxstats stats;
+    ghr_assert(gh_sandbox_stats(sandbox, &stats));
+    return stats.thread_count;
+}
+
+static void run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+int main(void) {
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_sandboxpool pool;
+    gh_sandboxpooloptions pool_options = (gh_sandboxpooloptions) {
+        .sandbox_options = {
+            .name = "ghost-test-sandbox",
+            .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+            .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+        },
+        .sandbox_count = SANDBOX_COUNT,
+        .placement = GH_SANDBOXPOOL_LEASTLOAD
+    };
+    ghr_assert(gh_sandboxpool_ctor(&pool, &alloc, pool_options));
+
+    for (size_t i = 0; i < SANDBOX_COUNT; i++) {
+        for (size_t j = 0; j < i; j++) assert(pool.sandboxes[i].pid != pool.sandboxes[j].pid);
+    }
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "pooled",
+        .safe_id = "pooled thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT
+    };
+
+    // threads are spread evenly
+    gh_thread threads[THREAD_COUNT];
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        ghr_assert(gh_sandboxpool_threadctor(&pool, threads + i, thread_options));
+        run(threads + i, "x = 1");
+    }
+    for (size_t i = 0; i < SANDBOX_COUNT; i++) {
+        assert(thread_count(pool.sandboxes + i) == THREADS_PER_SANDBOX);
+    }
+
+    // the next thread fills the gap left by a destroyed one
+    gh_sandbox * sandbox = threads[0].sandbox;
+    ghr_assert(gh_thread_dtor(threads + 0, NULL));
+    assert(thread_count(sandbox) == THREADS_PER_SANDBOX - 1);
+    assert(gh_sandboxpool_pick(&pool) == sandbox);
+    ghr_assert(gh_sandboxpool_threadctor(&pool, threads + 0, thread_options));
+    assert(threads[0].sandbox == sandbox);
+
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        ghr_assert(gh_thread_dtor(threads + i, NULL));
+    }
+    for (size_t i = 0; i < SANDBOX_COUNT; i++) {
+        assert(thread_count(pool.sandboxes + i) == 0);
+    }
+
+    gh_result jail_res;
+    ghr_assert(gh_sandboxpool_dtor(&pool, &jail_res));
+    ghr_assert(jail_res);
+
+    // round-robin placement cycles through the sandboxes
+    pool_options.placement = GH_SANDBOXPOOL_ROUNDROBIN;
+    ghr_assert(gh_sandboxpool_ctor(&pool, &alloc, pool_options));
+    for (size_t i = 0; i < SANDBOX_COUNT * 2; i++) {
+        assert(gh_sandboxpool_pick(&pool) == pool.sandboxes + i % SANDBOX_COUNT);
+    }
+    ghr_assert(gh_sandboxpool_dtor(&pool, NULL));
+
+    pool_options.sandbox_count = 0;
+    assert(ghr_is(gh_sandboxpool_ctor(&pool, &alloc, pool_options), GHR_SANDBOXPOOL_NOSANDBOXES));
+
+    ghr_assert(gh_rpc_dtor(&rpc));
+
+    return 0;
+}
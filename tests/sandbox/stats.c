@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+static void func_ping(gh_rpc * rpc, gh_rpcframe * frame) {
+    (void)rpc;
+    (void)frame;
+}
+
+static void run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+    ghr_assert(gh_rpc_register(&rpc, "ping", func_ping, GH_RPCFUNCTION_THREADSAFE));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "stats",
+        .safe_id = "stats thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT
+    };
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+
+    run(&thread, "local ghost = require('ghost'); ghost.call('ping', nil); ghost.call('ping', nil)");
+    run(&thread, "big = {}; for i = 1, 100000 do big[i] = i end");
+
+    gh_threadstats stats;
+    ghr_assert(gh_thread_stats(&thread, &stats));
+    printf("thread: heap %llu bytes, rss %zu bytes, cpu %llu ns, sent %llu/%llu, received %llu/%llu, %llu rpc calls, %llu scripts\n",
+        (unsigned long long)stats.lua_heap_bytes,
+        stats.rss_bytes,
+        (unsigned long long)stats.cpu_ns,
+        (unsigned long long)stats.ipc.messages_sent,
+        (unsigned long long)stats.ipc.bytes_sent,
+        (unsigned long long)stats.ipc.messages_received,
+        (unsigned long long)stats.ipc.bytes_received,
+        (unsigned long long)stats.rpc_calls,
+        (unsigned long long)stats.scripts_completed
+    );
+    assert(stats.scripts_completed == 2);
+    assert(stats.rpc_calls == 2);
+    // the table alone is larger than this
+    assert(stats.lua_heap_bytes > 100000 * sizeof(double));
+    assert(stats.rss_bytes > 0);
+    assert(stats.ipc.messages_sent > 0);
+    assert(stats.ipc.bytes_sent > 0);
+    assert(stats.ipc.messages_received > stats.scripts_completed);
+    assert(stats.ipc.bytes_received > 0);
+
+    // releasing the table shrinks the heap
+    uint64_t heap_before = stats.lua_heap_bytes;
+    run(&thread, "big = nil; collectgarbage()");
+    ghr_assert(gh_thread_stats(&thread, &stats));
+    assert(stats.lua_heap_bytes < heap_before);
+
+    gh_sandboxstats sandbox_stats;
+    ghr_assert(gh_sandbox_stats(&sandbox, &sandbox_stats));
+    printf("sandbox: rss %zu bytes, cpu %llu ns, %llu thread messages sent, %llu rpc calls, %llu scripts\n",
+        sandbox_stats.rss_bytes,
+        (unsigned long long)sandbox_stats.cpu_ns,
+        (unsigned long long)sandbox_stats.thread_ipc.messages_sent,
+        (unsigned long long)sandbox_stats.rpc_calls,
+        (unsigned long long)sandbox_stats.scripts_completed
+    );
+    assert(sandbox_stats.rss_bytes > 0);
+    assert(sandbox_stats.ipc.messages_sent > 0);
+    assert(sandbox_stats.thread_ipc.messages_sent == stats.ipc.messages_sent);
+    assert(sandbox_stats.thread_ipc.bytes_received == stats.ipc.bytes_received);
+    assert(sandbox_stats.rpc_calls == 2);
+    assert(sandbox_stats.scripts_completed == 3);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+static gh_threadtenant tenant_a;
+static gh_threadtenant tenant_b;
+static atomic_bool busy_done;
+
+static void run(gh_threadtenant * tenant, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_threadtenant_runstringsync(tenant, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+static int call_value(gh_threadtenant * tenant) {
+    gh_thread_callframe frame;
+    ghr_assert(gh_thread_callframe_ctor(&frame));
+
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_threadtenant_call(tenant, "value", &frame, &status));
+    ghr_assert(status.result);
+
+    int value;
+    assert(gh_thread_callframe_getint(&frame, &value));
+    ghr_assert(gh_thread_callframe_dtor(&frame));
+    return value;
+}
+
+// Busy loop in the interpreter for about a second. Meanwhile, the other
+// tenant must still be served.
+static void * busy_func(void * unused) {
+    (void)unused;
+    run(&tenant_a,
+        "jit.off()\n"
+        "local start = os.clock()\n"
+        "while os.clock() - start < 1 do end\n"
+    );
+    atomic_store(&busy_done, true);
+    return NULL;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_threadoptions thread_options = (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .name = "tenants",
+        .safe_id = "tenant host",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT
+    };
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, thread_options));
+
+    ghr_assert(gh_threadtenant_ctor(&tenant_a, &thread));
+    ghr_assert(gh_threadtenant_ctor(&tenant_b, &thread));
+
+    // globals, libraries and callbacks are separate
+    run(&tenant_a,
+        "counter = 1\n"
+        "string.upper = nil\n"
+        "require('ghost').callbacks.value = function() return 1 end\n"
+    );
+    run(&tenant_b,
+        "assert(counter == nil)\n"
+        "assert(string.upper('a') == 'A')\n"
+        "require('ghost').callbacks.value = function() return 2 end\n"
+    );
+
+    assert(call_value(&tenant_a) == 1);
+    assert(call_value(&tenant_b) == 2);
+
+    // the subjail's own environment is unaffected
+    const char check_main[] = "assert(counter == nil); assert(string.upper ~= nil)";
+    gh_threadnotif_script main_status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread, check_main, strlen(check_main), &main_status));
+    ghr_assert(main_status.result);
+
+    // script IDs are counted per tenant
+    gh_threadnotif_script status_a = {0};
+    gh_threadnotif_script status_b = {0};
+    ghr_assert(gh_threadtenant_runstringsync(&tenant_a, "", 0, &status_a));
+    ghr_assert(gh_threadtenant_runstringsync(&tenant_b, "", 0, &status_b));
+    assert(status_a.id == status_b.id);
+
+    // a long request of one tenant is preempted for requests of another
+    // (ordering instead of latency, so that slow machines don't fail it)
+    atomic_init(&busy_done, false);
+    pthread_t busy;
+    assert(pthread_create(&busy, NULL, busy_func, NULL) == 0);
+    usleep(100000);
+
+    assert(call_value(&tenant_b) == 2);
+    assert(!atomic_load(&busy_done));
+
+    assert(pthread_join(busy, NULL) == 0);
+
+    gh_threadtenantusage usage;
+    gh_threadtenant_usage(&tenant_a, &usage);
+    printf("tenant a: %llu requests, %llu ns cpu, %llu instructions\n",
+        (unsigned long long)usage.requests,
+        (unsigned long long)usage.cpu_ns,
+        (unsigned long long)usage.instructions
+    );
+    assert(usage.requests == 4);
+    assert(usage.instructions > 0);
+
+    ghr_assert(gh_threadtenant_dtor(&tenant_a));
+    ghr_assert(gh_threadtenant_dtor(&tenant_b));
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/procstat.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#define THREAD_COUNT 16
+
+static size_t thread_count(gh_sandbox * sandbox) {
+    gh_sandboxstats stats;
+    ghr_assert(gh_sandbox_stats(sandbox, &stats));
+    return stats.thread_count;
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_threadoptions thread_options[THREAD_COUNT];
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        thread_options[i] = (gh_threadoptions) {
+            .sandbox = &sandbox,
+            .rpc = &rpc,
+            .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+            .default_timeout_ms = GH_IPC_NOTIMEOUT
+        };
+        snprintf(thread_options[i].name, GH_THREAD_MAXNAME, "many%zu", i);
+        snprintf(thread_options[i].safe_id, GH_THREAD_MAXSAFEID, "batch thread %zu", i);
+    }
+
+    gh_thread threads[THREAD_COUNT];
+    ghr_assert(gh_thread_ctormany(threads, thread_options, THREAD_COUNT));
+    assert(thread_count(&sandbox) == THREAD_COUNT);
+
+    // every thread has its own, working subjail
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        for (size_t j = 0; j < i; j++) assert(threads[i].pid != threads[j].pid);
+        assert(strcmp(threads[i].name, thread_options[i].name) == 0);
+
+        pid_t pidfd_pid;
+        ghr_assert(gh_procstat_pidfdpid(threads[i].pidfd, &pidfd_pid));
+        assert(pidfd_pid == threads[i].pid);
+
+        char script[64];
+        snprintf(script, sizeof(script), "id = %zu; assert(id == %zu)", i, i);
+
+        gh_threadnotif_script status = {0};
+        ghr_assert(gh_thread_runstringsync(threads + i, script, strlen(script), &status));
+        if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+        ghr_assert(status.result);
+    }
+
+    // a subjail that died doesn't hold up the others
+    assert(kill(threads[0].pid, SIGKILL) == 0);
+
+    gh_result subjail_results[THREAD_COUNT];
+    ghr_assert(gh_thread_dtormany(threads, THREAD_COUNT, subjail_results));
+    for (size_t i = 1; i < THREAD_COUNT; i++) ghr_assert(subjail_results[i]);
+    assert(thread_count(&sandbox) == 0);
+
+    assert(ghr_isok(gh_thread_ctormany(threads, thread_options, 0)));
+
+    pid_t pid;
+    assert(ghr_is(gh_procstat_pidfdpid(STDIN_FILENO, &pid), GHR_PROCSTAT_NOTPIDFD));
+
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
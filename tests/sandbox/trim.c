@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+#define IDLE_TRIM_MS 100
+
+static void run(gh_thread * thread, const char * s) {
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(thread, s, strlen(s), &status));
+    if (ghr_iserr(status.result)) fprintf(stderr, "lua error: %s\n", status.error_msg);
+    ghr_assert(status.result);
+}
+
+static size_t rss(gh_thread * thread) {
+    gh_threadstats stats;
+    ghr_assert(gh_thread_stats(thread, &stats));
+    return stats.rss_bytes;
+}
+
+static gh_threadoptions thread_options(gh_sandbox * sandbox, gh_rpc * rpc, const char * name, int idle_trim_ms) {
+    gh_threadoptions options = (gh_threadoptions) {
+        .sandbox = sandbox,
+        .rpc = rpc,
+        .prompter = gh_permprompter_simpletui(STDIN_FILENO),
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .idle_trim_ms = idle_trim_ms
+    };
+    strcpy(options.name, name);
+    strcpy(options.safe_id, name);
+    return options;
+}
+
+// Grows the heap by roughly a hundred MB, then drops everything again.
+static void grow_and_release(gh_thread * thread, size_t * out_base, size_t * out_peak) {
+    *out_base = rss(thread);
+    run(thread, "big = {}; for i = 1, 1000000 do big[i] = { i } end");
+    *out_peak = rss(thread);
+    run(thread, "big = nil");
+    assert(*out_peak > *out_base);
+}
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    // trimmed on demand
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, thread_options(&sandbox, &rpc, "trim", GH_THREAD_NOIDLETRIM)));
+
+    size_t base;
+    size_t peak;
+    grow_and_release(&thread, &base, &peak);
+    ghr_assert(gh_thread_trim(&thread));
+    size_t trimmed = rss(&thread);
+    printf("on demand: base %zu, peak %zu, trimmed %zu bytes\n", base, peak, trimmed);
+    assert(trimmed < peak - (peak - base) / 2);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+
+    // trimmed after being idle
+    ghr_assert(gh_thread_ctor(&thread, thread_options(&sandbox, &rpc, "idletrim", IDLE_TRIM_MS)));
+
+    grow_and_release(&thread, &base, &peak);
+    usleep(IDLE_TRIM_MS * 1000 * 3);
+    trimmed = rss(&thread);
+    printf("idle: base %zu, peak %zu, trimmed %zu bytes\n", base, peak, trimmed);
+    assert(trimmed < peak - (peak - base) / 2);
+
+    // the subjail is still fully functional
+    run(&thread, "assert(big == nil)");
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+
+    return 0;
+}
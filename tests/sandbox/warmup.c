@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ghost/alloc.h>
+#include <ghost/rpc.h>
+#include <ghost/sandbox.h>
+#include <ghost/thread.h>
+
+int main(void) {
+    gh_sandbox sandbox;
+    gh_sandboxoptions options = (gh_sandboxoptions) {
+        .name = "ghost-test-sandbox",
+        .memory_limit_bytes = GH_SANDBOX_NOLIMIT,
+        .functioncall_frame_limit_bytes = GH_SANDBOX_NOLIMIT,
+    };
+    ghr_assert(gh_sandbox_ctor(&sandbox, options));
+
+    gh_alloc alloc = gh_alloc_default();
+
+    gh_rpc rpc;
+    ghr_assert(gh_rpc_ctor(&rpc, &alloc));
+
+    gh_thread thread;
+    ghr_assert(gh_thread_ctor(&thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .name = "warmup",
+        .safe_id = "warmup thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .prefault_bytes = 8 * 1024 * 1024,
+        .prefault_lock = true,
+        .warmup_script =
+            "local t = {}\n"
+            "for i = 1, 1000 do t[i] = tostring(i) end\n"
+            "warmed = #t\n"
+    }));
+
+    gh_threadstats stats;
+    ghr_assert(gh_thread_stats(&thread, &stats));
+    printf("rss after warm-up: %zu bytes\n", stats.rss_bytes);
+    assert(stats.scripts_completed == 1);
+
+    const char * s = "assert(warmed == 1000)";
+    gh_threadnotif_script status = {0};
+    ghr_assert(gh_thread_runstringsync(&thread, s, strlen(s), &status));
+    ghr_assert(status.result);
+
+    // the arena is prefaulted again after a reset
+    ghr_assert(gh_thread_reset(&thread));
+    ghr_assert(gh_thread_runstringsync(&thread, "return 1", strlen("return 1"), &status));
+    ghr_assert(status.result);
+
+    ghr_assert(gh_thread_dtor(&thread, NULL));
+
+    // a failing warm-up script fails the construction
+    gh_thread failed_thread;
+    gh_result res = gh_thread_ctor(&failed_thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .name = "warmup failure",
+        .safe_id = "warmup failure thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .warmup_script = "error('not warm')"
+    });
+    assert(ghr_iserr(res));
+
+    // the warm-up would run before a Landlock ruleset could be built
+    assert(ghr_is(gh_thread_ctor(&failed_thread, (gh_threadoptions) {
+        .sandbox = &sandbox,
+        .rpc = &rpc,
+        .name = "warmup landlock",
+        .safe_id = "warmup landlock thread",
+        .default_timeout_ms = GH_IPC_NOTIMEOUT,
+        .landlock = true,
+        .warmup_script = "return 1"
+    }), GHR_THREAD_WARMUPLANDLOCK));
+
+    gh_sandboxstats sandbox_stats;
+    ghr_assert(gh_sandbox_stats(&sandbox, &sandbox_stats));
+    assert(sandbox_stats.thread_count == 0);
+
+    ghr_assert(gh_rpc_dtor(&rpc));
+    ghr_assert(gh_sandbox_dtor(&sandbox, NULL));
+    return 0;
+}
@@ -0,0 +1,26 @@
+-- Compiles a Lua source file to LuaJIT bytecode.
+-- Usage: luajit luacompile.lua <input> <chunk name> <output>
+--
+-- Unlike `luajit -b`, this keeps debug information (so that errors still
+-- point at line numbers of the embedded scripts) and lets us set the
+-- chunk name that appears in error messages.
+
+local input_path, chunk_name, output_path = ...
+if input_path == nil or chunk_name == nil or output_path == nil then
+    io.stderr:write("usage: luacompile.lua <input> <chunk name> <output>\n")
+    os.exit(1)
+end
+
+local input = assert(io.open(input_path, "rb"))
+local source = input:read("*a")
+input:close()
+
+local chunk, err = loadstring(source, chunk_name)
+if chunk == nil then
+    io.stderr:write(err, "\n")
+    os.exit(1)
+end
+
+local output = assert(io.open(output_path, "wb"))
+output:write(string.dump(chunk))
+output:close()
@@ -0,0 +1,286 @@
+#!/usr/bin/env python3
+
+# Generates the seccomp BPF filters of the jail and subjail processes from
+# a syscall table (intermediate/gh_seccomp.csv).
+#
+# Layout of the jail filter:
+#   - architecture check (and rejection of x32 syscall numbers)
+#   - syscalls with a Hot rank, compared one by one in rank order
+#   - balanced binary search (JGE) over the remaining syscalls, ending in
+#     short runs of JEQ comparisons
+#   - argument checks of conditionally allowed syscalls
+#
+# Subjails inherit the jail filter, so their own filter only has to reject
+# what the jail allows but subjails may not - a binary search over that
+# (short) deny list, allowing everything else.
+#
+# Syscalls marked "notify" are handed to the supervisor of a user
+# notification listener. The jail has no listener, so they fail with ENOSYS
+# there; subjails stack a third filter that creates the listener. A syscall
+# allowed in the jail may be marked "notify" for subjails, in which case the
+# subjail filter allows it and only the third filter hands it over - subjails
+# restricted with Landlock skip that filter and make the syscall themselves.
+
+import sys
+import argparse
+import csv
+import re
+import shlex
+import subprocess
+
+LEAF_SIZE = 3
+MAX_JUMP = 255
+
+cmdline = shlex.join(sys.argv)
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-c", "--csv", required = True, help = "CSV file containing the syscall table")
+parser.add_argument("-o", "--output", required = True, help = "Path to output source file")
+parser.add_argument("--cc", default = "cc", help = "C compiler used to look up syscall numbers")
+args = parser.parse_args()
+
+def write_generated_notice(file):
+    print("// Warning: DO NOT EDIT THIS FILE!", file = file)
+    print("// This file has been automatically generated by the following command: ", file = file)
+    print(f"//     {cmdline}", file = file)
+    print("// CMake will automatically regenerate this file during build.", file = file)
+    print("", file = file)
+
+def syscall_numbers():
+    proc = subprocess.run(
+        [args.cc, "-E", "-dM", "-x", "c", "-"],
+        input = "#include <sys/syscall.h>\n",
+        capture_output = True,
+        text = True,
+        check = True
+    )
+
+    numbers = {}
+    for line in proc.stdout.splitlines():
+        match = re.match(r"#define __NR_(\w+) (\d+)$", line)
+        if match is not None:
+            numbers[match.group(1)] = int(match.group(2))
+    return numbers
+
+def parse_condition(cond):
+    # "" (deny), "allow", "notify" or "args[N]==CONSTANT"
+    if cond == "": return None
+    if cond == "allow": return "allow"
+    if cond == "notify": return "notify"
+
+    match = re.match(r"args\[(\d)\]==(\w+)$", cond)
+    if match is None:
+        raise RuntimeError(f"invalid condition: {cond}")
+    return (int(match.group(1)), match.group(2))
+
+class Syscall:
+    def __init__(self, row, numbers):
+        self.name = row["Syscall"]
+        if self.name not in numbers:
+            raise RuntimeError(f"unknown syscall: {self.name}")
+        self.nr = numbers[self.name]
+        self.jail = parse_condition(row["Jail"])
+        self.subjail = parse_condition(row["Subjail"])
+        self.hot = int(row["Hot"]) if row["Hot"] != "" else None
+
+# Instructions refer to labels until they are assembled.
+class Program:
+    def __init__(self):
+        self.insns = []
+        self.labels = {}
+
+    def label(self, name):
+        self.labels[name] = len(self.insns)
+
+    def stmt(self, code, k):
+        self.insns.append(("stmt", code, k, None, None))
+
+    def jump(self, code, k, jt, jf):
+        self.insns.append(("jump", code, k, jt, jf))
+
+    def jump_always(self, target):
+        self.insns.append(("ja", "BPF_JMP + BPF_JA", target, None, None))
+
+    def offset(self, index, target, max_jump = MAX_JUMP):
+        if target is None: return 0
+        off = self.labels[target] - index - 1
+        if off < 0 or off > max_jump:
+            raise RuntimeError(f"jump to {target} out of range ({off})")
+        return off
+
+    def assemble(self):
+        lines = []
+        for index, (kind, code, k, jt, jf) in enumerate(self.insns):
+            if kind == "stmt":
+                lines.append(f"BPF_STMT({code}, {k})")
+            elif kind == "ja":
+                lines.append(f"BPF_STMT({code}, {self.offset(index, k, 0xffffffff)})")
+            else:
+                lines.append(f"BPF_JUMP({code}, {k}, {self.offset(index, jt)}, {self.offset(index, jf)})")
+        return lines
+
+LD_ARCH = ("BPF_LD + BPF_W + BPF_ABS", "(offsetof(struct seccomp_data, arch))")
+LD_NR = ("BPF_LD + BPF_W + BPF_ABS", "(offsetof(struct seccomp_data, nr))")
+JEQ = "BPF_JMP + BPF_JEQ + BPF_K"
+JGE = "BPF_JMP + BPF_JGE + BPF_K"
+RET = "BPF_RET + BPF_K"
+
+label_counter = 0
+def new_label():
+    global label_counter
+    label_counter += 1
+    return f"L{label_counter}"
+
+# Emits a balanced binary search over syscalls (sorted by number), jumping to
+# targets[name] on a match and to default otherwise.
+def emit_search(prog, syscalls, targets, default):
+    if len(syscalls) == 0:
+        prog.jump_always(default)
+        return
+
+    if len(syscalls) <= LEAF_SIZE:
+        for i, syscall in enumerate(syscalls):
+            last = i == len(syscalls) - 1
+            prog.jump(JEQ, f"SYS_{syscall.name}", targets[syscall.name], default if last else None)
+        return
+
+    mid = len(syscalls) // 2
+    right = new_label()
+    prog.jump(JGE, f"SYS_{syscalls[mid].name}", right, None)
+    emit_search(prog, syscalls[:mid], targets, default)
+    prog.label(right)
+    emit_search(prog, syscalls[mid:], targets, default)
+
+def emit_prologue(prog, kill):
+    prog.stmt(*LD_ARCH)
+    prog.jump(JEQ, "AUDIT_ARCH_X86_64", None, kill)
+    prog.stmt(*LD_NR)
+    # x32 syscalls share the architecture with x86_64
+    prog.jump(JGE, "__X32_SYSCALL_BIT", kill, None)
+
+def jail_program(syscalls):
+    prog = Program()
+    allowed = [s for s in syscalls if s.jail is not None]
+
+    targets = {}
+    for syscall in allowed:
+        if syscall.jail == "allow" or syscall.jail == "notify":
+            targets[syscall.name] = syscall.jail.upper()
+        else:
+            targets[syscall.name] = f"ARG_{syscall.name}"
+
+    emit_prologue(prog, "KILL")
+
+    hot = sorted([s for s in allowed if s.hot is not None], key = lambda s: s.hot)
+    for syscall in hot:
+        prog.jump(JEQ, f"SYS_{syscall.name}", targets[syscall.name], None)
+
+    rest = sorted([s for s in allowed if s.hot is None], key = lambda s: s.nr)
+    emit_search(prog, rest, targets, "KILL")
+
+    for syscall in allowed:
+        if syscall.jail == "allow" or syscall.jail == "notify": continue
+        arg, value = syscall.jail
+        prog.label(f"ARG_{syscall.name}")
+        prog.stmt("BPF_LD + BPF_W + BPF_ABS", f"(offsetof(struct seccomp_data, args[{arg}]))")
+        prog.jump(JEQ, value, "ALLOW", "KILL")
+
+    if any(s.jail == "notify" for s in allowed):
+        prog.label("NOTIFY")
+        prog.stmt(RET, "SECCOMP_RET_USER_NOTIF")
+    prog.label("ALLOW")
+    prog.stmt(RET, "SECCOMP_RET_ALLOW")
+    prog.label("KILL")
+    prog.stmt(RET, "SECCOMP_RET_KILL_PROCESS")
+    return prog
+
+def subjail_program(syscalls):
+    denied = []
+    for syscall in syscalls:
+        if syscall.subjail == syscall.jail: continue
+        if syscall.subjail == "notify" and syscall.jail == "allow": continue
+        if syscall.subjail is not None:
+            raise RuntimeError(f"{syscall.name}: the subjail can only deny syscalls allowed in the jail")
+        denied.append(syscall)
+
+    for syscall in syscalls:
+        if syscall.subjail == "notify" and syscall.jail not in ("allow", "notify"):
+            raise RuntimeError(f"{syscall.name}: notify in the subjail requires allow or notify in the jail")
+
+    prog = Program()
+    emit_prologue(prog, "KILL")
+
+    denied.sort(key = lambda s: s.nr)
+    targets = { s.name: "KILL" for s in denied }
+    emit_search(prog, denied, targets, "ALLOW")
+
+    prog.label("ALLOW")
+    prog.stmt(RET, "SECCOMP_RET_ALLOW")
+    prog.label("KILL")
+    prog.stmt(RET, "SECCOMP_RET_KILL_PROCESS")
+    return prog
+
+# Filter creating the subjail's user notification listener. It has to be the
+# most recent filter returning SECCOMP_RET_USER_NOTIF for the syscall, so that
+# the kernel picks its listener.
+def subjail_notify_program(syscalls):
+    notified = sorted([s for s in syscalls if s.subjail == "notify"], key = lambda s: s.nr)
+
+    prog = Program()
+    emit_prologue(prog, "KILL")
+
+    targets = { s.name: "NOTIFY" for s in notified }
+    emit_search(prog, notified, targets, "ALLOW")
+
+    prog.label("NOTIFY")
+    prog.stmt(RET, "SECCOMP_RET_USER_NOTIF")
+    prog.label("ALLOW")
+    prog.stmt(RET, "SECCOMP_RET_ALLOW")
+    prog.label("KILL")
+    prog.stmt(RET, "SECCOMP_RET_KILL_PROCESS")
+    return prog
+
+def write_filter(file, name, prog):
+    lines = prog.assemble()
+    print(f"const struct sock_filter {name}[] = {{", file = file)
+    for i, line in enumerate(lines):
+        sep = "," if i < len(lines) - 1 else ""
+        print(f"    {line}{sep}", file = file)
+    print("};", file = file)
+    print(f"const unsigned short {name}_len = {len(lines)};", file = file)
+    print("", file = file)
+
+numbers = syscall_numbers()
+with open(args.csv, newline = "") as csv_file:
+    syscalls = [Syscall(row, numbers) for row in csv.DictReader(csv_file)]
+
+names = [s.name for s in syscalls]
+if len(names) != len(set(names)):
+    raise RuntimeError("duplicate syscall in table")
+
+jail = jail_program(syscalls)
+subjail = subjail_program(syscalls)
+subjail_notify = subjail_notify_program(syscalls)
+
+with open(args.output, "w") as out:
+    write_generated_notice(out)
+    print("#define _GNU_SOURCE", file = out)
+    print("#include <stddef.h>", file = out)
+    print("#include <fcntl.h>", file = out)
+    print("#include <sys/ioctl.h>", file = out)
+    print("#include <sys/mman.h>", file = out)
+    print("#include <sys/syscall.h>", file = out)
+    print("#include <linux/filter.h>", file = out)
+    print("#include <linux/seccomp.h>", file = out)
+    print("#include <linux/audit.h>", file = out)
+    print("#include <jail/seccomp.h>", file = out)
+    print("", file = out)
+
+    # the binary search was laid out with these numbers
+    for syscall in sorted(syscalls, key = lambda s: s.nr):
+        print(f"_Static_assert(SYS_{syscall.name} == {syscall.nr}, \"syscall numbers differ from the ones the filter was generated for\");", file = out)
+    print("", file = out)
+
+    write_filter(out, "gh_seccomp_jail_filter", jail)
+    write_filter(out, "gh_seccomp_subjail_filter", subjail)
+    write_filter(out, "gh_seccomp_subjail_notify_filter", subjail_notify)